@@ -0,0 +1,124 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// GMLogAsyncWriter
+//
+// A GMLogWriter that takes logging I/O off the calling thread. Messages
+// (already formatted by the GMLogger) are pushed into a fixed-size ring
+// buffer without taking a lock, and a background thread drains the ring in
+// batches to another GMLogWriter. A caller logging from a hot path only pays
+// for the formatting and a couple of atomic operations, never for the disk.
+//
+// The ring is a bounded multi-producer/single-consumer queue: each slot holds
+// a sequence number that tells producers whether it is free and tells the
+// consumer whether it has been filled, so producers only contend on a single
+// compare-and-swap of the enqueue position.
+//
+// When the ring is full the overflow policy decides what happens:
+//
+//   kGMLogAsyncOverflowDrop  - the message is dropped and counted; the count
+//                              is reported through the writer once there is
+//                              room again. Logging never blocks.
+//   kGMLogAsyncOverflowBlock - the caller waits for room. Nothing is lost.
+//
+// Messages at or above the synchronous level (kGMLoggerLevelAssert by
+// default) are never queued: everything before them is flushed and then they
+// are written on the calling thread, so an assert's message is out before
+// the process goes away. All live async writers are also flushed at exit().
+//
+// Example: make the shared logger's stdout writer asynchronous.
+//
+//   GMLogger *logger = [GMLogger sharedLogger];
+//   [logger setWriter:[GMLogAsyncWriter writerWithWriter:[logger writer]]];
+
+#import <Foundation/Foundation.h>
+#import <pthread.h>
+#import <stdint.h>
+#import "GMLogger.h"
+
+typedef enum {
+  kGMLogAsyncOverflowDrop,
+  kGMLogAsyncOverflowBlock,
+} GMLogAsyncOverflowPolicy;
+
+struct GMLogAsyncSlot;
+
+// Writers which can take many messages at once (e.g. with a single write(2))
+// may implement this; the async writer's background thread will use it.
+@protocol GMLogBatchWriter <GMLogWriter>
+// |levels| has one entry per message in |msgs|.
+- (void)logMessages:(NSArray *)msgs levels:(const GMLoggerLevel *)levels;
+@end
+
+// NSFileHandle writes a whole batch with one -writeData:.
+@interface NSFileHandle (GMFileHandleBatchWriter) <GMLogBatchWriter>
+@end
+
+@interface GMLogAsyncWriter : NSObject <GMLogWriter> {
+ @private
+  id<GMLogWriter> writer_;
+  GMLogAsyncOverflowPolicy policy_;
+  GMLoggerLevel synchronousLevel_;
+
+  // The ring. |capacity_| is a power of 2.
+  struct GMLogAsyncSlot *slots_;
+  uint32_t capacity_;
+  volatile int64_t enqueuePos_;
+  volatile int64_t dequeuePos_;   // written by the consumer only
+  volatile int32_t dropped_;
+
+  // Only used to put the consumer to sleep and wake it (or flushers) up;
+  // producers take |lock_| only when the consumer is asleep.
+  pthread_mutex_t lock_;
+  pthread_cond_t wakeConsumer_;
+  pthread_cond_t drained_;
+  volatile int32_t sleeping_;
+  volatile int32_t stopping_;
+  pthread_t thread_;
+  BOOL running_;
+}
+
+// Returns an autoreleased async writer in front of |writer| with a 4096
+// message ring and the drop overflow policy.
++ (id)writerWithWriter:(id<GMLogWriter>)writer;
+
+// Designated initializer. |capacity| is rounded up to a power of 2. Starts
+// the background thread.
+- (id)initWithWriter:(id<GMLogWriter>)writer
+            capacity:(unsigned)capacity
+      overflowPolicy:(GMLogAsyncOverflowPolicy)policy;
+
+// The writer messages are passed on to.
+- (id<GMLogWriter>)writer;
+
+// Messages at |level| and above are flushed and written synchronously.
+// Defaults to kGMLoggerLevelAssert.
+- (void)setSynchronousLevel:(GMLoggerLevel)level;
+
+// Blocks until every message logged before the call has been written.
+- (void)flush;
+
+// Flushes, then stops the background thread. Later messages are written
+// synchronously. Called by -dealloc.
+- (void)stop;
+
+// Number of messages dropped (and not yet reported) because the ring was
+// full.
+- (unsigned)droppedCount;
+
+// Flush every GMLogAsyncWriter in the process. Called at exit().
++ (void)flushAll;
+
+@end
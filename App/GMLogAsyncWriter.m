@@ -0,0 +1,337 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import "GMLogAsyncWriter.h"
+#import <libkern/OSAtomic.h>
+#import <sys/time.h>
+#import <stdlib.h>
+
+// The most messages written per batch, so a flood of logging doesn't keep a
+// batch (and its autorelease pool) growing forever.
+static const int kGMLogAsyncMaxBatch = 256;
+
+typedef struct GMLogAsyncSlot {
+  // pos: free for the producer claiming position pos.
+  // pos + 1: filled; ready for the consumer.
+  volatile int64_t sequence;
+  NSString *msg;
+  GMLoggerLevel level;
+} GMLogAsyncSlot;
+
+@interface GMLogAsyncWriter (PrivateMethods)
+- (BOOL)enqueueMessage:(NSString *)msg level:(GMLoggerLevel)level;
+- (BOOL)hasQueuedMessages;
+- (int)writeBatch;
+- (void)wakeConsumer;
+- (void)run;
+@end
+
+// Every live GMLogAsyncWriter (not retained), for flushing at exit.
+static CFMutableArrayRef gAsyncWriters = NULL;
+static pthread_mutex_t gAsyncWritersLock = PTHREAD_MUTEX_INITIALIZER;
+
+static void GMLogAsyncFlushAtExit(void) {
+  [GMLogAsyncWriter flushAll];
+}
+
+static void *GMLogAsyncThread(void *arg) {
+  [(GMLogAsyncWriter *)arg run];
+  return NULL;
+}
+
+// Sets |ts| to |ms| milliseconds from now, for pthread_cond_timedwait().
+static void GMLogAsyncDeadline(struct timespec *ts, long ms) {
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  long usec = now.tv_usec + ms * 1000;
+  ts->tv_sec = now.tv_sec + usec / 1000000;
+  ts->tv_nsec = (usec % 1000000) * 1000;
+}
+
+@implementation GMLogAsyncWriter
+
++ (id)writerWithWriter:(id<GMLogWriter>)writer {
+  return [[[self alloc] initWithWriter:writer
+                              capacity:4096
+                        overflowPolicy:kGMLogAsyncOverflowDrop] autorelease];
+}
+
++ (void)flushAll {
+  pthread_mutex_lock(&gAsyncWritersLock);
+  if (gAsyncWriters) {
+    CFIndex count = CFArrayGetCount(gAsyncWriters);
+    for (CFIndex i = 0; i < count; i++)
+      [(GMLogAsyncWriter *)CFArrayGetValueAtIndex(gAsyncWriters, i) flush];
+  }
+  pthread_mutex_unlock(&gAsyncWritersLock);
+}
+
+- (id)init {
+  return [self initWithWriter:nil
+                     capacity:4096
+               overflowPolicy:kGMLogAsyncOverflowDrop];
+}
+
+- (id)initWithWriter:(id<GMLogWriter>)writer
+            capacity:(unsigned)capacity
+      overflowPolicy:(GMLogAsyncOverflowPolicy)policy {
+  if ((self = [super init])) {
+    if (writer == nil)
+      writer = [NSFileHandle fileHandleWithStandardOutput];
+    writer_ = [writer retain];
+    policy_ = policy;
+    synchronousLevel_ = kGMLoggerLevelAssert;
+
+    capacity_ = 2;
+    while (capacity_ < capacity)
+      capacity_ <<= 1;
+    slots_ = calloc(capacity_, sizeof(GMLogAsyncSlot));
+    for (uint32_t i = 0; i < capacity_; i++)
+      slots_[i].sequence = i;
+
+    pthread_mutex_init(&lock_, NULL);
+    pthread_cond_init(&wakeConsumer_, NULL);
+    pthread_cond_init(&drained_, NULL);
+    running_ = (pthread_create(&thread_, NULL, GMLogAsyncThread, self) == 0);
+
+    pthread_mutex_lock(&gAsyncWritersLock);
+    if (gAsyncWriters == NULL) {
+      gAsyncWriters = CFArrayCreateMutable(kCFAllocatorDefault, 0, NULL);
+      atexit(GMLogAsyncFlushAtExit);
+    }
+    CFArrayAppendValue(gAsyncWriters, self);
+    pthread_mutex_unlock(&gAsyncWritersLock);
+  }
+  return self;
+}
+
+- (void)dealloc {
+  pthread_mutex_lock(&gAsyncWritersLock);
+  CFIndex index = CFArrayGetFirstIndexOfValue(gAsyncWriters,
+                                              CFRangeMake(0, CFArrayGetCount(gAsyncWriters)),
+                                              self);
+  if (index != kCFNotFound)
+    CFArrayRemoveValueAtIndex(gAsyncWriters, index);
+  pthread_mutex_unlock(&gAsyncWritersLock);
+
+  [self stop];
+  for (uint32_t i = 0; i < capacity_; i++)
+    [slots_[i].msg release];
+  free(slots_);
+  pthread_mutex_destroy(&lock_);
+  pthread_cond_destroy(&wakeConsumer_);
+  pthread_cond_destroy(&drained_);
+  [writer_ release];
+  [super dealloc];
+}
+
+- (id<GMLogWriter>)writer {
+  return [[writer_ retain] autorelease];
+}
+
+- (void)setSynchronousLevel:(GMLoggerLevel)level {
+  synchronousLevel_ = level;
+}
+
+- (unsigned)droppedCount {
+  return (unsigned)dropped_;
+}
+
+- (void)logMessage:(NSString *)msg level:(GMLoggerLevel)level {
+  BOOL onConsumer = running_ && pthread_equal(pthread_self(), thread_);
+  // Asserts (and whatever else must not wait) go out right away, after
+  // everything logged before them.
+  if ((level >= synchronousLevel_) || !running_ || onConsumer) {
+    if (!onConsumer)
+      [self flush];
+    [writer_ logMessage:msg level:level];
+    return;
+  }
+
+  NSString *copy = [msg copy];
+  while (![self enqueueMessage:copy level:level]) {
+    if (policy_ == kGMLogAsyncOverflowDrop) {
+      OSAtomicIncrement32Barrier(&dropped_);
+      [copy release];
+      return;
+    }
+    // kGMLogAsyncOverflowBlock: wait for the consumer to make room.
+    [self wakeConsumer];
+    usleep(100);
+  }
+  if (sleeping_)
+    [self wakeConsumer];
+}
+
+- (void)flush {
+  if (!running_ || pthread_equal(pthread_self(), thread_))
+    return;
+  int64_t target = enqueuePos_;
+  pthread_mutex_lock(&lock_);
+  while (dequeuePos_ < target) {
+    pthread_cond_signal(&wakeConsumer_);
+    struct timespec deadline;
+    GMLogAsyncDeadline(&deadline, 10);
+    pthread_cond_timedwait(&drained_, &lock_, &deadline);
+  }
+  pthread_mutex_unlock(&lock_);
+}
+
+- (void)stop {
+  if (!running_)
+    return;
+  [self flush];
+  OSAtomicCompareAndSwap32Barrier(0, 1, &stopping_);
+  [self wakeConsumer];
+  pthread_join(thread_, NULL);
+  running_ = NO;
+}
+
+@end  // GMLogAsyncWriter
+
+
+@implementation GMLogAsyncWriter (PrivateMethods)
+
+- (BOOL)enqueueMessage:(NSString *)msg level:(GMLoggerLevel)level {
+  uint32_t mask = capacity_ - 1;
+  int64_t pos = enqueuePos_;
+  GMLogAsyncSlot *slot = NULL;
+  for (;;) {
+    slot = &slots_[pos & mask];
+    int64_t sequence = slot->sequence;
+    OSMemoryBarrier();
+    int64_t difference = sequence - pos;
+    if (difference == 0) {
+      // The slot is free; try to claim it.
+      if (OSAtomicCompareAndSwap64Barrier(pos, pos + 1, &enqueuePos_))
+        break;
+      pos = enqueuePos_;
+    } else if (difference < 0) {
+      return NO;  // full
+    } else {
+      pos = enqueuePos_;  // someone else got there first
+    }
+  }
+  slot->msg = msg;
+  slot->level = level;
+  OSMemoryBarrier();
+  slot->sequence = pos + 1;  // publish
+  return YES;
+}
+
+- (BOOL)hasQueuedMessages {
+  int64_t pos = dequeuePos_;
+  return slots_[pos & (capacity_ - 1)].sequence == pos + 1;
+}
+
+// Returns the number of messages written.
+- (int)writeBatch {
+  uint32_t mask = capacity_ - 1;
+  NSMutableArray *msgs = [NSMutableArray array];
+  GMLoggerLevel levels[kGMLogAsyncMaxBatch];
+  int64_t pos = dequeuePos_;
+  int count = 0;
+  while (count < kGMLogAsyncMaxBatch) {
+    GMLogAsyncSlot *slot = &slots_[pos & mask];
+    if (slot->sequence != pos + 1)
+      break;
+    OSMemoryBarrier();
+    [msgs addObject:slot->msg];
+    [slot->msg release];
+    slot->msg = nil;
+    levels[count++] = slot->level;
+    OSMemoryBarrier();
+    slot->sequence = pos + capacity_;  // free for the next lap
+    pos++;
+  }
+  if (count == 0)
+    return 0;
+
+  if ([writer_ conformsToProtocol:@protocol(GMLogBatchWriter)]) {
+    [(id<GMLogBatchWriter>)writer_ logMessages:msgs levels:levels];
+  } else {
+    for (int i = 0; i < count; i++)
+      [writer_ logMessage:[msgs objectAtIndex:i] level:levels[i]];
+  }
+
+  int32_t dropped = dropped_;
+  while ((dropped > 0) &&
+         !OSAtomicCompareAndSwap32Barrier(dropped, 0, &dropped_))
+    dropped = dropped_;
+  if (dropped > 0) {
+    NSString *msg = [NSString stringWithFormat:
+                       @"GMLogAsyncWriter: %d messages dropped (log ring full)",
+                       dropped];
+    [writer_ logMessage:msg level:kGMLoggerLevelInfo];
+  }
+
+  pthread_mutex_lock(&lock_);
+  dequeuePos_ = pos;
+  pthread_cond_broadcast(&drained_);
+  pthread_mutex_unlock(&lock_);
+  return count;
+}
+
+- (void)wakeConsumer {
+  pthread_mutex_lock(&lock_);
+  pthread_cond_signal(&wakeConsumer_);
+  pthread_mutex_unlock(&lock_);
+}
+
+// The background thread.
+- (void)run {
+  for (;;) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    int written = [self writeBatch];
+    [pool release];
+    if (written > 0)
+      continue;
+    if (stopping_ && ![self hasQueuedMessages])
+      break;
+
+    // Nothing to do; sleep until a producer wakes us.
+    pthread_mutex_lock(&lock_);
+    OSAtomicCompareAndSwap32Barrier(0, 1, &sleeping_);
+    if (![self hasQueuedMessages] && !stopping_) {
+      struct timespec deadline;
+      GMLogAsyncDeadline(&deadline, 100);
+      pthread_cond_timedwait(&wakeConsumer_, &lock_, &deadline);
+    }
+    OSAtomicCompareAndSwap32Barrier(1, 0, &sleeping_);
+    pthread_mutex_unlock(&lock_);
+  }
+}
+
+@end  // PrivateMethods
+
+
+@implementation NSFileHandle (GMFileHandleBatchWriter)
+
+- (void)logMessages:(NSArray *)msgs levels:(const GMLoggerLevel *)levels {
+  NSMutableData *data = [NSMutableData data];
+  NSEnumerator *msgEnumerator = [msgs objectEnumerator];
+  NSString *msg = nil;
+  while ((msg = [msgEnumerator nextObject])) {
+    const char *utf8 = [msg UTF8String];
+    if (utf8)
+      [data appendBytes:utf8 length:strlen(utf8)];
+    [data appendBytes:"\n" length:1];
+  }
+  @synchronized(self) {
+    [self writeData:data];
+  }
+}
+
+@end  // GMFileHandleBatchWriter
@@ -0,0 +1,284 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import <SenTestingKit/SenTestingKit.h>
+#import <Cocoa/Cocoa.h>
+#include <pthread.h>
+#include <sys/time.h>
+#import "GMLogAsyncWriter.h"
+#import "GMLogAsyncWriterTest.h"
+
+// Remembers what it was asked to write, optionally pausing per write to
+// stand in for slow I/O, or holding all writes until opened.
+@interface GMLogRecordingWriter : NSObject <GMLogBatchWriter> {
+ @private
+  NSMutableArray *msgs_;
+  NSMutableArray *threads_;
+  useconds_t delay_;
+  NSConditionLock *gate_;  // 1 when open
+}
+- (id)initWithDelay:(useconds_t)delay;
+- (void)close;
+- (void)open;
+- (NSArray *)messages;
+- (BOOL)wroteOnlyOn:(NSThread *)thread;
+@end
+
+@implementation GMLogRecordingWriter
+
+- (id)initWithDelay:(useconds_t)delay {
+  if ((self = [super init])) {
+    msgs_ = [[NSMutableArray alloc] init];
+    threads_ = [[NSMutableArray alloc] init];
+    delay_ = delay;
+    gate_ = [[NSConditionLock alloc] initWithCondition:1];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [msgs_ release];
+  [threads_ release];
+  [gate_ release];
+  [super dealloc];
+}
+
+- (void)close {
+  [gate_ lock];
+  [gate_ unlockWithCondition:0];
+}
+
+- (void)open {
+  [gate_ lock];
+  [gate_ unlockWithCondition:1];
+}
+
+- (void)record:(NSArray *)msgs {
+  [gate_ lockWhenCondition:1];
+  [gate_ unlock];
+  // Like NSFileHandle's writer, one write at a time.
+  @synchronized(self) {
+    if (delay_)
+      usleep(delay_);
+    [msgs_ addObjectsFromArray:msgs];
+    [threads_ addObject:[NSThread currentThread]];
+  }
+}
+
+- (void)logMessage:(NSString *)msg level:(GMLoggerLevel)level {
+  [self record:[NSArray arrayWithObject:msg]];
+}
+
+- (void)logMessages:(NSArray *)msgs levels:(const GMLoggerLevel *)levels {
+  [self record:msgs];
+}
+
+- (NSArray *)messages {
+  @synchronized(self) {
+    return [[msgs_ copy] autorelease];
+  }
+  return nil;
+}
+
+- (BOOL)wroteOnlyOn:(NSThread *)thread {
+  @synchronized(self) {
+    NSEnumerator *threadEnumerator = [threads_ objectEnumerator];
+    NSThread *t = nil;
+    while ((t = [threadEnumerator nextObject])) {
+      if (t != thread)
+        return NO;
+    }
+  }
+  return YES;
+}
+
+@end
+
+static const int kThreads = 4;
+static const int kMessagesPerThread = 2000;
+
+@implementation GMLogAsyncWriterTest
+
+- (void)setUp {
+  done_ = [[NSConditionLock alloc] initWithCondition:0];
+}
+
+- (void)tearDown {
+  [done_ release];
+}
+
+// |args| is (writer, thread number).
+- (void)logFromThread:(NSArray *)args {
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  id<GMLogWriter> writer = [args objectAtIndex:0];
+  int thread = [[args objectAtIndex:1] intValue];
+  for (int i = 0; i < kMessagesPerThread; i++) {
+    [writer logMessage:[NSString stringWithFormat:@"%d %d", thread, i]
+                 level:kGMLoggerLevelInfo];
+  }
+  [done_ lock];
+  [done_ unlockWithCondition:[done_ condition] + 1];
+  [pool release];
+}
+
+// Log from kThreads threads at once; returns the seconds taken.
+- (NSTimeInterval)hammer:(id<GMLogWriter>)writer {
+  [done_ lock];
+  [done_ unlockWithCondition:0];
+  NSDate *start = [NSDate date];
+  for (int i = 0; i < kThreads; i++) {
+    NSArray *args = [NSArray arrayWithObjects:writer, [NSNumber numberWithInt:i], nil];
+    [NSThread detachNewThreadSelector:@selector(logFromThread:)
+                             toTarget:self
+                           withObject:args];
+  }
+  [done_ lockWhenCondition:kThreads];
+  [done_ unlock];
+  return -[start timeIntervalSinceNow];
+}
+
+- (void)testOrder {
+  GMLogRecordingWriter *recorder = [[[GMLogRecordingWriter alloc] initWithDelay:0]
+                                     autorelease];
+  GMLogAsyncWriter *writer = [GMLogAsyncWriter writerWithWriter:recorder];
+  STAssertEquals([writer writer], recorder, nil);
+  for (int i = 0; i < 1000; i++)
+    [writer logMessage:[NSString stringWithFormat:@"%d", i] level:kGMLoggerLevelInfo];
+  [writer flush];
+  NSArray *msgs = [recorder messages];
+  STAssertEquals([msgs count], (unsigned)1000, nil);
+  for (int i = 0; i < 1000; i++)
+    STAssertEquals([[msgs objectAtIndex:i] intValue], i, nil);
+  // Written from the background thread.
+  STAssertFalse([recorder wroteOnlyOn:[NSThread currentThread]], nil);
+  STAssertEquals([writer droppedCount], (unsigned)0, nil);
+}
+
+- (void)testContention {
+  GMLogRecordingWriter *recorder = [[[GMLogRecordingWriter alloc] initWithDelay:0]
+                                     autorelease];
+  GMLogAsyncWriter *writer = [[[GMLogAsyncWriter alloc]
+                                initWithWriter:recorder
+                                      capacity:100  // rounded up to 128
+                                overflowPolicy:kGMLogAsyncOverflowBlock]
+                               autorelease];
+  [self hammer:writer];
+  [writer flush];
+
+  // Nothing lost, and each thread's messages in the order logged.
+  NSArray *msgs = [recorder messages];
+  STAssertEquals([msgs count], (unsigned)(kThreads * kMessagesPerThread), nil);
+  int next[kThreads] = { 0 };
+  NSEnumerator *msgEnumerator = [msgs objectEnumerator];
+  NSString *msg = nil;
+  while ((msg = [msgEnumerator nextObject])) {
+    NSArray *parts = [msg componentsSeparatedByString:@" "];
+    int thread = [[parts objectAtIndex:0] intValue];
+    STAssertEquals([[parts objectAtIndex:1] intValue], next[thread], nil);
+    next[thread]++;
+  }
+}
+
+- (void)testDrop {
+  GMLogRecordingWriter *recorder = [[[GMLogRecordingWriter alloc] initWithDelay:0]
+                                     autorelease];
+  GMLogAsyncWriter *writer = [[[GMLogAsyncWriter alloc]
+                                initWithWriter:recorder
+                                      capacity:16
+                                overflowPolicy:kGMLogAsyncOverflowDrop]
+                               autorelease];
+  // Stall the writer; the ring fills and the rest are dropped.
+  [recorder close];
+  for (int i = 0; i < 100; i++)
+    [writer logMessage:@"msg" level:kGMLoggerLevelInfo];
+  // At most a ring's worth waits, plus a batch stuck in the writer.
+  unsigned dropped = [writer droppedCount];
+  STAssertTrue(dropped >= 100 - 2 * 16, nil);
+  [recorder open];
+  [writer flush];
+
+  // Everything not dropped was written, plus a note of the drops.
+  NSArray *msgs = [recorder messages];
+  STAssertEquals([msgs count], 100 - dropped + 1, nil);
+  int notes = 0;
+  NSEnumerator *msgEnumerator = [msgs objectEnumerator];
+  NSString *msg = nil;
+  while ((msg = [msgEnumerator nextObject])) {
+    if ([msg hasPrefix:@"GMLogAsyncWriter:"])
+      notes++;
+  }
+  STAssertEquals(notes, 1, nil);
+  STAssertEquals([writer droppedCount], (unsigned)0, nil);
+}
+
+- (void)testSynchronousLevel {
+  GMLogRecordingWriter *recorder = [[[GMLogRecordingWriter alloc] initWithDelay:1000]
+                                     autorelease];
+  GMLogAsyncWriter *writer = [GMLogAsyncWriter writerWithWriter:recorder];
+  for (int i = 0; i < 10; i++)
+    [writer logMessage:@"info" level:kGMLoggerLevelInfo];
+  // An assert is out before the call returns, after everything before it.
+  [writer logMessage:@"assert" level:kGMLoggerLevelAssert];
+  NSArray *msgs = [recorder messages];
+  STAssertEquals([msgs count], (unsigned)11, nil);
+  STAssertEqualObjects([msgs lastObject], @"assert", nil);
+
+  [writer setSynchronousLevel:kGMLoggerLevelError];
+  [writer logMessage:@"error" level:kGMLoggerLevelError];
+  STAssertEqualObjects([[recorder messages] lastObject], @"error", nil);
+}
+
+- (void)testStop {
+  GMLogRecordingWriter *recorder = [[[GMLogRecordingWriter alloc] initWithDelay:100]
+                                     autorelease];
+  GMLogAsyncWriter *writer = [GMLogAsyncWriter writerWithWriter:recorder];
+  for (int i = 0; i < 50; i++)
+    [writer logMessage:@"before" level:kGMLoggerLevelInfo];
+  [writer stop];
+  STAssertEquals([[recorder messages] count], (unsigned)50, nil);
+  // After stopping, messages are written directly.
+  [writer logMessage:@"after" level:kGMLoggerLevelInfo];
+  STAssertEqualObjects([[recorder messages] lastObject], @"after", nil);
+  [writer stop];  // harmless twice
+  [GMLogAsyncWriter flushAll];
+}
+
+// Cost per call of logging from several threads at once to a writer which
+// takes 20us per write (about what a small write(2) to disk costs), with and
+// without the async writer in front of it.
+- (void)testBenchmark {
+  GMLogRecordingWriter *slow = [[[GMLogRecordingWriter alloc] initWithDelay:20]
+                                 autorelease];
+  NSTimeInterval syncTime = [self hammer:slow];
+
+  GMLogRecordingWriter *slow2 = [[[GMLogRecordingWriter alloc] initWithDelay:20]
+                                  autorelease];
+  GMLogAsyncWriter *writer = [[[GMLogAsyncWriter alloc]
+                                initWithWriter:slow2
+                                      capacity:8192
+                                overflowPolicy:kGMLogAsyncOverflowBlock]
+                               autorelease];
+  NSTimeInterval asyncTime = [self hammer:writer];
+  [writer flush];
+
+  int calls = kThreads * kMessagesPerThread;
+  NSLog(@"GMLogAsyncWriter: %d threads, %.2fus per call synchronous, "
+        "%.2fus per call async", kThreads,
+        syncTime * 1e6 / calls, asyncTime * 1e6 / calls);
+  STAssertEquals([[slow2 messages] count], (unsigned)calls, nil);
+  STAssertTrue(asyncTime < syncTime, nil);
+}
+
+@end
@@ -0,0 +1,84 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// GMLogBinaryReader
+//
+// Reads the files written by GMLogBinaryWriter back, one message at a time,
+// putting each message's format and arguments back together. Messages can
+// be filtered by level and by function name. -nextLine renders messages the
+// way GMLogStandardFormatter would have:
+//
+//   2007-12-30 10:29:24.177 myapp[4588/0xa07d0f60] [lvl=1] func message
+//
+// A file cut short (e.g. by a crash part way through a write) reads up to
+// the last complete record, and then -error says so.
+
+#import <Foundation/Foundation.h>
+#import "GMLogger.h"
+
+// Keys in the dictionaries returned by -nextMessage.
+extern NSString *const kGMLogBinaryTimeKey;     // NSDate
+extern NSString *const kGMLogBinaryLevelKey;    // NSNumber (GMLoggerLevel)
+extern NSString *const kGMLogBinaryThreadKey;   // NSNumber (unsigned long long)
+extern NSString *const kGMLogBinaryFuncKey;     // NSString, absent if none
+extern NSString *const kGMLogBinaryProcessKey;  // NSString
+extern NSString *const kGMLogBinaryPidKey;      // NSNumber
+extern NSString *const kGMLogBinaryMessageKey;  // NSString
+
+@interface GMLogBinaryReader : NSObject {
+ @private
+  NSData *data_;
+  const uint8_t *pos_;
+  const uint8_t *end_;
+  // Per session.
+  NSMutableDictionary *formats_;  // NSNumber id -> NSData (UTF-8 format)
+  NSMutableDictionary *funcs_;    // NSNumber id -> NSString
+  NSString *processName_;
+  int pid_;
+  // Filters.
+  GMLoggerLevel minimumLevel_;
+  NSString *funcFilter_;
+  NSString *error_;
+}
+
+// Returns an autoreleased reader for the file at |path|, or nil if it can't
+// be read.
++ (id)readerWithContentsOfFile:(NSString *)path;
+
+// Designated initializer. |data| is retained.
+- (id)initWithData:(NSData *)data;
+
+// Skip messages below |level|. Defaults to kGMLoggerLevelUnknown (nothing
+// skipped).
+- (void)setMinimumLevel:(GMLoggerLevel)level;
+
+// Skip messages whose function name doesn't contain |substring|. nil (the
+// default) skips nothing.
+- (void)setFunctionFilter:(NSString *)substring;
+
+// Returns the next message which passes the filters (autoreleased), or nil
+// at the end of the file or on error.
+- (NSDictionary *)nextMessage;
+
+// The next message rendered as a line of text, without the newline.
+- (NSString *)nextLine;
+
+// Renders |message| (from -nextMessage) as a line of text.
++ (NSString *)lineForMessage:(NSDictionary *)message;
+
+// Why reading stopped early, or nil.
+- (NSString *)error;
+
+@end
@@ -0,0 +1,430 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import "GMLogBinaryReader.h"
+#import "GMLogBinaryWriter.h"
+#import <ctype.h>
+#import <stdio.h>
+#import <stdlib.h>
+#import <string.h>
+#import <time.h>
+
+NSString *const kGMLogBinaryTimeKey = @"time";
+NSString *const kGMLogBinaryLevelKey = @"level";
+NSString *const kGMLogBinaryThreadKey = @"thread";
+NSString *const kGMLogBinaryFuncKey = @"func";
+NSString *const kGMLogBinaryProcessKey = @"process";
+NSString *const kGMLogBinaryPidKey = @"pid";
+NSString *const kGMLogBinaryMessageKey = @"message";
+
+// A cursor over one record's payload. Reads past the end set |overrun|.
+typedef struct {
+  const uint8_t *pos;
+  const uint8_t *end;
+  BOOL overrun;
+} GMLogBinaryCursor;
+
+static BOOL GMLogBinaryHas(GMLogBinaryCursor *cursor, size_t length) {
+  if (cursor->overrun || (size_t)(cursor->end - cursor->pos) < length) {
+    cursor->overrun = YES;
+    return NO;
+  }
+  return YES;
+}
+
+static uint8_t GMLogBinaryReadUInt8(GMLogBinaryCursor *cursor) {
+  if (!GMLogBinaryHas(cursor, 1))
+    return 0;
+  return *cursor->pos++;
+}
+
+static uint32_t GMLogBinaryReadUInt32(GMLogBinaryCursor *cursor) {
+  if (!GMLogBinaryHas(cursor, 4))
+    return 0;
+  uint32_t value = 0;
+  for (int i = 0; i < 4; i++)
+    value |= (uint32_t)cursor->pos[i] << (8 * i);
+  cursor->pos += 4;
+  return value;
+}
+
+static uint64_t GMLogBinaryReadUInt64(GMLogBinaryCursor *cursor) {
+  if (!GMLogBinaryHas(cursor, 8))
+    return 0;
+  uint64_t value = 0;
+  for (int i = 0; i < 8; i++)
+    value |= (uint64_t)cursor->pos[i] << (8 * i);
+  cursor->pos += 8;
+  return value;
+}
+
+static NSString *GMLogBinaryReadRest(GMLogBinaryCursor *cursor) {
+  NSString *string = [[[NSString alloc]
+                        initWithBytes:cursor->pos
+                               length:cursor->end - cursor->pos
+                             encoding:NSUTF8StringEncoding] autorelease];
+  cursor->pos = cursor->end;
+  return string ? string : @"";
+}
+
+@interface GMLogBinaryReader (PrivateMethods)
+- (NSString *)renderFormat:(NSData *)format
+                 arguments:(GMLogBinaryCursor *)cursor;
+- (void)failWithError:(NSString *)error;
+@end
+
+@implementation GMLogBinaryReader
+
++ (id)readerWithContentsOfFile:(NSString *)path {
+  NSData *data = [NSData dataWithContentsOfMappedFile:path];
+  if (data == nil)
+    return nil;
+  return [[[self alloc] initWithData:data] autorelease];
+}
+
+- (id)init {
+  return [self initWithData:nil];
+}
+
+- (id)initWithData:(NSData *)data {
+  if ((self = [super init])) {
+    if (data == nil) {
+      [self release];
+      return nil;
+    }
+    data_ = [data retain];
+    pos_ = [data_ bytes];
+    end_ = pos_ + [data_ length];
+    formats_ = [[NSMutableDictionary alloc] init];
+    funcs_ = [[NSMutableDictionary alloc] init];
+    minimumLevel_ = kGMLoggerLevelUnknown;
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [data_ release];
+  [formats_ release];
+  [funcs_ release];
+  [processName_ release];
+  [funcFilter_ release];
+  [error_ release];
+  [super dealloc];
+}
+
+- (void)setMinimumLevel:(GMLoggerLevel)level {
+  minimumLevel_ = level;
+}
+
+- (void)setFunctionFilter:(NSString *)substring {
+  [funcFilter_ autorelease];
+  funcFilter_ = [substring copy];
+}
+
+- (NSString *)error {
+  return [[error_ retain] autorelease];
+}
+
+- (NSDictionary *)nextMessage {
+  while (error_ == nil && pos_ < end_) {
+    if (end_ - pos_ < 5) {
+      [self failWithError:@"truncated record header"];
+      break;
+    }
+    GMLogBinaryCursor header = { pos_, end_, NO };
+    uint8_t type = GMLogBinaryReadUInt8(&header);
+    uint32_t length = GMLogBinaryReadUInt32(&header);
+    if ((size_t)(end_ - header.pos) < length) {
+      [self failWithError:@"truncated record"];
+      break;
+    }
+    GMLogBinaryCursor cursor = { header.pos, header.pos + length, NO };
+    pos_ = cursor.end;
+
+    switch (type) {
+      case kGMLogBinarySessionRecord: {
+        if (!GMLogBinaryHas(&cursor, 4) ||
+            memcmp(cursor.pos, kGMLogBinaryMagic, 4) != 0) {
+          [self failWithError:@"not a GMLogBinaryWriter file"];
+          return nil;
+        }
+        cursor.pos += 4;
+        uint32_t version = GMLogBinaryReadUInt32(&cursor);
+        if (version > kGMLogBinaryVersion) {
+          [self failWithError:[NSString stringWithFormat:
+                               @"unknown version %u", version]];
+          return nil;
+        }
+        pid_ = GMLogBinaryReadUInt32(&cursor);
+        (void)GMLogBinaryReadUInt64(&cursor);  // start time
+        [processName_ release];
+        processName_ = [GMLogBinaryReadRest(&cursor) retain];
+        [formats_ removeAllObjects];
+        [funcs_ removeAllObjects];
+        break;
+      }
+      case kGMLogBinaryFormatRecord: {
+        uint32_t formatId = GMLogBinaryReadUInt32(&cursor);
+        if (cursor.overrun)
+          break;
+        NSData *format = [NSData dataWithBytes:cursor.pos
+                                        length:cursor.end - cursor.pos];
+        [formats_ setObject:format
+                     forKey:[NSNumber numberWithUnsignedInt:formatId]];
+        break;
+      }
+      case kGMLogBinaryFuncRecord: {
+        uint32_t funcId = GMLogBinaryReadUInt32(&cursor);
+        if (cursor.overrun)
+          break;
+        [funcs_ setObject:GMLogBinaryReadRest(&cursor)
+                   forKey:[NSNumber numberWithUnsignedInt:funcId]];
+        break;
+      }
+      case kGMLogBinaryMessageRecord:
+      case kGMLogBinaryTextRecord: {
+        if (processName_ == nil) {
+          [self failWithError:@"message before the session record"];
+          return nil;
+        }
+        int64_t usec = (int64_t)GMLogBinaryReadUInt64(&cursor);
+        uint64_t thread = GMLogBinaryReadUInt64(&cursor);
+        GMLoggerLevel level = GMLogBinaryReadUInt8(&cursor);
+        uint32_t funcId = GMLogBinaryReadUInt32(&cursor);
+        if (cursor.overrun) {
+          [self failWithError:@"short message record"];
+          return nil;
+        }
+        if (level < minimumLevel_)
+          break;
+        NSString *func = nil;
+        if (funcId)
+          func = [funcs_ objectForKey:[NSNumber numberWithUnsignedInt:funcId]];
+        if (funcFilter_ &&
+            (func == nil || [func rangeOfString:funcFilter_].location ==
+                              NSNotFound))
+          break;
+
+        NSString *msg = nil;
+        if (type == kGMLogBinaryTextRecord) {
+          msg = GMLogBinaryReadRest(&cursor);
+        } else {
+          uint32_t formatId = GMLogBinaryReadUInt32(&cursor);
+          NSData *format =
+            [formats_ objectForKey:[NSNumber numberWithUnsignedInt:formatId]];
+          if (format == nil) {
+            [self failWithError:[NSString stringWithFormat:
+                                 @"unknown format id %u", formatId]];
+            return nil;
+          }
+          msg = [self renderFormat:format arguments:&cursor];
+          if (msg == nil)
+            return nil;
+        }
+
+        NSMutableDictionary *message = [NSMutableDictionary dictionary];
+        NSDate *time = [NSDate dateWithTimeIntervalSince1970:usec / 1e6];
+        [message setObject:time forKey:kGMLogBinaryTimeKey];
+        [message setObject:[NSNumber numberWithInt:level]
+                    forKey:kGMLogBinaryLevelKey];
+        [message setObject:[NSNumber numberWithUnsignedLongLong:thread]
+                    forKey:kGMLogBinaryThreadKey];
+        if (func)
+          [message setObject:func forKey:kGMLogBinaryFuncKey];
+        [message setObject:processName_ forKey:kGMLogBinaryProcessKey];
+        [message setObject:[NSNumber numberWithInt:pid_]
+                    forKey:kGMLogBinaryPidKey];
+        [message setObject:msg forKey:kGMLogBinaryMessageKey];
+        return message;
+      }
+      default:
+        // Something newer; skip it.
+        break;
+    }
+  }
+  return nil;
+}
+
+- (NSString *)nextLine {
+  NSDictionary *message = [self nextMessage];
+  return message ? [[self class] lineForMessage:message] : nil;
+}
+
++ (NSString *)lineForMessage:(NSDictionary *)message {
+  NSTimeInterval seconds =
+    [[message objectForKey:kGMLogBinaryTimeKey] timeIntervalSince1970];
+  time_t whole = (time_t)seconds;
+  // Half a microsecond covers the rounding of |seconds|.
+  int ms = (int)((seconds - whole) * 1000 + 0.0005);
+  struct tm local;
+  localtime_r(&whole, &local);
+  char stamp[32];
+  strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &local);
+  NSString *func = [message objectForKey:kGMLogBinaryFuncKey];
+  return [NSString stringWithFormat:@"%s.%03d %@[%@/0x%llx] [lvl=%@] %@ %@",
+          stamp, ms,
+          [message objectForKey:kGMLogBinaryProcessKey],
+          [message objectForKey:kGMLogBinaryPidKey],
+          [[message objectForKey:kGMLogBinaryThreadKey] unsignedLongLongValue],
+          [message objectForKey:kGMLogBinaryLevelKey],
+          (func ? func : @"(no func)"),
+          [message objectForKey:kGMLogBinaryMessageKey]];
+}
+
+@end  // GMLogBinaryReader
+
+
+// snprintf()s one argument with up to two '*' values in front of it.
+#define GMLOG_RENDER(out, spec, stars, count, value)                  \
+  ((count) == 0 ? asprintf(out, spec, value) :                        \
+   (count) == 1 ? asprintf(out, spec, stars[0], value) :              \
+                  asprintf(out, spec, stars[0], stars[1], value))
+
+@implementation GMLogBinaryReader (PrivateMethods)
+
+// Puts the message back together from its format and the tagged arguments
+// at |cursor|. Returns nil (having set the error) if they don't match.
+- (NSString *)renderFormat:(NSData *)format
+                 arguments:(GMLogBinaryCursor *)cursor {
+  const char *fmt = [format bytes];
+  const char *end = fmt + [format length];
+  NSMutableData *out = [NSMutableData dataWithCapacity:[format length] + 64];
+
+  const char *p = fmt;
+  while (p < end) {
+    const char *percent = memchr(p, '%', end - p);
+    if (percent == NULL)
+      percent = end;
+    [out appendBytes:p length:percent - p];
+    if (percent == end)
+      break;
+
+    GMLogSpec spec;
+    size_t length = GMLogScanSpec(percent, end, &spec);
+    if (length == 0 || spec.kind == kGMLogSpecUnsupported) {
+      [self failWithError:@"bad format"];
+      return nil;
+    }
+    p = percent + length;
+    if (spec.kind == kGMLogSpecNone) {
+      [out appendBytes:"%" length:1];
+      continue;
+    }
+    if (spec.kind == kGMLogSpecCount)
+      continue;
+
+    int stars[2] = { 0, 0 };
+    for (int i = 0; i < spec.stars; i++) {
+      if (GMLogBinaryReadUInt8(cursor) != kGMLogBinaryIntArg)
+        cursor->overrun = YES;
+      stars[i] = (int)GMLogBinaryReadUInt64(cursor);
+    }
+    uint8_t tag = GMLogBinaryReadUInt8(cursor);
+
+    // The conversion's flags, width and precision, without its length
+    // modifier or conversion character; we supply our own to match what
+    // was stored.
+    const char *modifiers = percent + length - 1;
+    while (modifiers > percent && strchr("hlqLzjt", modifiers[-1]))
+      modifiers--;
+    char cspec[64];
+    size_t prefix = modifiers - percent;
+    if (prefix > sizeof(cspec) - 4) {
+      [self failWithError:@"bad format"];
+      return nil;
+    }
+    memcpy(cspec, percent, prefix);
+
+    char *rendered = NULL;
+    int count = -1;
+    switch (spec.kind) {
+      case kGMLogSpecInt:
+      case kGMLogSpecLong:
+      case kGMLogSpecLongLong: {
+        if (tag != kGMLogBinaryIntArg)
+          break;
+        long long value = (long long)GMLogBinaryReadUInt64(cursor);
+        if (spec.conversion == 'c') {
+          strcpy(cspec + prefix, "c");
+          count = GMLOG_RENDER(&rendered, cspec, stars, spec.stars,
+                               (int)value);
+        } else {
+          char conversion = spec.conversion;
+          if (conversion == 'D' || conversion == 'O' || conversion == 'U')
+            conversion = tolower(conversion);
+          snprintf(cspec + prefix, 4, "ll%c", conversion);
+          count = GMLOG_RENDER(&rendered, cspec, stars, spec.stars, value);
+        }
+        break;
+      }
+      case kGMLogSpecDouble:
+      case kGMLogSpecLongDouble: {
+        if (tag != kGMLogBinaryDoubleArg)
+          break;
+        union { uint64_t bits; double value; } number;
+        number.bits = GMLogBinaryReadUInt64(cursor);
+        snprintf(cspec + prefix, 2, "%c", spec.conversion);
+        count = GMLOG_RENDER(&rendered, cspec, stars, spec.stars,
+                             number.value);
+        break;
+      }
+      case kGMLogSpecPointer: {
+        if (tag != kGMLogBinaryPointerArg)
+          break;
+        char address[32];
+        snprintf(address, sizeof(address), "0x%llx",
+                 (unsigned long long)GMLogBinaryReadUInt64(cursor));
+        strcpy(cspec + prefix, "s");
+        count = GMLOG_RENDER(&rendered, cspec, stars, spec.stars, address);
+        break;
+      }
+      default: {
+        // The string kinds.
+        if (tag != kGMLogBinaryStringArg)
+          break;
+        uint32_t size = GMLogBinaryReadUInt32(cursor);
+        if (!GMLogBinaryHas(cursor, size))
+          break;
+        char *string = malloc(size + 1);
+        memcpy(string, cursor->pos, size);
+        string[size] = '\0';
+        cursor->pos += size;
+        strcpy(cspec + prefix, "s");
+        count = GMLOG_RENDER(&rendered, cspec, stars, spec.stars, string);
+        free(string);
+        break;
+      }
+    }
+    if (count < 0 || cursor->overrun) {
+      free(rendered);
+      [self failWithError:@"arguments don't match the format"];
+      return nil;
+    }
+    [out appendBytes:rendered length:count];
+    free(rendered);
+  }
+
+  NSString *msg = [[[NSString alloc] initWithData:out
+                                         encoding:NSUTF8StringEncoding]
+                    autorelease];
+  return msg ? msg : @"";
+}
+
+- (void)failWithError:(NSString *)error {
+  if (error_ == nil)
+    error_ = [error copy];
+}
+
+@end  // PrivateMethods
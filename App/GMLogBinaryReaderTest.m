@@ -0,0 +1,144 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import <SenTestingKit/SenTestingKit.h>
+#import <Cocoa/Cocoa.h>
+#include <pthread.h>
+#import "GMLogBinaryReader.h"
+#import "GMLogBinaryWriter.h"
+#import "GMLogBinaryReaderTest.h"
+
+@implementation GMLogBinaryReaderTest
+
+- (void)setUp {
+  path_ = [[NSTemporaryDirectory() stringByAppendingPathComponent:
+            [NSString stringWithFormat:@"GMLogBinaryReaderTest-%d.gmlog",
+             getpid()]] retain];
+  [[NSFileManager defaultManager] removeFileAtPath:path_ handler:nil];
+}
+
+- (void)tearDown {
+  [[NSFileManager defaultManager] removeFileAtPath:path_ handler:nil];
+  [path_ release];
+}
+
+// Writes a session to |path_| with one message per level, from -[Foo a]
+// (debug and info) and -[Bar b] (error and assert).
+- (void)writeSession {
+  GMLogBinaryWriter *writer = [GMLogBinaryWriter writerWithPath:path_];
+  GMLogger *logger =
+    [GMLogger loggerWithWriter:writer
+                     formatter:nil
+                        filter:[[[GMLogNoFilter alloc] init] autorelease]];
+  [logger logFuncDebug:"-[Foo a]" msg:@"debug %d", 1];
+  [logger logFuncInfo:"-[Foo a]" msg:@"info %d", 2];
+  [logger logFuncError:"-[Bar b]" msg:@"error %d", 3];
+  [logger logFuncAssert:"-[Bar b]" msg:@"assert %d", 4];
+  [writer flush];
+}
+
+- (NSArray *)linesFromReader:(GMLogBinaryReader *)reader {
+  NSMutableArray *lines = [NSMutableArray array];
+  NSString *line = nil;
+  while ((line = [reader nextLine]))
+    [lines addObject:line];
+  return lines;
+}
+
+- (void)testLine {
+  [self writeSession];
+  GMLogBinaryReader *reader = [GMLogBinaryReader readerWithContentsOfFile:path_];
+  NSString *line = [reader nextLine];
+
+  // The same layout as GMLogStandardFormatter.
+  NSProcessInfo *pinfo = [NSProcessInfo processInfo];
+  NSString *expected = [NSString stringWithFormat:
+                        @" %@[%d/%p] [lvl=%d] -[Foo a] debug 1",
+                        [pinfo processName], [pinfo processIdentifier],
+                        pthread_self(), kGMLoggerLevelDebug];
+  STAssertTrue([line hasSuffix:expected], line);
+  NSDateFormatter *dateFormatter = [[[NSDateFormatter alloc] init] autorelease];
+  [dateFormatter setFormatterBehavior:NSDateFormatterBehavior10_4];
+  [dateFormatter setDateFormat:@"yyyy-MM-dd HH:mm:ss.SSS"];
+  NSDate *date = [dateFormatter dateFromString:[line substringToIndex:23]];
+  STAssertTrue(fabs([date timeIntervalSinceNow]) < 5, line);
+}
+
+- (void)testFilters {
+  [self writeSession];
+  GMLogBinaryReader *reader = [GMLogBinaryReader readerWithContentsOfFile:path_];
+  [reader setMinimumLevel:kGMLoggerLevelInfo];
+  NSArray *lines = [self linesFromReader:reader];
+  STAssertEquals([lines count], (unsigned)3, nil);
+  STAssertTrue([[lines objectAtIndex:0] hasSuffix:@"info 2"], nil);
+
+  reader = [GMLogBinaryReader readerWithContentsOfFile:path_];
+  [reader setFunctionFilter:@"Bar"];
+  lines = [self linesFromReader:reader];
+  STAssertEquals([lines count], (unsigned)2, nil);
+  STAssertTrue([[lines objectAtIndex:0] hasSuffix:@"-[Bar b] error 3"], nil);
+
+  reader = [GMLogBinaryReader readerWithContentsOfFile:path_];
+  [reader setFunctionFilter:@"Foo"];
+  [reader setMinimumLevel:kGMLoggerLevelInfo];
+  lines = [self linesFromReader:reader];
+  STAssertEquals([lines count], (unsigned)1, nil);
+  STAssertNil([reader error], nil);
+}
+
+- (void)testSessions {
+  // Two processes' worth appended to one file; ids start again in each.
+  [self writeSession];
+  GMLogBinaryWriter *writer = [GMLogBinaryWriter writerWithPath:path_];
+  GMLogger *logger =
+    [GMLogger loggerWithWriter:writer
+                     formatter:nil
+                        filter:[[[GMLogNoFilter alloc] init] autorelease]];
+  [logger logFuncInfo:"-[Baz c]" msg:@"second session %d", 5];
+  [writer flush];
+
+  GMLogBinaryReader *reader = [GMLogBinaryReader readerWithContentsOfFile:path_];
+  NSArray *lines = [self linesFromReader:reader];
+  STAssertNil([reader error], [reader error]);
+  STAssertEquals([lines count], (unsigned)5, nil);
+  STAssertTrue([[lines lastObject] hasSuffix:@"-[Baz c] second session 5"],
+               [lines lastObject]);
+}
+
+- (void)testTruncated {
+  [self writeSession];
+  NSData *data = [NSData dataWithContentsOfFile:path_];
+  // Cut part way through the last message.
+  NSData *cut = [data subdataWithRange:NSMakeRange(0, [data length] - 3)];
+  GMLogBinaryReader *reader =
+    [[[GMLogBinaryReader alloc] initWithData:cut] autorelease];
+  NSArray *lines = [self linesFromReader:reader];
+  STAssertEquals([lines count], (unsigned)3, nil);
+  STAssertNotNil([reader error], nil);
+  STAssertNil([reader nextLine], nil);
+}
+
+- (void)testGarbage {
+  NSData *data = [@"this is not a log file" dataUsingEncoding:NSUTF8StringEncoding];
+  GMLogBinaryReader *reader =
+    [[[GMLogBinaryReader alloc] initWithData:data] autorelease];
+  STAssertNil([reader nextLine], nil);
+  STAssertNotNil([reader error], nil);
+
+  STAssertNil([GMLogBinaryReader readerWithContentsOfFile:@"/no/such/file"], nil);
+  STAssertNil([[[GMLogBinaryReader alloc] init] autorelease], nil);
+}
+
+@end
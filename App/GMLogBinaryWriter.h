@@ -0,0 +1,153 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// GMLogBinaryWriter
+//
+// A GMLogRecordWriter that records each message as (time, thread, level,
+// function, format id, arguments) in a compact binary file instead of
+// formatting it. Each format string and function name is written to the file
+// once, the first time it is used, and later messages refer to it by id; the
+// arguments are stored in their binary form. No formatting happens at all
+// for the common argument types, which makes it cheap enough to leave debug
+// logging on. GMLogBinaryReader (and the gmlogdecode tool built on it) turns
+// the files back into text.
+//
+// Example: record everything the shared logger sees.
+//
+//   GMLogBinaryWriter *writer =
+//     [GMLogBinaryWriter writerWithPath:@"/tmp/launcher.gmlog"];
+//   GMLogger *logger = [GMLogger sharedLogger];
+//   [logger setWriter:writer];
+//   [logger setFilter:[[[GMLogNoFilter alloc] init] autorelease]];
+//
+// Arguments are captured by their printf/NSString conversion: integers and
+// characters as 64-bit integers, floating point as doubles, %p as a 64-bit
+// address, and %s, %S, %C and %@ as UTF-8 strings (objects are asked for
+// their -description at log time, as NSLog would). Formats using positional
+// arguments ("%1$@") are formatted at log time and stored as text, as are
+// messages handed to -logMessage:level: (e.g. through an NSArray writer).
+//
+// File layout (all integers little-endian). The file is a sequence of
+// framed records:
+//
+//   uint8 type, uint32 payload length, payload
+//
+//   'S' session:  "GMLB", uint32 version, uint32 pid, int64 start (usec
+//                 since 1970), process name (UTF-8). Starts every session
+//                 appended to the file; ids below are per session.
+//   'F' format:   uint32 id, format (UTF-8)
+//   'N' function: uint32 id, name (UTF-8)
+//   'M' message:  int64 time (usec since 1970), uint64 thread, uint8 level,
+//                 uint32 function id (0 if none), uint32 format id,
+//                 then one tagged value per argument (including '*' widths
+//                 and precisions, in order):
+//                   'i' int64 | 'd' double (IEEE bits as uint64)
+//                   'p' uint64 | 's' uint32 length, UTF-8 bytes
+//   'T' text:     int64 time, uint64 thread, uint8 level, uint32 function
+//                 id, message (UTF-8)
+//
+// Readers skip record types they don't know.
+
+#import <Foundation/Foundation.h>
+#import <pthread.h>
+#import <stdint.h>
+#import "GMLogger.h"
+
+#define kGMLogBinaryMagic "GMLB"
+#define kGMLogBinaryVersion 1
+
+enum {
+  kGMLogBinarySessionRecord = 'S',
+  kGMLogBinaryFormatRecord = 'F',
+  kGMLogBinaryFuncRecord = 'N',
+  kGMLogBinaryMessageRecord = 'M',
+  kGMLogBinaryTextRecord = 'T',
+};
+
+enum {
+  kGMLogBinaryIntArg = 'i',
+  kGMLogBinaryDoubleArg = 'd',
+  kGMLogBinaryPointerArg = 'p',
+  kGMLogBinaryStringArg = 's',
+};
+
+// How a single conversion in a format string takes its argument.
+typedef enum {
+  kGMLogSpecNone,         // %%
+  kGMLogSpecInt,          // int (and char, short, %c)
+  kGMLogSpecLong,         // long, size_t, ptrdiff_t
+  kGMLogSpecLongLong,     // long long, intmax_t
+  kGMLogSpecDouble,
+  kGMLogSpecLongDouble,
+  kGMLogSpecCString,      // %s
+  kGMLogSpecObject,       // %@
+  kGMLogSpecUnichar,      // %C
+  kGMLogSpecUnicharString,  // %S
+  kGMLogSpecPointer,      // %p
+  kGMLogSpecCount,        // %n; the pointer is skipped
+  kGMLogSpecUnsupported,  // positional or unknown
+} GMLogSpecKind;
+
+typedef struct {
+  GMLogSpecKind kind;
+  char conversion;   // the final character, e.g. 'd'
+  BOOL isSigned;     // for the integer kinds
+  char size;         // 'H' (hh), 'h' or 0, for narrowing integers
+  int stars;         // '*' widths and precisions taking an int each
+  int precision;     // after the '.', or -1 if none or given by a '*'
+  BOOL starPrecision;  // the precision is the last of the stars
+} GMLogSpec;
+
+// Scans the conversion starting at |spec| (which points at the '%') and
+// ending no later than |end|. Fills in |*out| and returns the length of the
+// conversion, or 0 if it runs off the end.
+size_t GMLogScanSpec(const char *spec, const char *end, GMLogSpec *out);
+
+@interface GMLogBinaryWriter : NSObject <GMLogRecordWriter> {
+ @private
+  int fd_;
+  pthread_mutex_t lock_;
+  CFMutableDictionaryRef formats_;  // NSString -> struct GMLogBinaryFormat *
+  CFMutableDictionaryRef funcs_;    // C string -> id
+  uint32_t lastFormatId_;
+  uint32_t lastFuncId_;
+  char *buffer_;
+  size_t bufferLength_;
+  size_t bufferCapacity_;
+  size_t bufferLimit_;
+  GMLoggerLevel flushLevel_;
+}
+
+// Returns an autoreleased writer appending to the file at |path| (created
+// with mode 0644 if needed), or nil if it can't be opened.
++ (id)writerWithPath:(NSString *)path;
+
+// Designated initializer. Takes ownership of |fd|, which should be open for
+// appending, and writes a session record to it.
+- (id)initWithFileDescriptor:(int)fd;
+
+// Records are collected in memory and written out once there are |bytes|
+// of them (16k by default), when a message at the flush level or above is
+// logged, and on -flush. Zero writes every record as it is logged.
+- (void)setBufferLimit:(size_t)bytes;
+
+// Messages at |level| and above are written out immediately, along with
+// anything buffered before them. Defaults to kGMLoggerLevelError.
+- (void)setFlushLevel:(GMLoggerLevel)level;
+
+// Writes out anything buffered.
+- (void)flush;
+
+@end
@@ -0,0 +1,620 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import "GMLogBinaryWriter.h"
+#import <ctype.h>
+#import <errno.h>
+#import <fcntl.h>
+#import <stdlib.h>
+#import <string.h>
+#import <sys/time.h>
+#import <unistd.h>
+
+// More arguments than this in one format and the message is stored as text.
+static const int kGMLogBinaryMaxArgs = 32;
+
+// An interned format: its id and how to take its arguments.
+typedef struct GMLogBinaryFormat {
+  uint32_t formatId;
+  BOOL asText;   // can't be recorded argument by argument
+  int count;
+  GMLogSpec specs[1];  // |count| of them
+} GMLogBinaryFormat;
+
+// One captured argument.
+typedef struct {
+  char tag;  // kGMLogBinary*Arg
+  union {
+    int64_t i;
+    double d;
+    uint64_t p;
+  } value;
+  const char *string;
+  size_t length;  // of |string|
+} GMLogBinaryValue;
+
+size_t GMLogScanSpec(const char *spec, const char *end, GMLogSpec *out) {
+  memset(out, 0, sizeof(*out));
+  out->precision = -1;
+  const char *p = spec + 1;
+  if (p >= end)
+    return 0;
+  if (*p == '%') {
+    out->kind = kGMLogSpecNone;
+    out->conversion = '%';
+    return 2;
+  }
+
+  BOOL positional = NO;
+  const char *digits = p;
+  while (p < end && isdigit((unsigned char)*p))
+    p++;
+  if (p < end && *p == '$' && p > digits) {
+    positional = YES;
+    p++;
+  } else {
+    p = digits;
+  }
+
+  while (p < end && strchr("-+ #0'", *p))
+    p++;
+  if (p < end && *p == '*') {
+    out->stars++;
+    p++;
+  }
+  while (p < end && isdigit((unsigned char)*p))
+    p++;
+  if (p < end && *p == '.') {
+    p++;
+    if (p < end && *p == '*') {
+      out->stars++;
+      out->starPrecision = YES;
+      p++;
+    } else {
+      out->precision = 0;
+      while (p < end && isdigit((unsigned char)*p)) {
+        if (out->precision < 100000000)
+          out->precision = out->precision * 10 + (*p - '0');
+        p++;
+      }
+    }
+  }
+
+  // Length modifier.
+  char length = 0;
+  if (p < end && *p == 'h') {
+    length = 'h';
+    p++;
+    if (p < end && *p == 'h') {
+      length = 'H';
+      p++;
+    }
+  } else if (p < end && *p == 'l') {
+    length = 'l';
+    p++;
+    if (p < end && *p == 'l') {
+      length = 'q';
+      p++;
+    }
+  } else if (p < end && strchr("qLzjt", *p)) {
+    length = *p;
+    p++;
+  }
+  if (p >= end)
+    return 0;
+
+  out->conversion = *p;
+  switch (*p) {
+    case 'd': case 'i':
+    case 'o': case 'u': case 'x': case 'X':
+      out->isSigned = (*p == 'd' || *p == 'i');
+      if (length == 'l' || length == 'z' || length == 't')
+        out->kind = kGMLogSpecLong;
+      else if (length == 'q' || length == 'L' || length == 'j')
+        out->kind = kGMLogSpecLongLong;
+      else
+        out->kind = kGMLogSpecInt;
+      if (length == 'h' || length == 'H')
+        out->size = length;
+      break;
+    case 'D': case 'O': case 'U':
+      out->isSigned = (*p == 'D');
+      out->kind = kGMLogSpecLong;
+      break;
+    case 'c':
+      out->isSigned = YES;
+      out->kind = kGMLogSpecInt;
+      break;
+    case 'C':
+      out->kind = kGMLogSpecUnichar;
+      break;
+    case 's':
+      // %ls is a wchar_t string, which we don't take apart.
+      out->kind = (length == 'l') ? kGMLogSpecUnsupported : kGMLogSpecCString;
+      break;
+    case 'S':
+      out->kind = kGMLogSpecUnicharString;
+      break;
+    case '@':
+      out->kind = kGMLogSpecObject;
+      break;
+    case 'p':
+      out->kind = kGMLogSpecPointer;
+      break;
+    case 'e': case 'E': case 'f': case 'F':
+    case 'g': case 'G': case 'a': case 'A':
+      out->kind = (length == 'L') ? kGMLogSpecLongDouble : kGMLogSpecDouble;
+      break;
+    case 'n':
+      out->kind = kGMLogSpecCount;
+      break;
+    default:
+      out->kind = kGMLogSpecUnsupported;
+      break;
+  }
+  if (positional)
+    out->kind = kGMLogSpecUnsupported;
+  return p + 1 - spec;
+}
+
+// Parses |fmt| into a new (malloc'ed) GMLogBinaryFormat.
+static GMLogBinaryFormat *GMLogBinaryFormatCreate(const char *fmt,
+                                                  uint32_t formatId) {
+  size_t size = sizeof(GMLogBinaryFormat) +
+                kGMLogBinaryMaxArgs * sizeof(GMLogSpec);
+  GMLogBinaryFormat *format = calloc(1, size);
+  format->formatId = formatId;
+  const char *end = fmt + strlen(fmt);
+  const char *p = fmt;
+  while ((p = memchr(p, '%', end - p))) {
+    GMLogSpec spec;
+    size_t length = GMLogScanSpec(p, end, &spec);
+    if (length == 0 || spec.kind == kGMLogSpecUnsupported ||
+        format->count == kGMLogBinaryMaxArgs) {
+      format->asText = YES;
+      break;
+    }
+    if (spec.kind != kGMLogSpecNone)
+      format->specs[format->count++] = spec;
+    p += length;
+  }
+  return format;
+}
+
+static void GMLogBinaryFormatFree(CFAllocatorRef allocator,
+                                  const void *value) {
+  free((void *)value);
+}
+
+// C string keys for |funcs_|, copied on insertion.
+static const void *GMLogBinaryCStringRetain(CFAllocatorRef allocator,
+                                            const void *value) {
+  return strdup(value);
+}
+
+static void GMLogBinaryCStringRelease(CFAllocatorRef allocator,
+                                      const void *value) {
+  free((void *)value);
+}
+
+static Boolean GMLogBinaryCStringEqual(const void *a, const void *b) {
+  return strcmp(a, b) == 0;
+}
+
+static CFHashCode GMLogBinaryCStringHash(const void *value) {
+  // FNV-1a.
+  CFHashCode hash = 2166136261U;
+  for (const unsigned char *p = value; *p; p++)
+    hash = (hash ^ *p) * 16777619U;
+  return hash;
+}
+
+static int64_t GMLogBinaryNow(void) {
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return (int64_t)now.tv_sec * 1000000 + now.tv_usec;
+}
+
+// UTF-8 for |string|, or "(null)" the way NSLog would print nil.
+// strnlen(), which 10.4 doesn't have.
+static size_t GMLogBinaryStrnlen(const char *s, size_t limit) {
+  const char *nul = memchr(s, '\0', limit);
+  return nul ? (size_t)(nul - s) : limit;
+}
+
+static const char *GMLogBinaryUTF8(NSString *string) {
+  const char *utf8 = [string UTF8String];
+  return utf8 ? utf8 : "(null)";
+}
+
+@interface GMLogBinaryWriter (PrivateMethods)
+- (void)appendBytes:(const void *)bytes length:(size_t)length;
+- (void)appendUInt8:(uint8_t)value;
+- (void)appendUInt32:(uint32_t)value;
+- (void)appendUInt64:(uint64_t)value;
+- (size_t)beginRecord:(uint8_t)type;
+- (void)endRecord:(size_t)start;
+- (void)appendPrefixWithTime:(int64_t)now
+                       level:(GMLoggerLevel)level
+                      funcId:(uint32_t)funcId;
+- (uint32_t)idForFunc:(const char *)func;
+- (GMLogBinaryFormat *)formatFor:(NSString *)fmt;
+- (void)writeText:(NSString *)msg func:(const char *)func
+            level:(GMLoggerLevel)level;
+- (void)finishMessageAtLevel:(GMLoggerLevel)level;
+- (void)writeBuffer;
+@end
+
+@implementation GMLogBinaryWriter
+
++ (id)writerWithPath:(NSString *)path {
+  int fd = open([path fileSystemRepresentation],
+                O_WRONLY | O_CREAT | O_APPEND, 0644);
+  if (fd < 0)
+    return nil;
+  return [[[self alloc] initWithFileDescriptor:fd] autorelease];
+}
+
+- (id)init {
+  return [self initWithFileDescriptor:-1];
+}
+
+- (id)initWithFileDescriptor:(int)fd {
+  if ((self = [super init])) {
+    fd_ = fd;
+    pthread_mutex_init(&lock_, NULL);
+    if (fd_ < 0) {
+      [self release];
+      return nil;
+    }
+    CFDictionaryValueCallBacks formatCallBacks = {
+      0, NULL, GMLogBinaryFormatFree, NULL, NULL
+    };
+    formats_ = CFDictionaryCreateMutable(kCFAllocatorDefault, 0,
+                                         &kCFTypeDictionaryKeyCallBacks,
+                                         &formatCallBacks);
+    CFDictionaryKeyCallBacks funcCallBacks = {
+      0, GMLogBinaryCStringRetain, GMLogBinaryCStringRelease, NULL,
+      GMLogBinaryCStringEqual, GMLogBinaryCStringHash
+    };
+    funcs_ = CFDictionaryCreateMutable(kCFAllocatorDefault, 0,
+                                       &funcCallBacks, NULL);
+    bufferLimit_ = 16 * 1024;
+    flushLevel_ = kGMLoggerLevelError;
+
+    NSProcessInfo *pinfo = [NSProcessInfo processInfo];
+    size_t start = [self beginRecord:kGMLogBinarySessionRecord];
+    [self appendBytes:kGMLogBinaryMagic length:4];
+    [self appendUInt32:kGMLogBinaryVersion];
+    [self appendUInt32:[pinfo processIdentifier]];
+    [self appendUInt64:GMLogBinaryNow()];
+    const char *name = GMLogBinaryUTF8([pinfo processName]);
+    [self appendBytes:name length:strlen(name)];
+    [self endRecord:start];
+    [self writeBuffer];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [self flush];
+  if (fd_ >= 0)
+    close(fd_);
+  if (formats_)
+    CFRelease(formats_);
+  if (funcs_)
+    CFRelease(funcs_);
+  free(buffer_);
+  pthread_mutex_destroy(&lock_);
+  [super dealloc];
+}
+
+- (void)setBufferLimit:(size_t)bytes {
+  pthread_mutex_lock(&lock_);
+  bufferLimit_ = bytes;
+  pthread_mutex_unlock(&lock_);
+  [self flush];
+}
+
+- (void)setFlushLevel:(GMLoggerLevel)level {
+  pthread_mutex_lock(&lock_);
+  flushLevel_ = level;
+  pthread_mutex_unlock(&lock_);
+}
+
+- (void)flush {
+  pthread_mutex_lock(&lock_);
+  [self writeBuffer];
+  pthread_mutex_unlock(&lock_);
+}
+
+- (void)logMessage:(NSString *)msg level:(GMLoggerLevel)level {
+  [self writeText:msg func:NULL level:level];
+}
+
+- (void)logFunc:(const char *)func
+         format:(NSString *)fmt
+         valist:(va_list)args
+          level:(GMLoggerLevel)level {
+  int64_t now = GMLogBinaryNow();
+  pthread_mutex_lock(&lock_);
+  uint32_t funcId = func ? [self idForFunc:func] : 0;
+  GMLogBinaryFormat *format = [self formatFor:fmt];
+  pthread_mutex_unlock(&lock_);
+
+  if (format == NULL || format->asText) {
+    CFStringRef cfmsg = NULL;
+    if (fmt)
+      cfmsg = CFStringCreateWithFormatAndArguments(kCFAllocatorDefault, NULL,
+                                                   (CFStringRef)fmt, args);
+    [self writeText:(NSString *)cfmsg func:func level:level];
+    if (cfmsg)
+      CFRelease(cfmsg);
+    return;
+  }
+
+  // Take the arguments before locking: asking an object for its description
+  // may well log something itself.
+  GMLogBinaryValue values[kGMLogBinaryMaxArgs * 3];
+  int count = 0;
+  for (int i = 0; i < format->count; i++) {
+    const GMLogSpec *spec = &format->specs[i];
+    int precision = spec->precision;
+    for (int star = 0; star < spec->stars; star++) {
+      int v = va_arg(args, int);
+      values[count].tag = kGMLogBinaryIntArg;
+      values[count++].value.i = v;
+      // A negative precision counts as none.
+      if (spec->starPrecision && star == spec->stars - 1)
+        precision = (v >= 0) ? v : -1;
+    }
+    GMLogBinaryValue *value = &values[count];
+    value->tag = kGMLogBinaryIntArg;
+    switch (spec->kind) {
+      case kGMLogSpecInt: {
+        int v = va_arg(args, int);
+        if (spec->size == 'H')
+          v = spec->isSigned ? (int)(signed char)v : (int)(unsigned char)v;
+        else if (spec->size == 'h')
+          v = spec->isSigned ? (int)(short)v : (int)(unsigned short)v;
+        value->value.i = spec->isSigned ? (int64_t)v : (int64_t)(unsigned)v;
+        break;
+      }
+      case kGMLogSpecLong: {
+        long v = va_arg(args, long);
+        value->value.i = spec->isSigned ? (int64_t)v
+                                        : (int64_t)(unsigned long)v;
+        break;
+      }
+      case kGMLogSpecLongLong:
+        value->value.i = va_arg(args, long long);
+        break;
+      case kGMLogSpecDouble:
+        value->tag = kGMLogBinaryDoubleArg;
+        value->value.d = va_arg(args, double);
+        break;
+      case kGMLogSpecLongDouble:
+        value->tag = kGMLogBinaryDoubleArg;
+        value->value.d = (double)va_arg(args, long double);
+        break;
+      case kGMLogSpecCString: {
+        // With a precision, %s reads no further than that, and the
+        // string needn't be terminated any sooner.
+        const char *s = va_arg(args, const char *);
+        value->tag = kGMLogBinaryStringArg;
+        value->string = s ? s : "(null)";
+        if (precision >= 0)
+          value->length = GMLogBinaryStrnlen(value->string, precision);
+        else
+          value->length = strlen(value->string);
+        break;
+      }
+      case kGMLogSpecObject: {
+        id object = va_arg(args, id);
+        value->tag = kGMLogBinaryStringArg;
+        value->string = GMLogBinaryUTF8(object ? [object description] : nil);
+        value->length = strlen(value->string);
+        break;
+      }
+      case kGMLogSpecUnichar: {
+        unichar c = (unichar)va_arg(args, int);
+        value->tag = kGMLogBinaryStringArg;
+        value->string =
+          GMLogBinaryUTF8([NSString stringWithCharacters:&c length:1]);
+        value->length = strlen(value->string);
+        break;
+      }
+      case kGMLogSpecUnicharString: {
+        const unichar *chars = va_arg(args, const unichar *);
+        NSString *string = nil;
+        if (chars) {
+          // Like %s, no further than the precision.
+          NSUInteger length = 0;
+          while ((precision < 0 || length < (NSUInteger)precision) &&
+                 chars[length])
+            length++;
+          string = [NSString stringWithCharacters:chars length:length];
+        }
+        value->tag = kGMLogBinaryStringArg;
+        value->string = GMLogBinaryUTF8(string);
+        value->length = strlen(value->string);
+        break;
+      }
+      case kGMLogSpecPointer:
+        value->tag = kGMLogBinaryPointerArg;
+        value->value.p = (uint64_t)(uintptr_t)va_arg(args, void *);
+        break;
+      case kGMLogSpecCount:
+        (void)va_arg(args, void *);
+        continue;  // nothing to record
+      default:
+        continue;
+    }
+    count++;
+  }
+
+  pthread_mutex_lock(&lock_);
+  size_t start = [self beginRecord:kGMLogBinaryMessageRecord];
+  [self appendPrefixWithTime:now level:level funcId:funcId];
+  [self appendUInt32:format->formatId];
+  for (int i = 0; i < count; i++) {
+    GMLogBinaryValue *value = &values[i];
+    [self appendUInt8:value->tag];
+    if (value->tag == kGMLogBinaryStringArg) {
+      [self appendUInt32:value->length];
+      [self appendBytes:value->string length:value->length];
+    } else {
+      // The union's 64 bits, whichever member was set.
+      [self appendUInt64:value->value.p];
+    }
+  }
+  [self endRecord:start];
+  [self finishMessageAtLevel:level];
+  pthread_mutex_unlock(&lock_);
+}
+
+@end  // GMLogBinaryWriter
+
+
+@implementation GMLogBinaryWriter (PrivateMethods)
+
+// The append and record methods are called with |lock_| held.
+
+- (void)appendBytes:(const void *)bytes length:(size_t)length {
+  if (bufferLength_ + length > bufferCapacity_) {
+    size_t capacity = bufferCapacity_ ? bufferCapacity_ : 4096;
+    while (capacity < bufferLength_ + length)
+      capacity *= 2;
+    char *buffer = realloc(buffer_, capacity);
+    if (buffer == NULL)
+      return;
+    buffer_ = buffer;
+    bufferCapacity_ = capacity;
+  }
+  memcpy(buffer_ + bufferLength_, bytes, length);
+  bufferLength_ += length;
+}
+
+- (void)appendUInt8:(uint8_t)value {
+  [self appendBytes:&value length:1];
+}
+
+- (void)appendUInt32:(uint32_t)value {
+  uint8_t bytes[4];
+  for (int i = 0; i < 4; i++)
+    bytes[i] = (uint8_t)(value >> (8 * i));
+  [self appendBytes:bytes length:4];
+}
+
+- (void)appendUInt64:(uint64_t)value {
+  uint8_t bytes[8];
+  for (int i = 0; i < 8; i++)
+    bytes[i] = (uint8_t)(value >> (8 * i));
+  [self appendBytes:bytes length:8];
+}
+
+// Starts a record of |type|, returning where its length goes.
+- (size_t)beginRecord:(uint8_t)type {
+  [self appendUInt8:type];
+  size_t start = bufferLength_;
+  [self appendUInt32:0];
+  return start;
+}
+
+- (void)endRecord:(size_t)start {
+  if (start + 4 > bufferLength_)
+    return;  // out of memory part way through
+  uint32_t length = (uint32_t)(bufferLength_ - start - 4);
+  for (int i = 0; i < 4; i++)
+    buffer_[start + i] = (char)(length >> (8 * i));
+}
+
+- (void)appendPrefixWithTime:(int64_t)now
+                       level:(GMLoggerLevel)level
+                      funcId:(uint32_t)funcId {
+  [self appendUInt64:now];
+  [self appendUInt64:(uint64_t)(uintptr_t)pthread_self()];
+  [self appendUInt8:level];
+  [self appendUInt32:funcId];
+}
+
+- (uint32_t)idForFunc:(const char *)func {
+  uint32_t funcId = (uint32_t)(uintptr_t)CFDictionaryGetValue(funcs_, func);
+  if (funcId == 0) {
+    funcId = ++lastFuncId_;
+    CFDictionarySetValue(funcs_, func, (const void *)(uintptr_t)funcId);
+    size_t start = [self beginRecord:kGMLogBinaryFuncRecord];
+    [self appendUInt32:funcId];
+    [self appendBytes:func length:strlen(func)];
+    [self endRecord:start];
+  }
+  return funcId;
+}
+
+- (GMLogBinaryFormat *)formatFor:(NSString *)fmt {
+  if (fmt == nil)
+    return NULL;
+  GMLogBinaryFormat *format =
+    (GMLogBinaryFormat *)CFDictionaryGetValue(formats_, fmt);
+  if (format == NULL) {
+    const char *utf8 = GMLogBinaryUTF8(fmt);
+    format = GMLogBinaryFormatCreate(utf8, ++lastFormatId_);
+    // Copied, so a mutable format changing later can't confuse the table.
+    NSString *key = [fmt copy];
+    CFDictionarySetValue(formats_, key, format);
+    [key release];
+    if (!format->asText) {
+      size_t start = [self beginRecord:kGMLogBinaryFormatRecord];
+      [self appendUInt32:format->formatId];
+      [self appendBytes:utf8 length:strlen(utf8)];
+      [self endRecord:start];
+    }
+  }
+  return format;
+}
+
+- (void)writeText:(NSString *)msg func:(const char *)func
+            level:(GMLoggerLevel)level {
+  int64_t now = GMLogBinaryNow();
+  const char *utf8 = msg ? GMLogBinaryUTF8(msg) : "";
+  pthread_mutex_lock(&lock_);
+  uint32_t funcId = func ? [self idForFunc:func] : 0;
+  size_t start = [self beginRecord:kGMLogBinaryTextRecord];
+  [self appendPrefixWithTime:now level:level funcId:funcId];
+  [self appendBytes:utf8 length:strlen(utf8)];
+  [self endRecord:start];
+  [self finishMessageAtLevel:level];
+  pthread_mutex_unlock(&lock_);
+}
+
+- (void)finishMessageAtLevel:(GMLoggerLevel)level {
+  if (bufferLength_ >= bufferLimit_ || level >= flushLevel_)
+    [self writeBuffer];
+}
+
+- (void)writeBuffer {
+  size_t written = 0;
+  while (written < bufferLength_) {
+    ssize_t count = write(fd_, buffer_ + written, bufferLength_ - written);
+    if (count < 0 && errno == EINTR)
+      continue;
+    if (count <= 0)
+      break;  // nowhere to report it; drop the rest
+    written += count;
+  }
+  bufferLength_ = 0;
+}
+
+@end  // PrivateMethods
@@ -0,0 +1,275 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import <SenTestingKit/SenTestingKit.h>
+#import <Cocoa/Cocoa.h>
+#import "GMLogBinaryReader.h"
+#import "GMLogBinaryWriter.h"
+#import "GMLogBinaryWriterTest.h"
+
+@implementation GMLogBinaryWriterTest
+
+- (void)setUp {
+  path_ = [[NSTemporaryDirectory() stringByAppendingPathComponent:
+            [NSString stringWithFormat:@"GMLogBinaryWriterTest-%d.gmlog",
+             getpid()]] retain];
+  [[NSFileManager defaultManager] removeFileAtPath:path_ handler:nil];
+}
+
+- (void)tearDown {
+  [[NSFileManager defaultManager] removeFileAtPath:path_ handler:nil];
+  [path_ release];
+}
+
+- (GMLogger *)loggerWithWriter:(id<GMLogWriter>)writer {
+  return [GMLogger loggerWithWriter:writer
+                          formatter:nil
+                             filter:[[[GMLogNoFilter alloc] init] autorelease]];
+}
+
+// The messages read back from |path_|.
+- (NSArray *)messages {
+  GMLogBinaryReader *reader = [GMLogBinaryReader readerWithContentsOfFile:path_];
+  STAssertNotNil(reader, nil);
+  NSMutableArray *messages = [NSMutableArray array];
+  NSDictionary *message = nil;
+  while ((message = [reader nextMessage]))
+    [messages addObject:message];
+  STAssertNil([reader error], [reader error]);
+  return messages;
+}
+
+// Number of records of |type| in |path_|.
+- (int)countRecords:(uint8_t)type {
+  NSData *data = [NSData dataWithContentsOfFile:path_];
+  const uint8_t *p = [data bytes];
+  const uint8_t *end = p + [data length];
+  int count = 0;
+  while (end - p >= 5) {
+    uint32_t length = p[1] | (p[2] << 8) | (p[3] << 16) | (p[4] << 24);
+    if (p[0] == type)
+      count++;
+    p += 5 + length;
+  }
+  STAssertEquals(p, end, nil);
+  return count;
+}
+
+// Logs |fmt| through the binary writer and a GMLogBasicFormatter and
+// checks they come out the same.
+- (void)check:(NSString *)fmt, ... {
+  va_list args;
+  va_start(args, fmt);
+  GMLogBasicFormatter *basic = [[[GMLogBasicFormatter alloc] init] autorelease];
+  NSString *expected = [basic stringForFunc:nil
+                                 withFormat:fmt
+                                     valist:args
+                                      level:kGMLoggerLevelInfo];
+  va_end(args);
+
+  [[NSFileManager defaultManager] removeFileAtPath:path_ handler:nil];
+  GMLogBinaryWriter *writer = [GMLogBinaryWriter writerWithPath:path_];
+  va_start(args, fmt);
+  [writer logFunc:"-[GMLogBinaryWriterTest check:]"
+           format:fmt
+           valist:args
+            level:kGMLoggerLevelInfo];
+  va_end(args);
+  [writer flush];
+
+  NSArray *messages = [self messages];
+  STAssertEquals([messages count], (unsigned)1, fmt);
+  STAssertEqualObjects([[messages lastObject]
+                         objectForKey:kGMLogBinaryMessageKey], expected, fmt);
+}
+
+- (void)testRoundTrip {
+  [self check:@"plain"];
+  [self check:@"100%% sure"];
+  [self check:@"%d %i %u %x %X %o", -1, 42, 3000000000U, 255, 255, 8];
+  [self check:@"%ld %lu %lld %llu %qd", -1L, 2UL, -3LL, 4ULL, 5LL];
+  [self check:@"%zu %hd %hhd %hu", (size_t)7, (short)-8, (char)-9, 65535];
+  [self check:@"%5d|%-5d|%05d|%+d|% d", 1, 2, 3, 4, 5];
+  [self check:@"%*d|%-*d|%.*f", 6, 1, 6, 2, 3, 3.14159];
+  [self check:@"%f %.2f %e %g %10.3f", 1.5, 2.25, 1e10, 0.0001, -3.0];
+  [self check:@"%c%c%c", 'a', 'b', 'c'];
+  [self check:@"%s %s %.3s %10s", "c string", NULL, "truncated", "right"];
+  [self check:@"%@ %@ %@", @"string", [NSNumber numberWithInt:12], nil];
+  [self check:@"%@", [NSArray arrayWithObjects:@"a", @"b", nil]];
+  NSString *snowman = [NSString stringWithUTF8String:"\xe2\x98\x83"];
+  [self check:@"%@ %@", snowman, @"plain"];
+  unichar chars[] = { 'u', 'n', 'i', 0 };
+  [self check:@"%C %S", (unichar)0x2603, chars];
+  [self check:@"%p", (void *)0x1234];
+  [self check:@"%d%%%@%%%s", 1, @"two", "three"];
+}
+
+- (void)testStringPrecision {
+  // Only as much of a string as its precision allows is read and
+  // written, so it needn't be terminated there.
+  char *buffer = malloc(4096);
+  memset(buffer, 'x', 4095);
+  buffer[4095] = '\0';
+  [self check:@"%.*s|%.3s|%.0s|%5.2s", 2, buffer, buffer, buffer, buffer];
+  STAssertTrue([[NSData dataWithContentsOfFile:path_] length] < 1024, nil);
+  // A negative precision from a '*' is no precision.
+  [self check:@"%.*s|%*.*s", -1, "all", 4, 2, "part"];
+  unichar chars[] = { 'u', 'n', 'i', 0 };
+  [self check:@"%.2S", chars];
+  free(buffer);
+}
+
+- (void)testFormatsInternedOnce {
+  GMLogBinaryWriter *writer = [GMLogBinaryWriter writerWithPath:path_];
+  GMLogger *logger = [self loggerWithWriter:writer];
+  for (int i = 0; i < 100; i++) {
+    [logger logFuncDebug:"-[Foo one]" msg:@"first %d", i];
+    [logger logFuncInfo:"-[Foo two]" msg:@"second %@", @"x"];
+  }
+  [logger logDebug:@"no func"];
+  [writer flush];
+
+  STAssertEquals([self countRecords:kGMLogBinarySessionRecord], 1, nil);
+  STAssertEquals([self countRecords:kGMLogBinaryFormatRecord], 3, nil);
+  STAssertEquals([self countRecords:kGMLogBinaryFuncRecord], 2, nil);
+  STAssertEquals([self countRecords:kGMLogBinaryMessageRecord], 201, nil);
+
+  NSArray *messages = [self messages];
+  STAssertEquals([messages count], (unsigned)201, nil);
+  NSDictionary *message = [messages objectAtIndex:198];
+  STAssertEqualObjects([message objectForKey:kGMLogBinaryMessageKey],
+                       @"first 99", nil);
+  STAssertEqualObjects([message objectForKey:kGMLogBinaryFuncKey],
+                       @"-[Foo one]", nil);
+  STAssertEquals([[message objectForKey:kGMLogBinaryLevelKey] intValue],
+                 (int)kGMLoggerLevelDebug, nil);
+  STAssertEquals([[message objectForKey:kGMLogBinaryPidKey] intValue],
+                 [[NSProcessInfo processInfo] processIdentifier], nil);
+  STAssertEqualObjects([message objectForKey:kGMLogBinaryProcessKey],
+                       [[NSProcessInfo processInfo] processName], nil);
+  STAssertTrue(fabs([[message objectForKey:kGMLogBinaryTimeKey]
+                      timeIntervalSinceNow]) < 5, nil);
+  message = [messages lastObject];
+  STAssertNil([message objectForKey:kGMLogBinaryFuncKey], nil);
+  STAssertEqualObjects([message objectForKey:kGMLogBinaryMessageKey],
+                       @"no func", nil);
+
+  // A mutable format's contents count, not its address.
+  NSMutableString *fmt = [NSMutableString stringWithString:@"mutable %d"];
+  [logger logInfo:fmt, 1];
+  [fmt setString:@"changed %d"];
+  [logger logInfo:fmt, 2];
+  [writer flush];
+  STAssertEquals([self countRecords:kGMLogBinaryFormatRecord], 5, nil);
+  STAssertEqualObjects([[[self messages] lastObject]
+                         objectForKey:kGMLogBinaryMessageKey],
+                       @"changed 2", nil);
+}
+
+- (void)testTextFallback {
+  GMLogBinaryWriter *writer = [GMLogBinaryWriter writerWithPath:path_];
+  GMLogger *logger = [self loggerWithWriter:writer];
+  [logger logInfo:@"%2$@ %1$@", @"world", @"hello"];
+  // Plain messages, e.g. from an NSArray of writers.
+  [writer logMessage:@"as is" level:kGMLoggerLevelError];
+  [writer flush];
+
+  STAssertEquals([self countRecords:kGMLogBinaryFormatRecord], 0, nil);
+  STAssertEquals([self countRecords:kGMLogBinaryTextRecord], 2, nil);
+  NSArray *messages = [self messages];
+  STAssertEquals([messages count], (unsigned)2, nil);
+  STAssertEqualObjects([[messages objectAtIndex:0]
+                         objectForKey:kGMLogBinaryMessageKey],
+                       @"hello world", nil);
+  STAssertEqualObjects([[messages objectAtIndex:1]
+                         objectForKey:kGMLogBinaryMessageKey],
+                       @"as is", nil);
+}
+
+- (void)testBuffering {
+  GMLogBinaryWriter *writer = [GMLogBinaryWriter writerWithPath:path_];
+  GMLogger *logger = [self loggerWithWriter:writer];
+  unsigned long long sessionSize =
+    [[[NSFileManager defaultManager] fileAttributesAtPath:path_
+                                             traverseLink:NO] fileSize];
+  STAssertTrue(sessionSize > 0, nil);
+
+  // Held back until the buffer fills or something important comes along.
+  [logger logInfo:@"held"];
+  STAssertEquals([[self messages] count], (unsigned)0, nil);
+  [logger logError:@"error"];
+  STAssertEquals([[self messages] count], (unsigned)2, nil);
+
+  [writer setBufferLimit:0];
+  [logger logDebug:@"straight out"];
+  STAssertEquals([[self messages] count], (unsigned)3, nil);
+
+  [writer setBufferLimit:16 * 1024];
+  [writer setFlushLevel:kGMLoggerLevelAssert];
+  [logger logError:@"held too"];
+  STAssertEquals([[self messages] count], (unsigned)3, nil);
+  [writer flush];
+  STAssertEquals([[self messages] count], (unsigned)4, nil);
+
+  STAssertNil([GMLogBinaryWriter writerWithPath:@"/no/such/dir/x.gmlog"], nil);
+}
+
+// Cost per message of the binary writer against the standard formatter
+// writing text to a file, for a typical debug message.
+- (void)testBenchmark {
+  static const int kMessages = 20000;
+  NSString *textPath = [path_ stringByAppendingPathExtension:@"txt"];
+  NSFileHandle *handle = [NSFileHandle fileHandleForLoggingAtPath:textPath
+                                                             mode:0644];
+  GMLogger *text =
+    [GMLogger loggerWithWriter:handle
+                     formatter:[[[GMLogStandardFormatter alloc] init]
+                                 autorelease]
+                        filter:[[[GMLogNoFilter alloc] init] autorelease]];
+  GMLogBinaryWriter *writer = [GMLogBinaryWriter writerWithPath:path_];
+  GMLogger *binary = [self loggerWithWriter:writer];
+
+  NSTimeInterval times[2];
+  GMLogger *loggers[2] = { text, binary };
+  for (int l = 0; l < 2; l++) {
+    NSDate *start = [NSDate date];
+    for (int i = 0; i < kMessages; i++) {
+      NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+      [loggers[l] logFuncDebug:"-[MBEngineTask readOutput:]"
+                           msg:@"read %d bytes from pid %d (%@)", i * 7, 42,
+                               @"dev_appserver.py"];
+      [pool release];
+    }
+    times[l] = -[start timeIntervalSinceNow];
+  }
+  [writer flush];
+
+  unsigned long long textSize =
+    [[[NSFileManager defaultManager] fileAttributesAtPath:textPath
+                                             traverseLink:NO] fileSize];
+  unsigned long long binarySize =
+    [[[NSFileManager defaultManager] fileAttributesAtPath:path_
+                                             traverseLink:NO] fileSize];
+  [[NSFileManager defaultManager] removeFileAtPath:textPath handler:nil];
+  NSLog(@"GMLogBinaryWriter: %.2fus per message as text (%llu bytes), "
+        "%.2fus binary (%llu bytes)",
+        times[0] * 1e6 / kMessages, textSize,
+        times[1] * 1e6 / kMessages, binarySize);
+  STAssertEquals([[self messages] count], (unsigned)kMessages, nil);
+  STAssertTrue(times[1] < times[0], nil);
+  STAssertTrue(binarySize < textSize, nil);
+}
+
+@end
@@ -0,0 +1,89 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// GMLogLevelControl
+//
+// Decides the minimum level logged, per function, for GMLogLevelFilter.
+// Levels can be given for a whole module (an Objective-C class, or a C
+// function) or for names starting with a prefix, so they form a hierarchy:
+//
+//   "*"                              everything not matched below
+//   "MB"                             classes (and functions) starting MB
+//   "MBTaskArrayController"          that class
+//   "-[MBTaskArrayController run:]"  just that method
+//
+// An exact function name wins, then the longest prefix of the module name,
+// then "*". Levels are "debug", "info", "error", "assert", or a number.
+//
+// The levels come from, in increasing order of precedence:
+//
+//   - the build: everything in DEBUG builds, errors and up otherwise, or
+//     info and up if GMVerboseLogging is set in the defaults or (taking
+//     precedence) the environment, as GMLogLevelFilter always did;
+//   - the GMLogLevels default, a dictionary of name -> level;
+//   - the GMLogLevels environment variable, e.g. "MBTask=debug,*=info";
+//   - -setMinimumLevel:forName:.
+//
+// Those sources are only read when something changes: when the control is
+// created, when the user defaults change (NSUserDefaultsDidChangeNotification)
+// and on -reload. The answers are then cached. The GMLogger*() macros keep a
+// one-word cache per call site, checked before the message is formatted, so
+// a disabled log statement costs a load and a compare. Any change bumps
+// GMLoggerLevelGeneration, invalidating every call site's cache at once.
+//
+// -toggleVerboseOnSignal: installs a signal handler that switches debug
+// logging for everything on and off, e.g. "kill -USR1 <pid>".
+
+#import <Foundation/Foundation.h>
+#import <pthread.h>
+#import "GMLogger.h"
+
+@interface GMLogLevelControl : NSObject {
+ @private
+  pthread_mutex_t lock_;
+  NSMutableDictionary *overrides_;  // set in code; name -> NSNumber
+  // Computed from all the sources by -reload.
+  NSDictionary *rules_;             // name -> NSNumber, without "*"
+  volatile int32_t defaultLevel_;
+  volatile int32_t hasRules_;
+  CFMutableDictionaryRef cache_;    // C string function name -> level
+}
+
+// The control GMLogLevelFilter uses. Created on first use; it follows the
+// user defaults from then on.
++ (GMLogLevelControl *)sharedControl;
+
+// The lowest level logged from |func| (a __func__ string, or NULL).
+- (GMLoggerLevel)minimumLevelForFunc:(const char *)func;
+
+// Sets the level for |name| (see above), overriding the defaults and
+// environment. A nil |name| is the same as "*".
+- (void)setMinimumLevel:(GMLoggerLevel)level forName:(NSString *)name;
+
+// Forgets a level set with -setMinimumLevel:forName:.
+- (void)removeMinimumLevelForName:(NSString *)name;
+
+// Re-reads the environment and the user defaults.
+- (void)reload;
+
+// Each |signum| (e.g. SIGUSR1) toggles logging everything, regardless of
+// the levels above. The handler only touches two integers, so it is safe
+// whatever the process is doing.
+- (void)toggleVerboseOnSignal:(int)signum;
+
+// Parses a level name or number. Returns -1 if |name| isn't one.
++ (int)levelNamed:(NSString *)name;
+
+@end
@@ -0,0 +1,291 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import "GMLogLevelControl.h"
+#import <libkern/OSAtomic.h>
+#import <signal.h>
+#import <stdlib.h>
+#import <string.h>
+
+static NSString *const kGMLogLevelsKey = @"GMLogLevels";
+static NSString *const kGMVerboseLoggingKey = @"GMVerboseLogging";
+static NSString *const kGMDefaultLevelName = @"*";
+
+// Set (to 1) by the signal handler to log everything.
+static volatile uint32_t gVerboseToggle = 0;
+
+static void GMLogLevelToggleVerbose(int signum) {
+  OSAtomicXor32Barrier(1, &gVerboseToggle);
+  OSAtomicIncrement32Barrier(&GMLoggerLevelGeneration);
+}
+
+// Check the environment and the user preferences for the GMVerboseLogging key
+// to see if verbose logging has been enabled. The environment variable will
+// override the defaults setting, so check the environment first.
+static BOOL IsVerboseLoggingEnabled(void) {
+  const char *env = getenv([kGMVerboseLoggingKey UTF8String]);
+  if (env && env[0]) {
+    return (strtol(env, NULL, 10) != 0);
+  }
+
+  return [[NSUserDefaults standardUserDefaults] boolForKey:kGMVerboseLoggingKey];
+}
+
+// C string keys for |cache_|, copied on insertion.
+static const void *GMLogLevelCStringRetain(CFAllocatorRef allocator,
+                                           const void *value) {
+  return strdup(value);
+}
+
+static void GMLogLevelCStringRelease(CFAllocatorRef allocator,
+                                     const void *value) {
+  free((void *)value);
+}
+
+static Boolean GMLogLevelCStringEqual(const void *a, const void *b) {
+  return strcmp(a, b) == 0;
+}
+
+static CFHashCode GMLogLevelCStringHash(const void *value) {
+  // FNV-1a.
+  CFHashCode hash = 2166136261U;
+  for (const unsigned char *p = value; *p; p++)
+    hash = (hash ^ *p) * 16777619U;
+  return hash;
+}
+
+@interface GMLogLevelControl (PrivateMethods)
+- (GMLoggerLevel)computeLevelForFunc:(const char *)func;
+- (void)defaultsChanged:(NSNotification *)notification;
+@end
+
+static GMLogLevelControl *gSharedControl = nil;
+
+@implementation GMLogLevelControl
+
++ (GMLogLevelControl *)sharedControl {
+  @synchronized(self) {
+    if (gSharedControl == nil) {
+      gSharedControl = [[self alloc] init];
+      [[NSNotificationCenter defaultCenter]
+        addObserver:gSharedControl
+           selector:@selector(defaultsChanged:)
+               name:NSUserDefaultsDidChangeNotification
+             object:nil];
+    }
+  }
+  return gSharedControl;
+}
+
++ (int)levelNamed:(NSString *)name {
+  static NSString *const kNames[] = { @"debug", @"info", @"error", @"assert" };
+  static const GMLoggerLevel kLevels[] = {
+    kGMLoggerLevelDebug, kGMLoggerLevelInfo,
+    kGMLoggerLevelError, kGMLoggerLevelAssert
+  };
+  name = [name stringByTrimmingCharactersInSet:
+                 [NSCharacterSet whitespaceCharacterSet]];
+  for (size_t i = 0; i < sizeof(kNames) / sizeof(kNames[0]); i++) {
+    if ([name caseInsensitiveCompare:kNames[i]] == NSOrderedSame)
+      return kLevels[i];
+  }
+  NSScanner *scanner = [NSScanner scannerWithString:name];
+  int level = -1;
+  if ([scanner scanInt:&level] && [scanner isAtEnd] && level >= 0)
+    return level;
+  return -1;
+}
+
+- (id)init {
+  if ((self = [super init])) {
+    pthread_mutex_init(&lock_, NULL);
+    overrides_ = [[NSMutableDictionary alloc] init];
+    CFDictionaryKeyCallBacks keyCallBacks = {
+      0, GMLogLevelCStringRetain, GMLogLevelCStringRelease, NULL,
+      GMLogLevelCStringEqual, GMLogLevelCStringHash
+    };
+    cache_ = CFDictionaryCreateMutable(kCFAllocatorDefault, 0,
+                                       &keyCallBacks, NULL);
+    [self reload];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [[NSNotificationCenter defaultCenter] removeObserver:self];
+  [overrides_ release];
+  [rules_ release];
+  if (cache_)
+    CFRelease(cache_);
+  pthread_mutex_destroy(&lock_);
+  [super dealloc];
+}
+
+- (GMLoggerLevel)minimumLevelForFunc:(const char *)func {
+  if (gVerboseToggle)
+    return kGMLoggerLevelUnknown;
+  if (!hasRules_ || func == NULL)
+    return defaultLevel_;
+
+  pthread_mutex_lock(&lock_);
+  // Stored as level + 1, so a missing entry (NULL) is distinguishable.
+  uintptr_t cached = (uintptr_t)CFDictionaryGetValue(cache_, func);
+  GMLoggerLevel level;
+  if (cached) {
+    level = (GMLoggerLevel)(cached - 1);
+  } else {
+    level = [self computeLevelForFunc:func];
+    CFDictionarySetValue(cache_, func, (const void *)(uintptr_t)(level + 1));
+  }
+  pthread_mutex_unlock(&lock_);
+  return level;
+}
+
+- (void)setMinimumLevel:(GMLoggerLevel)level forName:(NSString *)name {
+  pthread_mutex_lock(&lock_);
+  [overrides_ setObject:[NSNumber numberWithInt:level]
+                 forKey:(name ? name : kGMDefaultLevelName)];
+  pthread_mutex_unlock(&lock_);
+  [self reload];
+}
+
+- (void)removeMinimumLevelForName:(NSString *)name {
+  pthread_mutex_lock(&lock_);
+  [overrides_ removeObjectForKey:(name ? name : kGMDefaultLevelName)];
+  pthread_mutex_unlock(&lock_);
+  [self reload];
+}
+
+- (void)reload {
+  // In DEBUG builds, log everything. If we're not in a debug build we'll
+  // assume that we're in a Release build.
+#if DEBUG
+  int defaultLevel = kGMLoggerLevelUnknown;
+#else
+  int defaultLevel = IsVerboseLoggingEnabled() ? kGMLoggerLevelInfo
+                                               : kGMLoggerLevelError;
+#endif
+  NSMutableDictionary *rules = [NSMutableDictionary dictionary];
+
+  id levels = [[NSUserDefaults standardUserDefaults]
+                objectForKey:kGMLogLevelsKey];
+  if ([levels isKindOfClass:[NSDictionary class]]) {
+    NSEnumerator *nameEnumerator = [levels keyEnumerator];
+    NSString *name = nil;
+    while ((name = [nameEnumerator nextObject])) {
+      id value = [levels objectForKey:name];
+      int level = -1;
+      if ([value isKindOfClass:[NSString class]])
+        level = [[self class] levelNamed:value];
+      else if ([value isKindOfClass:[NSNumber class]])
+        level = [value intValue];
+      if (level >= 0 && [name isKindOfClass:[NSString class]])
+        [rules setObject:[NSNumber numberWithInt:level] forKey:name];
+    }
+  }
+
+  const char *env = getenv([kGMLogLevelsKey UTF8String]);
+  if (env && env[0]) {
+    NSArray *pairs = [[NSString stringWithUTF8String:env]
+                       componentsSeparatedByString:@","];
+    NSEnumerator *pairEnumerator = [pairs objectEnumerator];
+    NSString *pair = nil;
+    while ((pair = [pairEnumerator nextObject])) {
+      NSRange equals = [pair rangeOfString:@"=" options:NSBackwardsSearch];
+      if (equals.location == NSNotFound)
+        continue;
+      NSString *name = [[pair substringToIndex:equals.location]
+                         stringByTrimmingCharactersInSet:
+                           [NSCharacterSet whitespaceCharacterSet]];
+      int level = [[self class] levelNamed:
+                     [pair substringFromIndex:NSMaxRange(equals)]];
+      if (level >= 0 && [name length])
+        [rules setObject:[NSNumber numberWithInt:level] forKey:name];
+    }
+  }
+
+  pthread_mutex_lock(&lock_);
+  [rules addEntriesFromDictionary:overrides_];
+  NSNumber *star = [rules objectForKey:kGMDefaultLevelName];
+  if (star) {
+    defaultLevel = [star intValue];
+    [rules removeObjectForKey:kGMDefaultLevelName];
+  }
+  BOOL changed = (defaultLevel != defaultLevel_ ||
+                  ![rules isEqualToDictionary:rules_]);
+  if (changed) {
+    [rules_ release];
+    rules_ = [rules copy];
+    CFDictionaryRemoveAllValues(cache_);
+    hasRules_ = ([rules_ count] > 0);
+    defaultLevel_ = defaultLevel;
+    OSMemoryBarrier();
+  }
+  pthread_mutex_unlock(&lock_);
+  if (changed)
+    GMLoggerInvalidateLevels();
+}
+
+- (void)toggleVerboseOnSignal:(int)signum {
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = GMLogLevelToggleVerbose;
+  sa.sa_flags = SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  sigaction(signum, &sa, NULL);
+}
+
+@end  // GMLogLevelControl
+
+
+@implementation GMLogLevelControl (PrivateMethods)
+
+// With |lock_| held: an exact match for |func|, else the longest name
+// which is a prefix of its module, else the default.
+- (GMLoggerLevel)computeLevelForFunc:(const char *)func {
+  NSString *name = [NSString stringWithUTF8String:func];
+  if (name == nil)
+    return defaultLevel_;
+  NSNumber *exact = [rules_ objectForKey:name];
+  if (exact)
+    return [exact intValue];
+
+  // "-[MBFoo(Private) bar:]" -> "MBFoo"; C functions are their own module.
+  NSString *module = name;
+  if ([name hasPrefix:@"-["] || [name hasPrefix:@"+["]) {
+    NSRange end = [name rangeOfCharacterFromSet:
+                   [NSCharacterSet characterSetWithCharactersInString:@" ("]];
+    if (end.location != NSNotFound)
+      module = [name substringWithRange:NSMakeRange(2, end.location - 2)];
+  }
+
+  NSNumber *best = nil;
+  unsigned bestLength = 0;
+  NSEnumerator *ruleEnumerator = [rules_ keyEnumerator];
+  NSString *rule = nil;
+  while ((rule = [ruleEnumerator nextObject])) {
+    if ([rule length] > bestLength && [module hasPrefix:rule]) {
+      best = [rules_ objectForKey:rule];
+      bestLength = [rule length];
+    }
+  }
+  return best ? [best intValue] : defaultLevel_;
+}
+
+- (void)defaultsChanged:(NSNotification *)notification {
+  [self reload];
+}
+
+@end  // PrivateMethods
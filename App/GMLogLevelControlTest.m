@@ -0,0 +1,320 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import <SenTestingKit/SenTestingKit.h>
+#import <Cocoa/Cocoa.h>
+#import <signal.h>
+#import "GMLogger.h"
+#import "GMLogLevelControl.h"
+#import "GMLogLevelControlTest.h"
+
+// Counts what reaches it.
+@interface GMLogCountingWriter : NSObject <GMLogWriter> {
+ @private
+  int count_;
+}
+- (int)count;
+@end
+
+@implementation GMLogCountingWriter
+
+- (void)logMessage:(NSString *)msg level:(GMLoggerLevel)level {
+  count_++;
+}
+
+- (int)count {
+  return count_;
+}
+
+@end
+
+// Filters by level after formatting, as GMLogLevelFilter used to.
+@interface GMLogPostFormatLevelFilter : NSObject <GMLogFilter>
+@end
+
+@implementation GMLogPostFormatLevelFilter
+
+- (BOOL)filterAllowsMessage:(NSString *)msg level:(GMLoggerLevel)level {
+  return level >= [[GMLogLevelControl sharedControl] minimumLevelForFunc:NULL];
+}
+
+@end
+
+static int gEvaluations = 0;
+
+static int Evaluate(void) {
+  return ++gEvaluations;
+}
+
+@implementation GMLogLevelControlTest
+
+- (void)setUp {
+  savedLogger_ = [[GMLogger sharedLogger] retain];
+  names_ = [[NSMutableArray alloc] init];
+}
+
+- (void)tearDown {
+  GMLogLevelControl *control = [GMLogLevelControl sharedControl];
+  NSEnumerator *nameEnumerator = [names_ objectEnumerator];
+  NSString *name = nil;
+  while ((name = [nameEnumerator nextObject]))
+    [control removeMinimumLevelForName:name];
+  [names_ release];
+  [GMLogger setSharedLogger:savedLogger_];
+  [savedLogger_ release];
+}
+
+- (void)setLevel:(GMLoggerLevel)level forName:(NSString *)name {
+  [[GMLogLevelControl sharedControl] setMinimumLevel:level forName:name];
+  [names_ addObject:name];
+}
+
+// Makes a shared logger with a GMLogLevelFilter, counting into |writer|.
+- (GMLogger *)installLoggerWithWriter:(GMLogCountingWriter *)writer {
+  GMLogger *logger =
+    [GMLogger loggerWithWriter:writer
+                     formatter:[[[GMLogBasicFormatter alloc] init] autorelease]
+                        filter:[[[GMLogLevelFilter alloc] init] autorelease]];
+  [GMLogger setSharedLogger:logger];
+  return logger;
+}
+
+- (void)testLevelNamed {
+  STAssertEquals([GMLogLevelControl levelNamed:@"debug"],
+                 (int)kGMLoggerLevelDebug, nil);
+  STAssertEquals([GMLogLevelControl levelNamed:@" Info"],
+                 (int)kGMLoggerLevelInfo, nil);
+  STAssertEquals([GMLogLevelControl levelNamed:@"ERROR"],
+                 (int)kGMLoggerLevelError, nil);
+  STAssertEquals([GMLogLevelControl levelNamed:@"assert"],
+                 (int)kGMLoggerLevelAssert, nil);
+  STAssertEquals([GMLogLevelControl levelNamed:@"2"], 2, nil);
+  STAssertEquals([GMLogLevelControl levelNamed:@"loud"], -1, nil);
+  STAssertEquals([GMLogLevelControl levelNamed:@"-1"], -1, nil);
+  STAssertEquals([GMLogLevelControl levelNamed:@""], -1, nil);
+}
+
+- (void)testHierarchy {
+  GMLogLevelControl *control = [GMLogLevelControl sharedControl];
+  [self setLevel:kGMLoggerLevelError forName:@"*"];
+  [self setLevel:kGMLoggerLevelInfo forName:@"MB"];
+  [self setLevel:kGMLoggerLevelDebug forName:@"MBTask"];
+  [self setLevel:kGMLoggerLevelAssert forName:@"-[MBTaskFoo quiet]"];
+
+  STAssertEquals([control minimumLevelForFunc:NULL],
+                 kGMLoggerLevelError, nil);
+  STAssertEquals([control minimumLevelForFunc:"-[NSObject foo]"],
+                 kGMLoggerLevelError, nil);
+  STAssertEquals([control minimumLevelForFunc:"main"],
+                 kGMLoggerLevelError, nil);
+  STAssertEquals([control minimumLevelForFunc:"-[MBProject name]"],
+                 kGMLoggerLevelInfo, nil);
+  STAssertEquals([control minimumLevelForFunc:"MBHelper"],
+                 kGMLoggerLevelInfo, nil);
+  STAssertEquals([control minimumLevelForFunc:"+[MBTaskFoo run:]"],
+                 kGMLoggerLevelDebug, nil);
+  STAssertEquals([control minimumLevelForFunc:"-[MBTaskFoo(Private) run:]"],
+                 kGMLoggerLevelDebug, nil);
+  STAssertEquals([control minimumLevelForFunc:"-[MBTaskFoo quiet]"],
+                 kGMLoggerLevelAssert, nil);
+  // Only the module is matched against prefixes, not the selector.
+  STAssertEquals([control minimumLevelForFunc:"-[NSObject MBTask]"],
+                 kGMLoggerLevelError, nil);
+
+  // Asking again comes from the cache, and gives the same answer.
+  STAssertEquals([control minimumLevelForFunc:"-[MBProject name]"],
+                 kGMLoggerLevelInfo, nil);
+}
+
+- (void)testRemove {
+  GMLogLevelControl *control = [GMLogLevelControl sharedControl];
+  [self setLevel:kGMLoggerLevelError forName:@"*"];
+  [self setLevel:kGMLoggerLevelDebug forName:@"MBTest"];
+  STAssertEquals([control minimumLevelForFunc:"-[MBTest foo]"],
+                 kGMLoggerLevelDebug, nil);
+  [control removeMinimumLevelForName:@"MBTest"];
+  STAssertEquals([control minimumLevelForFunc:"-[MBTest foo]"],
+                 kGMLoggerLevelError, nil);
+}
+
+- (void)testUserDefaults {
+  GMLogLevelControl *control = [GMLogLevelControl sharedControl];
+  NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+  id saved = [[defaults objectForKey:@"GMLogLevels"] retain];
+
+  NSDictionary *levels = [NSDictionary dictionaryWithObjectsAndKeys:
+                          @"debug", @"MBDefaultsTest",
+                          [NSNumber numberWithInt:kGMLoggerLevelAssert],
+                          @"MBDefaultsTestQuiet",
+                          @"nonsense", @"MBDefaultsTestBad",
+                          nil];
+  [defaults setObject:levels forKey:@"GMLogLevels"];
+  [control reload];
+  STAssertEquals([control minimumLevelForFunc:"-[MBDefaultsTest foo]"],
+                 kGMLoggerLevelDebug, nil);
+  STAssertEquals([control minimumLevelForFunc:"-[MBDefaultsTestQuiet foo]"],
+                 kGMLoggerLevelAssert, nil);
+  STAssertEquals([control minimumLevelForFunc:"-[MBDefaultsTestBad foo]"],
+                 kGMLoggerLevelDebug, @"bad levels are ignored");
+
+  // Code beats the defaults.
+  [self setLevel:kGMLoggerLevelInfo forName:@"MBDefaultsTest"];
+  STAssertEquals([control minimumLevelForFunc:"-[MBDefaultsTest foo]"],
+                 kGMLoggerLevelInfo, nil);
+
+  if (saved)
+    [defaults setObject:saved forKey:@"GMLogLevels"];
+  else
+    [defaults removeObjectForKey:@"GMLogLevels"];
+  [saved release];
+  [control reload];
+  // Only the level set in code is left.
+  STAssertEquals([control minimumLevelForFunc:"-[MBDefaultsTestQuiet foo]"],
+                 kGMLoggerLevelInfo, nil);
+}
+
+- (void)testGeneration {
+  GMLogLevelControl *control = [GMLogLevelControl sharedControl];
+  [control reload];
+  int32_t generation = GMLoggerLevelGeneration;
+  [control reload];
+  STAssertEquals(GMLoggerLevelGeneration, generation,
+                 @"nothing changed, so nothing to invalidate");
+  [self setLevel:kGMLoggerLevelDebug forName:@"MBGenerationTest"];
+  STAssertTrue(GMLoggerLevelGeneration != generation, nil);
+}
+
+- (void)testCallSiteCache {
+  GMLogCountingWriter *writer = [[[GMLogCountingWriter alloc] init]
+                                  autorelease];
+  [self installLoggerWithWriter:writer];
+  [self setLevel:kGMLoggerLevelError forName:@"GMLogLevelControlTest"];
+
+  static GMLoggerSite site;
+  STAssertFalse(GMLoggerIsEnabled(&site, __func__, kGMLoggerLevelDebug), nil);
+  STAssertTrue(GMLoggerIsEnabled(&site, __func__, kGMLoggerLevelError), nil);
+  for (int i = 0; i < 3; i++) {
+    GMLoggerDebug(@"debug %d", i);
+    GMLoggerError(@"error %d", i);
+  }
+  STAssertEquals([writer count], 3, nil);
+
+  // Changing the level reaches call sites which have already cached it.
+  [self setLevel:kGMLoggerLevelDebug forName:@"GMLogLevelControlTest"];
+  STAssertTrue(GMLoggerIsEnabled(&site, __func__, kGMLoggerLevelDebug), nil);
+  for (int i = 0; i < 3; i++)
+    GMLoggerDebug(@"debug %d", i);
+  STAssertEquals([writer count], 6, nil);
+
+  // So does replacing the shared logger.
+  GMLogCountingWriter *other = [[[GMLogCountingWriter alloc] init]
+                                 autorelease];
+  [GMLogger setSharedLogger:
+   [GMLogger loggerWithWriter:other
+                    formatter:[[[GMLogBasicFormatter alloc] init] autorelease]
+                       filter:[[[GMLogNoFilter alloc] init] autorelease]]];
+  [self setLevel:kGMLoggerLevelError forName:@"GMLogLevelControlTest"];
+  GMLoggerDebug(@"not filtered by GMLogNoFilter");
+  STAssertEquals([other count], 1, nil);
+}
+
+- (void)testDisabledArgumentsNotEvaluated {
+  GMLogCountingWriter *writer = [[[GMLogCountingWriter alloc] init]
+                                  autorelease];
+  [self installLoggerWithWriter:writer];
+  [self setLevel:kGMLoggerLevelInfo forName:@"GMLogLevelControlTest"];
+
+  gEvaluations = 0;
+  GMLoggerDebug(@"%d", Evaluate());
+  STAssertEquals(gEvaluations, 0, nil);
+  GMLoggerInfo(@"%d", Evaluate());
+  STAssertEquals(gEvaluations, 1, nil);
+  STAssertEquals([writer count], 1, nil);
+
+  // Calling the logger directly still filters, by function.
+  GMLogger *logger = [GMLogger sharedLogger];
+  [logger logFuncDebug:"-[GMLogLevelControlTest foo]" msg:@"dropped"];
+  [logger logFuncDebug:"-[SomethingElse foo]" msg:@"dropped too"];
+  [logger logFuncInfo:"-[GMLogLevelControlTest foo]" msg:@"kept"];
+  STAssertEquals([writer count], 2, nil);
+}
+
+- (void)testOtherFilters {
+  // Filters which look at the message don't get a per-function level, so
+  // every statement reaches them.
+  GMLogCountingWriter *writer = [[[GMLogCountingWriter alloc] init]
+                                  autorelease];
+  GMLogger *logger =
+    [GMLogger loggerWithWriter:writer
+                     formatter:[[[GMLogBasicFormatter alloc] init] autorelease]
+                        filter:[[[GMLogNoFilter alloc] init] autorelease]];
+  STAssertEquals([logger minimumLevelForFunc:__func__],
+                 (int)kGMLoggerLevelUnknown, nil);
+  [logger setFilter:[[[GMLogLevelFilter alloc] init] autorelease]];
+  [self setLevel:kGMLoggerLevelAssert forName:@"GMLogLevelControlTest"];
+  STAssertEquals([logger minimumLevelForFunc:__func__],
+                 (int)kGMLoggerLevelAssert, nil);
+}
+
+- (void)testSignalToggle {
+  GMLogLevelControl *control = [GMLogLevelControl sharedControl];
+  [self setLevel:kGMLoggerLevelError forName:@"MBSignalTest"];
+  [control toggleVerboseOnSignal:SIGUSR1];
+
+  int32_t generation = GMLoggerLevelGeneration;
+  raise(SIGUSR1);
+  STAssertTrue(GMLoggerLevelGeneration != generation, nil);
+  STAssertEquals([control minimumLevelForFunc:"-[MBSignalTest foo]"],
+                 kGMLoggerLevelUnknown, nil);
+  raise(SIGUSR1);
+  STAssertEquals([control minimumLevelForFunc:"-[MBSignalTest foo]"],
+                 kGMLoggerLevelError, nil);
+  signal(SIGUSR1, SIG_DFL);
+}
+
+- (void)testBenchmark {
+  static const int kCalls = 200000;
+  GMLogCountingWriter *writer = [[[GMLogCountingWriter alloc] init]
+                                  autorelease];
+  [self installLoggerWithWriter:writer];
+  [self setLevel:kGMLoggerLevelError forName:@"GMLogLevelControlTest"];
+
+  // What a disabled statement cost before: format, then filter.
+  GMLogger *formatting =
+    [GMLogger loggerWithWriter:writer
+                     formatter:[[[GMLogBasicFormatter alloc] init] autorelease]
+                        filter:[[[GMLogPostFormatLevelFilter alloc] init]
+                                 autorelease]];
+  [self setLevel:kGMLoggerLevelError forName:@"*"];
+  NSDate *start = [NSDate date];
+  for (int i = 0; i < kCalls; i++) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    [formatting logFuncDebug:NULL msg:@"line %d of %@", i, @"output"];
+    [pool release];
+  }
+  NSTimeInterval before = -[start timeIntervalSinceNow];
+
+  start = [NSDate date];
+  for (int i = 0; i < kCalls; i++)
+    GMLoggerDebug(@"line %d of %@", i, @"output");
+  NSTimeInterval after = -[start timeIntervalSinceNow];
+
+  NSLog(@"disabled GMLoggerDebug: %.3fus per call before, %.3fus after",
+        before * 1e6 / kCalls, after * 1e6 / kCalls);
+  STAssertEquals([writer count], 0, nil);
+  STAssertTrue(after < before, nil);
+}
+
+@end
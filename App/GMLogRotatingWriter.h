@@ -0,0 +1,100 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// GMLogRotatingWriter
+//
+// A GMLogWriter that appends to a file like
+// +[NSFileHandle fileHandleForLoggingAtPath:mode:], but rolls the file over
+// once it reaches a size or has been open for a while, and keeps only the
+// last few generations:
+//
+//   launcher.log      the one being written
+//   launcher.log.1.gz the previous one
+//   ...
+//   launcher.log.N.gz the oldest kept; older ones are deleted
+//
+// Rotation happens under the same lock as writing, so every message lands
+// whole in exactly one file. All a logging thread does to rotate is close,
+// rename the file out of the way and open a new one; shifting the older
+// generations along and compressing is done on a background thread, one
+// rotation at a time. Files left half-rotated by a crash are picked up the
+// next time a writer opens the same path.
+//
+// Example:
+//
+//   GMLogRotatingWriter *writer =
+//     [GMLogRotatingWriter writerWithPath:@"~/Library/Logs/launcher.log"];
+//   [[GMLogger sharedLogger] setWriter:writer];
+
+#import <Foundation/Foundation.h>
+#import <pthread.h>
+#import "GMLogger.h"
+#import "GMLogAsyncWriter.h"
+
+@interface GMLogRotatingWriter : NSObject <GMLogBatchWriter> {
+ @private
+  NSString *path_;
+  mode_t mode_;
+  unsigned long long maxBytes_;   // 0 for no size limit
+  NSTimeInterval maxAge_;         // 0 for no time limit
+  int generations_;
+  BOOL compress_;
+
+  // Guarded by |lock_|.
+  pthread_mutex_t lock_;
+  int fd_;
+  unsigned long long size_;
+  NSTimeInterval rotateAt_;       // seconds since 1970, or 0
+  unsigned rotations_;
+
+  // The background thread and its queue of files to put in place.
+  pthread_mutex_t jobLock_;
+  pthread_cond_t jobAdded_;
+  pthread_cond_t jobsDone_;
+  NSMutableArray *jobs_;          // paths of rotated-out files
+  BOOL working_;
+  BOOL stopping_;
+  pthread_t thread_;
+  BOOL running_;
+}
+
+// Returns an autoreleased writer for |path| (with ~ expanded) which rolls
+// over at 10MB or once a day, keeping 5 compressed generations. Returns nil
+// if the file can't be opened.
++ (id)writerWithPath:(NSString *)path;
+
+// Designated initializer. Appends to |path|, creating it with |mode|.
+// |maxBytes| and |maxAge| of 0 disable that limit; |generations| old files
+// are kept, gzipped if |compress|. Returns nil if the file can't be opened.
+- (id)initWithPath:(NSString *)path
+              mode:(mode_t)mode
+          maxBytes:(unsigned long long)maxBytes
+            maxAge:(NSTimeInterval)maxAge
+       generations:(int)generations
+          compress:(BOOL)compress;
+
+- (NSString *)path;
+
+// Path of generation |n| (1 is the newest old file).
+- (NSString *)pathForGeneration:(int)n;
+
+// Rolls over now, whatever the limits say.
+- (void)rotate;
+
+// Blocks until the background thread has finished with every rotation so
+// far.
+- (void)waitForCompression;
+
+@end
@@ -0,0 +1,352 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import "GMLogRotatingWriter.h"
+#import <errno.h>
+#import <fcntl.h>
+#import <stdio.h>
+#import <sys/stat.h>
+#import <sys/time.h>
+#import <sys/uio.h>
+#import <time.h>
+#import <unistd.h>
+#import <zlib.h>
+
+@interface GMLogRotatingWriter (PrivateMethods)
+- (void)writeVector:(struct iovec *)vector count:(int)count;
+- (void)rotateLocked;
+- (void)addJob:(NSString *)rotated;
+- (void)finishRotation:(NSString *)rotated;
+- (void)run;
+@end
+
+static void *GMLogRotatingThread(void *arg) {
+  [(GMLogRotatingWriter *)arg run];
+  return NULL;
+}
+
+static NSTimeInterval GMLogRotatingNow(void) {
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return now.tv_sec + now.tv_usec / 1e6;
+}
+
+// gzips |src| into |dst|. Returns NO (leaving no |dst|) on failure.
+static BOOL GMLogRotatingGzip(const char *src, const char *dst, mode_t mode) {
+  int in = open(src, O_RDONLY);
+  if (in < 0)
+    return NO;
+  int outfd = open(dst, O_WRONLY | O_CREAT | O_TRUNC, mode);
+  gzFile out = (outfd < 0) ? NULL : gzdopen(outfd, "wb");
+  if (out == NULL) {
+    if (outfd >= 0)
+      close(outfd);
+    close(in);
+    unlink(dst);
+    return NO;
+  }
+  BOOL ok = YES;
+  char buffer[64 * 1024];
+  ssize_t count;
+  while ((count = read(in, buffer, sizeof(buffer))) != 0) {
+    if (count < 0) {
+      if (errno == EINTR)
+        continue;
+      ok = NO;
+      break;
+    }
+    if (gzwrite(out, buffer, (unsigned)count) != count) {
+      ok = NO;
+      break;
+    }
+  }
+  if (gzclose(out) != Z_OK)
+    ok = NO;
+  close(in);
+  if (!ok)
+    unlink(dst);
+  return ok;
+}
+
+@implementation GMLogRotatingWriter
+
++ (id)writerWithPath:(NSString *)path {
+  return [[[self alloc] initWithPath:path
+                                mode:0644
+                            maxBytes:10 * 1024 * 1024
+                              maxAge:24 * 60 * 60
+                         generations:5
+                            compress:YES] autorelease];
+}
+
+- (id)init {
+  return [self initWithPath:nil
+                       mode:0644
+                   maxBytes:0
+                     maxAge:0
+                generations:0
+                   compress:NO];
+}
+
+- (id)initWithPath:(NSString *)path
+              mode:(mode_t)mode
+          maxBytes:(unsigned long long)maxBytes
+            maxAge:(NSTimeInterval)maxAge
+       generations:(int)generations
+          compress:(BOOL)compress {
+  if ((self = [super init])) {
+    fd_ = -1;
+    pthread_mutex_init(&lock_, NULL);
+    pthread_mutex_init(&jobLock_, NULL);
+    pthread_cond_init(&jobAdded_, NULL);
+    pthread_cond_init(&jobsDone_, NULL);
+    jobs_ = [[NSMutableArray alloc] init];
+    if (path)
+      path_ = [[path stringByStandardizingPath] copy];
+    mode_ = mode;
+    maxBytes_ = maxBytes;
+    maxAge_ = maxAge;
+    generations_ = (generations > 0) ? generations : 0;
+    compress_ = compress;
+
+    if (path_)
+      fd_ = open([path_ fileSystemRepresentation],
+                 O_WRONLY | O_APPEND | O_CREAT, mode_);
+    if (fd_ < 0) {
+      [self release];
+      return nil;
+    }
+    struct stat info;
+    if (fstat(fd_, &info) == 0)
+      size_ = info.st_size;
+    if (maxAge_ > 0)
+      rotateAt_ = GMLogRotatingNow() + maxAge_;
+
+    // Finish off any rotations a crash interrupted, oldest first.
+    NSString *dir = [path_ stringByDeletingLastPathComponent];
+    NSString *prefix =
+      [[path_ lastPathComponent] stringByAppendingString:@".rotating."];
+    NSArray *names = [[[NSFileManager defaultManager]
+                        directoryContentsAtPath:dir]
+                       sortedArrayUsingSelector:@selector(compare:)];
+    NSEnumerator *nameEnumerator = [names objectEnumerator];
+    NSString *name = nil;
+    while ((name = [nameEnumerator nextObject])) {
+      if ([name hasPrefix:prefix])
+        [self addJob:[dir stringByAppendingPathComponent:name]];
+    }
+  }
+  return self;
+}
+
+- (void)dealloc {
+  // Let the background thread finish what it was given.
+  if (running_) {
+    pthread_mutex_lock(&jobLock_);
+    stopping_ = YES;
+    pthread_cond_signal(&jobAdded_);
+    pthread_mutex_unlock(&jobLock_);
+    pthread_join(thread_, NULL);
+  }
+  if (fd_ >= 0)
+    close(fd_);
+  pthread_mutex_destroy(&lock_);
+  pthread_mutex_destroy(&jobLock_);
+  pthread_cond_destroy(&jobAdded_);
+  pthread_cond_destroy(&jobsDone_);
+  [jobs_ release];
+  [path_ release];
+  [super dealloc];
+}
+
+- (NSString *)path {
+  return [[path_ retain] autorelease];
+}
+
+- (NSString *)pathForGeneration:(int)n {
+  return [NSString stringWithFormat:@"%@.%d%@",
+          path_, n, (compress_ ? @".gz" : @"")];
+}
+
+- (void)logMessage:(NSString *)msg level:(GMLoggerLevel)level {
+  const char *utf8 = [msg UTF8String];
+  if (utf8 == NULL)
+    return;
+  // One writev(), so the message and its newline can't be split up.
+  struct iovec vector[2];
+  vector[0].iov_base = (void *)utf8;
+  vector[0].iov_len = strlen(utf8);
+  vector[1].iov_base = "\n";
+  vector[1].iov_len = 1;
+  [self writeVector:vector count:2];
+}
+
+- (void)logMessages:(NSArray *)msgs levels:(const GMLoggerLevel *)levels {
+  NSMutableData *data = [NSMutableData dataWithCapacity:[msgs count] * 128];
+  NSEnumerator *msgEnumerator = [msgs objectEnumerator];
+  NSString *msg = nil;
+  while ((msg = [msgEnumerator nextObject])) {
+    const char *utf8 = [msg UTF8String];
+    if (utf8 == NULL)
+      continue;
+    [data appendBytes:utf8 length:strlen(utf8)];
+    [data appendBytes:"\n" length:1];
+  }
+  struct iovec vector[1];
+  vector[0].iov_base = [data mutableBytes];
+  vector[0].iov_len = [data length];
+  [self writeVector:vector count:1];
+}
+
+- (void)rotate {
+  pthread_mutex_lock(&lock_);
+  [self rotateLocked];
+  pthread_mutex_unlock(&lock_);
+}
+
+- (void)waitForCompression {
+  pthread_mutex_lock(&jobLock_);
+  while ([jobs_ count] > 0)
+    pthread_cond_wait(&jobsDone_, &jobLock_);
+  pthread_mutex_unlock(&jobLock_);
+}
+
+@end  // GMLogRotatingWriter
+
+
+@implementation GMLogRotatingWriter (PrivateMethods)
+
+- (void)writeVector:(struct iovec *)vector count:(int)count {
+  size_t length = 0;
+  for (int i = 0; i < count; i++)
+    length += vector[i].iov_len;
+  if (length == 0)
+    return;
+
+  pthread_mutex_lock(&lock_);
+  BOOL full = (maxBytes_ > 0 && size_ > 0 && size_ + length > maxBytes_);
+  BOOL old = (rotateAt_ > 0 && GMLogRotatingNow() >= rotateAt_);
+  if (full || old || fd_ < 0)
+    [self rotateLocked];
+  if (fd_ >= 0) {
+    ssize_t written;
+    do {
+      written = writev(fd_, vector, count);
+    } while (written < 0 && errno == EINTR);
+    if (written > 0)
+      size_ += written;
+  }
+  pthread_mutex_unlock(&lock_);
+}
+
+// With |lock_| held: moves the current file aside for the background thread
+// and starts a new one. This is all a logging thread waits for.
+- (void)rotateLocked {
+  if (fd_ >= 0) {
+    close(fd_);
+    fd_ = -1;
+    NSString *rotated = [NSString stringWithFormat:@"%@.rotating.%010ld.%06u",
+                         path_, (long)time(NULL), ++rotations_];
+    if (rename([path_ fileSystemRepresentation],
+               [rotated fileSystemRepresentation]) == 0)
+      [self addJob:rotated];
+  }
+  fd_ = open([path_ fileSystemRepresentation],
+             O_WRONLY | O_APPEND | O_CREAT, mode_);
+  size_ = 0;
+  if (maxAge_ > 0)
+    rotateAt_ = GMLogRotatingNow() + maxAge_;
+}
+
+- (void)addJob:(NSString *)rotated {
+  pthread_mutex_lock(&jobLock_);
+  [jobs_ addObject:rotated];
+  if (!running_)
+    running_ = (pthread_create(&thread_, NULL, GMLogRotatingThread, self) == 0);
+  pthread_cond_signal(&jobAdded_);
+  pthread_mutex_unlock(&jobLock_);
+  if (!running_) {
+    // No thread; do it here rather than leave the file lying around.
+    [self finishRotation:rotated];
+    pthread_mutex_lock(&jobLock_);
+    [jobs_ removeObject:rotated];
+    pthread_mutex_unlock(&jobLock_);
+  }
+}
+
+// Shifts the old generations along by one, dropping the oldest, and puts
+// |rotated| in as generation 1. Only ever run on one thread at a time.
+- (void)finishRotation:(NSString *)rotated {
+  const char *rotatedPath = [rotated fileSystemRepresentation];
+  if (generations_ == 0) {
+    unlink(rotatedPath);
+    return;
+  }
+
+  // Both spellings, in case |compress_| was different last time.
+  NSString *suffixes[2] = { @"", @".gz" };
+  for (int s = 0; s < 2; s++) {
+    NSString *oldest = [NSString stringWithFormat:@"%@.%d%@",
+                        path_, generations_, suffixes[s]];
+    unlink([oldest fileSystemRepresentation]);
+    for (int n = generations_ - 1; n >= 1; n--) {
+      NSString *from = [NSString stringWithFormat:@"%@.%d%@",
+                        path_, n, suffixes[s]];
+      NSString *to = [NSString stringWithFormat:@"%@.%d%@",
+                      path_, n + 1, suffixes[s]];
+      rename([from fileSystemRepresentation], [to fileSystemRepresentation]);
+    }
+  }
+
+  NSString *first = [NSString stringWithFormat:@"%@.1", path_];
+  if (compress_) {
+    NSString *gz = [first stringByAppendingString:@".gz"];
+    NSString *tmp = [gz stringByAppendingString:@".tmp"];
+    if (GMLogRotatingGzip(rotatedPath, [tmp fileSystemRepresentation], mode_) &&
+        rename([tmp fileSystemRepresentation],
+               [gz fileSystemRepresentation]) == 0) {
+      unlink(rotatedPath);
+      return;
+    }
+    unlink([tmp fileSystemRepresentation]);
+    // Keep it uncompressed rather than lose it.
+  }
+  rename(rotatedPath, [first fileSystemRepresentation]);
+}
+
+- (void)run {
+  pthread_mutex_lock(&jobLock_);
+  while (YES) {
+    while ([jobs_ count] == 0 && !stopping_)
+      pthread_cond_wait(&jobAdded_, &jobLock_);
+    if ([jobs_ count] == 0)
+      break;  // stopping, and nothing left to do
+    NSString *rotated = [[jobs_ objectAtIndex:0] retain];
+    pthread_mutex_unlock(&jobLock_);
+
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    [self finishRotation:rotated];
+    [pool release];
+
+    pthread_mutex_lock(&jobLock_);
+    [jobs_ removeObjectAtIndex:0];
+    [rotated release];
+    if ([jobs_ count] == 0)
+      pthread_cond_broadcast(&jobsDone_);
+  }
+  pthread_mutex_unlock(&jobLock_);
+}
+
+@end  // PrivateMethods
@@ -0,0 +1,235 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import <SenTestingKit/SenTestingKit.h>
+#import <Cocoa/Cocoa.h>
+#include <zlib.h>
+#import "GMLogRotatingWriter.h"
+#import "GMLogRotatingWriterTest.h"
+
+static const int kThreads = 4;
+static const int kMessagesPerThread = 2000;
+
+@implementation GMLogRotatingWriterTest
+
+- (void)setUp {
+  dir_ = [[NSTemporaryDirectory() stringByAppendingPathComponent:
+           [NSString stringWithFormat:@"GMLogRotatingWriterTest-%d",
+            getpid()]] retain];
+  [[NSFileManager defaultManager] removeFileAtPath:dir_ handler:nil];
+  [[NSFileManager defaultManager] createDirectoryAtPath:dir_ attributes:nil];
+  path_ = [[dir_ stringByAppendingPathComponent:@"test.log"] retain];
+  done_ = [[NSConditionLock alloc] initWithCondition:0];
+}
+
+- (void)tearDown {
+  [[NSFileManager defaultManager] removeFileAtPath:dir_ handler:nil];
+  [dir_ release];
+  [path_ release];
+  [done_ release];
+}
+
+- (BOOL)exists:(NSString *)path {
+  return [[NSFileManager defaultManager] fileExistsAtPath:path];
+}
+
+// The lines of |path|, gunzipping it if needed.
+- (NSArray *)linesOf:(NSString *)path {
+  NSMutableData *data = [NSMutableData data];
+  gzFile in = gzopen([path fileSystemRepresentation], "rb");  // reads plain too
+  STAssertTrue(in != NULL, path);
+  char buffer[4096];
+  int count;
+  while ((count = gzread(in, buffer, sizeof(buffer))) > 0)
+    [data appendBytes:buffer length:count];
+  gzclose(in);
+  NSString *text = [[[NSString alloc] initWithData:data
+                                          encoding:NSUTF8StringEncoding]
+                     autorelease];
+  STAssertTrue([text length] == 0 || [text hasSuffix:@"\n"], path);
+  NSMutableArray *lines =
+    [[[text componentsSeparatedByString:@"\n"] mutableCopy] autorelease];
+  [lines removeLastObject];  // after the last newline
+  return lines;
+}
+
+- (void)testSizeRotation {
+  GMLogRotatingWriter *writer = [[[GMLogRotatingWriter alloc]
+                                   initWithPath:path_
+                                           mode:0600
+                                       maxBytes:1000
+                                         maxAge:0
+                                    generations:3
+                                       compress:NO] autorelease];
+  // 100 lines of 50 bytes: 20 per file.
+  for (int i = 0; i < 100; i++) {
+    NSString *msg = [NSString stringWithFormat:@"%049d", i];
+    [writer logMessage:msg level:kGMLoggerLevelInfo];
+  }
+  [writer waitForCompression];
+
+  STAssertEqualObjects([writer pathForGeneration:2],
+                       [path_ stringByAppendingString:@".2"], nil);
+  NSArray *lines = [self linesOf:path_];
+  STAssertEquals([lines count], (unsigned)20, nil);
+  STAssertEquals([[lines lastObject] intValue], 99, nil);
+  for (int n = 1; n <= 3; n++) {
+    lines = [self linesOf:[writer pathForGeneration:n]];
+    STAssertEquals([lines count], (unsigned)20, nil);
+    STAssertEquals([[lines objectAtIndex:0] intValue], 80 - 20 * n, nil);
+  }
+  STAssertFalse([self exists:[path_ stringByAppendingString:@".4"]], nil);
+  NSDictionary *attributes = [[NSFileManager defaultManager]
+                               fileAttributesAtPath:path_ traverseLink:NO];
+  STAssertEquals([attributes filePosixPermissions], (unsigned long)0600, nil);
+}
+
+- (void)testTimeRotation {
+  GMLogRotatingWriter *writer = [[[GMLogRotatingWriter alloc]
+                                   initWithPath:path_
+                                           mode:0644
+                                       maxBytes:0
+                                         maxAge:1
+                                    generations:2
+                                       compress:NO] autorelease];
+  [writer logMessage:@"early" level:kGMLoggerLevelInfo];
+  [writer logMessage:@"early too" level:kGMLoggerLevelInfo];
+  usleep(1100 * 1000);
+  [writer logMessage:@"late" level:kGMLoggerLevelInfo];
+  [writer waitForCompression];
+  STAssertEqualObjects([self linesOf:path_],
+                       [NSArray arrayWithObject:@"late"], nil);
+  STAssertEquals([[self linesOf:[writer pathForGeneration:1]] count],
+                 (unsigned)2, nil);
+}
+
+- (void)testCompression {
+  GMLogRotatingWriter *writer =
+    [GMLogRotatingWriter writerWithPath:path_];
+  STAssertNotNil(writer, nil);
+  NSMutableArray *expected = [NSMutableArray array];
+  for (int i = 0; i < 1000; i++) {
+    NSString *msg = [NSString stringWithFormat:@"message %d of 1000", i];
+    [expected addObject:msg];
+  }
+  [writer logMessages:expected levels:NULL];
+  [writer rotate];
+  [writer logMessage:@"after" level:kGMLoggerLevelInfo];
+  [writer rotate];
+  [writer waitForCompression];
+
+  NSString *gz = [writer pathForGeneration:2];
+  STAssertTrue([gz hasSuffix:@".2.gz"], gz);
+  STAssertEqualObjects([self linesOf:gz], expected, nil);
+  STAssertEqualObjects([self linesOf:[writer pathForGeneration:1]],
+                       [NSArray arrayWithObject:@"after"], nil);
+  unsigned long long compressed =
+    [[[NSFileManager defaultManager] fileAttributesAtPath:gz
+                                             traverseLink:NO] fileSize];
+  STAssertTrue(compressed < 1000 * 10, nil);
+  // Nothing left over.
+  NSArray *names = [[NSFileManager defaultManager] directoryContentsAtPath:dir_];
+  STAssertEquals([names count], (unsigned)3, [names description]);
+}
+
+// |args| is (writer, thread number).
+- (void)logFromThread:(NSArray *)args {
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  GMLogRotatingWriter *writer = [args objectAtIndex:0];
+  int thread = [[args objectAtIndex:1] intValue];
+  for (int i = 0; i < kMessagesPerThread; i++) {
+    [writer logMessage:[NSString stringWithFormat:@"%d %d", thread, i]
+                 level:kGMLoggerLevelInfo];
+  }
+  [done_ lock];
+  [done_ unlockWithCondition:[done_ condition] + 1];
+  [pool release];
+}
+
+- (void)testConcurrentRotation {
+  // Small files and enough generations to keep them all.
+  GMLogRotatingWriter *writer = [[[GMLogRotatingWriter alloc]
+                                   initWithPath:path_
+                                           mode:0644
+                                       maxBytes:2048
+                                         maxAge:0
+                                    generations:1000
+                                       compress:YES] autorelease];
+  for (int i = 0; i < kThreads; i++) {
+    NSArray *args = [NSArray arrayWithObjects:writer,
+                     [NSNumber numberWithInt:i], nil];
+    [NSThread detachNewThreadSelector:@selector(logFromThread:)
+                             toTarget:self
+                           withObject:args];
+  }
+  [done_ lockWhenCondition:kThreads];
+  [done_ unlock];
+  [writer waitForCompression];
+
+  // Every message is in exactly one file, whole, and each thread's are in
+  // order reading from the oldest file to the newest.
+  int next[kThreads] = { 0 };
+  int files = 0;
+  for (int n = 1000; n >= 0; n--) {
+    NSString *path = n ? [writer pathForGeneration:n] : path_;
+    if (![self exists:path])
+      continue;
+    files++;
+    NSEnumerator *lineEnumerator = [[self linesOf:path] objectEnumerator];
+    NSString *line = nil;
+    while ((line = [lineEnumerator nextObject])) {
+      NSArray *parts = [line componentsSeparatedByString:@" "];
+      STAssertEquals([parts count], (unsigned)2, line);
+      int thread = [[parts objectAtIndex:0] intValue];
+      STAssertEquals([[parts objectAtIndex:1] intValue], next[thread], line);
+      next[thread]++;
+    }
+  }
+  for (int i = 0; i < kThreads; i++)
+    STAssertEquals(next[i], kMessagesPerThread, nil);
+  STAssertTrue(files > 10, nil);
+}
+
+- (void)testRecovery {
+  // A rotation a crash interrupted before it was compressed.
+  NSString *left = [path_ stringByAppendingString:@".rotating.0000000001.000001"];
+  [@"left over\n" writeToFile:left atomically:NO];
+  GMLogRotatingWriter *writer = [GMLogRotatingWriter writerWithPath:path_];
+  [writer waitForCompression];
+  STAssertFalse([self exists:left], nil);
+  STAssertEqualObjects([self linesOf:[writer pathForGeneration:1]],
+                       [NSArray arrayWithObject:@"left over"], nil);
+
+  STAssertNil([GMLogRotatingWriter writerWithPath:@"/no/such/dir/x.log"], nil);
+}
+
+- (void)testNoGenerations {
+  GMLogRotatingWriter *writer = [[[GMLogRotatingWriter alloc]
+                                   initWithPath:path_
+                                           mode:0644
+                                       maxBytes:10
+                                         maxAge:0
+                                    generations:0
+                                       compress:YES] autorelease];
+  [writer logMessage:@"first message" level:kGMLoggerLevelInfo];
+  [writer logMessage:@"second message" level:kGMLoggerLevelInfo];
+  [writer waitForCompression];
+  STAssertEqualObjects([self linesOf:path_],
+                       [NSArray arrayWithObject:@"second message"], nil);
+  NSArray *names = [[NSFileManager defaultManager] directoryContentsAtPath:dir_];
+  STAssertEquals([names count], (unsigned)1, [names description]);
+}
+
+@end
@@ -111,15 +111,16 @@ limitations under the License.
 // take any special action based on the log level; it simply forwards this
 // information on to formatters, filters, and writers, each of which may
 // optionally take action based on the level. Since log level filtering is
-// performed at runtime, log messages are typically not filtered out at compile
-// time.  The exception to this rule is that calls to the GMLoggerDebug() macro
-// *ARE* filtered out of non-DEBUG builds. This is to be backwards compatible
-// with behavior that many developers are currently used to. Note that this
-// means that GMLoggerDebug(@"hi") will be compiled out of Release builds, but
-// [[GMLogger sharedLogger] logDebug:@"hi"] will NOT be compiled out.
+// performed at runtime, log messages are not filtered out at compile time
+// (unless GMLOGGER_STRIP_DEBUG is defined, which compiles GMLoggerDebug() calls
+// out).
 //
 // Standard loggers are created with the GMLogLevelFilter log filter, which
 // filters out certain log messages based on log level, and some other settings.
+// Its levels can be set per class or function and changed while the program
+// runs; see GMLogLevelControl. The GMLogger*() macros ask the filter before
+// formatting anything, and remember the answer, so a disabled GMLoggerDebug()
+// costs next to nothing.
 //
 // In addition to the -logDebug:, -logInfo:, and -logError: methods defined on
 // GMLogger itself, there are also C macros that make usage of the shared
@@ -129,8 +130,8 @@ limitations under the License.
 //   GMLoggerInfo(...)
 //   GMLoggerError(...)
 //
-// Again, a notable feature of these macros is that GMLogDebug() calls *will be
-// compiled out of non-DEBUG builds*.
+// A notable feature of these macros is that they check whether the message's
+// level is enabled for the calling function before evaluating the arguments.
 //
 // Standard Loggers
 // ----------------
@@ -158,14 +159,16 @@ limitations under the License.
 // --------
 // The following show some common GMLogger use cases.
 //
-// 1. You want to log something as simply as possible. Also, this call will only
-//    appear in debug builds. In non-DEBUG builds it will be completely removed.
+// 1. You want to log something as simply as possible. In non-DEBUG builds
+//    this is skipped (without formatting) unless debug logging is turned on
+//    for the function, e.g. with "defaults write <app> GMLogLevels
+//    -dict MyClass debug".
 //
 //      GMLoggerDebug(@"foo = %@", foo);
 //
 // 2. The previous example is similar to the following. The major difference is
-//    that the previous call (example 1) will be compiled out of Release builds
-//    but this statement will not be compiled out.
+//    that the previous call (example 1) checks the level before formatting,
+//    remembering the answer, and passes the function name along.
 //
 //      [[GMLogger sharedLogger] logDebug:@"foo = %@", foo];
 //
@@ -229,6 +232,9 @@ limitations under the License.
   id<GMLogWriter> writer_;
   id<GMLogFormatter> formatter_;
   id<GMLogFilter> filter_;
+  BOOL formatterTakesCFunc_;  // formatter_ has -stringForCFunc:...
+  BOOL writerTakesRecords_;   // writer_ is a GMLogRecordWriter
+  BOOL filterTakesFuncs_;     // filter_ is a GMLogFuncLevelFilter
 }
 
 //
@@ -329,23 +335,32 @@ limitations under the License.
 - (void)logFuncInfo:(const char *)func msg:(NSString *)fmt, ...;
 - (void)logFuncError:(const char *)func msg:(NSString *)fmt, ...;
 - (void)logFuncAssert:(const char *)func msg:(NSString *)fmt, ...;
+// The lowest level the filter lets through from |func|, if it can tell
+// without seeing the message; otherwise kGMLoggerLevelUnknown.
+- (int)minimumLevelForFunc:(const char *)func;
 @end
 
 // Convenience macros that log to the shared GMLogger instance. These macros
-// are how users should typically log to GMLogger. Notice that GMLoggerDebug()
-// calls will be compiled out of non-Debug builds.
+// are how users should typically log to GMLogger. Each one checks (and caches)
+// whether its level is enabled for the calling function first, so a disabled
+// message's arguments are never evaluated or formatted.
+#define GMLOGGER_LOG_IF_ENABLED(level, selector, ...)                    \
+  do {                                                                  \
+    static GMLoggerSite gmLoggerSite_ = { 0 };                          \
+    if (GMLoggerIsEnabled(&gmLoggerSite_, __func__, level))             \
+      [[GMLogger sharedLogger] selector:__func__ msg:__VA_ARGS__];      \
+  } while (0)
 #define GMLoggerDebug(...)  \
-  [[GMLogger sharedLogger] logFuncDebug:__func__ msg:__VA_ARGS__]
+  GMLOGGER_LOG_IF_ENABLED(kGMLoggerLevelDebug, logFuncDebug, __VA_ARGS__)
 #define GMLoggerInfo(...)   \
-  [[GMLogger sharedLogger] logFuncInfo:__func__ msg:__VA_ARGS__]
+  GMLOGGER_LOG_IF_ENABLED(kGMLoggerLevelInfo, logFuncInfo, __VA_ARGS__)
 #define GMLoggerError(...)  \
-  [[GMLogger sharedLogger] logFuncError:__func__ msg:__VA_ARGS__]
+  GMLOGGER_LOG_IF_ENABLED(kGMLoggerLevelError, logFuncError, __VA_ARGS__)
 #define GMLoggerAssert(...) \
-  [[GMLogger sharedLogger] logFuncAssert:__func__ msg:__VA_ARGS__]
+  GMLOGGER_LOG_IF_ENABLED(kGMLoggerLevelAssert, logFuncAssert, __VA_ARGS__)
 
-// If we're not in a debug build, remove the GMLoggerDebug statements. This
-// makes calls to GMLoggerDebug "compile out" of Release builds
-#ifndef DEBUG
+// Define GMLOGGER_STRIP_DEBUG to remove the GMLoggerDebug statements entirely.
+#ifdef GMLOGGER_STRIP_DEBUG
 #undef GMLoggerDebug
 #define GMLoggerDebug(...) do {} while(0)
 #endif
@@ -359,6 +374,31 @@ typedef enum {
   kGMLoggerLevelAssert,
 } GMLoggerLevel;
 
+// What a GMLogger*() macro call site remembers: the minimum level for its
+// function in the low 4 bits, and the GMLoggerLevelGeneration it was worked
+// out in above them. One word, so it is read and written atomically.
+typedef struct {
+  volatile int32_t state;
+} GMLoggerSite;
+
+// Bumped whenever the answer for any call site may have changed (a new shared
+// logger or filter, or new levels).
+extern volatile int32_t GMLoggerLevelGeneration;
+
+// Makes every call site ask again.
+void GMLoggerInvalidateLevels(void);
+
+// Works out |site|'s minimum level afresh and returns its new state.
+int32_t GMLoggerRefreshSite(GMLoggerSite *site, const char *func);
+
+static inline BOOL GMLoggerIsEnabled(GMLoggerSite *site, const char *func,
+                                     GMLoggerLevel level) {
+  int32_t state = site->state;
+  if ((state >> 4) != GMLoggerLevelGeneration)
+    state = GMLoggerRefreshSite(site, func);
+  return (int32_t)level >= (state & 0xF);
+}
+
 
 //
 //   Log Writers
@@ -370,6 +410,17 @@ typedef enum {
 - (void)logMessage:(NSString *)msg level:(GMLoggerLevel)level;
 @end
 
+// A log writer that wants the unformatted message. When a GMLogger's writer
+// conforms to this protocol the logger skips its formatter and passes the
+// function name, format and arguments straight through; its filter is shown
+// |fmt| in place of the formatted message. See GMLogBinaryWriter.
+@protocol GMLogRecordWriter <GMLogWriter>
+- (void)logFunc:(const char *)func
+         format:(NSString *)fmt
+         valist:(va_list)args
+          level:(GMLoggerLevel)level;
+@end
+
 // Simple category on NSFileHandle that makes NSFileHandles valid log writers.
 // This is convenient because something like, say, +fileHandleWithStandardError
 // now becomes a valid log writer. Log messages are written to the file handle
@@ -436,10 +487,33 @@ typedef enum {
 // also prepends a timestamp and some basic process info to the message, as
 // shown in the following sample output.
 //   2007-12-30 10:29:24.177 myapp[4588/0xa07d0f60] [lvl=1] log mesage here
+//
+// The line is assembled as UTF-8 in a buffer owned by the calling thread.
+// The "yyyy-MM-dd HH:mm:ss." part of the timestamp is only reformatted when
+// the second changes, and the "myapp[4588/" part is computed once, so the
+// only objects created per message are the formatted message itself and the
+// returned string. Callers that want bytes can skip the returned string, too.
 @interface GMLogStandardFormatter : GMLogBasicFormatter {
  @private
-  NSDateFormatter *dateFormatter_;  // yyyy-MM-dd HH:mm:ss.SSS
+  char *processPrefix_;  // "myapp[4588/"
+  size_t processPrefixLength_;
 }
+
+// Formats the complete line (without a trailing newline) into a buffer owned
+// by the calling thread and returns it, setting |*length|. The bytes are UTF-8
+// and are valid until the thread's next call. |func| may be NULL.
+- (const char *)bytesForCFunc:(const char *)func
+                   withFormat:(NSString *)fmt
+                       valist:(va_list)args
+                        level:(GMLoggerLevel)level
+                       length:(size_t *)length;
+
+// Same as -stringForFunc:withFormat:valist:level:, without converting |func|
+// to an NSString first. GMLogger uses this when its formatter supports it.
+- (NSString *)stringForCFunc:(const char *)func
+                  withFormat:(NSString *)fmt
+                      valist:(va_list)args
+                       level:(GMLoggerLevel)level;
 @end
 
 
@@ -453,12 +527,22 @@ typedef enum {
 - (BOOL)filterAllowsMessage:(NSString *)msg level:(GMLoggerLevel)level;
 @end
 
+// A filter which decides by level and calling function alone. GMLogger asks it
+// before formatting the message (and the macros cache its answers), and then
+// doesn't call -filterAllowsMessage:level:. Call GMLoggerInvalidateLevels()
+// when the answers change.
+@protocol GMLogFuncLevelFilter <GMLogFilter>
+// The lowest level let through from |func|, which may be NULL.
+- (GMLoggerLevel)minimumLevelForFunc:(const char *)func;
+@end
+
 // A log filter that filters messages at the kGMLoggerLevelDebug level out of
 // non-debug builds. Messages at the kGMLoggerLevelInfo level are also filtered out
 // of non-debug builds unless GMVerboseLogging is set in the environment or the
 // processes's defaults. Messages at the kGMLoggerLevelError level are never
-// filtered.
-@interface GMLogLevelFilter : NSObject <GMLogFilter>
+// filtered. All of this can be changed per class or function, and at runtime,
+// through GMLogLevelControl, which works out (and caches) the levels.
+@interface GMLogLevelFilter : NSObject <GMLogFuncLevelFilter>
 @end
 
 // A simple log filter that does NOT filter anything out;
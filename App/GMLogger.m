@@ -14,11 +14,15 @@ limitations under the License.
 */
 
 #import "GMLogger.h"
+#import "GMLogLevelControl.h"
 #import <fcntl.h>
 #import <unistd.h>
 #import <stdlib.h>
 #import <asl.h>
 #import <pthread.h>
+#import <libkern/OSAtomic.h>
+#import <sys/time.h>
+#import <time.h>
 
 // We define a trivial assertion macro here to avoid the dependency on GMLog
 #ifdef DEBUG
@@ -38,6 +42,23 @@ limitations under the License.
 // an easy reference to one shared instance.
 static GMLogger *gSharedLogger = nil;
 
+// Starts at 1 so that a zeroed GMLoggerSite is always out of date.
+volatile int32_t GMLoggerLevelGeneration = 1;
+
+void GMLoggerInvalidateLevels(void) {
+  OSAtomicIncrement32Barrier(&GMLoggerLevelGeneration);
+}
+
+int32_t GMLoggerRefreshSite(GMLoggerSite *site, const char *func) {
+  // Read the generation first: if it moves on while we work, the state we
+  // store is already stale and the next call asks again.
+  int32_t generation = GMLoggerLevelGeneration;
+  int level = [[GMLogger sharedLogger] minimumLevelForFunc:func];
+  int32_t state = (generation << 4) | (level & 0xF);
+  site->state = state;
+  return state;
+}
+
 @implementation GMLogger
 
 // Returns a pointer to the shared logger instance. If none exists, a standard
@@ -57,6 +78,7 @@ static GMLogger *gSharedLogger = nil;
     [gSharedLogger autorelease];
     gSharedLogger = [logger retain];
   }
+  GMLoggerInvalidateLevels();
 }
 
 + (id)standardLogger {
@@ -139,6 +161,8 @@ static GMLogger *gSharedLogger = nil;
       writer_ = [[NSFileHandle fileHandleWithStandardOutput] retain];
     else
       writer_ = [writer retain];
+    writerTakesRecords_ =
+      [writer_ conformsToProtocol:@protocol(GMLogRecordWriter)];
   }
   GMLOGGER_ASSERT(writer_ != nil);
 }
@@ -155,6 +179,9 @@ static GMLogger *gSharedLogger = nil;
       formatter_ = [[GMLogBasicFormatter alloc] init];
     else
       formatter_ = [formatter retain];
+    formatterTakesCFunc_ =
+      [formatter_ respondsToSelector:
+                    @selector(stringForCFunc:withFormat:valist:level:)];
   }
   GMLOGGER_ASSERT(formatter_ != nil);
 }
@@ -171,7 +198,10 @@ static GMLogger *gSharedLogger = nil;
       filter_ = [[GMLogNoFilter alloc] init];
     else
       filter_ = [filter retain];
+    filterTakesFuncs_ =
+      [filter_ conformsToProtocol:@protocol(GMLogFuncLevelFilter)];
   }
+  GMLoggerInvalidateLevels();
   GMLOGGER_ASSERT(filter_ != nil);
 }
 
@@ -236,6 +266,12 @@ static GMLogger *gSharedLogger = nil;
   va_end(args);
 }
 
+- (int)minimumLevelForFunc:(const char *)func {
+  if (!filterTakesFuncs_)
+    return kGMLoggerLevelUnknown;
+  return [(id<GMLogFuncLevelFilter>)filter_ minimumLevelForFunc:func];
+}
+
 @end  // GMLoggerMacroHelpers
 
 
@@ -248,12 +284,38 @@ static GMLogger *gSharedLogger = nil;
   GMLOGGER_ASSERT(filter_ != nil);
   GMLOGGER_ASSERT(writer_ != nil);
 
-  NSString *fname = func ? [NSString stringWithUTF8String:func] : nil;
-  NSString *msg = [formatter_ stringForFunc:fname
-                                 withFormat:fmt
-                                     valist:args
-                                      level:level];
-  if (msg && [filter_ filterAllowsMessage:msg level:level])
+  // Level-only filters are asked before any formatting.
+  BOOL filtered = NO;
+  if (filterTakesFuncs_) {
+    id<GMLogFuncLevelFilter> filter = (id<GMLogFuncLevelFilter>)filter_;
+    if (level < [filter minimumLevelForFunc:func])
+      return;
+    filtered = YES;
+  }
+
+  if (writerTakesRecords_) {
+    if (filtered || [filter_ filterAllowsMessage:fmt level:level])
+      [(id<GMLogRecordWriter>)writer_ logFunc:func
+                                       format:fmt
+                                       valist:args
+                                        level:level];
+    return;
+  }
+
+  NSString *msg = nil;
+  if (formatterTakesCFunc_) {
+    msg = [(GMLogStandardFormatter *)formatter_ stringForCFunc:func
+                                                    withFormat:fmt
+                                                        valist:args
+                                                         level:level];
+  } else {
+    NSString *fname = func ? [NSString stringWithUTF8String:func] : nil;
+    msg = [formatter_ stringForFunc:fname
+                         withFormat:fmt
+                             valist:args
+                              level:level];
+  }
+  if (msg && (filtered || [filter_ filterAllowsMessage:msg level:level]))
     [writer_ logMessage:msg level:level];
 }
 @end  // PrivateMethods
@@ -415,33 +477,177 @@ static GMLogger *gSharedLogger = nil;
 @end  // GMLogBasicFormatter
 
 
+// Per-thread scratch space for GMLogStandardFormatter, so formatting takes no
+// locks and (once the buffer has grown) allocates nothing.
+typedef struct GMLogLineBuffer {
+  char *bytes;
+  size_t length;
+  size_t capacity;
+  time_t second;     // when |stamp| was formatted
+  char stamp[32];    // "yyyy-MM-dd HH:mm:ss."
+  size_t stampLength;
+} GMLogLineBuffer;
+
+static pthread_key_t gLineBufferKey;
+static pthread_once_t gLineBufferOnce = PTHREAD_ONCE_INIT;
+
+static void GMLogLineBufferFree(void *arg) {
+  GMLogLineBuffer *buffer = arg;
+  free(buffer->bytes);
+  free(buffer);
+}
+
+static void GMLogLineBufferMakeKey(void) {
+  pthread_key_create(&gLineBufferKey, GMLogLineBufferFree);
+}
+
+static GMLogLineBuffer *GMLogLineBufferForThread(void) {
+  pthread_once(&gLineBufferOnce, GMLogLineBufferMakeKey);
+  GMLogLineBuffer *buffer = pthread_getspecific(gLineBufferKey);
+  if (buffer == NULL) {
+    buffer = calloc(1, sizeof(GMLogLineBuffer));
+    buffer->second = -1;
+    pthread_setspecific(gLineBufferKey, buffer);
+  }
+  return buffer;
+}
+
+// Makes room for |more| bytes after buffer->length.
+static char *GMLogLineBufferReserve(GMLogLineBuffer *buffer, size_t more) {
+  if (buffer->length + more > buffer->capacity) {
+    size_t capacity = buffer->capacity ? buffer->capacity : 256;
+    while (capacity < buffer->length + more)
+      capacity *= 2;
+    char *bytes = realloc(buffer->bytes, capacity);
+    if (bytes == NULL)
+      return NULL;
+    buffer->bytes = bytes;
+    buffer->capacity = capacity;
+  }
+  return buffer->bytes + buffer->length;
+}
+
+static void GMLogLineBufferAppend(GMLogLineBuffer *buffer,
+                                  const char *bytes, size_t length) {
+  char *dest = GMLogLineBufferReserve(buffer, length);
+  if (dest) {
+    memcpy(dest, bytes, length);
+    buffer->length += length;
+  }
+}
+
+// Appends |string| as UTF-8 without making an intermediate copy.
+static void GMLogLineBufferAppendString(GMLogLineBuffer *buffer,
+                                        CFStringRef string) {
+  CFIndex chars = CFStringGetLength(string);
+  CFIndex max = CFStringGetMaximumSizeForEncoding(chars, kCFStringEncodingUTF8);
+  char *dest = GMLogLineBufferReserve(buffer, max);
+  if (dest == NULL)
+    return;
+  CFIndex used = 0;
+  CFStringGetBytes(string, CFRangeMake(0, chars), kCFStringEncodingUTF8, '?',
+                   false, (UInt8 *)dest, max, &used);
+  buffer->length += used;
+}
+
 @implementation GMLogStandardFormatter
 
 - (id)init {
   if ((self = [super init])) {
-    dateFormatter_ = [[NSDateFormatter alloc] init];
-    [dateFormatter_ setFormatterBehavior:NSDateFormatterBehavior10_4];
-    [dateFormatter_ setDateFormat:@"yyyy-MM-dd HH:mm:ss.SSS"];
+    NSProcessInfo *pinfo = [NSProcessInfo processInfo];
+    NSString *prefix = [NSString stringWithFormat:@"%@[%d/",
+                        [pinfo processName], [pinfo processIdentifier]];
+    const char *utf8 = [prefix UTF8String];
+    processPrefixLength_ = strlen(utf8);
+    processPrefix_ = malloc(processPrefixLength_ + 1);
+    memcpy(processPrefix_, utf8, processPrefixLength_ + 1);
   }
   return self;
 }
 
 - (void)dealloc {
-  [dateFormatter_ release];
+  free(processPrefix_);
   [super dealloc];
 }
 
+- (const char *)bytesForCFunc:(const char *)func
+                   withFormat:(NSString *)fmt
+                       valist:(va_list)args
+                        level:(GMLoggerLevel)level
+                       length:(size_t *)length {
+  GMLOGGER_ASSERT(processPrefix_ != NULL);
+  GMLogLineBuffer *buffer = GMLogLineBufferForThread();
+  buffer->length = 0;
+
+  // 2007-12-30 10:29:24.177 -- only the milliseconds change every time.
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  if (now.tv_sec != buffer->second) {
+    struct tm local;
+    localtime_r(&now.tv_sec, &local);
+    buffer->stampLength = strftime(buffer->stamp, sizeof(buffer->stamp),
+                                   "%Y-%m-%d %H:%M:%S.", &local);
+    buffer->second = now.tv_sec;
+  }
+  GMLogLineBufferAppend(buffer, buffer->stamp, buffer->stampLength);
+  char scratch[64];
+  int count = snprintf(scratch, sizeof(scratch), "%03d ",
+                       (int)(now.tv_usec / 1000));
+  GMLogLineBufferAppend(buffer, scratch, count);
+
+  // myapp[4588/0xa07d0f60] [lvl=1] func
+  GMLogLineBufferAppend(buffer, processPrefix_, processPrefixLength_);
+  count = snprintf(scratch, sizeof(scratch), "%p] [lvl=%d] ",
+                   pthread_self(), level);
+  GMLogLineBufferAppend(buffer, scratch, count);
+  const char *fname = func ? func : "(no func)";
+  GMLogLineBufferAppend(buffer, fname, strlen(fname));
+  GMLogLineBufferAppend(buffer, " ", 1);
+
+  // The message. Without a '%' there's nothing to format.
+  if (fmt == nil) {
+    // Nothing to append.
+  } else if ([fmt rangeOfString:@"%"].location == NSNotFound) {
+    GMLogLineBufferAppendString(buffer, (CFStringRef)fmt);
+  } else {
+    CFStringRef cfmsg =
+      CFStringCreateWithFormatAndArguments(kCFAllocatorDefault, NULL,
+                                           (CFStringRef)fmt, args);
+    if (cfmsg) {
+      GMLogLineBufferAppendString(buffer, cfmsg);
+      CFRelease(cfmsg);
+    }
+  }
+
+  *length = buffer->length;
+  return buffer->bytes;
+}
+
+- (NSString *)stringForCFunc:(const char *)func
+                  withFormat:(NSString *)fmt
+                      valist:(va_list)args
+                       level:(GMLoggerLevel)level {
+  size_t length = 0;
+  const char *bytes = [self bytesForCFunc:func
+                               withFormat:fmt
+                                   valist:args
+                                    level:level
+                                   length:&length];
+  if (bytes == NULL)
+    return nil;
+  return [[[NSString alloc] initWithBytes:bytes
+                                   length:length
+                                 encoding:NSUTF8StringEncoding] autorelease];
+}
+
 - (NSString *)stringForFunc:(NSString *)func
                  withFormat:(NSString *)fmt
                      valist:(va_list)args
                       level:(GMLoggerLevel)level {
-  GMLOGGER_ASSERT(dateFormatter_ != nil);
-  NSString *tstamp = [dateFormatter_ stringFromDate:[NSDate date]];
-  NSProcessInfo *pinfo = [NSProcessInfo processInfo];
-  return [NSString stringWithFormat:@"%@ %@[%d/%p] [lvl=%d] %@ %@", tstamp,
-          [pinfo processName], [pinfo processIdentifier], pthread_self(),
-          level, (func ? func : @"(no func)"),
-          [super stringForFunc:func withFormat:fmt valist:args level:level]];
+  return [self stringForCFunc:(func ? [func UTF8String] : NULL)
+                   withFormat:fmt
+                       valist:args
+                        level:level];
 }
 
 @end  // GMLogStandardFormatter
@@ -449,48 +655,12 @@ static GMLogger *gSharedLogger = nil;
 
 @implementation GMLogLevelFilter
 
-// Check the environment and the user preferences for the GMVerboseLogging key
-// to see if verbose logging has been enabled. The environment variable will
-// override the defaults setting, so check the environment first.
-static BOOL IsVerboseLoggingEnabled(void) {
-  static NSString *const kVerboseLoggingKey = @"GMVerboseLogging";
-
-  const char *env = getenv([kVerboseLoggingKey UTF8String]);
-  if (env && env[0]) {
-    return (strtol(env, NULL, 10) != 0);
-  }
-
-  return [[NSUserDefaults standardUserDefaults] boolForKey:kVerboseLoggingKey];
+- (GMLoggerLevel)minimumLevelForFunc:(const char *)func {
+  return [[GMLogLevelControl sharedControl] minimumLevelForFunc:func];
 }
 
-// In DEBUG builds, log everything. If we're not in a debug build we'll assume
-// that we're in a Release build.
 - (BOOL)filterAllowsMessage:(NSString *)msg level:(GMLoggerLevel)level {
-#if DEBUG
-  return YES;
-#endif
-
-  BOOL allow = YES;
-
-  switch (level) {
-    case kGMLoggerLevelDebug:
-      allow = NO;
-      break;
-    case kGMLoggerLevelInfo:
-      allow = (IsVerboseLoggingEnabled() == YES);
-      break;
-    case kGMLoggerLevelError:
-      allow = YES;
-      break;
-    case kGMLoggerLevelAssert:
-      allow = YES;
-      break;
-    default:
-      allow = YES;
-      break;
-  }
-
-  return allow;
+  return level >= [self minimumLevelForFunc:NULL];
 }
 
 @end  // GMLogLevelFilter
@@ -0,0 +1,226 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import <SenTestingKit/SenTestingKit.h>
+#import <Cocoa/Cocoa.h>
+#include <pthread.h>
+#import "GMLogger.h"
+#import "GMLoggerTest.h"
+
+// Remembers the last message it was asked to write.
+@interface GMLogLastMessageWriter : NSObject <GMLogWriter> {
+ @private
+  NSString *last_;
+}
+- (NSString *)last;
+@end
+
+@implementation GMLogLastMessageWriter
+
+- (void)dealloc {
+  [last_ release];
+  [super dealloc];
+}
+
+- (void)logMessage:(NSString *)msg level:(GMLoggerLevel)level {
+  [last_ autorelease];
+  last_ = [msg copy];
+}
+
+- (NSString *)last {
+  return last_;
+}
+
+@end
+
+// The old, NSDateFormatter-based GMLogStandardFormatter, for comparison.
+@interface GMLogOldStandardFormatter : GMLogBasicFormatter {
+ @private
+  NSDateFormatter *dateFormatter_;
+}
+@end
+
+@implementation GMLogOldStandardFormatter
+
+- (id)init {
+  if ((self = [super init])) {
+    dateFormatter_ = [[NSDateFormatter alloc] init];
+    [dateFormatter_ setFormatterBehavior:NSDateFormatterBehavior10_4];
+    [dateFormatter_ setDateFormat:@"yyyy-MM-dd HH:mm:ss.SSS"];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [dateFormatter_ release];
+  [super dealloc];
+}
+
+- (NSString *)stringForFunc:(NSString *)func
+                 withFormat:(NSString *)fmt
+                     valist:(va_list)args
+                      level:(GMLoggerLevel)level {
+  NSString *tstamp = [dateFormatter_ stringFromDate:[NSDate date]];
+  NSProcessInfo *pinfo = [NSProcessInfo processInfo];
+  return [NSString stringWithFormat:@"%@ %@[%d/%p] [lvl=%d] %@ %@", tstamp,
+          [pinfo processName], [pinfo processIdentifier], pthread_self(),
+          level, (func ? func : @"(no func)"),
+          [super stringForFunc:func withFormat:fmt valist:args level:level]];
+}
+
+@end
+
+@implementation GMLoggerTest
+
+- (NSString *)format:(id<GMLogFormatter>)formatter
+                func:(NSString *)func
+               level:(GMLoggerLevel)level
+              format:(NSString *)fmt, ... {
+  va_list args;
+  va_start(args, fmt);
+  NSString *msg = [formatter stringForFunc:func
+                                withFormat:fmt
+                                    valist:args
+                                     level:level];
+  va_end(args);
+  return msg;
+}
+
+- (void)testStandardFormat {
+  GMLogStandardFormatter *formatter = [[[GMLogStandardFormatter alloc] init]
+                                        autorelease];
+  NSString *msg = [self format:formatter
+                          func:@"-[Foo bar]"
+                         level:kGMLoggerLevelError
+                        format:@"%d apples and %@", 3, @"pears"];
+  NSProcessInfo *pinfo = [NSProcessInfo processInfo];
+  NSString *expected = [NSString stringWithFormat:
+                        @" %@[%d/%p] [lvl=%d] -[Foo bar] 3 apples and pears",
+                        [pinfo processName], [pinfo processIdentifier],
+                        pthread_self(), kGMLoggerLevelError];
+  STAssertTrue([msg hasSuffix:expected], msg);
+
+  // 2007-12-30 10:29:24.177, parseable the way the old formatter wrote it.
+  NSString *stamp = [msg substringToIndex:23];
+  NSDateFormatter *dateFormatter = [[[NSDateFormatter alloc] init] autorelease];
+  [dateFormatter setFormatterBehavior:NSDateFormatterBehavior10_4];
+  [dateFormatter setDateFormat:@"yyyy-MM-dd HH:mm:ss.SSS"];
+  NSDate *date = [dateFormatter dateFromString:stamp];
+  STAssertNotNil(date, stamp);
+  STAssertTrue(fabs([date timeIntervalSinceNow]) < 5, stamp);
+  STAssertEquals([msg length], 23 + [expected length], msg);
+
+  // The same as the old formatter, give or take the clock.
+  GMLogOldStandardFormatter *old = [[[GMLogOldStandardFormatter alloc] init]
+                                     autorelease];
+  NSString *oldMsg = [self format:old
+                             func:@"-[Foo bar]"
+                            level:kGMLoggerLevelError
+                           format:@"%d apples and %@", 3, @"pears"];
+  STAssertEqualObjects([oldMsg substringFromIndex:23],
+                       [msg substringFromIndex:23], nil);
+}
+
+- (void)testNoFunc {
+  GMLogStandardFormatter *formatter = [[[GMLogStandardFormatter alloc] init]
+                                        autorelease];
+  NSString *msg = [self format:formatter
+                          func:nil
+                         level:kGMLoggerLevelInfo
+                        format:@"no percent here"];
+  STAssertTrue([msg hasSuffix:@"[lvl=2] (no func) no percent here"], msg);
+}
+
+- (void)testNonASCII {
+  GMLogStandardFormatter *formatter = [[[GMLogStandardFormatter alloc] init]
+                                        autorelease];
+  NSString *word = [NSString stringWithUTF8String:"caf\xc3\xa9 \xe2\x98\x83"];
+  NSString *msg = [self format:formatter
+                          func:@"f"
+                         level:kGMLoggerLevelInfo
+                        format:@"%@!", word];
+  STAssertTrue([msg hasSuffix:[word stringByAppendingString:@"!"]], msg);
+  // A long one, to make the buffer grow.
+  NSMutableString *longWord = [NSMutableString string];
+  for (int i = 0; i < 1000; i++)
+    [longWord appendString:word];
+  msg = [self format:formatter
+                func:@"f"
+               level:kGMLoggerLevelInfo
+              format:longWord];
+  STAssertTrue([msg hasSuffix:longWord], nil);
+}
+
+- (void)testSameSecond {
+  // The cached second must not leak into the next one.
+  GMLogStandardFormatter *formatter = [[[GMLogStandardFormatter alloc] init]
+                                        autorelease];
+  NSString *first = [self format:formatter
+                            func:@"f"
+                           level:kGMLoggerLevelInfo
+                          format:@"x"];
+  usleep(1100 * 1000);
+  NSString *second = [self format:formatter
+                             func:@"f"
+                            level:kGMLoggerLevelInfo
+                           format:@"x"];
+  STAssertFalse([[first substringToIndex:19]
+                 isEqualToString:[second substringToIndex:19]], nil);
+}
+
+- (void)testLoggerUsesCFunc {
+  GMLogLastMessageWriter *writer = [[[GMLogLastMessageWriter alloc] init]
+                                     autorelease];
+  GMLogger *logger =
+    [GMLogger loggerWithWriter:writer
+                     formatter:[[[GMLogStandardFormatter alloc] init]
+                                 autorelease]
+                        filter:[[[GMLogNoFilter alloc] init] autorelease]];
+  [logger logFuncInfo:"-[Foo baz]" msg:@"hello %d", 42];
+  STAssertTrue([[writer last] hasSuffix:@"-[Foo baz] hello 42"], [writer last]);
+
+  // Formatters without the C string entry point still work.
+  [logger setFormatter:[[[GMLogBasicFormatter alloc] init] autorelease]];
+  [logger logFuncInfo:"-[Foo baz]" msg:@"hello %d", 43];
+  STAssertEqualObjects([writer last], @"hello 43", nil);
+}
+
+// Cost per line of the old and new standard formatters.
+- (void)testBenchmark {
+  static const int kLines = 20000;
+  GMLogStandardFormatter *formatter = [[[GMLogStandardFormatter alloc] init]
+                                        autorelease];
+  GMLogOldStandardFormatter *old = [[[GMLogOldStandardFormatter alloc] init]
+                                     autorelease];
+  NSTimeInterval times[2];
+  id<GMLogFormatter> formatters[2] = { old, formatter };
+  for (int f = 0; f < 2; f++) {
+    NSDate *start = [NSDate date];
+    for (int i = 0; i < kLines; i++) {
+      NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+      [self format:formatters[f]
+              func:@"-[MBTaskArrayController run:]"
+             level:kGMLoggerLevelInfo
+            format:@"line %d of %@", i, @"output"];
+      [pool release];
+    }
+    times[f] = -[start timeIntervalSinceNow];
+  }
+  NSLog(@"GMLogStandardFormatter: %.2fus per line before, %.2fus after",
+        times[0] * 1e6 / kLines, times[1] * 1e6 / kLines);
+  STAssertTrue(times[1] < times[0], nil);
+}
+
+@end
@@ -13,6 +13,8 @@ See the License for the specific language governing permissions and
 limitations under the License.
 */
 
+#import <Cocoa/Cocoa.h>
+#import <pthread.h>
 #import "GMLogger.h"
 
 // Traditionally, assert failure means app death.  In this spirit,
@@ -22,9 +24,15 @@ limitations under the License.
 // unfriendly.  This class is a replacement for GMLogger's
 // GMLogWriter, which allows us (for example) to intercept a
 // GMAssert's log.  Once we have it, we can display a dialog informing
-// the user of the fatal error and imminent app death.  This class
-// also displays GMLogger error-level messages in a dialog but (unlike
-// asserts) errors do not cause us to terminate the app.
+// the user of the fatal error and imminent app death.
+//
+// This class also displays GMLogger error-level messages but (unlike
+// asserts) errors do not cause us to terminate the app, so they don't
+// stop it either.  Errors are queued from any thread and shown together
+// in one non-modal panel on the next pass of the main run loop; identical
+// messages are shown once, with a count.  A burst of errors (say, every
+// project failing verification) is one panel, and task output keeps
+// flowing while it's up.  Closing the panel forgets the errors shown.
 @interface MBAlertWriter : NSObject <GMLogWriter> {
  @private
   // We save the original log writer so we can call it for non-aborts.
@@ -33,6 +41,19 @@ limitations under the License.
   // preallocate an alert to help minimize the chance we hit more
   // problems before death.
   NSAlert *alert_;
+
+  // Errors logged but not yet shown, and whether the main thread has
+  // been asked to show them.  Guarded by |lock_|.
+  pthread_mutex_t lock_;
+  NSMutableArray *pendingErrors_;
+  BOOL showScheduled_;
+
+  // Main thread only.
+  NSMutableArray *errors_;       // distinct messages, oldest first
+  NSCountedSet *errorCounts_;
+  unsigned droppedErrors_;       // distinct messages past the limit
+  NSPanel *errorPanel_;
+  NSTextView *errorText_;
 }
 
 // Install an MBAlertWriter as the GMLogger's default log writer.
@@ -42,18 +63,32 @@ limitations under the License.
 // if we chose to not intercept this message (e.g. if it's not an
 // alert or error message).  If |w| is nil, use the [GMLogger
 // sharedLogger]'s current writer.  |alert| is an allocated NSAlert
-// object to be used to display an error or alert message.  If |alert|
+// object to be used to display an assert message.  If |alert|
 // is nil, create an NSAlert.
 - (id)initWithOriginalWriter:(id<GMLogWriter>)w alert:(NSAlert *)alert;
 
 // Using our alert_ member, configure it with |title| and |msg| and
-// run it modally.  We currently do not support a "continue anyway"
-// mechanism for alerts, or a "stop telling me" mechanism for error
-// messages.
+// run it modally.  Only used for asserts.  We currently do not support
+// a "continue anyway" mechanism for alerts.
 - (void)alertWithTitle:(NSString *)title message:(NSString *)msg;
 
 // MBAlertWriter will call this method when it wants to terminate.
 - (void)terminate;
 
-@end
+// The errors being shown, oldest first, each once.  Main thread only.
+- (NSArray *)errors;
+
+// How many times |msg| has been logged since the panel was last closed.
+- (unsigned)countForError:(NSString *)msg;
 
+// The text of the error panel.
+- (NSString *)errorSummary;
+
+// Shows (or updates) the error panel without making it modal.  Called on
+// the main thread after new errors arrive.
+- (void)showErrorPanel;
+
+// Forgets the errors shown and closes the panel.
+- (void)clearErrors;
+
+@end
@@ -14,15 +14,34 @@ limitations under the License.
 */
 
 #import "MBAlertWriter.h"
+#import "GMLogAsyncWriter.h"
+#import "MBStallWatchdog.h"
+#import "MBStartupTrace.h"
 
+// Distinct errors kept for the panel; any more are only counted.
+static const unsigned kMaxErrors = 50;
+
+@interface MBAlertWriter (PrivateMethods)
+- (void)queueError:(NSString *)msg;
+- (void)showPendingErrors;
+- (void)forgetErrors;
+- (void)createErrorPanel;
+@end
 
 @implementation MBAlertWriter
 
 static BOOL gInstalled = NO;
 + (void)install {
+  MB_TRACE_SCOPE(__func__);
   @synchronized(self) {
     if (gInstalled == NO) {
-       MBAlertWriter *writer = [[[MBAlertWriter alloc] init] autorelease];
+      // Errors and asserts are shown here and now; everything else
+      // goes to the original writer without waiting on its I/O.
+      id<GMLogWriter> original = [GMLogAsyncWriter writerWithWriter:
+                                                     [[GMLogger sharedLogger] writer]];
+      MBAlertWriter *writer = [[[MBAlertWriter alloc] initWithOriginalWriter:original
+                                                                       alert:nil]
+                                autorelease];
       [[GMLogger sharedLogger] setWriter:writer];
 
       // For a GUI app displaying an error dialog, we simply don't care
@@ -49,6 +68,10 @@ static BOOL gInstalled = NO;
     }
     originalWriter_ = [w retain];
     alert_ = [alert retain];
+    pthread_mutex_init(&lock_, NULL);
+    pendingErrors_ = [[NSMutableArray alloc] init];
+    errors_ = [[NSMutableArray alloc] init];
+    errorCounts_ = [[NSCountedSet alloc] init];
   }
   return self;
 }
@@ -57,13 +80,22 @@ static BOOL gInstalled = NO;
   [[GMLogger sharedLogger] setWriter:nil];  // can't be us anymore!
   [originalWriter_ release];
   [alert_ release];
+  [errorPanel_ setDelegate:nil];
+  [errorPanel_ close];
+  [errorPanel_ release];
+  [pendingErrors_ release];
+  [errors_ release];
+  [errorCounts_ release];
+  pthread_mutex_destroy(&lock_);
   [super dealloc];
 }
 
 - (void)alertWithTitle:(NSString *)title message:(NSString *)msg {
   [alert_ setMessageText:title];
   [alert_ setInformativeText:msg];
+  const char *previous = MBStallWatchdogSetAction(__func__);
   [alert_ runModal];
+  MBStallWatchdogSetAction(previous);
 }
 
 // Split out in a seperate method so it can be overridden for testing
@@ -71,14 +103,30 @@ static BOOL gInstalled = NO;
   [NSApp terminate:self];
 }
 
+// |args| is (message, level).
+- (void)logMessageOnMainThread:(NSArray *)args {
+  [self logMessage:[args objectAtIndex:0]
+             level:[[args objectAtIndex:1] intValue]];
+}
+
 - (void)logMessage:(NSString *)msg level:(GMLoggerLevel)level {
+  // Alerts are UI, and UI belongs on the main thread.  Asserts from
+  // worker threads (e.g. startup probes) wait for the user there.
+  if ((level == kGMLoggerLevelAssert) && !pthread_main_np()) {
+    NSArray *args = [NSArray arrayWithObjects:msg,
+                             [NSNumber numberWithInt:level], nil];
+    [self performSelectorOnMainThread:@selector(logMessageOnMainThread:)
+                           withObject:args
+                        waitUntilDone:YES];
+    return;
+  }
   switch (level) {
     case kGMLoggerLevelAssert:
       [self alertWithTitle:@"Fatal Error" message:msg];
       [self terminate];
       break;
     case kGMLoggerLevelError:
-      [self alertWithTitle:@"Error" message:msg];
+      [self queueError:msg];
       break;
     default:
       // TODO(jrg): perhaps use the original formatter as well?
@@ -87,4 +135,139 @@ static BOOL gInstalled = NO;
   }
 }
 
+- (NSArray *)errors {
+  return [[errors_ copy] autorelease];
+}
+
+- (unsigned)countForError:(NSString *)msg {
+  return [errorCounts_ countForObject:msg];
+}
+
+- (NSString *)errorSummary {
+  NSMutableString *summary = [NSMutableString string];
+  NSEnumerator *errorEnumerator = [errors_ objectEnumerator];
+  NSString *msg = nil;
+  while ((msg = [errorEnumerator nextObject])) {
+    if ([summary length])
+      [summary appendString:@"\n\n"];
+    [summary appendString:msg];
+    unsigned count = [errorCounts_ countForObject:msg];
+    if (count > 1)
+      [summary appendFormat:@" (%u times)", count];
+  }
+  if (droppedErrors_)
+    [summary appendFormat:@"\n\n...and %u more.", droppedErrors_];
+  return summary;
+}
+
+- (void)showErrorPanel {
+  if (errorPanel_ == nil)
+    [self createErrorPanel];
+  NSString *title = ([errors_ count] + droppedErrors_ == 1) ?
+    @"Error" : @"Errors";
+  [errorPanel_ setTitle:title];
+  [errorText_ setString:[self errorSummary]];
+  [errorText_ scrollRangeToVisible:
+                NSMakeRange([[errorText_ string] length], 0)];
+  [errorPanel_ orderFront:self];
+}
+
+- (void)clearErrors {
+  [self forgetErrors];
+  [errorPanel_ orderOut:self];
+}
+
+// NSWindow delegate
+- (void)windowWillClose:(NSNotification *)notification {
+  if ([notification object] == errorPanel_)
+    [self forgetErrors];
+}
+
 @end
+
+
+@implementation MBAlertWriter (PrivateMethods)
+
+// Any thread.  Only the first error of a burst asks the main thread to
+// show them; the rest join it.
+- (void)queueError:(NSString *)msg {
+  BOOL schedule = NO;
+  pthread_mutex_lock(&lock_);
+  [pendingErrors_ addObject:msg];
+  if (!showScheduled_) {
+    showScheduled_ = YES;
+    schedule = YES;
+  }
+  pthread_mutex_unlock(&lock_);
+  if (schedule) {
+    // Modal panels and menu tracking shouldn't hold errors back.
+    NSArray *modes = [NSArray arrayWithObjects:NSDefaultRunLoopMode,
+                              NSModalPanelRunLoopMode,
+                              NSEventTrackingRunLoopMode, nil];
+    [self performSelectorOnMainThread:@selector(showPendingErrors)
+                           withObject:nil
+                        waitUntilDone:NO
+                                modes:modes];
+  }
+}
+
+- (void)showPendingErrors {
+  pthread_mutex_lock(&lock_);
+  NSArray *pending = [[pendingErrors_ copy] autorelease];
+  [pendingErrors_ removeAllObjects];
+  showScheduled_ = NO;
+  pthread_mutex_unlock(&lock_);
+
+  NSEnumerator *errorEnumerator = [pending objectEnumerator];
+  NSString *msg = nil;
+  while ((msg = [errorEnumerator nextObject])) {
+    if ([errorCounts_ countForObject:msg] == 0) {
+      if ([errors_ count] >= kMaxErrors) {
+        droppedErrors_++;
+        continue;
+      }
+      [errors_ addObject:msg];
+    }
+    [errorCounts_ addObject:msg];
+  }
+  if ([pending count])
+    [self showErrorPanel];
+}
+
+- (void)forgetErrors {
+  [errors_ removeAllObjects];
+  [errorCounts_ release];
+  errorCounts_ = [[NSCountedSet alloc] init];
+  droppedErrors_ = 0;
+}
+
+- (void)createErrorPanel {
+  NSRect frame = NSMakeRect(0, 0, 480, 240);
+  errorPanel_ = [[NSPanel alloc]
+                  initWithContentRect:frame
+                            styleMask:(NSTitledWindowMask |
+                                       NSClosableWindowMask |
+                                       NSResizableWindowMask)
+                              backing:NSBackingStoreBuffered
+                                defer:YES];
+  [errorPanel_ setReleasedWhenClosed:NO];
+  [errorPanel_ setHidesOnDeactivate:NO];
+  [errorPanel_ setDelegate:self];
+
+  NSScrollView *scroller = [[[NSScrollView alloc] initWithFrame:frame]
+                             autorelease];
+  [scroller setHasVerticalScroller:YES];
+  [scroller setAutoresizingMask:(NSViewWidthSizable | NSViewHeightSizable)];
+  NSSize size = [scroller contentSize];
+  errorText_ = [[[NSTextView alloc]
+                  initWithFrame:NSMakeRect(0, 0, size.width, size.height)]
+                 autorelease];
+  [errorText_ setEditable:NO];
+  [errorText_ setAutoresizingMask:NSViewWidthSizable];
+  [errorText_ setTextContainerInset:NSMakeSize(8, 8)];
+  [scroller setDocumentView:errorText_];  // retains it
+  [errorPanel_ setContentView:scroller];
+  [errorPanel_ center];
+}
+
+@end  // PrivateMethods
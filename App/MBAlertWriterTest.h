@@ -20,6 +20,8 @@ limitations under the License.
 
 - (void)testInit;
 - (void)testAlerts;
+- (void)testCoalescing;
+- (void)testErrorLimit;
 - (void)testInstall;
 
 @end
@@ -46,13 +46,16 @@ limitations under the License.
 @end
 
 /* -------------------------------------------------------- */
-// Subclass of MBAlertWriter which records a BOOL instead of terminating
+// Subclass of MBAlertWriter which records a BOOL instead of terminating,
+// and counts error panels instead of showing them
 @interface MBFakeAlertWriter : MBAlertWriter {
  @private
   BOOL didTerminate_;
+  int panelShows_;
 }
 - (BOOL)didTerminate;
 - (void)clearTerminate;
+- (int)panelShows;
 @end
 
 @implementation MBFakeAlertWriter
@@ -70,12 +73,34 @@ limitations under the License.
   didTerminate_ = NO;
 }
 
+// override
+- (void)showErrorPanel {
+  panelShows_++;
+}
+
+- (int)panelShows {
+  return panelShows_;
+}
+
 @end  // MBFakeAlertWriter
 
 /* -------------------------------------------------------- */
 
 @implementation MBAlertWriterTest
 
+// Errors are shown on the next pass of the run loop.
+- (void)runLoop {
+  [[NSRunLoop currentRunLoop]
+    runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+}
+
+- (void)logErrorsOnThread:(MBAlertWriter *)writer {
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  for (int i = 0; i < 3; i++)
+    [writer logMessage:@"from a thread" level:kGMLoggerLevelError];
+  [pool release];
+}
+
 - (void)testInit {
   MBAlertWriter *w = [[MBAlertWriter alloc] init];
   STAssertNotNil(w, nil);
@@ -112,13 +137,15 @@ limitations under the License.
   STAssertTrue([alert didRunModal] == NO, nil);
   STAssertTrue([writer didTerminate] == NO, nil);
 
+  // Errors don't block: they wait for the run loop, then get a panel.
   GMLoggerError(@"error");
-  STAssertTrue([alert didRunModal] == YES, nil);
-  STAssertTrue([writer didTerminate] == NO, nil);
-  
-  [alert clearRunModal];
   STAssertTrue([alert didRunModal] == NO, nil);
   STAssertTrue([writer didTerminate] == NO, nil);
+  STAssertEquals([writer panelShows], 0, nil);
+  [self runLoop];
+  STAssertEquals([writer panelShows], 1, nil);
+  STAssertEquals([[writer errors] count], (unsigned)1, nil);
+  STAssertTrue([alert didRunModal] == NO, nil);
 
   GMLoggerAssert(@"assert");
   STAssertTrue([alert didRunModal] == YES, nil);
@@ -128,6 +155,63 @@ limitations under the License.
   [writer release];
 }
 
+- (void)testCoalescing {
+  MBFakeAlertWriter *writer = [[[MBFakeAlertWriter alloc]
+                                 initWithOriginalWriter:nil
+                                                  alert:[[[MBFakeAlert alloc]
+                                                           init] autorelease]]
+                                autorelease];
+  for (int i = 0; i < 5; i++)
+    [writer logMessage:@"Project foo failed to verify" level:kGMLoggerLevelError];
+  [writer logMessage:@"Project bar failed to verify" level:kGMLoggerLevelError];
+  [NSThread detachNewThreadSelector:@selector(logErrorsOnThread:)
+                           toTarget:self
+                         withObject:writer];
+  [NSThread sleepUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.2]];
+  [self runLoop];
+
+  // One panel for the lot.
+  STAssertEquals([writer panelShows], 1, nil);
+  NSArray *expected = [NSArray arrayWithObjects:
+                       @"Project foo failed to verify",
+                       @"Project bar failed to verify",
+                       @"from a thread", nil];
+  STAssertEqualObjects([writer errors], expected, nil);
+  STAssertEquals([writer countForError:@"Project foo failed to verify"],
+                 (unsigned)5, nil);
+  STAssertEquals([writer countForError:@"from a thread"], (unsigned)3, nil);
+  NSString *summary = [writer errorSummary];
+  STAssertTrue([summary rangeOfString:@"verify (5 times)"].location !=
+               NSNotFound, summary);
+
+  // More of the same while the panel is up add to it.
+  [writer logMessage:@"Project bar failed to verify" level:kGMLoggerLevelError];
+  [self runLoop];
+  STAssertEquals([writer panelShows], 2, nil);
+  STAssertEquals([[writer errors] count], (unsigned)3, nil);
+  STAssertEquals([writer countForError:@"Project bar failed to verify"],
+                 (unsigned)2, nil);
+
+  [writer clearErrors];
+  STAssertEquals([[writer errors] count], (unsigned)0, nil);
+  STAssertEquals([writer countForError:@"from a thread"], (unsigned)0, nil);
+}
+
+- (void)testErrorLimit {
+  MBFakeAlertWriter *writer = [[[MBFakeAlertWriter alloc]
+                                 initWithOriginalWriter:nil
+                                                  alert:[[[MBFakeAlert alloc]
+                                                           init] autorelease]]
+                                autorelease];
+  for (int i = 0; i < 60; i++)
+    [writer logMessage:[NSString stringWithFormat:@"error %d", i]
+                 level:kGMLoggerLevelError];
+  [self runLoop];
+  STAssertEquals([[writer errors] count], (unsigned)50, nil);
+  STAssertTrue([[writer errorSummary] hasSuffix:@"...and 10 more."],
+               [writer errorSummary]);
+}
+
 - (void)testInstall {
   id<GMLogWriter> w = [[GMLogger sharedLogger] writer];
   STAssertTrue([w isKindOfClass:[MBAlertWriter class]] == NO, nil);
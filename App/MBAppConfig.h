@@ -0,0 +1,54 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import <Foundation/Foundation.h>
+
+// An MBAppConfig is the parsed contents of a project's app.yaml (see
+// MBYamlParser).  It is immutable; an MBProject keeps one around
+// (until app.yaml changes on disk) so anything which wants to know
+// about a project's handlers, static files, etc. doesn't need to go
+// back to disk.
+@interface MBAppConfig : NSObject {
+ @private
+  NSDictionary *yaml_;
+}
+
+// Parse |data| (the contents of an app.yaml).  Returns nil if the
+// YAML can't be parsed or isn't a mapping.
++ (id)configWithData:(NSData *)data;
+
+// Read and parse the file at |path|.  Returns nil if the file can't
+// be read or parsed.
++ (id)configWithContentsOfFile:(NSString *)path;
+
+// Designated initializer.  |dict| is the top-level YAML mapping.
+- (id)initWithDictionary:(NSDictionary *)dict;
+
+// The complete parsed document.
+- (NSDictionary *)dictionary;
+
+// Top-level scalars.  Return nil if missing or not a scalar.
+- (NSString *)application;
+- (NSString *)version;
+- (NSString *)runtime;
+
+// The "handlers:" list, as an array of NSDictionaries (e.g. with
+// "url" and "script" or "static_dir" keys).  Never nil.
+- (NSArray *)handlers;
+
+// The static_dir of every handler which has one, in handler order.
+- (NSArray *)staticDirs;
+
+@end
@@ -0,0 +1,107 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import "MBAppConfig.h"
+#import "MBYamlParser.h"
+
+@implementation MBAppConfig
+
++ (id)configWithData:(NSData *)data {
+  if (data == nil)
+    return nil;
+  NSString *error = nil;
+  id yaml = [MBYamlParser parseData:data error:&error];
+  if ([yaml isKindOfClass:[NSDictionary class]] == NO) {
+    if (error)
+      GMLoggerInfo(@"Can't parse app.yaml: %@", error);
+    return nil;
+  }
+  return [[[self alloc] initWithDictionary:yaml] autorelease];
+}
+
++ (id)configWithContentsOfFile:(NSString *)path {
+  NSData *data = [[NSFileManager defaultManager] contentsAtPath:path];
+  return [self configWithData:data];
+}
+
+- (id)init {
+  return [self initWithDictionary:nil];
+}
+
+- (id)initWithDictionary:(NSDictionary *)dict {
+  if ((self = [super init])) {
+    yaml_ = dict ? [dict copy] : [[NSDictionary alloc] init];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [yaml_ release];
+  [super dealloc];
+}
+
+- (NSDictionary *)dictionary {
+  return [[yaml_ retain] autorelease];
+}
+
+// Return the top-level value for |key| if it is a non-empty string.
+- (NSString *)scalarForKey:(NSString *)key {
+  id value = [yaml_ objectForKey:key];
+  if ([value isKindOfClass:[NSString class]] && ([value length] > 0))
+    return value;
+  return nil;
+}
+
+- (NSString *)application {
+  return [self scalarForKey:@"application"];
+}
+
+- (NSString *)version {
+  return [self scalarForKey:@"version"];
+}
+
+- (NSString *)runtime {
+  return [self scalarForKey:@"runtime"];
+}
+
+- (NSArray *)handlers {
+  id handlers = [yaml_ objectForKey:@"handlers"];
+  if ([handlers isKindOfClass:[NSArray class]] == NO)
+    return [NSArray array];
+
+  // Skip anything malformed so callers can assume dictionaries.
+  NSMutableArray *array = [NSMutableArray arrayWithCapacity:[handlers count]];
+  NSEnumerator *henum = [handlers objectEnumerator];
+  id handler = nil;
+  while ((handler = [henum nextObject])) {
+    if ([handler isKindOfClass:[NSDictionary class]])
+      [array addObject:handler];
+  }
+  return array;
+}
+
+- (NSArray *)staticDirs {
+  NSMutableArray *dirs = [NSMutableArray array];
+  NSEnumerator *henum = [[self handlers] objectEnumerator];
+  NSDictionary *handler = nil;
+  while ((handler = [henum nextObject])) {
+    id dir = [handler objectForKey:@"static_dir"];
+    if ([dir isKindOfClass:[NSString class]])
+      [dirs addObject:dir];
+  }
+  return dirs;
+}
+
+@end
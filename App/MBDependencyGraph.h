@@ -0,0 +1,81 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import <Foundation/Foundation.h>
+#include <pthread.h>
+
+// Where a step runs.
+typedef enum {
+  // Cheap steps: run by the thread which called -run, while it waits.
+  kMBGraphStepCallerThread = 0,
+  // Steps which might put up UI.  Run by the calling thread if that's
+  // the main thread, else sent to the main thread.
+  kMBGraphStepMainThread,
+  // Slow steps (I/O, child processes) which are worth overlapping.
+  kMBGraphStepBackground
+} MBGraphStepThread;
+
+// An MBDependencyGraph runs a set of named steps, each of which may
+// depend on others.  A step starts as soon as everything it depends on
+// has finished.  Only background steps get a thread, and a thread
+// which finishes a step goes on to run a background step it made
+// ready, so a chain of slow steps runs on one thread and only steps
+// which really can overlap get another.
+//
+// -run blocks until all steps are done, waiting on a condition
+// variable; it does not run the run loop, so nothing else happens on
+// the calling thread meanwhile.  Don't call it on the main thread if a
+// background step might need the main thread (e.g. an assert alert
+// from MBAlertWriter); run the graph from a worker thread instead.
+//
+// The time each step took is recorded for logging.
+@interface MBDependencyGraph : NSObject {
+ @private
+  NSMutableArray *steps_;         // in the order added
+  NSMutableDictionary *byName_;   // name --> step
+  pthread_mutex_t lock_;          // protects what follows
+  pthread_cond_t changed_;        // a step finished or was queued
+  NSMutableArray *callerSteps_;   // ready, for the thread in -run
+  int remaining_;
+  BOOL callerIsMain_;
+  double wallTime_;
+}
+
+// Add a step which performs |selector| (which takes no args) on
+// |target|.  |dependencies| is an array of step names (which may be
+// added later, but must be added before -run).  Steps are retained
+// until the graph is released; so is |target|.
+- (void)addStep:(NSString *)name
+         target:(id)target
+       selector:(SEL)selector
+   dependencies:(NSArray *)dependencies
+         thread:(MBGraphStepThread)thread;
+
+// Run every step, respecting dependencies.  Returns NO (having run
+// nothing) if a dependency is unknown or the dependencies have a
+// cycle.  Only call once.
+- (BOOL)run;
+
+// After -run: step name --> NSNumber of seconds it took.
+- (NSDictionary *)timings;
+
+// After -run: elapsed time of the whole graph, in seconds.
+- (double)wallTime;
+
+// After -run: a one line summary for the log, e.g.
+// "python 0.010s, path 0.201s (wall 0.204s)".
+- (NSString *)timingSummary;
+
+@end
@@ -0,0 +1,298 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import "MBDependencyGraph.h"
+#import "MBStartupTrace.h"
+
+// One step of the graph.
+@interface MBGraphStep : NSObject {
+ @public
+  NSString *name_;
+  id target_;
+  SEL selector_;
+  NSArray *dependencies_;        // of NSString
+  NSMutableArray *dependents_;   // of MBGraphStep; not retained (cycles)
+  MBGraphStepThread thread_;
+  int waitingOn_;                // unfinished dependencies
+  double duration_;
+}
+@end
+
+@implementation MBGraphStep
+
+- (void)dealloc {
+  [name_ release];
+  [target_ release];
+  [dependencies_ release];
+  [dependents_ release];
+  [super dealloc];
+}
+
+@end
+
+
+@interface MBDependencyGraph (Private)
+- (BOOL)prepare;
+- (MBGraphStep *)schedule:(NSArray *)steps claim:(BOOL)claim;
+- (NSArray *)finishStep:(MBGraphStep *)step;
+- (void)performStep:(MBGraphStep *)step;
+- (void)runStepOnMainThread:(MBGraphStep *)step;
+- (void)runStepsInBackground:(MBGraphStep *)step;
+@end
+
+
+@implementation MBDependencyGraph
+
+- (id)init {
+  if ((self = [super init])) {
+    steps_ = [[NSMutableArray alloc] init];
+    byName_ = [[NSMutableDictionary alloc] init];
+    callerSteps_ = [[NSMutableArray alloc] init];
+    pthread_mutex_init(&lock_, NULL);
+    pthread_cond_init(&changed_, NULL);
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [steps_ release];
+  [byName_ release];
+  [callerSteps_ release];
+  pthread_cond_destroy(&changed_);
+  pthread_mutex_destroy(&lock_);
+  [super dealloc];
+}
+
+- (void)addStep:(NSString *)name
+         target:(id)target
+       selector:(SEL)selector
+   dependencies:(NSArray *)dependencies
+         thread:(MBGraphStepThread)thread {
+  GMAssert([byName_ objectForKey:name] == nil, @"Duplicate step %@", name);
+  MBGraphStep *step = [[[MBGraphStep alloc] init] autorelease];
+  step->name_ = [name copy];
+  step->target_ = [target retain];
+  step->selector_ = selector;
+  step->dependencies_ = [(dependencies ? dependencies : [NSArray array]) copy];
+  step->dependents_ = [[NSMutableArray alloc] init];
+  step->thread_ = thread;
+  [steps_ addObject:step];
+  [byName_ setObject:step forKey:name];
+}
+
+- (BOOL)run {
+  if ([self prepare] == NO)
+    return NO;
+
+  NSDate *start = [NSDate date];
+  NSMutableArray *ready = [NSMutableArray array];
+  NSEnumerator *senum = [steps_ objectEnumerator];
+  MBGraphStep *step = nil;
+  while ((step = [senum nextObject])) {
+    if (step->waitingOn_ == 0)
+      [ready addObject:step];
+  }
+
+  // (+[NSThread isMainThread] is 10.5-only.)
+  pthread_mutex_lock(&lock_);
+  callerIsMain_ = (pthread_main_np() != 0);
+  remaining_ = [steps_ count];
+  [self schedule:ready claim:NO];
+
+  // Run our own steps as they become ready, until everything is done.
+  while (remaining_ > 0) {
+    if ([callerSteps_ count] == 0) {
+      pthread_cond_wait(&changed_, &lock_);
+      continue;
+    }
+    step = [[[callerSteps_ objectAtIndex:0] retain] autorelease];
+    [callerSteps_ removeObjectAtIndex:0];
+    pthread_mutex_unlock(&lock_);
+    [self performStep:step];
+    pthread_mutex_lock(&lock_);
+    [self schedule:[self finishStep:step] claim:NO];
+  }
+  pthread_mutex_unlock(&lock_);
+  wallTime_ = -[start timeIntervalSinceNow];
+  return YES;
+}
+
+- (NSDictionary *)timings {
+  NSMutableDictionary *timings = [NSMutableDictionary dictionary];
+  NSEnumerator *senum = [steps_ objectEnumerator];
+  MBGraphStep *step = nil;
+  while ((step = [senum nextObject])) {
+    [timings setObject:[NSNumber numberWithDouble:step->duration_]
+                forKey:step->name_];
+  }
+  return timings;
+}
+
+- (double)wallTime {
+  return wallTime_;
+}
+
+- (NSString *)timingSummary {
+  NSMutableString *summary = [NSMutableString string];
+  NSEnumerator *senum = [steps_ objectEnumerator];
+  MBGraphStep *step = nil;
+  while ((step = [senum nextObject])) {
+    [summary appendFormat:@"%@%@ %.3fs", ([summary length] ? @", " : @""),
+             step->name_, step->duration_];
+  }
+  [summary appendFormat:@" (wall %.3fs)", wallTime_];
+  return summary;
+}
+
+@end
+
+
+@implementation MBDependencyGraph (Private)
+
+// Link up dependents and check for unknown names and cycles.
+- (BOOL)prepare {
+  NSEnumerator *senum = [steps_ objectEnumerator];
+  MBGraphStep *step = nil;
+  while ((step = [senum nextObject])) {
+    step->waitingOn_ = [step->dependencies_ count];
+    NSEnumerator *denum = [step->dependencies_ objectEnumerator];
+    NSString *name = nil;
+    while ((name = [denum nextObject])) {
+      MBGraphStep *dependency = [byName_ objectForKey:name];
+      if (dependency == nil) {
+        GMLoggerError(@"Step %@ depends on unknown step %@", step->name_, name);
+        return NO;
+      }
+      [dependency->dependents_ addObject:step];
+    }
+  }
+
+  // Kahn's algorithm, on a copy of the counts, to find cycles.
+  int count = [steps_ count];
+  int *waiting = malloc(sizeof(int) * (count + 1));
+  NSMutableArray *queue = [NSMutableArray array];
+  for (int i = 0; i < count; i++) {
+    step = [steps_ objectAtIndex:i];
+    waiting[i] = step->waitingOn_;
+    if (waiting[i] == 0)
+      [queue addObject:step];
+  }
+  int visited = 0;
+  while ([queue count]) {
+    step = [queue objectAtIndex:0];
+    [queue removeObjectAtIndex:0];
+    visited++;
+    NSEnumerator *denum = [step->dependents_ objectEnumerator];
+    MBGraphStep *dependent = nil;
+    while ((dependent = [denum nextObject])) {
+      int i = [steps_ indexOfObjectIdenticalTo:dependent];
+      if (--waiting[i] == 0)
+        [queue addObject:dependent];
+    }
+  }
+  free(waiting);
+  if (visited != count) {
+    GMLoggerError(@"Dependency cycle in startup steps");
+    return NO;
+  }
+  return YES;
+}
+
+// Called with |lock_| held.  Sends each of |steps| where it runs.  If
+// |claim| is set the first background step isn't started but returned,
+// for the calling (background) thread to run next.
+- (MBGraphStep *)schedule:(NSArray *)steps claim:(BOOL)claim {
+  MBGraphStep *claimed = nil;
+  NSEnumerator *senum = [steps objectEnumerator];
+  MBGraphStep *step = nil;
+  while ((step = [senum nextObject])) {
+    switch (step->thread_) {
+      case kMBGraphStepMainThread:
+        if (!callerIsMain_) {
+          [self performSelectorOnMainThread:@selector(runStepOnMainThread:)
+                                 withObject:step
+                              waitUntilDone:NO];
+          break;
+        }
+        // Fall through; the caller is the main thread.
+      case kMBGraphStepCallerThread:
+        [callerSteps_ addObject:step];
+        pthread_cond_broadcast(&changed_);
+        break;
+      case kMBGraphStepBackground:
+        if (claim && claimed == nil) {
+          claimed = step;
+        } else {
+          [NSThread detachNewThreadSelector:@selector(runStepsInBackground:)
+                                   toTarget:self
+                                 withObject:step];
+        }
+        break;
+    }
+  }
+  return claimed;
+}
+
+// Called with |lock_| held, after |step| ran.  Returns the steps it
+// made ready.
+- (NSArray *)finishStep:(MBGraphStep *)step {
+  NSMutableArray *ready = [NSMutableArray array];
+  NSEnumerator *denum = [step->dependents_ objectEnumerator];
+  MBGraphStep *dependent = nil;
+  while ((dependent = [denum nextObject])) {
+    if (--dependent->waitingOn_ == 0)
+      [ready addObject:dependent];
+  }
+  remaining_--;
+  pthread_cond_broadcast(&changed_);
+  return ready;
+}
+
+- (void)performStep:(MBGraphStep *)step {
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  NSDate *start = [NSDate date];
+  int span = MBTraceBegin([step->name_ UTF8String]);
+  @try {
+    [step->target_ performSelector:step->selector_];
+  } @catch (NSException *e) {
+    // Keep going; dependents may be able to cope, and -run must return.
+    GMLoggerError(@"Startup step %@ failed: %@", step->name_, [e reason]);
+  }
+  MBTraceEnd(span);
+  step->duration_ = -[start timeIntervalSinceNow];
+  [pool release];
+}
+
+- (void)runStepOnMainThread:(MBGraphStep *)step {
+  [self performStep:step];
+  pthread_mutex_lock(&lock_);
+  [self schedule:[self finishStep:step] claim:NO];
+  pthread_mutex_unlock(&lock_);
+}
+
+// A background thread: runs |step|, then any background step it makes
+// ready, and so on down the chain.
+- (void)runStepsInBackground:(MBGraphStep *)step {
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  while (step) {
+    [self performStep:step];
+    pthread_mutex_lock(&lock_);
+    step = [self schedule:[self finishStep:step] claim:YES];
+    pthread_mutex_unlock(&lock_);
+  }
+  [pool release];
+}
+
+@end
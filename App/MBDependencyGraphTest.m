@@ -0,0 +1,147 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import <SenTestingKit/SenTestingKit.h>
+#import <Cocoa/Cocoa.h>
+#include <pthread.h>
+#import "GMLogger.h"
+#import "MBDependencyGraph.h"
+#import "MBDependencyGraphTest.h"
+
+@implementation MBDependencyGraphTest
+
+- (void)setUp {
+  order_ = [[NSMutableArray alloc] init];
+  lock_ = [[NSLock alloc] init];
+}
+
+- (void)tearDown {
+  [order_ release];
+  [lock_ release];
+}
+
+- (void)note:(NSString *)name {
+  [lock_ lock];
+  [order_ addObject:name];
+  [lock_ unlock];
+}
+
+- (void)stepA {
+  usleep(50000);
+  [self note:@"a"];
+}
+
+- (void)stepB {
+  usleep(50000);
+  [self note:@"b"];
+}
+
+- (void)stepC {
+  [self note:@"c"];
+}
+
+- (void)stepMain {
+  STAssertTrue(pthread_main_np() != 0, nil);
+  [self note:@"main"];
+}
+
+// Notes which thread ran it.
+- (void)stepThread {
+  [lock_ lock];
+  [order_ addObject:[NSValue valueWithPointer:pthread_self()]];
+  [lock_ unlock];
+}
+
+- (void)timerFired {
+  [self note:@"timer"];
+}
+
+- (void)testOrder {
+  MBDependencyGraph *g = [[[MBDependencyGraph alloc] init] autorelease];
+  // c needs a and b; main needs c.  a and b are independent.
+  [g addStep:@"main" target:self selector:@selector(stepMain)
+    dependencies:[NSArray arrayWithObject:@"c"] thread:kMBGraphStepMainThread];
+  [g addStep:@"c" target:self selector:@selector(stepC)
+    dependencies:[NSArray arrayWithObjects:@"a", @"b", nil] thread:kMBGraphStepBackground];
+  [g addStep:@"a" target:self selector:@selector(stepA)
+    dependencies:nil thread:kMBGraphStepBackground];
+  [g addStep:@"b" target:self selector:@selector(stepB)
+    dependencies:nil thread:kMBGraphStepBackground];
+  STAssertTrue([g run], nil);
+
+  STAssertTrue([order_ count] == 4, nil);
+  STAssertEqualObjects([order_ objectAtIndex:2], @"c", nil);
+  STAssertEqualObjects([order_ objectAtIndex:3], @"main", nil);
+
+  NSDictionary *timings = [g timings];
+  STAssertTrue([timings count] == 4, nil);
+  STAssertTrue([[timings objectForKey:@"a"] doubleValue] >= 0.04, nil);
+  // a and b ran side by side.
+  STAssertTrue([g wallTime] < 0.09, nil);
+  STAssertTrue([[g timingSummary] rangeOfString:@"wall"].location != NSNotFound, nil);
+}
+
+- (void)testThreads {
+  MBDependencyGraph *g = [[[MBDependencyGraph alloc] init] autorelease];
+  // A chain of background steps, and a cheap step after it.
+  [g addStep:@"first" target:self selector:@selector(stepThread)
+    dependencies:nil thread:kMBGraphStepBackground];
+  [g addStep:@"second" target:self selector:@selector(stepThread)
+    dependencies:[NSArray arrayWithObject:@"first"]
+          thread:kMBGraphStepBackground];
+  [g addStep:@"cheap" target:self selector:@selector(stepThread)
+    dependencies:[NSArray arrayWithObject:@"second"]
+          thread:kMBGraphStepCallerThread];
+
+  // -run waits without running the run loop.
+  [self performSelector:@selector(timerFired) withObject:nil afterDelay:0];
+  STAssertTrue([g run], nil);
+  STAssertTrue([order_ count] == 3, nil);
+  NSValue *caller = [NSValue valueWithPointer:pthread_self()];
+  STAssertFalse([[order_ objectAtIndex:0] isEqual:caller], nil);
+  STAssertEqualObjects([order_ objectAtIndex:0], [order_ objectAtIndex:1],
+                       @"a chain runs on one thread");
+  STAssertEqualObjects([order_ objectAtIndex:2], caller, nil);
+
+  [[NSRunLoop currentRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.05]];
+  STAssertEqualObjects([order_ lastObject], @"timer", nil);
+}
+
+- (void)testBadGraphs {
+  [[GMLogger sharedLogger] setWriter:nil];  // no UI
+
+  MBDependencyGraph *g = [[[MBDependencyGraph alloc] init] autorelease];
+  [g addStep:@"a" target:self selector:@selector(stepA)
+    dependencies:[NSArray arrayWithObject:@"nope"] thread:kMBGraphStepBackground];
+  STAssertFalse([g run], nil);
+
+  g = [[[MBDependencyGraph alloc] init] autorelease];
+  [g addStep:@"a" target:self selector:@selector(stepA)
+    dependencies:[NSArray arrayWithObject:@"b"] thread:kMBGraphStepBackground];
+  [g addStep:@"b" target:self selector:@selector(stepB)
+    dependencies:[NSArray arrayWithObject:@"a"] thread:kMBGraphStepBackground];
+  [g addStep:@"c" target:self selector:@selector(stepC)
+    dependencies:nil thread:kMBGraphStepBackground];
+  STAssertFalse([g run], nil);
+  STAssertTrue([order_ count] == 0, nil);
+}
+
+- (void)testEmpty {
+  MBDependencyGraph *g = [[[MBDependencyGraph alloc] init] autorelease];
+  STAssertTrue([g run], nil);
+  STAssertTrue([[g timings] count] == 0, nil);
+}
+
+@end
@@ -14,17 +14,21 @@ limitations under the License.
 */
 
 #import <Foundation/Foundation.h>
+@class MBRuntimeProbeCache;
+@class MBZipExtractor;
 
 // A Engine Runtime is everything needed to run Engine.  This included
 // a specific python; a pointer to a dev_appserver.py; demos which
 // work with this runtime; and so on.  Most of these are packaged into
-// a bundle, embedded in GoogleAppEngineLauncher.app.  In theory we
-// could have multiple Runtimes (so, for example, Engine apps don't
-// break on a silent update).  However, for now we only have one, and
-// projects are hard-coded to use it.
+// a bundle, embedded in GoogleAppEngineLauncher.app.  There may be
+// several installed side by side (so, for example, Engine apps don't
+// break on a silent update); MBRuntimeRegistry keeps track of them,
+// and each project is pinned to one.
 @interface MBEngineRuntime : NSObject {
  @private
   NSBundle *runtimeBundle_;
+  NSString *name_;  // e.g. GoogleAppEngine-default
+  BOOL contentsFound_;
   NSString *pythonCommand_;
   NSString *packageManagerCommand_;
   NSString *pythonPathEnvVar_;
@@ -34,10 +38,37 @@ limitations under the License.
   NSArray *extraCommandLineFlags_;
   NSArray *productionCommandLineFlags_;
   BOOL extractionNeeded_;
+  BOOL extractionConfirmed_;  // --query said there's nothing to extract
+
+  // Probe results from a previous launch.  If valid, we skip spawning
+  // python at startup and recheck on a background thread instead.
+  MBRuntimeProbeCache *probeCache_;
+  BOOL probedFromCache_;
+
+  // How long each part of -findRuntimeContents took, for the log.
+  NSString *probeTimingSummary_;
+
+  // The archive being extracted (if any) and how far along we are.
+  MBZipExtractor *extractor_;
+  int archivesExtracted_;
+  int archivesToExtract_;
+
+  // NSInvocations waiting for a background -findRuntimeContents, or
+  // nil if none is underway.  Main thread only.
+  NSMutableArray *contentsWaiters_;
 }
 
+// The registry's default runtime.
 + (id)defaultRuntime;
 
+// Designated initializer.  |bundle| is a GoogleAppEngine-*.bundle.
+// Nothing is probed or extracted until -findRuntimeContents.
+- (id)initWithBundle:(NSBundle *)bundle;
+
+// The runtime's name (its bundle name without the extension).
+- (NSString *)name;
+- (NSBundle *)bundle;
+
 // Return YES if we need to extract.
 // Lets the caller know to bring up UI.
 - (BOOL)extractionNeeded;
@@ -45,6 +76,39 @@ limitations under the License.
 // For delayed extraction
 - (void)findRuntimeContents;
 
+// Extract and find our contents unless already done.  Blocks until
+// they're found; the main thread should use
+// -findRuntimeContentsInBackgroundForTarget:selector: instead.
+- (void)findRuntimeContentsIfNeeded;
+- (BOOL)contentsFound;
+
+// Runs -extractionNeeded and -findRuntimeContents on a worker thread,
+// unless the contents have been found, then sends |selector| (which
+// takes this runtime) to |target| on the main thread; right away if
+// they already were.  A request made while a search is underway waits
+// for that one.  Call on the main thread.  If the runtime needs
+// extracting, waiting targets which implement -runtimeWillExtract:
+// are sent it first, so they can show progress.
+- (void)findRuntimeContentsInBackgroundForTarget:(id)target
+                                        selector:(SEL)selector;
+
+// How much of the extraction done by -findRuntimeContents is
+// complete (0.0 -- 1.0), or -1 if we can't tell.  Thread-safe; for
+// progress UI.
+- (double)extractionProgress;
+
+// YES if the last -extractionNeeded or -findRuntimeContents used
+// cached probe results.
+- (BOOL)probedFromCache;
+
+// A one line description of where the last -findRuntimeContents
+// spent its time.
+- (NSString *)probeTimingSummary;
+
+// Where probe results are cached.  Tests may replace it.
+- (MBRuntimeProbeCache *)probeCache;
+- (void)setProbeCache:(MBRuntimeProbeCache *)cache;
+
 // Returns a full path to the "python" command we will be using
 // (e.g. /usr/bin/python)
 - (NSString *)pythonCommand;
@@ -104,3 +168,9 @@ limitations under the License.
 - (NSString *)makeLinks;
 @end
 
+// Optional method for targets of
+// -findRuntimeContentsInBackgroundForTarget:selector:.
+@interface NSObject (MBEngineRuntimeTarget)
+- (void)runtimeWillExtract:(MBEngineRuntime *)runtime;
+@end
+
@@ -15,12 +15,20 @@ limitations under the License.
 
 #import "MBEngineRuntime.h"
 #import "MBPreferences.h"
+#import "MBRuntimeProbeCache.h"
+#import "MBRuntimeRegistry.h"
+#import "MBPythonFinder.h"
+#import "MBDependencyGraph.h"
+#import "MBZipExtractor.h"
+#import "MBStallWatchdog.h"
+#import "MBStartupTrace.h"
 #import "GMSystemVersion.h"
 #import <Security/Authorization.h>
 #import <Security/AuthorizationTags.h>
 #import <unistd.h>
 
 @interface MBEngineRuntime (Private)
+- (NSString *)probePython;
 - (void)findPython;
 - (void)findPackageManager;
 - (void)findPythonPathEnvVar;
@@ -29,6 +37,22 @@ limitations under the License.
 - (void)findProductionCommandLineFlags;
 - (void)extractIfNeeded;
 - (NSString *)runPackageManagerWithArg:(NSString *)arg;
+- (NSArray *)runtimeArchives;
+- (NSString *)packsToExtract;
+- (BOOL)extractArchives;
+- (void)setPythonPathEnvVar:(NSString *)pythonPath;
+- (void)findRuntimeContentsOnThread:(id)unused;
+- (void)willExtract;
+- (void)didFindRuntimeContents;
+- (void)warnPythonNeeded;
+
+// Probe cache support.
+- (NSDictionary *)probeCacheKey;
+- (NSArray *)probeCacheFiles;
+- (BOOL)loadCachedProbe;
+- (void)saveProbe;
+- (void)revalidateProbe:(NSDictionary *)probe;
+- (void)applyRevalidatedProbe:(NSDictionary *)probe;
 
 // return all command-line commands (e.g. for makeLinks)
 - (NSArray *)commands;
@@ -38,46 +62,26 @@ limitations under the License.
 
 @implementation MBEngineRuntime
 
-static MBEngineRuntime *gDefaultRuntime = nil;
-
-// Currently we ONLY have a "default"
+// The default runtime comes from the registry, which owns it.
 + (id)defaultRuntime {
-  @synchronized(self) {
-    if (gDefaultRuntime == nil) {
-      gDefaultRuntime = [[self alloc] init];
-    }
-  }
-  return gDefaultRuntime;
+  return [[MBRuntimeRegistry sharedRegistry] defaultRuntime];
 }
 
-// TODO(jrg): make mockable (pass in bundle?)
-// TODO: choke if the right stuff isn't found?
+// A new instance of the default runtime.
 - (id)init {
+  MBRuntimeRegistry *registry = [MBRuntimeRegistry sharedRegistry];
+  NSString *path = [registry bundlePathForRuntime:[registry defaultRuntimeName]];
+  return [self initWithBundle:(path ? [NSBundle bundleWithPath:path] : nil)];
+}
+
+// TODO: choke if the right stuff isn't found?
+- (id)initWithBundle:(NSBundle *)bundle {
   if ((self = [super init])) {
-    NSBundle *bundle = [NSBundle bundleForClass:[self class]];
-    NSString *resources = [bundle resourcePath];
-
-    // contents of GoogleAppEngineLauncher.app/Contents/Resources/
-    NSArray *contents = [[NSFileManager defaultManager] directoryContentsAtPath:resources];
-    if (contents) {
-      NSEnumerator *denum = [contents objectEnumerator];
-      NSString *file = nil;
-      while ((file = [denum nextObject])) {
-        // for now, just use the first one we find.
-        // TODO(jrg): use GMRegex?
-        if ([file hasPrefix:@"GoogleAppEngine-"] &&
-            [file hasSuffix:@".bundle"]) {
-          NSString *runtime = [NSString stringWithFormat:@"%@/%@", resources, file];
-          runtimeBundle_ = [NSBundle bundleWithPath:runtime];
-          break;
-        }
-      }
-    }
-    if (runtimeBundle_ != nil) {
-      // Delayed from awakeFromNib: to avoid a dbl-help menu problem
-      // with a dialog before the menu nib is loadeed
-      // [self findRuntimeContents];
-    }
+    runtimeBundle_ = [bundle retain];
+    name_ = [[MBRuntimeRegistry runtimeNameForBundlePath:[bundle bundlePath]] copy];
+    // Contents are found later (-findRuntimeContents) to avoid a
+    // dbl-help menu problem with a dialog before the menu nib is
+    // loaded, and so unused runtimes cost nothing.
   }
   GMAssert(runtimeBundle_, @"No valid runtime found (install problem?)");
   return self;
@@ -85,6 +89,7 @@ static MBEngineRuntime *gDefaultRuntime = nil;
 
 - (void)dealloc {
   [runtimeBundle_ release];
+  [name_ release];
   [pythonCommand_ release];
   [packageManagerCommand_ release];
   [pythonPathEnvVar_ release];
@@ -93,16 +98,28 @@ static MBEngineRuntime *gDefaultRuntime = nil;
   [devAppServer_ release];
   [extraCommandLineFlags_ release];
   [productionCommandLineFlags_ release];
+  [probeCache_ release];
+  [probeTimingSummary_ release];
+  [extractor_ release];
+  [contentsWaiters_ release];
   [super dealloc];
 }
 
+- (NSString *)name {
+  return [[name_ copy] autorelease];
+}
+
+- (NSBundle *)bundle {
+  return [[runtimeBundle_ retain] autorelease];
+}
+
 - (NSString *)pythonCommand {
   return [[pythonCommand_ copy] autorelease];
 }
 
 - (void)refreshPythonCommand {
-  [pythonCommand_ release];
   [self findPython];
+  [self saveProbe];
 }
 
 - (NSString *)pythonExtraEnvironmentString {
@@ -330,22 +347,137 @@ static MBEngineRuntime *gDefaultRuntime = nil;
 }
 
 - (void)findRuntimeContents {
+  MB_TRACE_SCOPE(__func__);
   GMAssert(runtimeBundle_, @"No valid runtime found (install problem?)");
-  [self findPython];
-  [self findPackageManager];
-  [self extractIfNeeded];
-  [self findPythonPathEnvVar];
-  [self findGoogleAppEngine];
-  [self findExtraCommandLineFlags];
-  [self findProductionCommandLineFlags];
+  if (probedFromCache_ || [self loadCachedProbe]) {
+    [self findExtraCommandLineFlags];
+    [self findProductionCommandLineFlags];
+    // Trust, but verify (without holding up the launch).
+    NSDictionary *probe = [NSDictionary dictionaryWithObjectsAndKeys:
+                                          pythonCommand_, @"python",
+                                          pythonPathEnvVar_, @"pythonPath",
+                                          nil];
+    [NSThread detachNewThreadSelector:@selector(revalidateProbe:)
+                             toTarget:self
+                           withObject:probe];
+    [probeTimingSummary_ release];
+    probeTimingSummary_ = @"cached";
+    contentsFound_ = YES;
+    return;
+  }
+
+  // Each step sets its own ivars, so independent ones can run in
+  // parallel.  Everything after extraction needs it done first.  The
+  // packageManager -> extract -> pythonPath chain is the slow part and
+  // runs on one background thread; the flags are just assignments.
+  MBDependencyGraph *graph = [[[MBDependencyGraph alloc] init] autorelease];
+  NSArray *afterPackageManager = [NSArray arrayWithObject:@"packageManager"];
+  NSArray *afterExtract = [NSArray arrayWithObject:@"extract"];
+  // findPython runs each new interpreter; only its alert needs the
+  // main thread, and it doesn't wait for that.
+  [graph addStep:@"python" target:self selector:@selector(findPython)
+    dependencies:nil thread:kMBGraphStepBackground];
+  [graph addStep:@"packageManager" target:self selector:@selector(findPackageManager)
+    dependencies:nil thread:kMBGraphStepBackground];
+  [graph addStep:@"extract" target:self selector:@selector(extractIfNeeded)
+    dependencies:afterPackageManager thread:kMBGraphStepBackground];
+  [graph addStep:@"pythonPath" target:self selector:@selector(findPythonPathEnvVar)
+    dependencies:afterExtract thread:kMBGraphStepBackground];
+  [graph addStep:@"devAppServer" target:self selector:@selector(findGoogleAppEngine)
+    dependencies:afterExtract thread:kMBGraphStepCallerThread];
+  [graph addStep:@"flags" target:self selector:@selector(findExtraCommandLineFlags)
+    dependencies:nil thread:kMBGraphStepCallerThread];
+  [graph addStep:@"productionFlags" target:self
+        selector:@selector(findProductionCommandLineFlags)
+    dependencies:nil thread:kMBGraphStepCallerThread];
+  [graph run];
+  [probeTimingSummary_ release];
+  probeTimingSummary_ = [[graph timingSummary] retain];
+  contentsFound_ = YES;
+
+  [self saveProbe];
+}
+
+// Not @synchronized: extraction takes our lock from other threads
+// while -findRuntimeContents waits for it.
+- (void)findRuntimeContentsIfNeeded {
+  if (!contentsFound_) {
+    [self extractionNeeded];
+    [self findRuntimeContents];
+  }
+}
+
+- (BOOL)contentsFound {
+  return contentsFound_;
+}
+
+- (void)findRuntimeContentsInBackgroundForTarget:(id)target
+                                        selector:(SEL)selector {
+  if (contentsFound_ && contentsWaiters_ == nil) {
+    [target performSelector:selector withObject:self];
+    return;
+  }
+  NSInvocation *waiter = [NSInvocation invocationWithMethodSignature:
+                                         [target methodSignatureForSelector:selector]];
+  [waiter setTarget:target];
+  [waiter setSelector:selector];
+  [waiter setArgument:&self atIndex:2];
+  [waiter retainArguments];
+  if (contentsWaiters_) {
+    [contentsWaiters_ addObject:waiter];
+    return;
+  }
+  contentsWaiters_ = [[NSMutableArray alloc] initWithObjects:waiter, nil];
+  [NSThread detachNewThreadSelector:@selector(findRuntimeContentsOnThread:)
+                           toTarget:self
+                         withObject:nil];
+}
+
+- (double)extractionProgress {
+  @synchronized(self) {
+    if (archivesToExtract_ == 0)
+      return -1.0;
+    double current = extractor_ ? [extractor_ progress] : 0.0;
+    return (archivesExtracted_ + current) / archivesToExtract_;
+  }
+  return -1.0;  // not reached
+}
+
+- (NSString *)probeTimingSummary {
+  return [[probeTimingSummary_ copy] autorelease];
+}
+
+- (BOOL)probedFromCache {
+  return probedFromCache_;
+}
+
+// Locked: -revalidateProbe: uses the cache from its own thread.
+- (MBRuntimeProbeCache *)probeCache {
+  @synchronized(self) {
+    if (probeCache_ == nil)
+      probeCache_ = [[MBRuntimeProbeCache alloc]
+                      initWithPath:[MBRuntimeProbeCache cachePathForRuntime:name_]];
+    return [[probeCache_ retain] autorelease];
+  }
+  return nil;  // not reached
+}
+
+- (void)setProbeCache:(MBRuntimeProbeCache *)cache {
+  @synchronized(self) {
+    [probeCache_ autorelease];
+    probeCache_ = [cache retain];
+  }
 }
 
 // Don't assume any configuration has happened yet.
 - (BOOL)extractionNeeded {
   extractionNeeded_ = NO;
+  // A valid cache means a previous launch confirmed extraction.
+  if ([self loadCachedProbe])
+    return NO;
   [self findPython];
   [self findPackageManager];
-  NSString *packsToExtract = [self runPackageManagerWithArg:@"--query"];
+  NSString *packsToExtract = [self packsToExtract];
   if ([packsToExtract length] > 0) {
     extractionNeeded_ = YES;
   }
@@ -356,33 +488,42 @@ static MBEngineRuntime *gDefaultRuntime = nil;
 
 
 @implementation MBEngineRuntime (Private)
-- (void)findPython {
+
+// Return the python we should use, or nil if none of the usual
+// suspects are around.  No UI; safe to call from any thread.
+- (NSString *)probePython {
   // check the pref
   NSString *python = [[NSUserDefaults standardUserDefaults]
                        stringForKey:kMBPythonPref];
   if ((python != nil) && ([python isEqual:@""] == NO)) {
-    pythonCommand_ = [python copy];
-    return;
+    return python;
   }
 
-  // This is really important just for 10.4 where /usr/bin/python is v2.3.
-  // When we obsolete 10.4 support, /usr/bin/python will be just fine.
-  NSArray *commands = [NSArray arrayWithObjects:@"/usr/bin/python2.6", /* 10.6 */
-                               @"/usr/bin/python2.5", /* 10.5 */
-                               @"/usr/local/bin/python2.5", /* a guess */
-                               @"/Library/Frameworks/Python.framework/Versions/Current/bin/python2.5", /* MacPython.org */
-                               @"/opt/local/bin/python2.5",   /* macports? */
-                               @"/sw/bin/python2.5",          /* fink? */
-                               nil];
-  NSEnumerator *cenum = [commands objectEnumerator];
-  NSString *command = nil;
-  while ((command = [cenum nextObject])) {
-    if ([[NSFileManager defaultManager] isExecutableFileAtPath:command]) {
-      // TODO(jrg): run with --version and look for "Python 2.5" in
-      // the output string
-      pythonCommand_ = [command retain];
-      return;
-    }
+  // Only runs interpreters it hasn't seen before.
+  // The SDK unpacks to Resources/google_appengine/google/appengine.
+  MBPythonFinder *finder = [[[MBPythonFinder alloc] init] autorelease];
+  [finder setSDKDirectory:[[runtimeBundle_ resourcePath]
+                            stringByAppendingPathComponent:@"google_appengine"]];
+  NSDictionary *best = [finder bestInterpreter];
+  if (best == nil)
+    return nil;
+  if ([finder spawnCount] > 0) {
+    GMLoggerInfo(@"Using python %@ (version %@, %@, %@-bit%@)",
+                 [best objectForKey:kMBPythonPathKey],
+                 [best objectForKey:kMBPythonVersionKey],
+                 [best objectForKey:kMBPythonMachineKey],
+                 [best objectForKey:kMBPythonBitsKey],
+                 [[best objectForKey:kMBPythonSDKKey] boolValue] ? @"" : @", SDK not importable");
+  }
+  return [best objectForKey:kMBPythonPathKey];
+}
+
+- (void)findPython {
+  NSString *python = [self probePython];
+  [pythonCommand_ autorelease];
+  if (python) {
+    pythonCommand_ = [python copy];
+    return;
   }
 
   pythonCommand_ = @"/usr/bin/python"; /* when all else fails */
@@ -390,25 +531,33 @@ static MBEngineRuntime *gDefaultRuntime = nil;
     // we're fine; python2.5 is the default.
     return;
   } else {
-    NSAlert *alert = [self alert];
-    [alert setMessageText:@"Python Needed"];
-    NSString *text = @"Python version 2.5 could not be found.  "
-        "Google App Engine may not work correctly.  "
-        "Please install Python from http://www.pythonmac.org/packages/";
-    [alert setInformativeText:text];
-    [alert addButtonWithTitle:@"OK"];
-    /* NSInteger rtn = */ [alert runModal];
+    [self performSelectorOnMainThread:@selector(warnPythonNeeded)
+                           withObject:nil
+                        waitUntilDone:NO];
   }
   return;
 }
 
+- (void)warnPythonNeeded {
+  NSAlert *alert = [self alert];
+  [alert setMessageText:@"Python Needed"];
+  NSString *text = @"Python version 2.5 could not be found.  "
+      "Google App Engine may not work correctly.  "
+      "Please install Python from http://www.pythonmac.org/packages/";
+  [alert setInformativeText:text];
+  [alert addButtonWithTitle:@"OK"];
+  /* NSInteger rtn = */ [alert runModal];
+}
+
 - (void)findPackageManager {
   NSString *pm = [runtimeBundle_ pathForResource:@"packagemanager" ofType:@"py"];
   GMAssert(pm, @"Can't determine how to manage packages (install problem?)");
+  [packageManagerCommand_ autorelease];
   packageManagerCommand_ = [pm retain];
 }
 
 - (NSString *)runPackageManagerWithArg:(NSString *)arg {
+  const char *previous = MBStallWatchdogSetAction(__func__);
   NSTask *task = [[NSTask alloc] init];
   [task setLaunchPath:packageManagerCommand_];
   [task setCurrentDirectoryPath:[runtimeBundle_ resourcePath]];
@@ -423,17 +572,94 @@ static MBEngineRuntime *gDefaultRuntime = nil;
                              autorelease];
   [task waitUntilExit];
   [task release];
+  MBStallWatchdogSetAction(previous);
   return outputString;
 }
 
+// The zip archives packaged in the runtime bundle.
+- (NSArray *)runtimeArchives {
+  NSString *resources = [runtimeBundle_ resourcePath];
+  NSArray *contents = [[NSFileManager defaultManager] directoryContentsAtPath:resources];
+  NSMutableArray *archives = [NSMutableArray array];
+  NSEnumerator *cenum = [contents objectEnumerator];
+  NSString *file = nil;
+  while ((file = [cenum nextObject])) {
+    if ([[file pathExtension] isEqual:@"zip"])
+      [archives addObject:[resources stringByAppendingPathComponent:file]];
+  }
+  return archives;
+}
+
+// Like "packagemanager.py --query": a non-empty string if anything
+// needs extracting.  Answered natively (no python) when the runtime
+// is made of zip archives we can extract ourselves.
+- (NSString *)packsToExtract {
+  NSArray *archives = [self runtimeArchives];
+  if ([archives count] == 0)
+    return [self runPackageManagerWithArg:@"--query"];
+
+  NSString *resources = [runtimeBundle_ resourcePath];
+  NSMutableArray *packs = [NSMutableArray array];
+  NSEnumerator *aenum = [archives objectEnumerator];
+  NSString *archive = nil;
+  while ((archive = [aenum nextObject])) {
+    if (![MBZipExtractor isArchive:archive extractedTo:resources])
+      [packs addObject:[archive lastPathComponent]];
+  }
+  return [packs componentsJoinedByString:@" "];
+}
+
+// Extract our archives natively.  Returns NO if any failed (in which
+// case packagemanager.py gets a turn).  A previously interrupted
+// extraction picks up where it left off.
+- (BOOL)extractArchives {
+  NSString *resources = [runtimeBundle_ resourcePath];
+  NSMutableArray *archives = [NSMutableArray array];
+  NSEnumerator *aenum = [[self runtimeArchives] objectEnumerator];
+  NSString *archive = nil;
+  while ((archive = [aenum nextObject])) {
+    if (![MBZipExtractor isArchive:archive extractedTo:resources])
+      [archives addObject:archive];
+  }
+
+  @synchronized(self) {
+    archivesExtracted_ = 0;
+    archivesToExtract_ = [archives count];
+  }
+  BOOL worked = YES;
+  aenum = [archives objectEnumerator];
+  while (worked && (archive = [aenum nextObject])) {
+    MBZipExtractor *extractor = [[[MBZipExtractor alloc]
+                                   initWithArchive:archive
+                                       destination:resources] autorelease];
+    @synchronized(self) {
+      [extractor_ autorelease];
+      extractor_ = [extractor retain];
+    }
+    worked = [extractor extract];
+    if (!worked)
+      GMLoggerInfo(@"Native extraction of %@ failed: %@",
+                   archive, [extractor error]);
+    @synchronized(self) {
+      [extractor_ release];
+      extractor_ = nil;
+      if (worked)
+        archivesExtracted_++;
+    }
+  }
+  return worked;
+}
+
 - (void)extractIfNeeded {
   if (extractionNeeded_) {
-    [self runPackageManagerWithArg:@"--extract"];
+    if (([[self runtimeArchives] count] == 0) || ![self extractArchives])
+      [self runPackageManagerWithArg:@"--extract"];
     extractionNeeded_ = NO;
   }
 
   // confirm
-  NSString *packsToExtract = [self runPackageManagerWithArg:@"--query"];
+  NSString *packsToExtract = [self packsToExtract];
+  extractionConfirmed_ = ([packsToExtract length] == 0);
   if ([packsToExtract length] > 0) {
     GMLoggerError(@"The Google App Engine Runtime could not be extracted "
                   "(perhaps you are running the Launcher from the dmg?  "
@@ -445,8 +671,14 @@ static MBEngineRuntime *gDefaultRuntime = nil;
 - (void)findPythonPathEnvVar {
   GMAssert(packageManagerCommand_, @"no package manager command.");
   NSCharacterSet *charSet = [NSCharacterSet whitespaceAndNewlineCharacterSet];
-  pythonPathEnvVar_ = [[[self runPackageManagerWithArg:@"--path"]
-                         stringByTrimmingCharactersInSet:charSet] retain];
+  [self setPythonPathEnvVar:[[self runPackageManagerWithArg:@"--path"]
+                              stringByTrimmingCharactersInSet:charSet]];
+}
+
+// Takes the output of "packagemanager.py --path" (PYTHONPATH=blah).
+- (void)setPythonPathEnvVar:(NSString *)pythonPath {
+  [pythonPathEnvVar_ autorelease];
+  pythonPathEnvVar_ = [pythonPath copy];
   NSArray *components = [pythonPathEnvVar_ componentsSeparatedByString:@"="];
   GMAssert([components count] == 2,
            @"Sorry, pieces of GoogleAppEngineLauncher.app appear missing "
@@ -469,10 +701,14 @@ static MBEngineRuntime *gDefaultRuntime = nil;
   // GoogleAppEngine is the SDK.
   // Doesn't seem right to use the launcher version in a var named '*_SDK_*'.
   [dict setObject:sdkName forKey:@"APPCFG_SDK_NAME"];
+  [pythonExtraEnvironment_ autorelease];
   pythonExtraEnvironment_ = [dict retain];
 }
 
 - (void)findGoogleAppEngine {
+  [devAppDirectory_ autorelease];
+  [devAppServer_ autorelease];
+  devAppServer_ = nil;
   devAppDirectory_ = [[runtimeBundle_ resourcePath] retain];
   NSString *das = [NSString stringWithFormat:@"%@/%@",
                             devAppDirectory_,
@@ -512,4 +748,164 @@ static MBEngineRuntime *gDefaultRuntime = nil;
   return array;
 }
 
+// Anything that changes the probe results without touching one of
+// -probeCacheFiles goes in here.
+- (NSDictionary *)probeCacheKey {
+  NSString *bundlePath = [runtimeBundle_ bundlePath];
+  NSString *runtimeVersion = [[runtimeBundle_ infoDictionary]
+                               objectForKey:(id)kCFBundleVersionKey];
+  NSString *launcherVersion = [[[NSBundle mainBundle] infoDictionary]
+                                objectForKey:(id)kCFBundleVersionKey];
+  NSString *pythonPref = [[NSUserDefaults standardUserDefaults]
+                           stringForKey:kMBPythonPref];
+  NSDictionary *identity = [MBRuntimeProbeCache identityOfFileAtPath:bundlePath];
+  return [NSDictionary dictionaryWithObjectsAndKeys:
+                         (bundlePath ? bundlePath : @""), @"runtime",
+                         (runtimeVersion ? runtimeVersion : @""), @"runtimeVersion",
+                         (identity ? identity : [NSDictionary dictionary]), @"runtimeIdentity",
+                         (launcherVersion ? launcherVersion : @""), @"launcherVersion",
+                         (pythonPref ? pythonPref : @""), @"pythonPref",
+                         nil];
+}
+
+// Files whose modification invalidates the probe results.
+- (NSArray *)probeCacheFiles {
+  NSMutableArray *files = [NSMutableArray array];
+  if (pythonCommand_)
+    [files addObject:pythonCommand_];
+  if (packageManagerCommand_)
+    [files addObject:packageManagerCommand_];
+  if (devAppServer_)
+    [files addObject:devAppServer_];
+  return files;
+}
+
+// Returns YES (and sets everything -findRuntimeContents would, except
+// the command line flags) if the cache is valid.
+- (BOOL)loadCachedProbe {
+  if (runtimeBundle_ == nil)
+    return NO;
+  NSDictionary *results = [[self probeCache] resultsForKey:[self probeCacheKey]];
+  NSString *python = [results objectForKey:@"python"];
+  NSString *pythonPath = [results objectForKey:@"pythonPath"];
+  NSString *das = [results objectForKey:@"devAppServer"];
+  if ((python == nil) || (pythonPath == nil) || (das == nil))
+    return NO;
+
+  [self findPackageManager];
+  [pythonCommand_ autorelease];
+  pythonCommand_ = [python copy];
+  [self setPythonPathEnvVar:pythonPath];
+  [devAppDirectory_ autorelease];
+  devAppDirectory_ = [[runtimeBundle_ resourcePath] retain];
+  [devAppServer_ autorelease];
+  devAppServer_ = [das copy];
+  probedFromCache_ = YES;
+  return YES;
+}
+
+- (void)saveProbe {
+  // Only cache a runtime known to be fully extracted and configured.
+  if (!(extractionConfirmed_ || probedFromCache_) ||
+      !pythonCommand_ || !pythonPathEnvVar_ || !devAppServer_)
+    return;
+  NSDictionary *results = [NSDictionary dictionaryWithObjectsAndKeys:
+                                          pythonCommand_, @"python",
+                                          pythonPathEnvVar_, @"pythonPath",
+                                          devAppServer_, @"devAppServer",
+                                          nil];
+  [[self probeCache] setResults:results
+                         forKey:[self probeCacheKey]
+               dependingOnFiles:[self probeCacheFiles]];
+}
+
+// Runs on a background thread after a launch from cached results.
+// Repeats the probes we skipped; if anything changed, the main thread
+// picks it up (and rewrites the cache).  |probe| holds the values in
+// use, so we don't touch our ivars from here.
+- (void)revalidateProbe:(NSDictionary *)probe {
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  NSString *python = [self probePython];
+  if (python == nil)
+    python = @"/usr/bin/python";
+  NSString *packsToExtract = [self packsToExtract];
+  NSCharacterSet *charSet = [NSCharacterSet whitespaceAndNewlineCharacterSet];
+  NSString *pythonPath = [[self runPackageManagerWithArg:@"--path"]
+                           stringByTrimmingCharactersInSet:charSet];
+
+  if ([packsToExtract length] > 0) {
+    // Part of the runtime went missing; extract on the next launch.
+    [[self probeCache] removeResults];
+  } else if (![python isEqual:[probe objectForKey:@"python"]] ||
+             ![pythonPath isEqual:[probe objectForKey:@"pythonPath"]]) {
+    NSDictionary *update = [NSDictionary dictionaryWithObjectsAndKeys:
+                                           python, @"python",
+                                           pythonPath, @"pythonPath",
+                                           nil];
+    [self performSelectorOnMainThread:@selector(applyRevalidatedProbe:)
+                           withObject:update
+                        waitUntilDone:NO];
+  }
+  [pool release];
+}
+
+- (void)applyRevalidatedProbe:(NSDictionary *)probe {
+  NSString *python = [probe objectForKey:@"python"];
+  NSString *pythonPath = [probe objectForKey:@"pythonPath"];
+  if (![python isEqual:pythonCommand_]) {
+    [pythonCommand_ autorelease];
+    pythonCommand_ = [python copy];
+  }
+  if ([[pythonPath componentsSeparatedByString:@"="] count] == 2)
+    [self setPythonPathEnvVar:pythonPath];
+  [self saveProbe];
+}
+
+// The worker thread for -findRuntimeContentsInBackgroundForTarget:.
+// Both the extraction check and the probe run interpreters and
+// packagemanager.py, so neither belongs on the main thread.
+- (void)findRuntimeContentsOnThread:(id)unused {
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  if (!contentsFound_) {
+    int checkSpan = MBTraceBegin("extractionNeeded");
+    BOOL extracting = [self extractionNeeded];
+    MBTraceEnd(checkSpan);
+    if (extracting)
+      [self performSelectorOnMainThread:@selector(willExtract)
+                             withObject:nil
+                          waitUntilDone:NO];
+    [self findRuntimeContents];
+  }
+  [self performSelectorOnMainThread:@selector(didFindRuntimeContents)
+                         withObject:nil
+                      waitUntilDone:NO];
+  [pool release];
+}
+
+// Lets the waiting targets put up progress.  Sent before
+// -didFindRuntimeContents, from the same thread, so it arrives first.
+- (void)willExtract {
+  NSMutableArray *targets = [NSMutableArray array];
+  NSEnumerator *wenum = [contentsWaiters_ objectEnumerator];
+  NSInvocation *waiter = nil;
+  while ((waiter = [wenum nextObject])) {
+    id target = [waiter target];
+    if (![targets containsObject:target] &&
+        [target respondsToSelector:@selector(runtimeWillExtract:)]) {
+      [targets addObject:target];
+      [target runtimeWillExtract:self];
+    }
+  }
+}
+
+- (void)didFindRuntimeContents {
+  NSArray *waiters = [contentsWaiters_ autorelease];
+  contentsWaiters_ = nil;
+  NSEnumerator *wenum = [waiters objectEnumerator];
+  NSInvocation *waiter = nil;
+  while ((waiter = [wenum nextObject])) {
+    [waiter invoke];
+  }
+}
+
 @end  // MBEngineRuntime (Private)
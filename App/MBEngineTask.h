@@ -45,6 +45,9 @@ limitations under the License.
 
   // The MBProject we are associated with.
   MBProject *project_;
+
+  // Whether anything has been read since -launch.
+  BOOL sawOutput_;
 }
 
 + (id)taskWithProject:(MBProject *)project;
@@ -78,6 +81,9 @@ limitations under the License.
 - (void)launch;
 - (void)interrupt;
 - (void)waitUntilExit;
+- (BOOL)isRunning;
+- (int)processIdentifier;    // 0 if not yet launched
+- (int)terminationStatus;    // only valid once the task has exited
 
 @end  // MBEngineTask
 
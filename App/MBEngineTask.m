@@ -16,10 +16,14 @@ limitations under the License.
 #import "MBEngineTask.h"
 #import "MBLogFilter.h"
 #import "MBProject.h"
+#import "MBMetrics.h"
+#import "MBTraceRecorder.h"
+#import <string.h>
 
 @interface MBEngineTask (Private)
 - (void)startListening;
 - (void)stopListening;
+- (void)countLogData:(NSData *)data decoded:(BOOL)decoded;
 @end
 
 @implementation MBEngineTask
@@ -111,12 +115,18 @@ limitations under the License.
 
 // Called from an NSNotification when we get input
 - (void)dataIsAvailable:(NSNotification *)notification {
+  NSData *data = [[notification userInfo]
+                     objectForKey:NSFileHandleNotificationDataItem];
+  NSString *string = [[[NSString alloc] initWithData:data
+                                            encoding:NSUTF8StringEncoding]
+                       autorelease];
+  [self countLogData:data decoded:(string != nil)];
+  if (!sawOutput_ && [data length]) {
+    sawOutput_ = YES;
+    MBTraceRecordTask("output", [self processIdentifier],
+                      [[project_ name] UTF8String]);
+  }
   if (receiver_) {
-    NSData *data = [[notification userInfo]
-                       objectForKey:NSFileHandleNotificationDataItem];
-    NSString *string = [[[NSString alloc] initWithData:data
-                                              encoding:NSUTF8StringEncoding]
-                         autorelease];
 
     // Give our filter a chance to see it... or change it.
     if (filter_)
@@ -131,6 +141,31 @@ limitations under the License.
   [handle readInBackgroundAndNotify];
 }
 
+// Adds |data| to the log metrics for our project.  A chunk that isn't
+// valid UTF-8 never reaches the console, so its lines count as dropped.
+- (void)countLogData:(NSData *)data decoded:(BOOL)decoded {
+  NSUInteger length = [data length];
+  if (length == 0)
+    return;
+  const char *bytes = [data bytes];
+  unsigned lines = 0;
+  const char *newline = bytes;
+  while ((newline = memchr(newline, '\n', bytes + length - newline))) {
+    lines++;
+    newline++;
+  }
+
+  MBMetrics *metrics = [MBMetrics sharedMetrics];
+  NSString *name = [project_ name];
+  NSDictionary *labels =
+    [NSDictionary dictionaryWithObject:(name ? name : @"") forKey:@"project"];
+  [metrics addValue:length toCounter:@"launcher_log_bytes_total" labels:labels];
+  [metrics addValue:lines toCounter:@"launcher_log_lines_total" labels:labels];
+  if (!decoded)
+    [metrics addValue:(lines ? lines : 1)
+            toCounter:@"launcher_log_dropped_lines_total"
+               labels:labels];
+}
 
 // Want private; need to expose for task death notification
 - (NSTask *)task {
@@ -155,6 +190,7 @@ limitations under the License.
 }
 
 - (void)launch {
+  sawOutput_ = NO;
   [self startListening];
   [task_ launch];
 }
@@ -163,6 +199,18 @@ limitations under the License.
   [task_ interrupt];
 }
 
+- (BOOL)isRunning {
+  return [task_ isRunning];
+}
+
+- (int)processIdentifier {
+  return [task_ processIdentifier];
+}
+
+- (int)terminationStatus {
+  return [task_ terminationStatus];
+}
+
 - (void)waitUntilExit {
   [task_ waitUntilExit];
 
@@ -0,0 +1,121 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// MBLogBenchmark
+//
+// Measures the path dev_appserver's output takes through the launcher:
+// MBEngineTask reads the pipe, runs it past its MBLogFilter, and hands it
+// to the console. An MBLogBenchmark sits at the end of that path as the
+// task's output receiver, passes everything on to the real receiver (an
+// MBConsoleController), and then looks at what arrived.
+//
+// It expects lines written by fakeappserver, each of which carries
+// "#<sequence>@<microseconds>": its line number and when it was written.
+// From those it counts lines lost or out of order, and how long
+// each line took from the write() to having been shown. Lines without a
+// marker (the startup banner, say) are passed on but not measured. Chunks
+// which weren't valid UTF-8, and so reach the receiver as nil, are
+// counted too; their lines show up as dropped.
+//
+// Example (see logbench.m):
+//
+//   MBLogBenchmark *benchmark =
+//     [[MBLogBenchmark alloc] initWithReceiver:console];
+//   [task setOutputReceiver:benchmark];
+//   [benchmark start];
+//   [task launch];
+//   ... run the run loop until [benchmark isFinished] ...
+//   [benchmark finish];
+//   printf("%s", [[benchmark report] UTF8String]);
+
+#import <Foundation/Foundation.h>
+#import "MBEngineTask.h"
+
+@interface MBLogBenchmark : NSObject <MBEngineTaskOutputReceiver> {
+ @private
+  id<MBEngineTaskOutputReceiver> receiver_;  // weak
+  NSMutableData *partial_;        // the start of a line yet to be finished
+  NSMutableData *latencies_;      // one uint32_t (microseconds) per line
+
+  unsigned long chunks_;
+  unsigned long undecodableChunks_;
+  unsigned long long bytes_;
+  unsigned long lines_;           // every line, marked or not
+  unsigned long markedLines_;
+  unsigned long nextSequence_;    // the sequence number expected next
+  unsigned long dropped_;
+  unsigned long outOfOrder_;      // repeated, or arrived after a later one
+  long expectedLines_;            // from the trailer; -1 until then
+  BOOL sawEndOfFile_;
+
+  NSTimeInterval startTime_;
+  NSTimeInterval launchedTime_;   // when the launch-complete hook fired
+  NSTimeInterval firstLineTime_;
+  NSTimeInterval lastLineTime_;
+  NSTimeInterval receiverTime_;   // spent inside |receiver_|
+  NSTimeInterval finishTime_;
+
+  unsigned long long startMemory_;  // resident bytes
+  unsigned long long peakMemory_;
+  unsigned long long endMemory_;
+}
+
+// Designated initializer. Everything received is passed on to |receiver|,
+// which may be nil.
+- (id)initWithReceiver:(id<MBEngineTaskOutputReceiver>)receiver;
+
+// Notes the time and memory use before the task is launched.
+- (void)start;
+
+// The target of a launch-complete callback on the task's MBLogFilter
+// (-[MBLogFilter addProjectLaunchCompleteCallback:]).
+- (void)launchCompleted;
+
+// YES once the pipe has reached end of file, i.e. the task has exited and
+// everything it wrote has been received.
+- (BOOL)isFinished;
+
+// Notes the time and memory use at the end.
+- (void)finish;
+
+// Lines received, and those with a marker.
+- (unsigned long)lineCount;
+- (unsigned long)markedLineCount;
+
+// Marked lines which never arrived, counting any missing from the end if
+// the trailer said how many were written.
+- (unsigned long)droppedLineCount;
+- (unsigned long)outOfOrderLineCount;
+- (unsigned long)undecodableChunkCount;
+
+// Marked lines per second, from the first to the last one received.
+- (double)linesPerSecond;
+
+// The latency (in milliseconds) which |percent| percent of the marked lines
+// were within, e.g. 99 for the 99th percentile; 100 is the maximum.
+- (double)latencyPercentile:(double)percent;
+
+// Growth in resident memory from -start to -finish, and at its peak while
+// running, in bytes.
+- (long long)memoryGrowth;
+- (long long)peakMemoryGrowth;
+
+// Seconds from -start to the launch-complete hook, or -1 if it never ran.
+- (NSTimeInterval)timeToLaunch;
+
+// A summary, one "name: value" per line.
+- (NSString *)report;
+
+@end
@@ -0,0 +1,307 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import "MBLogBenchmark.h"
+#import <mach/mach.h>
+#import <math.h>
+#import <stdlib.h>
+#import <string.h>
+#import <sys/time.h>
+
+static NSString *const kTrailer = @"fakeappserver: done, wrote ";
+
+@interface MBLogBenchmark (PrivateMethods)
+- (void)processLine:(const char *)line length:(size_t)length
+                 at:(unsigned long long)now;
+- (void)sampleMemory;
+@end
+
+// Wall clock time in microseconds, the same clock fakeappserver stamps its
+// lines with.
+static unsigned long long MBLogBenchmarkNow(void) {
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return (unsigned long long)now.tv_sec * 1000000 + now.tv_usec;
+}
+
+static unsigned long long MBLogBenchmarkResidentMemory(void) {
+  struct task_basic_info info;
+  mach_msg_type_number_t count = TASK_BASIC_INFO_COUNT;
+  if (task_info(mach_task_self(), TASK_BASIC_INFO,
+                (task_info_t)&info, &count) != KERN_SUCCESS)
+    return 0;
+  return info.resident_size;
+}
+
+// Finds "#<sequence>@<microseconds>" in |line|. Returns NO if there isn't
+// one.
+static BOOL MBLogBenchmarkFindMarker(const char *line, size_t length,
+                                     unsigned long *sequence,
+                                     unsigned long long *written) {
+  const char *end = line + length;
+  for (const char *p = line; p < end; p++) {
+    if (*p != '#')
+      continue;
+    const char *q = p + 1;
+    unsigned long seq = 0;
+    while (q < end && *q >= '0' && *q <= '9')
+      seq = seq * 10 + (*q++ - '0');
+    if (q == p + 1 || q == end || *q != '@')
+      continue;
+    const char *r = ++q;
+    unsigned long long usec = 0;
+    while (r < end && *r >= '0' && *r <= '9')
+      usec = usec * 10 + (*r++ - '0');
+    if (r == q)
+      continue;
+    *sequence = seq;
+    *written = usec;
+    return YES;
+  }
+  return NO;
+}
+
+static int MBLogBenchmarkCompareLatencies(const void *a, const void *b) {
+  uint32_t x = *(const uint32_t *)a;
+  uint32_t y = *(const uint32_t *)b;
+  return (x < y) ? -1 : (x > y);
+}
+
+@implementation MBLogBenchmark
+
+- (id)init {
+  return [self initWithReceiver:nil];
+}
+
+- (id)initWithReceiver:(id<MBEngineTaskOutputReceiver>)receiver {
+  if ((self = [super init])) {
+    receiver_ = receiver;
+    partial_ = [[NSMutableData alloc] init];
+    latencies_ = [[NSMutableData alloc] init];
+    nextSequence_ = 1;
+    expectedLines_ = -1;
+    launchedTime_ = -1;
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [partial_ release];
+  [latencies_ release];
+  [super dealloc];
+}
+
+- (void)start {
+  startTime_ = MBLogBenchmarkNow() / 1e6;
+  startMemory_ = MBLogBenchmarkResidentMemory();
+  peakMemory_ = startMemory_;
+}
+
+- (void)launchCompleted {
+  launchedTime_ = MBLogBenchmarkNow() / 1e6;
+}
+
+- (void)processString:(NSString *)string {
+  unsigned long long before = MBLogBenchmarkNow();
+  [receiver_ processString:string];
+  unsigned long long now = MBLogBenchmarkNow();
+  receiverTime_ += (now - before) / 1e6;
+
+  if (string == nil) {
+    // MBEngineTask couldn't decode the chunk; its lines are lost.
+    chunks_++;
+    undecodableChunks_++;
+    return;
+  }
+  const char *utf8 = [string UTF8String];
+  size_t length = strlen(utf8);
+  if (length == 0) {
+    sawEndOfFile_ = YES;
+    return;
+  }
+  chunks_++;
+  bytes_ += length;
+  [self sampleMemory];
+
+  // Every line is timed when the chunk finishing it has been shown.
+  [partial_ appendBytes:utf8 length:length];
+  const char *bytes = [partial_ bytes];
+  size_t available = [partial_ length];
+  size_t used = 0;
+  const char *newline;
+  while ((newline = memchr(bytes + used, '\n', available - used))) {
+    [self processLine:bytes + used length:newline - (bytes + used) at:now];
+    used = newline + 1 - bytes;
+  }
+  [partial_ replaceBytesInRange:NSMakeRange(0, used) withBytes:NULL length:0];
+}
+
+- (BOOL)isFinished {
+  return sawEndOfFile_;
+}
+
+- (void)finish {
+  // A last line without a newline still counts.
+  if ([partial_ length]) {
+    [self processLine:[partial_ bytes] length:[partial_ length]
+                   at:MBLogBenchmarkNow()];
+    [partial_ setLength:0];
+  }
+  finishTime_ = MBLogBenchmarkNow() / 1e6;
+  [self sampleMemory];
+  endMemory_ = MBLogBenchmarkResidentMemory();
+}
+
+- (unsigned long)lineCount {
+  return lines_;
+}
+
+- (unsigned long)markedLineCount {
+  return markedLines_;
+}
+
+- (unsigned long)droppedLineCount {
+  unsigned long dropped = dropped_;
+  if (expectedLines_ >= (long)nextSequence_)
+    dropped += expectedLines_ - (nextSequence_ - 1);
+  return dropped;
+}
+
+- (unsigned long)outOfOrderLineCount {
+  return outOfOrder_;
+}
+
+- (unsigned long)undecodableChunkCount {
+  return undecodableChunks_;
+}
+
+- (double)linesPerSecond {
+  NSTimeInterval elapsed = lastLineTime_ - firstLineTime_;
+  if (markedLines_ < 2 || elapsed <= 0)
+    return 0;
+  // The first line starts the clock.
+  return (markedLines_ - 1) / elapsed;
+}
+
+- (double)latencyPercentile:(double)percent {
+  size_t count = [latencies_ length] / sizeof(uint32_t);
+  if (count == 0)
+    return 0;
+  uint32_t *latencies = [latencies_ mutableBytes];
+  qsort(latencies, count, sizeof(uint32_t), MBLogBenchmarkCompareLatencies);
+  // The smallest value at least |percent| of the lines are within.
+  size_t rank = (size_t)ceil(percent / 100.0 * count);
+  if (rank < 1)
+    rank = 1;
+  if (rank > count)
+    rank = count;
+  return latencies[rank - 1] / 1000.0;
+}
+
+- (long long)memoryGrowth {
+  return (long long)endMemory_ - (long long)startMemory_;
+}
+
+- (long long)peakMemoryGrowth {
+  return (long long)peakMemory_ - (long long)startMemory_;
+}
+
+- (NSTimeInterval)timeToLaunch {
+  if (launchedTime_ < 0)
+    return -1;
+  return launchedTime_ - startTime_;
+}
+
+- (NSString *)report {
+  NSMutableString *report = [NSMutableString string];
+  NSTimeInterval run = finishTime_ - startTime_;
+  [report appendFormat:@"lines: %lu\n", lines_];
+  [report appendFormat:@"measured lines: %lu\n", markedLines_];
+  if (expectedLines_ >= 0)
+    [report appendFormat:@"lines written: %ld\n", expectedLines_];
+  else
+    [report appendString:@"lines written: unknown (no trailer)\n"];
+  [report appendFormat:@"bytes: %llu in %lu reads\n", bytes_, chunks_];
+  [report appendFormat:@"lines/sec: %.0f\n", [self linesPerSecond]];
+  [report appendFormat:@"latency p50 (ms): %.3f\n",
+                       [self latencyPercentile:50]];
+  [report appendFormat:@"latency p90 (ms): %.3f\n",
+                       [self latencyPercentile:90]];
+  [report appendFormat:@"latency p99 (ms): %.3f\n",
+                       [self latencyPercentile:99]];
+  [report appendFormat:@"latency max (ms): %.3f\n",
+                       [self latencyPercentile:100]];
+  [report appendFormat:@"dropped lines: %lu\n", [self droppedLineCount]];
+  [report appendFormat:@"out of order lines: %lu\n", outOfOrder_];
+  [report appendFormat:@"undecodable reads: %lu\n", undecodableChunks_];
+  if (launchedTime_ >= 0)
+    [report appendFormat:@"time to launch (s): %.3f\n", [self timeToLaunch]];
+  else
+    [report appendString:@"time to launch (s): never\n"];
+  [report appendFormat:@"time in receiver (s): %.3f of %.3f\n",
+                       receiverTime_, run];
+  [report appendFormat:@"memory growth (KB): %lld\n",
+                       [self memoryGrowth] / 1024];
+  [report appendFormat:@"peak memory growth (KB): %lld\n",
+                       [self peakMemoryGrowth] / 1024];
+  return report;
+}
+
+@end  // MBLogBenchmark
+
+
+@implementation MBLogBenchmark (PrivateMethods)
+
+- (void)processLine:(const char *)line length:(size_t)length
+                 at:(unsigned long long)now {
+  lines_++;
+  unsigned long sequence;
+  unsigned long long written;
+  if (!MBLogBenchmarkFindMarker(line, length, &sequence, &written)) {
+    const char *trailer = [kTrailer UTF8String];
+    size_t trailerLength = strlen(trailer);
+    for (size_t i = 0; i + trailerLength <= length; i++) {
+      if (memcmp(line + i, trailer, trailerLength) == 0) {
+        expectedLines_ = strtol(line + i + trailerLength, NULL, 10);
+        break;
+      }
+    }
+    return;
+  }
+
+  markedLines_++;
+  if (markedLines_ == 1)
+    firstLineTime_ = now / 1e6;
+  lastLineTime_ = now / 1e6;
+  uint32_t latency = (now > written) ? (uint32_t)(now - written) : 0;
+  [latencies_ appendBytes:&latency length:sizeof(latency)];
+
+  if (sequence == nextSequence_) {
+    nextSequence_++;
+  } else if (sequence > nextSequence_) {
+    dropped_ += sequence - nextSequence_;
+    nextSequence_ = sequence + 1;
+  } else {
+    outOfOrder_++;
+  }
+}
+
+- (void)sampleMemory {
+  unsigned long long resident = MBLogBenchmarkResidentMemory();
+  if (resident > peakMemory_)
+    peakMemory_ = resident;
+}
+
+@end  // PrivateMethods
@@ -0,0 +1,30 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import <SenTestingKit/SenTestingKit.h>
+
+@interface MBLogBenchmarkTest : SenTestCase {
+  NSMutableString *output_;  // what the benchmark passed on
+}
+
+- (void)testPassesEverythingOn;
+- (void)testLinesSplitAcrossReads;
+- (void)testDroppedAndOutOfOrder;
+- (void)testLatencyPercentiles;
+- (void)testEndOfFile;
+- (void)testLaunchCompleted;
+- (void)testEngineTask;
+
+@end
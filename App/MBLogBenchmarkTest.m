@@ -0,0 +1,182 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import <SenTestingKit/SenTestingKit.h>
+#import <Cocoa/Cocoa.h>
+#import <sys/time.h>
+#import "MBEngineTask.h"
+#import "MBLogBenchmark.h"
+#import "MBLogBenchmarkTest.h"
+
+static unsigned long long NowMicroseconds(void) {
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return (unsigned long long)now.tv_sec * 1000000 + now.tv_usec;
+}
+
+// A line as fakeappserver writes it, written |age| microseconds ago.
+static NSString *MarkedLine(unsigned long sequence, unsigned long long age) {
+  return [NSString stringWithFormat:@"INFO main.py:1] #%lu@%llu hello\n",
+          sequence, NowMicroseconds() - age];
+}
+
+@implementation MBLogBenchmarkTest
+
+- (void)setUp {
+  output_ = [[NSMutableString alloc] init];
+}
+
+- (void)tearDown {
+  [output_ release];
+}
+
+- (void)processString:(NSString *)string {
+  if (string)
+    [output_ appendString:string];
+}
+
+- (void)testPassesEverythingOn {
+  MBLogBenchmark *b = [[[MBLogBenchmark alloc] initWithReceiver:self]
+                        autorelease];
+  [b start];
+  [b processString:@"Running application x on port 8080: http://localhost:8080\n"];
+  [b processString:@"partial"];
+  STAssertEqualObjects(output_, @"Running application x on port 8080: "
+                       @"http://localhost:8080\npartial", nil);
+  STAssertEquals([b lineCount], 1UL, nil);
+  STAssertEquals([b markedLineCount], 0UL, nil);
+
+  // No receiver is fine too.
+  b = [[[MBLogBenchmark alloc] initWithReceiver:nil] autorelease];
+  [b processString:MarkedLine(1, 0)];
+  STAssertEquals([b markedLineCount], 1UL, nil);
+}
+
+- (void)testLinesSplitAcrossReads {
+  MBLogBenchmark *b = [[[MBLogBenchmark alloc] initWithReceiver:self]
+                        autorelease];
+  [b start];
+  NSMutableString *all = [NSMutableString string];
+  for (unsigned long i = 1; i <= 50; i++)
+    [all appendString:MarkedLine(i, 0)];
+  // Read 7 characters at a time, splitting lines and markers.
+  for (unsigned i = 0; i < [all length]; i += 7) {
+    unsigned length = MIN(7, [all length] - i);
+    [b processString:[all substringWithRange:NSMakeRange(i, length)]];
+  }
+  [b finish];
+  STAssertEqualObjects(output_, all, nil);
+  STAssertEquals([b lineCount], 50UL, nil);
+  STAssertEquals([b markedLineCount], 50UL, nil);
+  STAssertEquals([b droppedLineCount], 0UL, nil);
+  STAssertEquals([b outOfOrderLineCount], 0UL, nil);
+
+  // A last line without a newline counts once finished.
+  b = [[[MBLogBenchmark alloc] initWithReceiver:nil] autorelease];
+  [b processString:@"#1@1"];
+  STAssertEquals([b lineCount], 0UL, nil);
+  [b finish];
+  STAssertEquals([b lineCount], 1UL, nil);
+}
+
+- (void)testDroppedAndOutOfOrder {
+  MBLogBenchmark *b = [[[MBLogBenchmark alloc] initWithReceiver:nil]
+                        autorelease];
+  [b start];
+  [b processString:[MarkedLine(1, 0) stringByAppendingString:MarkedLine(2, 0)]];
+  [b processString:MarkedLine(5, 0)];  // 3 and 4 lost
+  [b processString:MarkedLine(4, 0)];  // late
+  [b processString:MarkedLine(6, 0)];
+  STAssertEquals([b droppedLineCount], 2UL, nil);
+  STAssertEquals([b outOfOrderLineCount], 1UL, nil);
+
+  // The trailer says 2 more were written.
+  [b processString:@"INFO     fakeappserver: done, wrote 8 lines\n"];
+  [b finish];
+  STAssertEquals([b droppedLineCount], 4UL, nil);
+  STAssertEquals([b lineCount], 6UL, nil);
+  STAssertEquals([b markedLineCount], 5UL, nil);
+  NSString *report = [b report];
+  STAssertTrue([report rangeOfString:@"dropped lines: 4\n"].length, report);
+  STAssertTrue([report rangeOfString:@"lines written: 8\n"].length, report);
+}
+
+- (void)testLatencyPercentiles {
+  MBLogBenchmark *b = [[[MBLogBenchmark alloc] initWithReceiver:nil]
+                        autorelease];
+  STAssertEquals([b latencyPercentile:50], 0.0, nil);
+  [b start];
+  // Written 10ms, 20ms, ... 1s ago.
+  NSMutableString *lines = [NSMutableString string];
+  for (unsigned long i = 1; i <= 100; i++)
+    [lines appendString:MarkedLine(i, i * 10000)];
+  [b processString:lines];
+  [b finish];
+
+  // Allow for the time the test itself takes.
+  double p50 = [b latencyPercentile:50];
+  STAssertTrue(p50 >= 500 && p50 < 600, @"%f", p50);
+  double p99 = [b latencyPercentile:99];
+  STAssertTrue(p99 >= 990 && p99 < 1090, @"%f", p99);
+  double max = [b latencyPercentile:100];
+  STAssertTrue(max >= 1000 && max < 1100, @"%f", max);
+  STAssertTrue([b latencyPercentile:0] >= 10, nil);
+  STAssertTrue([b latencyPercentile:0] <= p50, nil);
+}
+
+- (void)testEndOfFile {
+  MBLogBenchmark *b = [[[MBLogBenchmark alloc] initWithReceiver:self]
+                        autorelease];
+  [b start];
+  [b processString:MarkedLine(1, 0)];
+  STAssertFalse([b isFinished], nil);
+  // A read MBEngineTask couldn't turn into a string.
+  [b processString:nil];
+  STAssertEquals([b undecodableChunkCount], 1UL, nil);
+  STAssertFalse([b isFinished], nil);
+  [b processString:@""];
+  STAssertTrue([b isFinished], nil);
+  [b finish];
+  STAssertTrue([[b report] rangeOfString:@"undecodable reads: 1\n"].length,
+               nil);
+}
+
+- (void)testLaunchCompleted {
+  MBLogBenchmark *b = [[[MBLogBenchmark alloc] initWithReceiver:nil]
+                        autorelease];
+  [b start];
+  STAssertEquals([b timeToLaunch], -1.0, nil);
+  [b launchCompleted];
+  STAssertTrue([b timeToLaunch] >= 0 && [b timeToLaunch] < 1, nil);
+}
+
+- (void)testEngineTask {
+  MBLogBenchmark *b = [[[MBLogBenchmark alloc] initWithReceiver:self]
+                        autorelease];
+  MBEngineTask *t = [MBEngineTask taskWithProject:nil];
+  [t setOutputReceiver:b];
+  [t setLaunchPath:@"/bin/sh"];
+  [t setArguments:[NSArray arrayWithObjects:@"-c",
+                   @"printf 'a #1@1\\nb #2@1\\n' >&2", nil]];
+  [b start];
+  [t launch];
+  [t waitUntilExit];
+  [b finish];
+  STAssertEquals([b markedLineCount], 2UL, output_);
+  STAssertEquals([b droppedLineCount], 0UL, nil);
+  STAssertEqualObjects(output_, @"a #1@1\nb #2@1\n", nil);
+}
+
+@end
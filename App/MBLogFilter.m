@@ -17,6 +17,7 @@ limitations under the License.
 
 #include <string.h>
 #import "GMRegex.h"
+#import "MBMetrics.h"
 
 
 @interface MBLogFilter (Private)
@@ -64,7 +65,12 @@ limitations under the License.
   NSMutableIndexSet *firedHooks = [NSMutableIndexSet indexSet];
   for (unsigned int i = 0; i < [hooks_ count]; ++i) {
     NSDictionary *hook = [hooks_ objectAtIndex:i];
-    if ([line matchesPattern:[hook objectForKey:@"regex"]]) {
+    NSString *regex = [hook objectForKey:@"regex"];
+    if ([line matchesPattern:regex]) {
+      [[MBMetrics sharedMetrics]
+        addValue:1
+       toCounter:@"launcher_log_hook_matches_total"
+          labels:[NSDictionary dictionaryWithObject:regex forKey:@"regex"]];
       [[hook objectForKey:@"callback"] invoke];
       [firedHooks addIndex:i];
     }
@@ -78,6 +78,7 @@ limitations under the License.
       NSArray *nameArray = [names componentsSeparatedByString:splitString];
       NSString *name = nil;
       NSEnumerator *nenum = [nameArray objectEnumerator];
+      [projectController_ beginBatchUpdate];
       while ((name = [nenum nextObject]) != nil) {
         NSCharacterSet *whitespace = [NSCharacterSet whitespaceAndNewlineCharacterSet];
         name = [name stringByTrimmingCharactersInSet:whitespace];
@@ -85,6 +86,7 @@ limitations under the License.
           [projectController_ addProjectForDirectory:name];
         }
       }
+      [projectController_ commitBatchUpdate];
     }
   }
 }
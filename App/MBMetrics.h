@@ -0,0 +1,99 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import <Foundation/Foundation.h>
+#import <pthread.h>
+
+@class MBMetrics;
+
+typedef enum {
+  kMBMetricCounter = 0,
+  kMBMetricGauge,
+  kMBMetricHistogram
+} MBMetricType;
+
+// Something whose metrics are read when they're asked for, rather than
+// kept up to date as they change (e.g. the memory a child process uses).
+@protocol MBMetricsCollector
+// Set (or add to) metrics in |metrics|. Called on the thread calling
+// -exposition, which for MBMetricsServer is the main thread.
+- (void)collectMetrics:(MBMetrics *)metrics;
+@end
+
+// MBMetrics keeps the launcher's counters, gauges and histograms, and
+// prints them in the Prometheus text format (version 0.0.4):
+//
+//   # HELP launcher_log_lines_total Log lines read from each project.
+//   # TYPE launcher_log_lines_total counter
+//   launcher_log_lines_total{project="guestbook"} 1234
+//
+// Each sample is a metric name plus labels (a dictionary of strings,
+// possibly empty or nil). The launcher's metrics are described in
+// MBMetrics.m, so all of them are listed in one place; using any other
+// name creates it, with no help text. Values can be set from any thread.
+//
+// Example:
+//
+//   NSDictionary *labels = [NSDictionary dictionaryWithObject:[project name]
+//                                                      forKey:@"project"];
+//   [[MBMetrics sharedMetrics] addValue:1
+//                             toCounter:@"launcher_task_spawns_total"
+//                                labels:labels];
+@interface MBMetrics : NSObject <MBMetricsCollector> {
+ @private
+  pthread_mutex_t lock_;
+  NSMutableDictionary *families_;  // name -> MBMetricFamily
+  NSMutableArray *collectors_;     // not retained
+}
+
+// The launcher's metrics, including its own memory and CPU time.
++ (MBMetrics *)sharedMetrics;
+
+// Describes a metric. Histograms need |buckets|, an ascending array of
+// NSNumber upper bounds (+Inf is implied); other types ignore it.
+// Describing a metric again replaces it, dropping its samples.
+- (void)defineMetric:(NSString *)name
+                type:(MBMetricType)type
+                help:(NSString *)help
+             buckets:(NSArray *)buckets;
+
+- (void)addValue:(double)value
+       toCounter:(NSString *)name
+          labels:(NSDictionary *)labels;
+// Sets a gauge, or a counter kept somewhere else (e.g. by a collector).
+// Creates a gauge if |name| hasn't been described.
+- (void)setValue:(double)value
+       forMetric:(NSString *)name
+          labels:(NSDictionary *)labels;
+- (void)observeValue:(double)value
+         inHistogram:(NSString *)name
+              labels:(NSDictionary *)labels;
+
+// Forgets every sample of |name|, e.g. so a collector can start again
+// without leaving behind projects which have gone.
+- (void)removeSamplesForMetric:(NSString *)name;
+
+// A counter's or gauge's value, a histogram's count, or 0 if there's no
+// such sample.
+- (double)valueForMetric:(NSString *)name labels:(NSDictionary *)labels;
+
+// Collectors are not retained; remove them before they go away.
+- (void)addCollector:(id<MBMetricsCollector>)collector;
+- (void)removeCollector:(id<MBMetricsCollector>)collector;
+
+// Runs the collectors, then returns every metric as text.
+- (NSString *)exposition;
+
+@end
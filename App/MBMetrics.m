@@ -0,0 +1,393 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import "MBMetrics.h"
+#import <mach/mach.h>
+#import <stdlib.h>
+#import <sys/resource.h>
+
+// Histogram bucket upper bounds, ending with -1.
+static const double kMBReadyBuckets[] = { 0.5, 1, 2, 5, 10, 30, 60, -1 };
+static const double kMBRequestBuckets[] = {
+  0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10, -1
+};
+
+// Everything the launcher publishes.
+static const struct {
+  NSString *name;
+  MBMetricType type;
+  NSString *help;
+  const double *buckets;  // histograms only
+} kMBLauncherMetrics[] = {
+  { @"launcher_projects", kMBMetricGauge,
+    @"Projects in each run state." },
+  { @"launcher_task_spawns_total", kMBMetricCounter,
+    @"dev_appserver processes started, by project." },
+  { @"launcher_task_restarts_total", kMBMetricCounter,
+    @"Starts of a project which had already been started since launch." },
+  { @"launcher_task_exits_total", kMBMetricCounter,
+    @"dev_appserver processes which have exited, by project." },
+  { @"launcher_task_deploys_total", kMBMetricCounter,
+    @"appcfg.py deploys started, by project." },
+  { @"launcher_task_ready_seconds", kMBMetricHistogram,
+    @"Time from starting dev_appserver to it serving.", kMBReadyBuckets },
+  { @"launcher_task_resident_memory_bytes", kMBMetricGauge,
+    @"Resident memory of each running dev_appserver." },
+  { @"launcher_task_cpu_seconds_total", kMBMetricCounter,
+    @"CPU time used by each running dev_appserver." },
+  { @"launcher_log_bytes_total", kMBMetricCounter,
+    @"Log output read from each project." },
+  { @"launcher_log_lines_total", kMBMetricCounter,
+    @"Log lines read from each project." },
+  { @"launcher_log_dropped_lines_total", kMBMetricCounter,
+    @"Log lines read but lost because they weren't valid UTF-8." },
+  { @"launcher_log_hook_matches_total", kMBMetricCounter,
+    @"Log lines which fired a log filter hook, by regex." },
+  { @"launcher_main_thread_stalls_total", kMBMetricCounter,
+    @"Times the main thread stopped servicing its run loop for too long." },
+  { @"launcher_main_thread_stall_seconds_total", kMBMetricCounter,
+    @"Time the main thread spent stalled, by what it was doing." },
+  { @"launcher_proxy_requests_total", kMBMetricCounter,
+    @"Requests through the proxy, by project and status code." },
+  { @"launcher_proxy_request_seconds", kMBMetricHistogram,
+    @"Time per proxied request, split into waiting on dev_appserver "
+    @"(part=\"backend\") and everything else (part=\"proxy\").",
+    kMBRequestBuckets },
+  { @"launcher_proxy_backend_connections_total", kMBMetricCounter,
+    @"Connections to dev_appserver used by the proxy, by whether they "
+    @"were reused from the keep-alive pool." },
+  { @"process_resident_memory_bytes", kMBMetricGauge,
+    @"Resident memory of the launcher." },
+  { @"process_cpu_seconds_total", kMBMetricCounter,
+    @"CPU time used by the launcher." },
+};
+
+// One metric: its description and samples.
+@interface MBMetricFamily : NSObject {
+ @public
+  MBMetricType type_;
+  NSString *help_;
+  NSArray *buckets_;              // of NSNumber, for histograms
+  NSMutableDictionary *samples_;  // rendered labels -> NSMutableData
+}
+@end
+
+@implementation MBMetricFamily
+
+- (void)dealloc {
+  [help_ release];
+  [buckets_ release];
+  [samples_ release];
+  [super dealloc];
+}
+
+@end
+
+
+@interface MBMetrics (PrivateMethods)
+- (MBMetricFamily *)familyNamed:(NSString *)name type:(MBMetricType)type;
+- (double *)valuesForSample:(NSDictionary *)labels
+                   inFamily:(MBMetricFamily *)family;
+- (void)collectProcessMetrics;
+@end
+
+// Escapes a label value for the text format.
+static NSString *MBMetricsEscape(NSString *value) {
+  NSMutableString *escaped = [NSMutableString stringWithString:value];
+  [escaped replaceOccurrencesOfString:@"\\" withString:@"\\\\"
+                              options:0
+                                range:NSMakeRange(0, [escaped length])];
+  [escaped replaceOccurrencesOfString:@"\"" withString:@"\\\""
+                              options:0
+                                range:NSMakeRange(0, [escaped length])];
+  [escaped replaceOccurrencesOfString:@"\n" withString:@"\\n"
+                              options:0
+                                range:NSMakeRange(0, [escaped length])];
+  return escaped;
+}
+
+// 'key="value",...' in key order, so the same labels always give the same
+// sample.
+static NSString *MBMetricsRenderLabels(NSDictionary *labels) {
+  if ([labels count] == 0)
+    return @"";
+  NSMutableString *rendered = [NSMutableString string];
+  NSArray *keys = [[labels allKeys] sortedArrayUsingSelector:@selector(compare:)];
+  NSEnumerator *keyEnumerator = [keys objectEnumerator];
+  NSString *key = nil;
+  while ((key = [keyEnumerator nextObject])) {
+    [rendered appendFormat:@"%@%@=\"%@\"", ([rendered length] ? @"," : @""),
+              key, MBMetricsEscape([[labels objectForKey:key] description])];
+  }
+  return rendered;
+}
+
+static NSString *MBMetricsNumber(double value) {
+  return [NSString stringWithFormat:@"%.15g", value];
+}
+
+static MBMetrics *gSharedMetrics = nil;
+
+@implementation MBMetrics
+
++ (MBMetrics *)sharedMetrics {
+  @synchronized(self) {
+    if (gSharedMetrics == nil) {
+      gSharedMetrics = [[self alloc] init];
+      for (size_t i = 0;
+           i < sizeof(kMBLauncherMetrics) / sizeof(kMBLauncherMetrics[0]);
+           i++) {
+        NSMutableArray *buckets = [NSMutableArray array];
+        const double *bound = kMBLauncherMetrics[i].buckets;
+        for (; bound && *bound >= 0; bound++)
+          [buckets addObject:[NSNumber numberWithDouble:*bound]];
+        [gSharedMetrics defineMetric:kMBLauncherMetrics[i].name
+                                type:kMBLauncherMetrics[i].type
+                                help:kMBLauncherMetrics[i].help
+                             buckets:buckets];
+      }
+      [gSharedMetrics addCollector:gSharedMetrics];
+    }
+  }
+  return gSharedMetrics;
+}
+
+- (id)init {
+  if ((self = [super init])) {
+    pthread_mutex_init(&lock_, NULL);
+    families_ = [[NSMutableDictionary alloc] init];
+    collectors_ = [[NSMutableArray alloc] init];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [families_ release];
+  [collectors_ release];
+  pthread_mutex_destroy(&lock_);
+  [super dealloc];
+}
+
+- (void)defineMetric:(NSString *)name
+                type:(MBMetricType)type
+                help:(NSString *)help
+             buckets:(NSArray *)buckets {
+  MBMetricFamily *family = [[[MBMetricFamily alloc] init] autorelease];
+  family->type_ = type;
+  family->help_ = [help copy];
+  if (type == kMBMetricHistogram)
+    family->buckets_ = [buckets copy];
+  family->samples_ = [[NSMutableDictionary alloc] init];
+  pthread_mutex_lock(&lock_);
+  [families_ setObject:family forKey:name];
+  pthread_mutex_unlock(&lock_);
+}
+
+- (void)addValue:(double)value
+       toCounter:(NSString *)name
+          labels:(NSDictionary *)labels {
+  pthread_mutex_lock(&lock_);
+  MBMetricFamily *family = [self familyNamed:name type:kMBMetricCounter];
+  [self valuesForSample:labels inFamily:family][0] += value;
+  pthread_mutex_unlock(&lock_);
+}
+
+- (void)setValue:(double)value
+       forMetric:(NSString *)name
+          labels:(NSDictionary *)labels {
+  pthread_mutex_lock(&lock_);
+  MBMetricFamily *family = [self familyNamed:name type:kMBMetricGauge];
+  [self valuesForSample:labels inFamily:family][0] = value;
+  pthread_mutex_unlock(&lock_);
+}
+
+- (void)observeValue:(double)value
+         inHistogram:(NSString *)name
+              labels:(NSDictionary *)labels {
+  pthread_mutex_lock(&lock_);
+  MBMetricFamily *family = [self familyNamed:name type:kMBMetricHistogram];
+  double *values = [self valuesForSample:labels inFamily:family];
+  // A count for each bucket (not cumulative), then the sum and the count.
+  unsigned buckets = [family->buckets_ count];
+  for (unsigned i = 0; i < buckets; i++) {
+    if (value <= [[family->buckets_ objectAtIndex:i] doubleValue]) {
+      values[i] += 1;
+      break;
+    }
+  }
+  values[buckets] += value;
+  values[buckets + 1] += 1;
+  pthread_mutex_unlock(&lock_);
+}
+
+- (void)removeSamplesForMetric:(NSString *)name {
+  pthread_mutex_lock(&lock_);
+  MBMetricFamily *family = [families_ objectForKey:name];
+  if (family)
+    [family->samples_ removeAllObjects];
+  pthread_mutex_unlock(&lock_);
+}
+
+- (double)valueForMetric:(NSString *)name labels:(NSDictionary *)labels {
+  double value = 0;
+  pthread_mutex_lock(&lock_);
+  MBMetricFamily *family = [families_ objectForKey:name];
+  NSData *data = family ? [family->samples_ objectForKey:
+                                              MBMetricsRenderLabels(labels)]
+                        : nil;
+  if (data) {
+    const double *values = [data bytes];
+    if (family->type_ == kMBMetricHistogram)
+      value = values[[family->buckets_ count] + 1];
+    else
+      value = values[0];
+  }
+  pthread_mutex_unlock(&lock_);
+  return value;
+}
+
+- (void)addCollector:(id<MBMetricsCollector>)collector {
+  pthread_mutex_lock(&lock_);
+  NSValue *value = [NSValue valueWithNonretainedObject:collector];
+  if (![collectors_ containsObject:value])
+    [collectors_ addObject:value];
+  pthread_mutex_unlock(&lock_);
+}
+
+- (void)removeCollector:(id<MBMetricsCollector>)collector {
+  pthread_mutex_lock(&lock_);
+  [collectors_ removeObject:[NSValue valueWithNonretainedObject:collector]];
+  pthread_mutex_unlock(&lock_);
+}
+
+- (NSString *)exposition {
+  pthread_mutex_lock(&lock_);
+  NSArray *collectors = [[collectors_ copy] autorelease];
+  pthread_mutex_unlock(&lock_);
+  NSEnumerator *collectorEnumerator = [collectors objectEnumerator];
+  NSValue *collector = nil;
+  while ((collector = [collectorEnumerator nextObject]))
+    [[collector nonretainedObjectValue] collectMetrics:self];
+
+  NSMutableString *text = [NSMutableString string];
+  pthread_mutex_lock(&lock_);
+  NSArray *names = [[families_ allKeys] sortedArrayUsingSelector:@selector(compare:)];
+  NSEnumerator *nameEnumerator = [names objectEnumerator];
+  NSString *name = nil;
+  while ((name = [nameEnumerator nextObject])) {
+    MBMetricFamily *family = [families_ objectForKey:name];
+    if ([family->samples_ count] == 0)
+      continue;
+    static NSString *const kTypes[] = { @"counter", @"gauge", @"histogram" };
+    if ([family->help_ length])
+      [text appendFormat:@"# HELP %@ %@\n", name, family->help_];
+    [text appendFormat:@"# TYPE %@ %@\n", name, kTypes[family->type_]];
+
+    NSArray *labelSets = [[family->samples_ allKeys]
+                           sortedArrayUsingSelector:@selector(compare:)];
+    NSEnumerator *labelEnumerator = [labelSets objectEnumerator];
+    NSString *labels = nil;
+    while ((labels = [labelEnumerator nextObject])) {
+      const double *values = [[family->samples_ objectForKey:labels] bytes];
+      if (family->type_ != kMBMetricHistogram) {
+        if ([labels length])
+          [text appendFormat:@"%@{%@} %@\n", name, labels,
+                MBMetricsNumber(values[0])];
+        else
+          [text appendFormat:@"%@ %@\n", name, MBMetricsNumber(values[0])];
+        continue;
+      }
+      NSString *separator = [labels length] ? @"," : @"";
+      unsigned buckets = [family->buckets_ count];
+      double cumulative = 0;
+      for (unsigned i = 0; i < buckets; i++) {
+        cumulative += values[i];
+        [text appendFormat:@"%@_bucket{%@%@le=\"%@\"} %@\n", name, labels,
+              separator,
+              MBMetricsNumber([[family->buckets_ objectAtIndex:i] doubleValue]),
+              MBMetricsNumber(cumulative)];
+      }
+      [text appendFormat:@"%@_bucket{%@%@le=\"+Inf\"} %@\n", name, labels,
+            separator, MBMetricsNumber(values[buckets + 1])];
+      NSString *braced = [labels length]
+        ? [NSString stringWithFormat:@"{%@}", labels] : @"";
+      [text appendFormat:@"%@_sum%@ %@\n", name, braced,
+            MBMetricsNumber(values[buckets])];
+      [text appendFormat:@"%@_count%@ %@\n", name, braced,
+            MBMetricsNumber(values[buckets + 1])];
+    }
+  }
+  pthread_mutex_unlock(&lock_);
+  return text;
+}
+
+// The shared metrics collect the launcher's own memory and CPU time.
+- (void)collectMetrics:(MBMetrics *)metrics {
+  [self collectProcessMetrics];
+}
+
+@end  // MBMetrics
+
+
+@implementation MBMetrics (PrivateMethods)
+
+// With |lock_| held. Creates an undescribed metric on first use.
+- (MBMetricFamily *)familyNamed:(NSString *)name type:(MBMetricType)type {
+  MBMetricFamily *family = [families_ objectForKey:name];
+  if (family == nil) {
+    family = [[[MBMetricFamily alloc] init] autorelease];
+    family->type_ = type;
+    family->help_ = [[NSString alloc] init];
+    if (type == kMBMetricHistogram)
+      family->buckets_ = [[NSArray alloc] init];
+    family->samples_ = [[NSMutableDictionary alloc] init];
+    [families_ setObject:family forKey:name];
+  }
+  return family;
+}
+
+// With |lock_| held. The values of the sample, zeroed when new.
+- (double *)valuesForSample:(NSDictionary *)labels
+                   inFamily:(MBMetricFamily *)family {
+  NSString *key = MBMetricsRenderLabels(labels);
+  NSMutableData *data = [family->samples_ objectForKey:key];
+  if (data == nil) {
+    unsigned count = 1;
+    if (family->type_ == kMBMetricHistogram)
+      count = [family->buckets_ count] + 2;
+    data = [NSMutableData dataWithLength:count * sizeof(double)];
+    [family->samples_ setObject:data forKey:key];
+  }
+  return [data mutableBytes];
+}
+
+- (void)collectProcessMetrics {
+  struct task_basic_info info;
+  mach_msg_type_number_t count = TASK_BASIC_INFO_COUNT;
+  if (task_info(mach_task_self(), TASK_BASIC_INFO,
+                (task_info_t)&info, &count) == KERN_SUCCESS)
+    [self setValue:info.resident_size
+         forMetric:@"process_resident_memory_bytes"
+            labels:nil];
+
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+    double seconds = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+                     usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+    [self setValue:seconds forMetric:@"process_cpu_seconds_total" labels:nil];
+  }
+}
+
+@end  // PrivateMethods
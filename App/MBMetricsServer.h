@@ -0,0 +1,76 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import <Foundation/Foundation.h>
+
+@class MBMetrics;
+
+// MBMetricsServer answers "GET /metrics" over HTTP with an MBMetrics
+// exposition, for Prometheus (or curl) to scrape, and "GET /trace" with
+// MBTraceRecorder's Chrome trace:
+//
+//   defaults write com.google.GoogleAppEngineLauncher MBMetricsPort 9119
+//   curl http://127.0.0.1:9119/metrics
+//
+//   defaults write com.google.GoogleAppEngineLauncher \
+//     MBMetricsSocket ~/Library/Caches/GoogleAppEngineLauncher.metrics
+//   curl --unix-socket ~/Library/Caches/GoogleAppEngineLauncher.metrics \
+//     http://localhost/metrics
+//
+// It's off unless one of those defaults is set. TCP listens on the
+// loopback interface only, and a Unix socket is made readable by its
+// owner only, since the metrics name the user's projects.
+//
+// Everything happens on the main run loop (like the launcher's signal
+// handling), so collectors can look at the task and project controllers
+// without locking. Each connection gets one response and is closed;
+// requests over 8KB are refused.
+@interface MBMetricsServer : NSObject {
+ @private
+  MBMetrics *metrics_;
+  NSMutableArray *listeners_;      // of CFSocketRef
+  NSString *socketPath_;           // to remove when we stop
+  int port_;
+  CFMutableDictionaryRef clients_; // CFSocketRef -> NSMutableData request
+}
+
+// The server for the launcher's metrics. Created by +startFromDefaults.
++ (MBMetricsServer *)sharedServer;
+
+// Starts the shared server listening where the MBMetricsPort and
+// MBMetricsSocket defaults say, if they say anything. Call on the main
+// thread.
++ (void)startFromDefaults;
+
+// Designated initializer.
+- (id)initWithMetrics:(MBMetrics *)metrics;
+
+// Listens on 127.0.0.1:|port|; 0 picks a free port (see -port).
+// Returns NO if the port can't be had.
+- (BOOL)listenOnPort:(int)port;
+
+// Listens on a Unix domain socket at |path|, replacing any old one.
+- (BOOL)listenOnSocketPath:(NSString *)path;
+
+// The TCP port listened on, or 0.
+- (int)port;
+
+// Closes the listeners and any connections.
+- (void)stop;
+
+// The complete HTTP response to |request| (the request line and headers).
+- (NSData *)responseForRequest:(NSData *)request;
+
+@end
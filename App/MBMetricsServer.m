@@ -0,0 +1,339 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import "MBMetricsServer.h"
+#import "MBMetrics.h"
+#import "MBTraceRecorder.h"
+#import <netinet/in.h>
+#import <stdlib.h>
+#import <string.h>
+#import <sys/socket.h>
+#import <sys/stat.h>
+#import <sys/un.h>
+#import <unistd.h>
+
+static NSString *const kMBMetricsPortKey = @"MBMetricsPort";
+static NSString *const kMBMetricsSocketKey = @"MBMetricsSocket";
+
+// Longest request (line and headers) we'll wait for.
+static const CFIndex kMBMetricsMaxRequest = 8 * 1024;
+
+// How long to wait on a client which isn't reading its response.
+static const CFTimeInterval kMBMetricsSendTimeout = 1.0;
+
+@interface MBMetricsServer (PrivateMethods)
+- (BOOL)listenWithFamily:(int)family address:(NSData *)address;
+- (void)acceptConnection:(CFSocketNativeHandle)fd;
+- (void)client:(CFSocketRef)client receivedData:(NSData *)data;
+- (void)closeClient:(CFSocketRef)client;
+@end
+
+static void MBMetricsServerAccept(CFSocketRef listener,
+                                  CFSocketCallBackType type,
+                                  CFDataRef address,
+                                  const void *data,
+                                  void *info) {
+  if (type != kCFSocketAcceptCallBack)
+    return;
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  [(MBMetricsServer *)info acceptConnection:*(CFSocketNativeHandle *)data];
+  [pool release];
+}
+
+static void MBMetricsServerRead(CFSocketRef client,
+                                CFSocketCallBackType type,
+                                CFDataRef address,
+                                const void *data,
+                                void *info) {
+  if (type != kCFSocketDataCallBack)
+    return;
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  [(MBMetricsServer *)info client:client receivedData:(NSData *)data];
+  [pool release];
+}
+
+static NSData *MBMetricsResponse(NSString *status, NSString *type,
+                                 NSData *body, BOOL headOnly) {
+  NSString *header = [NSString stringWithFormat:
+                      @"HTTP/1.0 %@\r\n"
+                      @"Content-Type: %@\r\n"
+                      @"Content-Length: %u\r\n"
+                      @"Connection: close\r\n"
+                      @"\r\n",
+                      status, type, (unsigned)[body length]];
+  NSMutableData *response =
+    [NSMutableData dataWithData:[header dataUsingEncoding:NSUTF8StringEncoding]];
+  if (!headOnly)
+    [response appendData:body];
+  return response;
+}
+
+static NSData *MBMetricsError(NSString *status) {
+  NSData *body = [[status stringByAppendingString:@"\n"]
+                   dataUsingEncoding:NSUTF8StringEncoding];
+  return MBMetricsResponse(status, @"text/plain; charset=utf-8", body, NO);
+}
+
+static MBMetricsServer *gSharedServer = nil;
+
+@implementation MBMetricsServer
+
++ (MBMetricsServer *)sharedServer {
+  @synchronized(self) {
+    if (gSharedServer == nil)
+      gSharedServer = [[self alloc] initWithMetrics:[MBMetrics sharedMetrics]];
+  }
+  return gSharedServer;
+}
+
++ (void)startFromDefaults {
+  NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+  int port = [defaults integerForKey:kMBMetricsPortKey];
+  NSString *path = [defaults stringForKey:kMBMetricsSocketKey];
+  if (port > 0) {
+    if ([[self sharedServer] listenOnPort:port])
+      GMLoggerInfo(@"Serving metrics at http://127.0.0.1:%d/metrics", port);
+    else
+      GMLoggerError(@"Can't serve metrics on port %d", port);
+  }
+  if ([path length]) {
+    path = [path stringByExpandingTildeInPath];
+    if ([[self sharedServer] listenOnSocketPath:path])
+      GMLoggerInfo(@"Serving metrics on %@", path);
+    else
+      GMLoggerError(@"Can't serve metrics on %@", path);
+  }
+}
+
+- (id)init {
+  return [self initWithMetrics:nil];
+}
+
+- (id)initWithMetrics:(MBMetrics *)metrics {
+  if ((self = [super init])) {
+    metrics_ = [metrics retain];
+    listeners_ = [[NSMutableArray alloc] init];
+    clients_ = CFDictionaryCreateMutable(kCFAllocatorDefault, 0,
+                                         &kCFTypeDictionaryKeyCallBacks,
+                                         &kCFTypeDictionaryValueCallBacks);
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [self stop];
+  [metrics_ release];
+  [listeners_ release];
+  if (clients_)
+    CFRelease(clients_);
+  [super dealloc];
+}
+
+- (BOOL)listenOnPort:(int)port {
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_len = sizeof(addr);
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (![self listenWithFamily:PF_INET
+                      address:[NSData dataWithBytes:&addr length:sizeof(addr)]])
+    return NO;
+
+  // Find out which port we got, in case it was 0.
+  CFSocketRef listener = (CFSocketRef)[listeners_ lastObject];
+  struct sockaddr_in bound;
+  socklen_t length = sizeof(bound);
+  if (getsockname(CFSocketGetNative(listener),
+                  (struct sockaddr *)&bound, &length) == 0)
+    port_ = ntohs(bound.sin_port);
+  return YES;
+}
+
+- (BOOL)listenOnSocketPath:(NSString *)path {
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  const char *fsPath = [path fileSystemRepresentation];
+  if (fsPath == NULL || strlen(fsPath) >= sizeof(addr.sun_path))
+    return NO;
+  addr.sun_len = sizeof(addr);
+  addr.sun_family = AF_UNIX;
+  strlcpy(addr.sun_path, fsPath, sizeof(addr.sun_path));
+
+  // Left over from the last run (or a crash).
+  unlink(fsPath);
+  if (![self listenWithFamily:PF_LOCAL
+                      address:[NSData dataWithBytes:&addr length:sizeof(addr)]])
+    return NO;
+  chmod(fsPath, S_IRUSR | S_IWUSR);
+  [socketPath_ release];
+  socketPath_ = [path copy];
+  return YES;
+}
+
+- (int)port {
+  return port_;
+}
+
+- (void)stop {
+  NSEnumerator *listenerEnumerator = [listeners_ objectEnumerator];
+  id listener = nil;
+  while ((listener = [listenerEnumerator nextObject]))
+    CFSocketInvalidate((CFSocketRef)listener);
+  [listeners_ removeAllObjects];
+  port_ = 0;
+
+  CFIndex count = CFDictionaryGetCount(clients_);
+  if (count) {
+    const void **clients = malloc(count * sizeof(void *));
+    CFDictionaryGetKeysAndValues(clients_, clients, NULL);
+    for (CFIndex i = 0; i < count; i++)
+      CFSocketInvalidate((CFSocketRef)clients[i]);
+    free(clients);
+    CFDictionaryRemoveAllValues(clients_);
+  }
+
+  if (socketPath_) {
+    unlink([socketPath_ fileSystemRepresentation]);
+    [socketPath_ release];
+    socketPath_ = nil;
+  }
+}
+
+- (NSData *)responseForRequest:(NSData *)request {
+  NSString *text = [[[NSString alloc] initWithData:request
+                                          encoding:NSISOLatin1StringEncoding]
+                     autorelease];
+  NSString *line = [[text componentsSeparatedByString:@"\n"] objectAtIndex:0];
+  NSArray *words = [[line stringByTrimmingCharactersInSet:
+                          [NSCharacterSet whitespaceAndNewlineCharacterSet]]
+                     componentsSeparatedByString:@" "];
+  if ([words count] < 2)
+    return MBMetricsError(@"400 Bad Request");
+
+  NSString *method = [words objectAtIndex:0];
+  BOOL headOnly = [method isEqualToString:@"HEAD"];
+  if (!headOnly && ![method isEqualToString:@"GET"])
+    return MBMetricsError(@"405 Method Not Allowed");
+
+  NSString *path = [words objectAtIndex:1];
+  NSRange query = [path rangeOfString:@"?"];
+  if (query.location != NSNotFound)
+    path = [path substringToIndex:query.location];
+  if ([path isEqualToString:@"/trace"])
+    return MBMetricsResponse(@"200 OK", @"application/json",
+                             [MBTraceRecorder chromeTraceData], headOnly);
+  if (![path isEqualToString:@"/metrics"])
+    return MBMetricsError(@"404 Not Found");
+
+  NSData *body = [[metrics_ exposition] dataUsingEncoding:NSUTF8StringEncoding];
+  return MBMetricsResponse(@"200 OK", @"text/plain; version=0.0.4", body,
+                           headOnly);
+}
+
+@end  // MBMetricsServer
+
+
+@implementation MBMetricsServer (PrivateMethods)
+
+- (BOOL)listenWithFamily:(int)family address:(NSData *)address {
+  CFSocketContext context = { 0, self, NULL, NULL, NULL };
+  CFSocketRef listener = CFSocketCreate(kCFAllocatorDefault, family,
+                                        SOCK_STREAM, 0,
+                                        kCFSocketAcceptCallBack,
+                                        MBMetricsServerAccept, &context);
+  if (listener == NULL)
+    return NO;
+  if (family == PF_INET) {
+    int yes = 1;
+    setsockopt(CFSocketGetNative(listener), SOL_SOCKET, SO_REUSEADDR,
+               &yes, sizeof(yes));
+  }
+  if (CFSocketSetAddress(listener, (CFDataRef)address) != kCFSocketSuccess) {
+    CFSocketInvalidate(listener);
+    CFRelease(listener);
+    return NO;
+  }
+
+  // Common modes, so a scrape isn't held up by a modal panel.
+  CFRunLoopSourceRef source =
+    CFSocketCreateRunLoopSource(kCFAllocatorDefault, listener, 0);
+  CFRunLoopAddSource(CFRunLoopGetMain(), source, kCFRunLoopCommonModes);
+  CFRelease(source);
+  [listeners_ addObject:(id)listener];
+  CFRelease(listener);
+  return YES;
+}
+
+- (void)acceptConnection:(CFSocketNativeHandle)fd {
+  // A client hanging up early mustn't take the launcher down with it.
+  int yes = 1;
+  setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &yes, sizeof(yes));
+
+  CFSocketContext context = { 0, self, NULL, NULL, NULL };
+  CFSocketRef client = CFSocketCreateWithNative(kCFAllocatorDefault, fd,
+                                                kCFSocketDataCallBack,
+                                                MBMetricsServerRead,
+                                                &context);
+  if (client == NULL) {
+    close(fd);
+    return;
+  }
+  CFDictionarySetValue(clients_, client, [NSMutableData data]);
+  CFRunLoopSourceRef source =
+    CFSocketCreateRunLoopSource(kCFAllocatorDefault, client, 0);
+  CFRunLoopAddSource(CFRunLoopGetMain(), source, kCFRunLoopCommonModes);
+  CFRelease(source);
+  CFRelease(client);
+}
+
+- (void)client:(CFSocketRef)client receivedData:(NSData *)data {
+  NSMutableData *request =
+    (NSMutableData *)CFDictionaryGetValue(clients_, client);
+  if (request == nil)
+    return;
+  if ([data length] == 0) {
+    // Hung up before finishing the request.
+    [self closeClient:client];
+    return;
+  }
+  [request appendData:data];
+
+  NSData *response = nil;
+  if ([request length] > kMBMetricsMaxRequest) {
+    response = MBMetricsError(@"413 Request Entity Too Large");
+  } else {
+    // Wait for the blank line ending the headers.
+    const char *bytes = [request bytes];
+    NSUInteger length = [request length];
+    for (NSUInteger i = 1; i < length && response == nil; i++) {
+      if (bytes[i] == '\n' &&
+          (bytes[i - 1] == '\n' ||
+           (i >= 3 && bytes[i - 1] == '\r' && bytes[i - 2] == '\n')))
+        response = [self responseForRequest:request];
+    }
+  }
+  if (response) {
+    CFSocketSendData(client, NULL, (CFDataRef)response, kMBMetricsSendTimeout);
+    [self closeClient:client];
+  }
+}
+
+- (void)closeClient:(CFSocketRef)client {
+  CFSocketInvalidate(client);
+  CFDictionaryRemoveValue(clients_, client);
+}
+
+@end  // PrivateMethods
@@ -0,0 +1,204 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import <SenTestingKit/SenTestingKit.h>
+#import <Cocoa/Cocoa.h>
+#import <sys/stat.h>
+#import "MBMetrics.h"
+#import "MBMetricsServer.h"
+#import "MBMetricsTest.h"
+
+// Sets one gauge when collected.
+@interface MBMetricsTestCollector : NSObject <MBMetricsCollector> {
+ @public
+  int collections_;
+}
+@end
+
+@implementation MBMetricsTestCollector
+
+- (void)collectMetrics:(MBMetrics *)metrics {
+  collections_++;
+  [metrics setValue:collections_ forMetric:@"test_collections" labels:nil];
+}
+
+@end
+
+static NSDictionary *Labels(NSString *key, NSString *value) {
+  return [NSDictionary dictionaryWithObject:value forKey:key];
+}
+
+@implementation MBMetricsTest
+
+- (void)testCounterAndGauge {
+  MBMetrics *m = [[[MBMetrics alloc] init] autorelease];
+  [m defineMetric:@"test_total" type:kMBMetricCounter
+             help:@"Things." buckets:nil];
+  [m addValue:2 toCounter:@"test_total" labels:Labels(@"project", @"a")];
+  [m addValue:3 toCounter:@"test_total" labels:Labels(@"project", @"a")];
+  [m addValue:1 toCounter:@"test_total" labels:Labels(@"project", @"b")];
+  [m setValue:7 forMetric:@"test_gauge" labels:nil];
+  [m setValue:4.5 forMetric:@"test_gauge" labels:nil];
+  STAssertEquals([m valueForMetric:@"test_total"
+                            labels:Labels(@"project", @"a")], 5.0, nil);
+  STAssertEquals([m valueForMetric:@"test_gauge" labels:nil], 4.5, nil);
+  STAssertEquals([m valueForMetric:@"test_missing" labels:nil], 0.0, nil);
+
+  NSString *text = [m exposition];
+  NSString *expected =
+    @"# TYPE test_gauge gauge\n"
+    @"test_gauge 4.5\n"
+    @"# HELP test_total Things.\n"
+    @"# TYPE test_total counter\n"
+    @"test_total{project=\"a\"} 5\n"
+    @"test_total{project=\"b\"} 1\n";
+  STAssertEqualObjects(text, expected, nil);
+
+  [m removeSamplesForMetric:@"test_total"];
+  STAssertEquals([m valueForMetric:@"test_total"
+                            labels:Labels(@"project", @"a")], 0.0, nil);
+  STAssertTrue([[m exposition] rangeOfString:@"test_total"].location ==
+               NSNotFound, nil);
+}
+
+- (void)testHistogram {
+  MBMetrics *m = [[[MBMetrics alloc] init] autorelease];
+  NSArray *buckets = [NSArray arrayWithObjects:
+                      [NSNumber numberWithDouble:1],
+                      [NSNumber numberWithDouble:5],
+                      nil];
+  [m defineMetric:@"test_seconds" type:kMBMetricHistogram
+             help:@"Waits." buckets:buckets];
+  [m observeValue:0.5 inHistogram:@"test_seconds" labels:nil];
+  [m observeValue:1 inHistogram:@"test_seconds" labels:nil];
+  [m observeValue:3 inHistogram:@"test_seconds" labels:nil];
+  [m observeValue:10 inHistogram:@"test_seconds" labels:nil];
+  STAssertEquals([m valueForMetric:@"test_seconds" labels:nil], 4.0, nil);
+
+  NSString *expected =
+    @"# HELP test_seconds Waits.\n"
+    @"# TYPE test_seconds histogram\n"
+    @"test_seconds_bucket{le=\"1\"} 2\n"
+    @"test_seconds_bucket{le=\"5\"} 3\n"
+    @"test_seconds_bucket{le=\"+Inf\"} 4\n"
+    @"test_seconds_sum 14.5\n"
+    @"test_seconds_count 4\n";
+  STAssertEqualObjects([m exposition], expected, nil);
+
+  [m observeValue:2 inHistogram:@"test_seconds" labels:Labels(@"project", @"a")];
+  STAssertTrue([[m exposition] rangeOfString:
+                 @"test_seconds_bucket{project=\"a\",le=\"5\"} 1\n"].location !=
+               NSNotFound, nil);
+}
+
+- (void)testLabels {
+  MBMetrics *m = [[[MBMetrics alloc] init] autorelease];
+  NSMutableDictionary *labels = [NSMutableDictionary dictionary];
+  [labels setObject:@"say \"hi\"\nC:\\" forKey:@"z"];
+  [labels setObject:@"first" forKey:@"a"];
+  [m setValue:1 forMetric:@"test_gauge" labels:labels];
+  NSString *expected =
+    @"# TYPE test_gauge gauge\n"
+    @"test_gauge{a=\"first\",z=\"say \\\"hi\\\"\\nC:\\\\\"} 1\n";
+  STAssertEqualObjects([m exposition], expected, nil);
+}
+
+- (void)testCollector {
+  MBMetrics *m = [[[MBMetrics alloc] init] autorelease];
+  MBMetricsTestCollector *collector =
+    [[[MBMetricsTestCollector alloc] init] autorelease];
+  [m addCollector:collector];
+  [m addCollector:collector];  // only once
+  [m exposition];
+  STAssertEquals(collector->collections_, 1, nil);
+  STAssertEquals([m valueForMetric:@"test_collections" labels:nil], 1.0, nil);
+  [m exposition];
+  STAssertEquals(collector->collections_, 2, nil);
+
+  [m removeCollector:collector];
+  [m exposition];
+  STAssertEquals(collector->collections_, 2, nil);
+
+  // The launcher's own figures.
+  MBMetrics *shared = [MBMetrics sharedMetrics];
+  STAssertTrue([[shared exposition] rangeOfString:
+                 @"\nprocess_resident_memory_bytes "].location != NSNotFound,
+               nil);
+  STAssertTrue([shared valueForMetric:@"process_resident_memory_bytes"
+                               labels:nil] > 0, nil);
+}
+
+- (void)testServerResponse {
+  MBMetrics *m = [[[MBMetrics alloc] init] autorelease];
+  [m setValue:3 forMetric:@"test_gauge" labels:nil];
+  MBMetricsServer *server =
+    [[[MBMetricsServer alloc] initWithMetrics:m] autorelease];
+
+  NSData *request = [@"GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n"
+                      dataUsingEncoding:NSASCIIStringEncoding];
+  NSString *response =
+    [[[NSString alloc] initWithData:[server responseForRequest:request]
+                           encoding:NSUTF8StringEncoding] autorelease];
+  STAssertTrue([response hasPrefix:@"HTTP/1.0 200 OK\r\n"], response);
+  STAssertTrue([response rangeOfString:
+                 @"Content-Type: text/plain; version=0.0.4\r\n"].location !=
+               NSNotFound, response);
+  STAssertTrue([response hasSuffix:@"\r\n\r\n# TYPE test_gauge gauge\n"
+                                   @"test_gauge 3\n"], response);
+
+  struct {
+    NSString *request;
+    NSString *status;
+  } cases[] = {
+    { @"GET /metrics?x=1 HTTP/1.0\n\n", @"HTTP/1.0 200 " },
+    { @"HEAD /metrics HTTP/1.0\n\n", @"HTTP/1.0 200 " },
+    { @"GET /trace HTTP/1.0\n\n", @"HTTP/1.0 200 " },
+    { @"GET / HTTP/1.0\n\n", @"HTTP/1.0 404 " },
+    { @"POST /metrics HTTP/1.0\n\n", @"HTTP/1.0 405 " },
+    { @"\n\n", @"HTTP/1.0 400 " },
+  };
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    NSData *data = [server responseForRequest:
+                     [cases[i].request dataUsingEncoding:NSASCIIStringEncoding]];
+    NSString *text = [[[NSString alloc] initWithData:data
+                                            encoding:NSUTF8StringEncoding]
+                       autorelease];
+    STAssertTrue([text hasPrefix:cases[i].status], cases[i].request);
+  }
+}
+
+- (void)testServerListen {
+  MBMetricsServer *server =
+    [[[MBMetricsServer alloc] initWithMetrics:[MBMetrics sharedMetrics]]
+      autorelease];
+  STAssertEquals([server port], 0, nil);
+  STAssertTrue([server listenOnPort:0], nil);
+  STAssertTrue([server port] > 0, nil);
+
+  NSString *path = [NSTemporaryDirectory()
+                     stringByAppendingPathComponent:@"MBMetricsTest.sock"];
+  STAssertTrue([server listenOnSocketPath:path], nil);
+  struct stat info;
+  STAssertEquals(stat([path fileSystemRepresentation], &info), 0, nil);
+  STAssertEquals((int)(info.st_mode & 0777), 0600, nil);
+  // Again, over the top of the old one.
+  STAssertTrue([server listenOnSocketPath:path], nil);
+
+  [server stop];
+  STAssertEquals([server port], 0, nil);
+  STAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:path], nil);
+}
+
+@end
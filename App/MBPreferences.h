@@ -32,3 +32,7 @@ limitations under the License.
 // NSString for the deploy server.
 // E.g. your-server.company.com
 #define kMBDeployPref          @"Deploy"
+
+// NSArray of NSStrings.  fnmatch(3) patterns for directory names
+// skipped by "Import Applications..." (e.g. ".*", "node_modules").
+#define kMBImportIgnorePatternsPref  @"ImportIgnorePatterns"
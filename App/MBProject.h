@@ -14,6 +14,10 @@ limitations under the License.
 */
 
 #import <Foundation/Foundation.h>
+#include <sys/types.h>
+#include <time.h>
+
+@class MBAppConfig;
 
 // Run state for a project, encoded in an NSNumber.
 typedef enum {
@@ -37,11 +41,17 @@ typedef enum {
   NSString *name_;
   NSString *path_;
   NSString *port_;
-  NSString *runtime_;  // only have default; can't pick (for now).
+  NSString *runtime_;  // name of our runtime; nil means the default
   // extra flags for the dev_appserver.py command line
   NSMutableArray *commandLineFlags_;
   // Is our path_ valid?
   BOOL valid_;
+  // Parsed app.yaml from the last verify, and the file identity it
+  // was parsed from (so we only reparse when app.yaml changes).
+  MBAppConfig *appConfig_;
+  ino_t appYamlInode_;
+  off_t appYamlSize_;
+  struct timespec appYamlModTime_;
 }
 
 // Return a project with some default values.
@@ -53,12 +63,14 @@ typedef enum {
 - (NSString *)name;
 - (NSString *)path;
 - (NSString *)port;
+- (NSString *)runtime;
 - (MBRunState)runState;
 - (id)runStateAsObject;  // for KVC
 - (NSArray *)commandLineFlags;
 - (void)setName:(NSString *)name;
 - (void)setPath:(NSString *)path;
 - (void)setPort:(NSString *)port;
+- (void)setRuntime:(NSString *)runtime;
 - (void)setRunState:(MBRunState)runState;
 - (void)setCommandLineFlags:(NSArray *)flags;
 
@@ -70,8 +82,13 @@ typedef enum {
 
 // Return YES if the project path is valid; else no.
 // Update the project name if needed from the project's app.yaml.
+// app.yaml is only reread and reparsed if it changed since the last call.
 - (BOOL)verify;
 
+// The parsed app.yaml as of the last -verify, or nil if it couldn't
+// be read or parsed.  Not saved across launches.
+- (MBAppConfig *)appConfig;
+
 // Not visible to the user: unique ID for this project.  Not saved
 // across launches.
 - (NSNumber *)identifier;
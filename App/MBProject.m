@@ -14,6 +14,8 @@ limitations under the License.
 */
 
 #import "MBProject.h"
+#import "MBAppConfig.h"
+#include <sys/stat.h>
 
 // Used for generating a unique project identifier.
 static int gProjectIdentifier = 0;
@@ -28,6 +30,22 @@ static int gProjectIdentifier = 0;
   return number;
 }
 
++ (void)initialize {
+  if (self == [MBProject class]) {
+    // The table's run state column is bound to runStateAsObject.
+    [self setKeys:[NSArray arrayWithObject:@"runState"]
+          triggerChangeNotificationsForDependentKey:@"runStateAsObject"];
+  }
+}
+
+// Observers of runState (e.g. MBRunStateModel, and through
+// runStateAsObject, the table) only hear about real changes.
++ (BOOL)automaticallyNotifiesObserversForKey:(NSString *)key {
+  if ([key isEqual:@"runState"])
+    return NO;
+  return [super automaticallyNotifiesObserversForKey:key];
+}
+
 + (id)project {
   return [[[self alloc] init] autorelease];
 }
@@ -62,6 +80,7 @@ static int gProjectIdentifier = 0;
     path_ = [[coder decodeObjectForKey:@"path"] retain];
     port_ = [[coder decodeObjectForKey:@"port"] retain];
     commandLineFlags_ = [[coder decodeObjectForKey:@"flags"] retain];
+    runtime_ = [[coder decodeObjectForKey:@"runtime"] retain];  // nil if old
     valid_ = YES;
   }
   return self;
@@ -74,6 +93,7 @@ static int gProjectIdentifier = 0;
   [port_ release];
   [runtime_ release];
   [commandLineFlags_ release];
+  [appConfig_ release];
   [super dealloc];
 }
 
@@ -89,6 +109,10 @@ static int gProjectIdentifier = 0;
   return [[port_ copy] autorelease];
 }
 
+- (NSString *)runtime {
+  return [[runtime_ copy] autorelease];
+}
+
 - (MBRunState)runState {
   return runState_;
 }
@@ -110,6 +134,9 @@ static int gProjectIdentifier = 0;
 - (void)setPath:(NSString *)path {
   [path_ autorelease];
   path_ = [path copy];
+  // A new path means a new app.yaml.
+  [appConfig_ release];
+  appConfig_ = nil;
   // TODO(jrg): call [self verify]?
 }
 
@@ -118,8 +145,17 @@ static int gProjectIdentifier = 0;
   port_ = [port copy];
 }
 
+- (void)setRuntime:(NSString *)runtime {
+  [runtime_ autorelease];
+  runtime_ = [runtime copy];
+}
+
 - (void)setRunState:(MBRunState)runState {
+  if (runState == runState_)
+    return;
+  [self willChangeValueForKey:@"runState"];
   runState_ = runState;
+  [self didChangeValueForKey:@"runState"];
 }
 
 - (void)setCommandLineFlags:(NSArray *)flags {
@@ -134,38 +170,47 @@ static int gProjectIdentifier = 0;
 }
 
 - (BOOL)verify {
-  valid_ = NO;  // until proven otherwise
-
   NSString *appYaml = [path_ stringByAppendingPathComponent:@"app.yaml"];
 
   // Implicitly verifies that path_ is a directory and contains an app.yaml
-  NSData *data = [[NSFileManager defaultManager] contentsAtPath:appYaml];
-  if (data == nil) {
+  struct stat sb;
+  if (stat([appYaml fileSystemRepresentation], &sb) != 0) {
+    [appConfig_ release];
+    appConfig_ = nil;
+    valid_ = NO;
     return valid_;
   }
 
-  // TODO(jrg): Use a real YAML library to parse properly.
-  //            This cheat will work for now but isn't ideal.
-  NSArray *lines = [[[[NSString alloc] initWithData:data
-                                       encoding:NSUTF8StringEncoding]
-                      autorelease] componentsSeparatedByString:@"\n"];
-  NSString *line = nil;
-  NSEnumerator *senum = [lines objectEnumerator];
-  while ((line = [senum nextObject])) {
-    NSRange range = [line rangeOfString:@"application:"];
-    if (range.location == 0) {
-      NSString *name = [[line substringFromIndex:range.length]
-                         stringByTrimmingCharactersInSet:
-                           [NSCharacterSet whitespaceAndNewlineCharacterSet]];
+  // verify is called for every project each time the app is
+  // activated; don't reread app.yaml unless it has changed.
+  if (!(appConfig_ &&
+        (sb.st_ino == appYamlInode_) &&
+        (sb.st_size == appYamlSize_) &&
+        (sb.st_mtimespec.tv_sec == appYamlModTime_.tv_sec) &&
+        (sb.st_mtimespec.tv_nsec == appYamlModTime_.tv_nsec))) {
+    [appConfig_ release];
+    appConfig_ = [[MBAppConfig configWithContentsOfFile:appYaml] retain];
+    appYamlInode_ = sb.st_ino;
+    appYamlSize_ = sb.st_size;
+    appYamlModTime_ = sb.st_mtimespec;
+  }
+
+  // The name comes from app.yaml, even if it was changed since.
+  valid_ = NO;  // until proven otherwise
+  NSString *name = [appConfig_ application];
+  if (name) {
+    if (![name isEqual:name_])
       [self setName:name];
-      valid_ = YES;
-      break;
-    }
+    valid_ = YES;
   }
 
   return valid_;
 }
 
+- (MBAppConfig *)appConfig {
+  return [[appConfig_ retain] autorelease];
+}
+
 - (NSNumber *)identifier {
   return [[identifier_ copy] autorelease];
 }
@@ -175,6 +220,8 @@ static int gProjectIdentifier = 0;
   [coder encodeObject:path_ forKey:@"path"];
   [coder encodeObject:port_ forKey:@"port"];
   [coder encodeObject:commandLineFlags_ forKey:@"flags"];
+  if (runtime_)
+    [coder encodeObject:runtime_ forKey:@"runtime"];
 }
 
 @end
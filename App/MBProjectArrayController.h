@@ -17,18 +17,36 @@ limitations under the License.
 #import "MBAddExistingAppController.h"
 #import "MBAddNewAppController.h"
 #import "MBProject.h"
+#import "MBMetrics.h"
 
 @class MBTaskArrayController;
 @class MBDeployController;
+@class MBProjectRegistry;
+@class MBRunStateModel;
 
 // The main C (in MVC) for the launcher.  Controller for an array of
 // projects, the main group of static data.  Controller for the main
 // project window, and most UI action (e.g. menus).
-@interface MBProjectArrayController : NSArrayController {
+@interface MBProjectArrayController : NSArrayController <MBMetricsCollector> {
   IBOutlet MBTaskArrayController *taskController_;
   IBOutlet NSView *mainProjectView_;
   IBOutlet NSTableView *mainTableView_;
   IBOutlet MBDeployController *deployController_;
+
+  // Hash indexes over our content (by path, identifier and port).
+  // Kept in sync by our add/remove overrides; created lazily.
+  MBProjectRegistry *registry_;
+
+  // Run state counts for our content and the current projects, for
+  // menu and toolbar validation.  Created lazily.
+  MBRunStateModel *runStates_;
+
+  // Batch update state; see -beginBatchUpdate.
+  int batchDepth_;
+  NSMutableArray *pendingAdds_;  // in order added
+  NSMutableSet *pendingRemoves_;
+  BOOL needsSave_;
+  BOOL needsVerify_;
 }
 // convenience
 - (NSArray *)currentProjects;
@@ -43,9 +61,27 @@ limitations under the License.
 // Add a new project when only the directory name is known.
 - (void)addProjectForDirectory:(NSString *)dirname;
 
+// Add a project for each directory in |dirnames| that we don't
+// already have, with consecutive unused ports.  Saves and verifies
+// once for the whole lot.  Returns the number of projects added.
+- (int)addProjectsForDirectories:(NSArray *)dirnames;
+
 // Remove a project.
 - (void)removeProject:(MBProject *)project;
 
+// Group many adds and removes into one update.  Between begin and
+// commit, -addProject: and -removeProject: only update our indexes
+// (so duplicate checks and -unusedProjectPort see the pending
+// changes); the content array, the table, the save file and
+// verification are all updated once at the outermost commit.  Calls
+// nest.  Note that -projects does not reflect pending changes.
+- (void)beginBatchUpdate;
+- (void)commitBatchUpdate;
+
+// Constant-time lookups.  Return nil if there is no such project.
+- (MBProject *)projectForPath:(NSString *)path;
+- (MBProject *)projectForIdentifier:(NSNumber *)identifier;
+
 // Return the list of projects.
 // Only exposed for unit testing.
 - (NSArray *)projects;
@@ -81,6 +117,7 @@ limitations under the License.
 // Most are self-explanatory.
 - (IBAction)addNewApp:(id)sender;
 - (IBAction)addExistingApp:(id)sender;
+- (IBAction)importApps:(id)sender;  // all apps under a directory
 - (IBAction)addDemoApp:(id)sender;
 - (IBAction)removeApps:(id)sender;
 - (IBAction)makeCommandLineSymlinks:(id)sender;
@@ -102,7 +139,7 @@ limitations under the License.
 
 // To allow others (e.g. MBMainTableView) to configure menu enabling
 // based on current state (e.g. disable 'Stop' option if nothing is
-// running.)
+// running.)  Constant time; "selected" means -currentProjects.
 - (BOOL)isAnySelectedProjectInState:(MBRunState)state;
 - (BOOL)isAnySelectedProjectNotInState:(MBRunState)state;
 
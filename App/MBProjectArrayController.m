@@ -16,17 +16,194 @@ limitations under the License.
 #import "MBProjectArrayController.h"
 #import "MBTaskArrayController.h"
 #import "MBProject.h"
+#import "MBProjectRegistry.h"
+#import "MBRunStateModel.h"
+#import "MBStallWatchdog.h"
+#import "MBStartupTrace.h"
+#import "MBTraceRecorder.h"
+#import "MBProxy.h"
+#import "MBProjectCrawler.h"
+#import "MBTemplateEngine.h"
 #import "MBEngineRuntime.h"
+#import "MBRuntimeRegistry.h"
 #import "MBProjectInfoController.h"
 #import "MBDeployController.h"
 #import "MBPreferenceController.h"
 #import "MBPreferences.h"
 
+// KVO context for watching our own selection.
+static NSString *const kMBSelectionContext = @"MBProjectArrayControllerSelection";
+
 @implementation MBProjectArrayController
 
+- (void)dealloc {
+  [[MBMetrics sharedMetrics] removeCollector:self];
+  [[NSNotificationCenter defaultCenter] removeObserver:self];
+  if (runStates_) {
+    [self removeObserver:self forKeyPath:@"selectedObjects"];
+    [self removeObserver:self forKeyPath:@"arrangedObjects"];
+    [runStates_ setDelegate:nil];
+  }
+  [runStates_ release];
+  [registry_ release];
+  [pendingAdds_ release];
+  [pendingRemoves_ release];
+  [super dealloc];
+}
+
+- (MBProjectRegistry *)registry {
+  if (registry_ == nil) {
+    registry_ = [[MBProjectRegistry alloc] init];
+    [registry_ addProjects:[self content]];
+  }
+  return registry_;
+}
+
+- (MBRunStateModel *)runStates {
+  if (runStates_ == nil) {
+    runStates_ = [[MBRunStateModel alloc] init];
+    [runStates_ addProjects:[self content]];
+    [runStates_ setSelectedProjects:[self currentProjects]];
+    [runStates_ setDelegate:self];
+    // -currentProjects depends on both.
+    [self addObserver:self
+           forKeyPath:@"selectedObjects"
+              options:0
+              context:kMBSelectionContext];
+    [self addObserver:self
+           forKeyPath:@"arrangedObjects"
+              options:0
+              context:kMBSelectionContext];
+  }
+  return runStates_;
+}
+
+- (void)observeValueForKeyPath:(NSString *)keyPath
+                      ofObject:(id)object
+                        change:(NSDictionary *)change
+                       context:(void *)context {
+  if (context != kMBSelectionContext) {
+    [super observeValueForKeyPath:keyPath
+                         ofObject:object
+                           change:change
+                          context:context];
+    return;
+  }
+  [runStates_ setSelectedProjects:[self currentProjects]];
+}
+
+// MBMetricsCollector.  Projects in each run state.
+- (void)collectMetrics:(MBMetrics *)metrics {
+  static const MBRunState kStates[] = {
+    kMBProjectStop, kMBProjectStarting, kMBProjectRun,
+    kMBProjectProductionRun, kMBProjectDied
+  };
+  static NSString *const kNames[] = {
+    @"stopped", @"starting", @"running", @"production", @"died"
+  };
+  MBRunStateModel *model = [self runStates];
+  for (size_t i = 0; i < sizeof(kStates) / sizeof(kStates[0]); i++) {
+    [metrics setValue:[model countOfProjectsInState:kStates[i]]
+            forMetric:@"launcher_projects"
+               labels:[NSDictionary dictionaryWithObject:kNames[i]
+                                                  forKey:@"state"]];
+  }
+}
+
+// MBRunStateModel delegate.  Only the project's row needs drawing, and
+// only its route (if the proxy is up) changing.
+- (void)runStateModel:(MBRunStateModel *)model
+    didChangeRunStateOfProject:(MBProject *)project {
+  MBProxy *proxy = [MBProxy sharedProxy];
+  if ([proxy isRunning])
+    [proxy updateRouteForProject:project];
+  NSUInteger row = [[self arrangedObjects] indexOfObjectIdenticalTo:project];
+  if (row != NSNotFound)
+    [mainTableView_ setNeedsDisplayInRect:[mainTableView_ rectOfRow:row]];
+}
+
+// MBRunStateModel delegate.  A running project renamed or moved to
+// another port is routed by its new name and port.
+- (void)runStateModel:(MBRunStateModel *)model
+    didChangeAddressOfProject:(MBProject *)project {
+  MBProxy *proxy = [MBProxy sharedProxy];
+  if ([proxy isRunning])
+    [proxy updateRouteForProject:project];
+}
+
+// The NSArrayController mutators are overridden to keep registry_
+// and runStates_ in sync with our content.  Some of these call each
+// other internally; that's fine since both ignore duplicate adds and
+// removes.  (Reordering content doesn't change either.)
+- (void)setContent:(id)content {
+  [super setContent:content];
+  if (registry_) {
+    [registry_ removeAllProjects];
+    [registry_ addProjects:[self content]];
+  }
+  [runStates_ setProjects:[self content]];
+  [runStates_ setSelectedProjects:[self currentProjects]];
+}
+
+- (void)addObject:(id)object {
+  [super addObject:object];
+  [[self registry] addProject:object];
+  [[self runStates] addProject:object];
+}
+
+- (void)addObjects:(NSArray *)objects {
+  [super addObjects:objects];
+  [[self registry] addProjects:objects];
+  [[self runStates] addProjects:objects];
+}
+
+- (void)insertObject:(id)object atArrangedObjectIndex:(NSUInteger)index {
+  [super insertObject:object atArrangedObjectIndex:index];
+  [[self registry] addProject:object];
+  [[self runStates] addProject:object];
+}
+
+- (void)insertObjects:(NSArray *)objects
+    atArrangedObjectIndexes:(NSIndexSet *)indexes {
+  [super insertObjects:objects atArrangedObjectIndexes:indexes];
+  [[self registry] addProjects:objects];
+  [[self runStates] addProjects:objects];
+}
+
+- (void)removeObject:(id)object {
+  [super removeObject:object];
+  [[self registry] removeProject:object];
+  [[self runStates] removeProject:object];
+}
+
+- (void)removeObjects:(NSArray *)objects {
+  [super removeObjects:objects];
+  [[self registry] removeProjects:objects];
+  [[self runStates] removeProjects:objects];
+}
+
+- (void)removeObjectAtArrangedObjectIndex:(NSUInteger)index {
+  id object = [[[[self arrangedObjects] objectAtIndex:index] retain] autorelease];
+  [super removeObjectAtArrangedObjectIndex:index];
+  [[self registry] removeProject:object];
+  [[self runStates] removeProject:object];
+}
+
+- (void)removeObjectsAtArrangedObjectIndexes:(NSIndexSet *)indexes {
+  NSArray *objects = [[self arrangedObjects] objectsAtIndexes:indexes];
+  [super removeObjectsAtArrangedObjectIndexes:indexes];
+  [[self registry] removeProjects:objects];
+  [[self runStates] removeProjects:objects];
+}
+
 // Verifies all projects in our data (MBProject array).
 // Project names can be updated based on file changes.
 - (void)verifyAllProjects:(id)obj {
+  MB_TRACE_SCOPE(__func__);
+  if (batchDepth_ > 0) {
+    needsVerify_ = YES;
+    return;
+  }
   NSEnumerator *penum = [[self content] objectEnumerator];
   MBProject *project = nil;
 
@@ -164,9 +341,11 @@ static NSString *MBProjectPboardType = @"MBProject";
       return NO;
     NSString *file = nil;
     NSEnumerator *fenum = [files objectEnumerator];
+    [self beginBatchUpdate];
     while ((file = [fenum nextObject]) != nil) {
       [self addProjectForDirectory:file];
     }
+    [self commitBatchUpdate];
     return YES;
   }
 
@@ -175,23 +354,13 @@ static NSString *MBProjectPboardType = @"MBProject";
 }
 
 - (BOOL)isAnySelectedProjectInState:(MBRunState)state {
-  NSEnumerator *en = [[self currentProjects] objectEnumerator];
-  MBProject *project;
-  while ((project = [en nextObject])) {
-    if ([project runState] == state)
-      return YES;
-  }
-  return NO;
+  return [[self runStates] countOfSelectedProjectsInState:state] > 0;
 }
 
 - (BOOL)isAnySelectedProjectNotInState:(MBRunState)state {
-  NSEnumerator *en = [[self currentProjects] objectEnumerator];
-  MBProject *project;
-  while ((project = [en nextObject])) {
-    if ([project runState] != state)
-      return YES;
-  }
-  return NO;
+  MBRunStateModel *runStates = [self runStates];
+  return ([runStates countOfSelectedProjects] >
+          [runStates countOfSelectedProjectsInState:state]);
 }
 
 - (BOOL)selectorArray:(SEL*)array containsSelector:(SEL)selector {
@@ -239,11 +408,46 @@ static NSString *MBProjectPboardType = @"MBProject";
   } else if ([self selectorArray:needAnyRunning containsSelector:action]) {
     return anyRunning;
   } else if ([self selectorArray:needAnyProjects containsSelector:action]) {
-    return [[self currentProjects] count] > 0 ? YES : NO;
+    return [[self runStates] countOfSelectedProjects] > 0 ? YES : NO;
   }
   return YES;
 }
 
+// Depth-first search of |menu| for an item with |action|.
+- (NSMenuItem *)menuItemWithAction:(SEL)action inMenu:(NSMenu *)menu {
+  NSEnumerator *ienum = [[menu itemArray] objectEnumerator];
+  NSMenuItem *item = nil;
+  while ((item = [ienum nextObject])) {
+    if ([item action] == action)
+      return item;
+    if ([item hasSubmenu]) {
+      NSMenuItem *found = [self menuItemWithAction:action inMenu:[item submenu]];
+      if (found)
+        return found;
+    }
+  }
+  return nil;
+}
+
+// "Import Applications..." lives right after "Add Existing
+// Application..." in the File menu.  It's added here rather than in
+// MainMenu.nib.
+- (void)addImportMenuItem {
+  NSMenuItem *existing = [self menuItemWithAction:@selector(addExistingApp:)
+                                           inMenu:[NSApp mainMenu]];
+  NSMenu *menu = [existing menu];
+  if ((menu == nil) ||
+      ([menu indexOfItemWithTarget:self andAction:@selector(importApps:)] >= 0))
+    return;
+  NSString *title = [NSString stringWithFormat:@"Import Applications%C",
+                              (unichar)0x2026];
+  NSMenuItem *item = [[[NSMenuItem alloc] initWithTitle:title
+                                                 action:@selector(importApps:)
+                                          keyEquivalent:@""] autorelease];
+  [item setTarget:self];
+  [menu insertItem:item atIndex:[menu indexOfItem:existing] + 1];
+}
+
 - (void)awakeFromNib {
   [self loadProjects];
 
@@ -263,6 +467,8 @@ static NSString *MBProjectPboardType = @"MBProject";
   // dbl-click on a project runs "Get Info"
   [mainTableView_ setTarget:self];
   [mainTableView_ setDoubleAction:@selector(infoOnCurrentProjects:)];
+
+  [self addImportMenuItem];
 }
 
 - (NSArray *)currentProjects {
@@ -280,31 +486,27 @@ static NSString *MBProjectPboardType = @"MBProject";
 }
 
 - (int)unusedProjectPort {
-  if ([[self content] count] == 0)
+  // The registry (unlike our content) includes batched adds.
+  if ([[self registry] count] == 0)
     return 8080;
-  NSEnumerator *penum = [[self content] objectEnumerator];
-  MBProject *p = nil;
-  int maxPort = 0;
-  int projectPort = 0;
-  while ((p = [penum nextObject])) {
-    projectPort = [[p port] intValue];
-    if (projectPort > maxPort)
-      maxPort = projectPort;
-  }
-  return maxPort+1;
+  return [[self registry] maxPort] + 1;
 }
 
 - (void)addProject:(MBProject *)project {
-  NSEnumerator *penum = [[self content] objectEnumerator];
-  MBProject *p = nil;
-  NSString *path = nil;
-  while ((p = [penum nextObject])) {
-    path = [p path];
-    if ([path isEqual:[project path]]) {
-      GMLoggerError(@"Sorry, you already have a project named \"%@\" at that path.",
-                    [project name]);
-      return;
-    }
+  if ([[self registry] projectForPath:[project path]]) {
+    GMLoggerError(@"Sorry, you already have a project named \"%@\" at that path.",
+                  [project name]);
+    return;
+  }
+  // New projects stay on today's runtime when another is installed.
+  if ([project runtime] == nil)
+    [project setRuntime:[[MBRuntimeRegistry sharedRegistry] defaultRuntimeName]];
+  if (batchDepth_ > 0) {
+    [registry_ addProject:project];
+    [pendingRemoves_ removeObject:project];
+    [pendingAdds_ addObject:project];
+    needsSave_ = needsVerify_ = YES;
+    return;
   }
   [self addObject:project];
   [self saveProjects];
@@ -320,13 +522,110 @@ static NSString *MBProjectPboardType = @"MBProject";
   [self addProject:project];
 }
 
+- (int)addProjectsForDirectories:(NSArray *)dirnames {
+  int added = 0;
+  [self beginBatchUpdate];
+  NSEnumerator *denum = [dirnames objectEnumerator];
+  NSString *dirname = nil;
+  while ((dirname = [denum nextObject])) {
+    // Pending adds are in the registry, so this catches repeats in
+    // |dirnames| too.
+    if ([registry_ projectForPath:dirname])
+      continue;
+    [self addProjectForDirectory:dirname];
+    added++;
+  }
+  [self commitBatchUpdate];
+  return added;
+}
+
 - (void)removeProject:(MBProject *)project {
+  [taskController_ cancelPendingRunsForProject:project];
   [taskController_ removeConsoleForProject:project];
+  if (batchDepth_ > 0) {
+    if ([registry_ containsProject:project]) {
+      [registry_ removeProject:project];
+      [pendingRemoves_ addObject:project];
+      needsSave_ = needsVerify_ = YES;
+    }
+    return;
+  }
   [self removeObject:project];
   [self saveProjects];
   [self verifyAllProjects:nil];
 }
 
+- (void)beginBatchUpdate {
+  if (batchDepth_++ > 0)
+    return;
+  // Make sure the registry exists before we start diverging from content.
+  [self registry];
+  pendingAdds_ = [[NSMutableArray alloc] init];
+  pendingRemoves_ = [[NSMutableSet alloc] init];
+  needsSave_ = needsVerify_ = NO;
+}
+
+- (void)commitBatchUpdate {
+  GMAssert(batchDepth_ > 0, @"commitBatchUpdate without beginBatchUpdate");
+  if (batchDepth_ <= 0 || --batchDepth_ > 0)
+    return;
+
+  // Apply the adds and removes with a single change to our content so
+  // observers (e.g. the table) see one update.
+  if ([pendingAdds_ count] || [pendingRemoves_ count]) {
+    NSArray *oldContent = [self content];
+    NSMutableArray *content = [NSMutableArray arrayWithCapacity:
+                                                [oldContent count] + [pendingAdds_ count]];
+    NSMutableSet *placed = [NSMutableSet set];
+    NSEnumerator *penum = [oldContent objectEnumerator];
+    MBProject *project = nil;
+    while ((project = [penum nextObject])) {
+      if (![pendingRemoves_ containsObject:project]) {
+        [content addObject:project];
+        [placed addObject:project];
+      }
+    }
+    penum = [pendingAdds_ objectEnumerator];
+    while ((project = [penum nextObject])) {
+      if (![pendingRemoves_ containsObject:project] &&
+          ![placed containsObject:project]) {
+        [content addObject:project];
+        [placed addObject:project];
+      }
+    }
+
+    NSMutableArray *selection = [NSMutableArray array];
+    penum = [[self selectedObjects] objectEnumerator];
+    while ((project = [penum nextObject])) {
+      if ([placed containsObject:project])
+        [selection addObject:project];
+    }
+
+    [self setContent:content];
+    if ([selection count])
+      [self setSelectedObjects:selection];
+  }
+  [pendingAdds_ release];
+  pendingAdds_ = nil;
+  [pendingRemoves_ release];
+  pendingRemoves_ = nil;
+
+  if (needsSave_)
+    [self saveProjects];
+  if (needsVerify_)
+    [self verifyAllProjects:nil];
+  needsSave_ = needsVerify_ = NO;
+  [mainProjectView_ setNeedsDisplay:YES];
+}
+
+- (MBProject *)projectForPath:(NSString *)path {
+  return [[self registry] projectForPath:path];
+}
+
+- (MBProject *)projectForIdentifier:(NSNumber *)identifier {
+  return [[self registry] projectForIdentifier:identifier];
+}
+
 - (NSArray *)projects {
   return [self content];
 }
@@ -372,16 +671,17 @@ static NSString *MBProjectPboardType = @"MBProject";
       if (!success) {
         GMLoggerError(@"Whoa; can't start project %@", [project name]);
       }
-      [mainProjectView_ setNeedsDisplay:YES];
     }
   }
 }
 
 - (IBAction)runCurrentProjects:(id)sender {
+  MB_TRACE_EVENT_SCOPE("ui", __func__);
   [self startProjects:[self currentProjects] inProduction:NO];
 }
 
 - (IBAction)productionRunCurrentProjects:(id)sender {
+  MB_TRACE_EVENT_SCOPE("ui", __func__);
   [self startProjects:[self currentProjects] inProduction:YES];
 }
 
@@ -393,14 +693,12 @@ static NSString *MBProjectPboardType = @"MBProject";
   } else {
     [project setRunState:kMBProjectProductionRun];
   }
-  [mainProjectView_ setNeedsDisplay:YES];
 }
 
 // Called when a project task died, which may have been expected.
 // E.g. deploy is done.
 - (void)deathForProject:(MBProject *)project {
   [project setRunState:kMBProjectStop];
-  [mainProjectView_ setNeedsDisplay:YES];
 }
 
 // Called when a project died unexpectedly.
@@ -409,7 +707,6 @@ static NSString *MBProjectPboardType = @"MBProject";
       ([project runState] == kMBProjectProductionRun) ||
       ([project runState] == kMBProjectStarting)) {
     [project setRunState:kMBProjectDied];
-    [mainProjectView_ setNeedsDisplay:YES];
   }
 }
 
@@ -432,12 +729,12 @@ static NSString *MBProjectPboardType = @"MBProject";
     }
     if (success) {
       [project setRunState:kMBProjectStop];
-      [mainProjectView_ setNeedsDisplay:YES];
     }
   }
 }
 
 - (IBAction)stopCurrentProjects:(id)sender {
+  MB_TRACE_EVENT_SCOPE("ui", __func__);
   NSArray *a = [self currentProjects];
   NSEnumerator *aenum = [a objectEnumerator];
   MBProject *project = nil;
@@ -452,6 +749,7 @@ static NSString *MBProjectPboardType = @"MBProject";
 // replaced by the local port number for each project.
 - (IBAction)genericBrowseForCurrentProjects:(id)sender
                                     urlBase:(NSString *)urlBase {
+  const char *previous = MBStallWatchdogSetAction(__func__);
   NSArray *a = [self currentProjects];
   NSEnumerator *aenum = [a objectEnumerator];
   MBProject *project = nil;
@@ -483,6 +781,7 @@ static NSString *MBProjectPboardType = @"MBProject";
       }
     }
   }
+  MBStallWatchdogSetAction(previous);
 }
 
 - (IBAction)browseCurrentProjects:(id)sender {
@@ -604,6 +903,7 @@ static NSString *MBProjectPboardType = @"MBProject";
 
 // Uses new-style auth dialog
 - (IBAction)deployCurrentProjects:(id)sender {
+  MB_TRACE_EVENT_SCOPE("ui", __func__);
   NSArray *projects = [self currentProjects];
   if ([projects count] == 0)
     return;
@@ -617,7 +917,6 @@ static NSString *MBProjectPboardType = @"MBProject";
         ([project runState] == kMBProjectRun)) {
       [taskController_ stopTaskForProject:project];
       [project setRunState:kMBProjectStop];
-      [mainProjectView_ setNeedsDisplay:YES];
     }
 
     // Can't do this yet; cancel in the auth dialog leaves the project
@@ -695,6 +994,7 @@ static NSString *MBProjectPboardType = @"MBProject";
 }
 
 - (IBAction)addExistingApp:(id)sender {
+  MB_TRACE_EVENT_SCOPE("ui", __func__);
   MBAddExistingAppController *controller =
       (MBAddExistingAppController *)[self addApp:@"AddExisting"
                              withControllerClass:[MBAddExistingAppController class]];
@@ -709,7 +1009,51 @@ static NSString *MBProjectPboardType = @"MBProject";
   [self addProject:project];
 }
 
+// Runs on a background thread so the crawl doesn't block the UI.
+- (void)crawlForImport:(NSArray *)roots {
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  MBProjectCrawler *crawler = [[[MBProjectCrawler alloc] initWithRoots:roots]
+                                autorelease];
+  NSArray *patterns = [[NSUserDefaults standardUserDefaults]
+                        arrayForKey:kMBImportIgnorePatternsPref];
+  if (patterns)
+    [crawler setIgnorePatterns:patterns];
+  NSArray *found = [crawler crawl];
+  [self performSelectorOnMainThread:@selector(importDirectories:)
+                         withObject:found
+                      waitUntilDone:NO];
+  [pool release];
+}
+
+- (void)importDirectories:(NSArray *)dirnames {
+  if ([dirnames count] == 0) {
+    GMLoggerError(@"No applications (directories containing an app.yaml) "
+                  "were found.");
+    return;
+  }
+  int added = [self addProjectsForDirectories:dirnames];
+  GMLoggerInfo(@"Imported %d of %d applications found.",
+               added, (int)[dirnames count]);
+}
+
+- (IBAction)importApps:(id)sender {
+  MB_TRACE_EVENT_SCOPE("ui", __func__);
+  NSOpenPanel *panel = [NSOpenPanel openPanel];
+  [panel setAllowsMultipleSelection:YES];
+  [panel setCanChooseDirectories:YES];
+  [panel setCanChooseFiles:NO];
+  // TODO(jrg): I18N
+  [panel setPrompt:@"Import"];
+  [panel setTitle:@"Import All Applications In Directory"];
+  if ([panel runModalForTypes:nil] != NSOKButton)
+    return;
+  [NSThread detachNewThreadSelector:@selector(crawlForImport:)
+                           toTarget:self
+                         withObject:[panel filenames]];
+}
+
 - (IBAction)addNewApp:(id)sender {
+  MB_TRACE_EVENT_SCOPE("ui", __func__);
   MBAddNewAppController *controller =
       (MBAddNewAppController *)[self addApp:@"AddNew"
                         withControllerClass:[MBAddNewAppController class]];
@@ -721,36 +1065,17 @@ static NSString *MBProjectPboardType = @"MBProject";
 
   NSString *template = [runtime newAppTemplateDirectory];
   NSString *dest = [[controller directory] stringByAppendingPathComponent:[controller name]];
-  BOOL worked = [[NSFileManager defaultManager] copyPath:template
-                                                  toPath:dest
-                                                handler:nil];
-  if (worked == NO) {
-    GMLoggerError(@"A directory or file named %@ may already exist, "
-                  "or you may not have permission to create it.",
-                  dest);
-    return;
-  }
-
-  NSArray *args = [NSArray arrayWithObjects:@"-R", @"u+w", dest, nil];
-  NSTask *task = [NSTask launchedTaskWithLaunchPath:@"/bin/chmod"
-                         arguments:args];
-    [task waitUntilExit];
-
+  MBTemplateEngine *engine = [[[MBTemplateEngine alloc] initWithTemplate:template
+                                                             destination:dest]
+                               autorelease];
   // Now fix the default project
-  NSString *appYamlFile = [dest stringByAppendingPathComponent:@"app.yaml"];
-  NSMutableString *yamlString = [NSMutableString stringWithContentsOfFile:appYamlFile
-                                                                 encoding:NSUTF8StringEncoding
-                                                                    error:NULL];
-  [yamlString replaceOccurrencesOfString:@"new-project-template"
-              withString:[controller name]
-                 options:NSLiteralSearch
-                   range:NSMakeRange(0, [yamlString length])];
-  worked = [yamlString writeToFile:appYamlFile
-                        atomically:YES
-                          encoding:NSUTF8StringEncoding
-                             error:NULL];
-  if (worked == NO) {
-    GMLoggerError(@"Can't setup new project correctly.");
+  NSDictionary *names = [NSDictionary dictionaryWithObject:[controller name]
+                                                    forKey:@"new-project-template"];
+  [engine setSubstitutions:names forFiles:[NSArray arrayWithObject:@"app.yaml"]];
+  if ([engine materialize] == NO) {
+    GMLoggerError(@"A directory or file named %@ may already exist, "
+                  "or you may not have permission to create it.  (%@)",
+                  dest, [engine error]);
     return;
   }
 
@@ -761,6 +1086,7 @@ static NSString *MBProjectPboardType = @"MBProject";
 }
 
 - (IBAction)addDemoApp:(id)sender {
+  MB_TRACE_EVENT_SCOPE("ui", __func__);
   NSString *title = [sender title];
   NSString *oldPath = [taskController_ fullpathForDemo:title];
   NSString *port = [NSString stringWithFormat:@"%d", [self unusedProjectPort]];
@@ -772,14 +1098,13 @@ static NSString *MBProjectPboardType = @"MBProject";
       newPath = [NSString stringWithFormat:@"%@/%@-%d", NSHomeDirectory(),
                           title, count++];
     }
-    [[NSFileManager defaultManager] copyPath:oldPath
-                                      toPath:newPath
-                                      handler:nil];
-
-    NSArray *args = [NSArray arrayWithObjects:@"-R", @"u+w", newPath, nil];
-    NSTask *task = [NSTask launchedTaskWithLaunchPath:@"/bin/chmod"
-                                            arguments:args];
-    [task waitUntilExit];
+    MBTemplateEngine *engine = [[[MBTemplateEngine alloc] initWithTemplate:oldPath
+                                                               destination:newPath]
+                                 autorelease];
+    if ([engine materialize] == NO) {
+      GMLoggerError(@"Can't copy the %@ demo: %@", title, [engine error]);
+      return;
+    }
 
     // TODO(jrg): confirm?
     MBProject *project = [MBProject project];
@@ -791,6 +1116,7 @@ static NSString *MBProjectPboardType = @"MBProject";
 }
 
 - (IBAction)removeApps:(id)sender {
+  MB_TRACE_EVENT_SCOPE("ui", __func__);
   NSArray *a = [self currentProjects];
 
   // TODO(jrg): abstract so testing is easier
@@ -816,12 +1142,14 @@ static NSString *MBProjectPboardType = @"MBProject";
 
   NSEnumerator *aenum = [a objectEnumerator];
   MBProject *project = nil;
+  [self beginBatchUpdate];
   while ((project = [aenum nextObject])) {
     if ([project runState] == kMBProjectRun) {
       [self stopProject:project];
     }
     [self removeProject:project];
   }
+  [self commitBatchUpdate];
 }
 
 - (IBAction)makeCommandLineSymlinks:(id)sender {
@@ -893,8 +1221,9 @@ static NSString *MBProjectPboardType = @"MBProject";
 
 // TODO(jrg): add some asserts...
 - (void)loadProjects {
+  MB_TRACE_EVENT_SCOPE("projects", __func__);
   [self createProjectSaveDirectory];
-  [[self content] removeAllObjects];
+  NSMutableArray *loaded = [NSMutableArray array];
   NSString *path = [self projectSavePath];
   NSData *data = [NSData dataWithContentsOfFile:path];
   if (data) {
@@ -903,12 +1232,19 @@ static NSString *MBProjectPboardType = @"MBProject";
     NSArray *projects = [unarchiver decodeObjectForKey:@"projects"];
     [unarchiver finishDecoding];
     if (projects)
-      [self addObjects:projects];
+      [loaded addObjectsFromArray:projects];
   }
+  // Replaces the old projects in registry_ and runStates_ too.
+  [self setContent:loaded];
   [self verifyAllProjects:nil];
 }
 
 - (void)saveProjects {
+  if (batchDepth_ > 0) {
+    needsSave_ = YES;
+    return;
+  }
+  MB_TRACE_EVENT_SCOPE("projects", __func__);
   [self createProjectSaveDirectory];
   NSString *path = [self projectSavePath];
   NSArray *projects = [self content];
@@ -20,6 +20,10 @@ limitations under the License.
 - (void)testAwakeFromNib;
 - (void)testBasics;
 - (void)testLoadSave;
+- (void)testLookup;
+- (void)testAddDirectories;
+- (void)testBatch;
+- (void)testSelectedRunStates;
 - (void)testDialogs;
 
 @end
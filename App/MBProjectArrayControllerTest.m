@@ -19,6 +19,7 @@ limitations under the License.
 #import "MBProject.h"
 #import "MBProjectArrayController.h"
 #import "MBProjectArrayControllerTest.h"
+#import "MBRunStateModel.h"
 
 // ---------------------------------------------
 
@@ -26,10 +27,15 @@ limitations under the License.
 @interface MBProjectArrayTestController : MBProjectArrayController {
   NSString *unique_;
 }
+- (MBRunStateModel *)runStateModel;
 @end
 
 @implementation MBProjectArrayTestController
 
+- (MBRunStateModel *)runStateModel {
+  return runStates_;
+}
+
 - (NSString *)projectSavePath {
   if (unique_ == nil) {
     unique_ = [[NSString stringWithFormat:@"/tmp/pactest-%d",
@@ -98,6 +104,36 @@ limitations under the License.
   // [c openDashboardForCurrentProjects:nil];
 }
 
+- (void)testSelectedRunStates {
+  MBProjectArrayController *c = [[[MBProjectArrayTestController alloc] init] autorelease];
+  MBProject *p0 = [MBProject projectWithName:@"name0" path:@"path0" port:@"8080"];
+  MBProject *p1 = [MBProject projectWithName:@"name1" path:@"path1" port:@"8081"];
+  [c addProject:p0];
+  STAssertFalse([c isAnySelectedProjectInState:kMBProjectRun], nil);
+
+  // Only one project: it's current even if not selected.
+  [c setSelectedObjects:[NSArray array]];
+  STAssertTrue([c isAnySelectedProjectInState:kMBProjectStop], nil);
+
+  [c addProject:p1];
+  [c setSelectedObjects:[NSArray arrayWithObject:p1]];
+  [p0 setRunState:kMBProjectRun];
+  STAssertFalse([c isAnySelectedProjectInState:kMBProjectRun], nil);
+  STAssertTrue([c isAnySelectedProjectInState:kMBProjectStop], nil);
+  STAssertFalse([c isAnySelectedProjectNotInState:kMBProjectStop], nil);
+
+  [p1 setRunState:kMBProjectProductionRun];
+  STAssertTrue([c isAnySelectedProjectInState:kMBProjectProductionRun], nil);
+  STAssertTrue([c isAnySelectedProjectNotInState:kMBProjectStop], nil);
+
+  [c setSelectedObjects:[NSArray arrayWithObjects:p0, p1, nil]];
+  STAssertTrue([c isAnySelectedProjectInState:kMBProjectRun], nil);
+  STAssertFalse([c isAnySelectedProjectInState:kMBProjectStop], nil);
+
+  [c removeProject:p0];
+  STAssertFalse([c isAnySelectedProjectInState:kMBProjectRun], nil);
+}
+
 - (void)testLoadSave {
   MBProjectArrayController *c = [[[MBProjectArrayTestController alloc] init] autorelease];
   STAssertNotNil(c, nil);
@@ -124,6 +160,83 @@ limitations under the License.
   // "search by name/path/port" mechanism.
 }
 
+- (void)testLookup {
+  MBProjectArrayController *c = [[[MBProjectArrayTestController alloc] init] autorelease];
+  MBProject *p1 = [MBProject projectWithName:@"name0" path:@"path0" port:@"8080"];
+  MBProject *p2 = [MBProject projectWithName:@"super" path:@"smash" port:@"8091"];
+  [c addProject:p1];
+  [c addProject:p2];
+  STAssertTrue([c projectForPath:@"path0"] == p1, nil);
+  STAssertTrue([c projectForIdentifier:[p2 identifier]] == p2, nil);
+  STAssertTrue([c unusedProjectPort] == 8092, nil);
+
+  [c removeProject:p2];
+  STAssertNil([c projectForPath:@"smash"], nil);
+  STAssertTrue([c unusedProjectPort] == 8081, nil);
+
+  // Reload replaces every project; the old objects must be gone.
+  [c saveProjects];
+  [c loadProjects];
+  STAssertTrue([[c projects] count] == 1, nil);
+  STAssertTrue([c projectForIdentifier:[p1 identifier]] == nil, nil);
+  STAssertNotNil([c projectForPath:@"path0"], nil);
+  // So are their run states, however often we reload.
+  [c loadProjects];
+  MBRunStateModel *runStates = [(MBProjectArrayTestController *)c runStateModel];
+  STAssertEquals([runStates count], 1U, nil);
+  STAssertEquals([runStates countOfProjectsInState:kMBProjectStop], 1U, nil);
+}
+
+- (void)testAddDirectories {
+  MBProjectArrayController *c = [[[MBProjectArrayTestController alloc] init] autorelease];
+  [c addProject:[MBProject projectWithName:@"name0" path:@"path0" port:@"8080"]];
+  NSArray *dirs = [NSArray arrayWithObjects:@"/a/path1", @"path0", @"/b/path2",
+                           @"/a/path1", nil];
+  STAssertTrue([c addProjectsForDirectories:dirs] == 2, nil);
+  STAssertTrue([[c projects] count] == 3, nil);
+  MBProject *p1 = [c projectForPath:@"/a/path1"];
+  MBProject *p2 = [c projectForPath:@"/b/path2"];
+  STAssertEqualObjects([p1 port], @"8081", nil);
+  STAssertEqualObjects([p2 port], @"8082", nil);
+  STAssertTrue([c addProjectsForDirectories:dirs] == 0, nil);
+  STAssertTrue([c addProjectsForDirectories:nil] == 0, nil);
+}
+- (void)testBatch {
+  MBProjectArrayController *c = [[[MBProjectArrayTestController alloc] init] autorelease];
+  MBProject *p0 = [MBProject projectWithName:@"name0" path:@"path0" port:@"8080"];
+  [c addProject:p0];
+  NSFileManager *fm = [NSFileManager defaultManager];
+  [fm removeFileAtPath:[c projectSavePath] handler:nil];
+
+  [c beginBatchUpdate];
+  [c beginBatchUpdate];  // nests
+  [c addProjectForDirectory:@"/x/path1"];
+  [c addProjectForDirectory:@"/x/path2"];
+  [[GMLogger sharedLogger] setWriter:nil];
+  [c addProjectForDirectory:@"/x/path1"];  // dup; fails
+  STAssertTrue([c unusedProjectPort] == 8083, nil);
+  [c removeProject:[c projectForPath:@"/x/path2"]];
+  [c removeProject:p0];
+  [c commitBatchUpdate];
+
+  // Nothing applied until the outermost commit.
+  STAssertTrue([[c projects] count] == 1, nil);
+  STAssertFalse([fm fileExistsAtPath:[c projectSavePath]], nil);
+  STAssertNil([c projectForPath:@"path0"], nil);
+
+  [c commitBatchUpdate];
+  STAssertTrue([[c projects] count] == 1, nil);
+  MBProject *p1 = [[c projects] objectAtIndex:0];
+  STAssertEqualObjects([p1 path], @"/x/path1", nil);
+  STAssertEqualObjects([p1 port], @"8081", nil);
+  STAssertTrue([c projectForPath:@"/x/path1"] == p1, nil);
+  STAssertTrue([fm fileExistsAtPath:[c projectSavePath]], nil);
+
+  // An empty batch changes nothing.
+  [c beginBatchUpdate];
+  [c commitBatchUpdate];
+  STAssertTrue([[c projects] count] == 1, nil);
+}
 
 - (void)testDialogs {
   //
@@ -0,0 +1,86 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// MBProjectBenchmark
+//
+// Times the project list operations whose cost grows with the number of
+// projects, on a synthetic tree of project directories (each with an
+// app.yaml) in a scratch directory:
+//
+//   add                 addProjectsForDirectories: for every project
+//   save                saveProjects
+//   load                loadProjects into a new controller (which verifies
+//                       every project, reading each app.yaml)
+//   verify              verifyAllProjects: again, with nothing changed
+//   duplicateAdd        addProject: of a path already present (rejected);
+//                       per call
+//   unusedProjectPort   per call
+//   projectForPath      per call
+//   dragReorder         one drag and drop within the table, which saves
+//                       the list; per drop
+//
+// Times are in seconds. Results are plists, so runs can be kept and
+// compared:
+//
+//   {
+//     format = 1;
+//     date = <NSDate>;
+//     results = ( { projects = 100; add = 0.01; save = 0.02; ... }, ... );
+//   }
+//
+// See projectbench.m for running it.
+
+#import <Foundation/Foundation.h>
+
+// The result keys above.
+extern NSString *const kMBProjectBenchmarkProjects;
+extern NSString *const kMBProjectBenchmarkResults;
+
+@interface MBProjectBenchmark : NSObject {
+ @private
+  NSString *directory_;
+  int repeats_;
+}
+
+// Designated initializer. |directory| holds the projects and the saved
+// project list; it is created if need be, and emptied before each run.
+- (id)initWithDirectory:(NSString *)directory;
+
+// How many times the per-call operations are run, to average over (1000).
+// Drags, which save the whole list, are done a tenth as often.
+- (void)setRepeats:(int)repeats;
+
+// Times everything with |count| (at least 1) projects. Returns one result
+// dictionary.
+- (NSDictionary *)runWithProjectCount:(int)count;
+
+// Runs each count (NSNumbers) in turn. Returns a results plist as above.
+- (NSDictionary *)runWithProjectCounts:(NSArray *)counts;
+
+// The operation names, in the order above.
++ (NSArray *)operations;
+
+// Lines of "operation<TAB>projects<TAB>seconds" for |results|.
++ (NSString *)tableForResults:(NSDictionary *)results;
+
+// Compares |results| with an earlier |baseline|, one line per operation
+// and project count found in both. Sets |*slower| (if given) to YES if any
+// is more than |factor| times slower than before.
++ (NSString *)compareResults:(NSDictionary *)results
+                  toBaseline:(NSDictionary *)baseline
+                      factor:(double)factor
+                      slower:(BOOL *)slower;
+
+@end
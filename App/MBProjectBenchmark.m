@@ -0,0 +1,356 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import <Cocoa/Cocoa.h>
+#import "GMLogger.h"
+#import "MBProject.h"
+#import "MBProjectArrayController.h"
+#import "MBProjectBenchmark.h"
+
+NSString *const kMBProjectBenchmarkProjects = @"projects";
+NSString *const kMBProjectBenchmarkResults = @"results";
+
+static NSString *const kMBProjectBenchmarkFormat = @"format";
+static NSString *const kMBProjectBenchmarkDate = @"date";
+
+// Matches MBProjectArrayController's private pasteboard type.
+static NSString *const kMBProjectBenchmarkPboardType = @"MBProject";
+
+// Saves its project list in the benchmark's directory, not the user's.
+@interface MBProjectBenchmarkController : MBProjectArrayController {
+ @private
+  NSString *savePath_;
+}
+- (id)initWithSavePath:(NSString *)path;
+@end
+
+@implementation MBProjectBenchmarkController
+
+- (id)initWithSavePath:(NSString *)path {
+  if ((self = [super init])) {
+    savePath_ = [path copy];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [savePath_ release];
+  [super dealloc];
+}
+
+- (NSString *)projectSavePath {
+  return savePath_;
+}
+
+@end
+
+
+// Just enough of an NSDraggingInfo for a drop within the table.
+@interface MBProjectBenchmarkDrag : NSObject {
+ @private
+  NSPasteboard *pasteboard_;
+}
+- (id)initWithPasteboard:(NSPasteboard *)pasteboard;
+- (NSPasteboard *)draggingPasteboard;
+@end
+
+@implementation MBProjectBenchmarkDrag
+
+- (id)initWithPasteboard:(NSPasteboard *)pasteboard {
+  if ((self = [super init])) {
+    pasteboard_ = [pasteboard retain];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [pasteboard_ release];
+  [super dealloc];
+}
+
+- (NSPasteboard *)draggingPasteboard {
+  return pasteboard_;
+}
+
+@end
+
+
+// Turns away everything short of an assert, before it's formatted, so
+// a timed loop doesn't pay to format or write messages.
+@interface MBProjectBenchmarkSilence : NSObject <GMLogFuncLevelFilter>
+@end
+
+@implementation MBProjectBenchmarkSilence
+
+- (GMLoggerLevel)minimumLevelForFunc:(const char *)func {
+  return kGMLoggerLevelAssert;
+}
+
+- (BOOL)filterAllowsMessage:(NSString *)msg level:(GMLoggerLevel)level {
+  return level >= kGMLoggerLevelAssert;
+}
+
+@end
+
+
+@interface MBProjectBenchmark (PrivateMethods)
+- (NSArray *)makeProjects:(int)count;
+@end
+
+static NSTimeInterval MBProjectBenchmarkNow(void) {
+  return [NSDate timeIntervalSinceReferenceDate];
+}
+
+@implementation MBProjectBenchmark
+
++ (NSArray *)operations {
+  return [NSArray arrayWithObjects:@"add", @"save", @"load", @"verify",
+          @"duplicateAdd", @"unusedProjectPort", @"projectForPath",
+          @"dragReorder", nil];
+}
+
+- (id)init {
+  return [self initWithDirectory:nil];
+}
+
+- (id)initWithDirectory:(NSString *)directory {
+  if ((self = [super init])) {
+    if (directory == nil) {
+      [self release];
+      return nil;
+    }
+    directory_ = [[directory stringByStandardizingPath] copy];
+    repeats_ = 1000;
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [directory_ release];
+  [super dealloc];
+}
+
+- (void)setRepeats:(int)repeats {
+  repeats_ = (repeats > 0) ? repeats : 1;
+}
+
+- (NSDictionary *)runWithProjectCount:(int)count {
+  if (count < 1)
+    count = 1;
+  NSMutableDictionary *result = [NSMutableDictionary dictionary];
+  [result setObject:[NSNumber numberWithInt:count]
+             forKey:kMBProjectBenchmarkProjects];
+  NSArray *paths = [self makeProjects:count];
+  NSString *savePath = [directory_ stringByAppendingPathComponent:
+                                     @"Projects.plist"];
+  NSTimeInterval start;
+
+  MBProjectBenchmarkController *c =
+    [[[MBProjectBenchmarkController alloc] initWithSavePath:savePath]
+      autorelease];
+  start = MBProjectBenchmarkNow();
+  [c addProjectsForDirectories:paths];
+  [result setObject:[NSNumber numberWithDouble:MBProjectBenchmarkNow() - start]
+             forKey:@"add"];
+
+  start = MBProjectBenchmarkNow();
+  [c saveProjects];
+  [result setObject:[NSNumber numberWithDouble:MBProjectBenchmarkNow() - start]
+             forKey:@"save"];
+
+  MBProjectBenchmarkController *loaded =
+    [[[MBProjectBenchmarkController alloc] initWithSavePath:savePath]
+      autorelease];
+  start = MBProjectBenchmarkNow();
+  [loaded loadProjects];
+  [result setObject:[NSNumber numberWithDouble:MBProjectBenchmarkNow() - start]
+             forKey:@"load"];
+  if ((int)[[loaded projects] count] != count)
+    GMLoggerError(@"Loaded %u projects of %d",
+                  (unsigned)[[loaded projects] count], count);
+
+  start = MBProjectBenchmarkNow();
+  [loaded verifyAllProjects:nil];
+  [result setObject:[NSNumber numberWithDouble:MBProjectBenchmarkNow() - start]
+             forKey:@"verify"];
+
+  // Every add is a duplicate, so is refused with an error; drop them
+  // (a nil writer would mean stdout, not nowhere).
+  GMLogger *logger = [GMLogger sharedLogger];
+  id<GMLogFilter> filter = [[[logger filter] retain] autorelease];
+  [logger setFilter:[[[MBProjectBenchmarkSilence alloc] init] autorelease]];
+  NSMutableArray *duplicates = [NSMutableArray arrayWithCapacity:repeats_];
+  for (int i = 0; i < repeats_; i++) {
+    NSString *path = [paths objectAtIndex:i % count];
+    [duplicates addObject:[MBProject projectWithName:[path lastPathComponent]
+                                                path:path
+                                                port:@"8080"]];
+  }
+  start = MBProjectBenchmarkNow();
+  for (int i = 0; i < repeats_; i++)
+    [loaded addProject:[duplicates objectAtIndex:i]];
+  [result setObject:[NSNumber numberWithDouble:
+                       (MBProjectBenchmarkNow() - start) / repeats_]
+             forKey:@"duplicateAdd"];
+  [logger setFilter:filter];
+
+  start = MBProjectBenchmarkNow();
+  for (int i = 0; i < repeats_; i++)
+    [loaded unusedProjectPort];
+  [result setObject:[NSNumber numberWithDouble:
+                       (MBProjectBenchmarkNow() - start) / repeats_]
+             forKey:@"unusedProjectPort"];
+
+  start = MBProjectBenchmarkNow();
+  for (int i = 0; i < repeats_; i++)
+    [loaded projectForPath:[paths objectAtIndex:(i * 7919) % count]];
+  [result setObject:[NSNumber numberWithDouble:
+                       (MBProjectBenchmarkNow() - start) / repeats_]
+             forKey:@"projectForPath"];
+
+  // Drag the first project to a row further down, as a user would.
+  int drops = (repeats_ >= 10) ? repeats_ / 10 : 1;
+  NSPasteboard *pasteboard = [NSPasteboard pasteboardWithUniqueName];
+  [pasteboard declareTypes:[NSArray arrayWithObject:
+                                      kMBProjectBenchmarkPboardType]
+                     owner:nil];
+  [pasteboard setData:[NSKeyedArchiver archivedDataWithRootObject:
+                                         [NSIndexSet indexSetWithIndex:0]]
+              forType:kMBProjectBenchmarkPboardType];
+  MBProjectBenchmarkDrag *drag =
+    [[[MBProjectBenchmarkDrag alloc] initWithPasteboard:pasteboard]
+      autorelease];
+  start = MBProjectBenchmarkNow();
+  for (int i = 0; i < drops; i++) {
+    [loaded tableView:nil
+           acceptDrop:(id<NSDraggingInfo>)drag
+                  row:(count > 1) ? 1 + i % (count - 1) : 0
+        dropOperation:NSTableViewDropAbove];
+  }
+  [result setObject:[NSNumber numberWithDouble:
+                       (MBProjectBenchmarkNow() - start) / drops]
+             forKey:@"dragReorder"];
+  [pasteboard releaseGlobally];
+
+  return result;
+}
+
+- (NSDictionary *)runWithProjectCounts:(NSArray *)counts {
+  NSMutableArray *results = [NSMutableArray array];
+  NSEnumerator *countEnumerator = [counts objectEnumerator];
+  NSNumber *count = nil;
+  while ((count = [countEnumerator nextObject])) {
+    NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+    [results addObject:[self runWithProjectCount:[count intValue]]];
+    [pool release];
+  }
+  [[NSFileManager defaultManager] removeFileAtPath:directory_ handler:nil];
+  return [NSDictionary dictionaryWithObjectsAndKeys:
+          [NSNumber numberWithInt:1], kMBProjectBenchmarkFormat,
+          [NSDate date], kMBProjectBenchmarkDate,
+          results, kMBProjectBenchmarkResults,
+          nil];
+}
+
++ (NSString *)tableForResults:(NSDictionary *)results {
+  NSMutableString *table = [NSMutableString string];
+  NSEnumerator *resultEnumerator =
+    [[results objectForKey:kMBProjectBenchmarkResults] objectEnumerator];
+  NSDictionary *result = nil;
+  while ((result = [resultEnumerator nextObject])) {
+    NSEnumerator *operationEnumerator = [[self operations] objectEnumerator];
+    NSString *operation = nil;
+    while ((operation = [operationEnumerator nextObject])) {
+      NSNumber *seconds = [result objectForKey:operation];
+      if (seconds == nil)
+        continue;
+      [table appendFormat:@"%@\t%@\t%.9f\n", operation,
+             [result objectForKey:kMBProjectBenchmarkProjects],
+             [seconds doubleValue]];
+    }
+  }
+  return table;
+}
+
++ (NSString *)compareResults:(NSDictionary *)results
+                  toBaseline:(NSDictionary *)baseline
+                      factor:(double)factor
+                      slower:(BOOL *)slower {
+  // projects -> result, for the baseline.
+  NSMutableDictionary *before = [NSMutableDictionary dictionary];
+  NSEnumerator *resultEnumerator =
+    [[baseline objectForKey:kMBProjectBenchmarkResults] objectEnumerator];
+  NSDictionary *result = nil;
+  while ((result = [resultEnumerator nextObject])) {
+    NSNumber *projects = [result objectForKey:kMBProjectBenchmarkProjects];
+    if (projects)
+      [before setObject:result forKey:projects];
+  }
+
+  if (slower)
+    *slower = NO;
+  NSMutableString *comparison = [NSMutableString string];
+  resultEnumerator =
+    [[results objectForKey:kMBProjectBenchmarkResults] objectEnumerator];
+  while ((result = [resultEnumerator nextObject])) {
+    NSNumber *projects = [result objectForKey:kMBProjectBenchmarkProjects];
+    NSDictionary *old = [before objectForKey:projects];
+    NSEnumerator *operationEnumerator = [[self operations] objectEnumerator];
+    NSString *operation = nil;
+    while ((operation = [operationEnumerator nextObject])) {
+      double now = [[result objectForKey:operation] doubleValue];
+      double then = [[old objectForKey:operation] doubleValue];
+      if (old == nil || then <= 0 || [result objectForKey:operation] == nil)
+        continue;
+      BOOL worse = (factor > 0 && now > then * factor);
+      if (worse && slower)
+        *slower = YES;
+      [comparison appendFormat:@"%@\t%@\t%.9f\t%.9f\t%.2fx%@\n", operation,
+                  projects, then, now, now / then, (worse ? @"\tSLOWER" : @"")];
+    }
+  }
+  return comparison;
+}
+
+@end  // MBProjectBenchmark
+
+
+@implementation MBProjectBenchmark (PrivateMethods)
+
+// Empties |directory_| and fills it with |count| project directories.
+// Returns their paths.
+- (NSArray *)makeProjects:(int)count {
+  NSFileManager *fm = [NSFileManager defaultManager];
+  [fm removeFileAtPath:directory_ handler:nil];
+  [fm createDirectoryAtPath:directory_ attributes:nil];
+  NSMutableArray *paths = [NSMutableArray arrayWithCapacity:count];
+  for (int i = 0; i < count; i++) {
+    NSString *name = [NSString stringWithFormat:@"app%05d", i];
+    NSString *path = [directory_ stringByAppendingPathComponent:name];
+    [fm createDirectoryAtPath:path attributes:nil];
+    NSString *yaml = [NSString stringWithFormat:
+                      @"application: %@\nversion: 1\nruntime: python\n"
+                      @"api_version: 1\n\nhandlers:\n- url: /.*\n"
+                      @"  script: main.py\n", name];
+    [yaml writeToFile:[path stringByAppendingPathComponent:@"app.yaml"]
+           atomically:NO
+             encoding:NSUTF8StringEncoding
+                error:NULL];
+    [paths addObject:path];
+  }
+  return paths;
+}
+
+@end  // PrivateMethods
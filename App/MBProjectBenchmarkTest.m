@@ -0,0 +1,115 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import <SenTestingKit/SenTestingKit.h>
+#import <Cocoa/Cocoa.h>
+#import "MBProjectBenchmark.h"
+#import "MBProjectBenchmarkTest.h"
+
+static NSString *ScratchDirectory(void) {
+  return [NSString stringWithFormat:@"/tmp/projectbenchtest-%d",
+          [[NSProcessInfo processInfo] processIdentifier]];
+}
+
+// A results plist with one operation at one count.
+static NSDictionary *Results(int projects, NSString *operation,
+                             double seconds) {
+  NSDictionary *result = [NSDictionary dictionaryWithObjectsAndKeys:
+                          [NSNumber numberWithInt:projects],
+                          kMBProjectBenchmarkProjects,
+                          [NSNumber numberWithDouble:seconds], operation,
+                          nil];
+  return [NSDictionary dictionaryWithObject:[NSArray arrayWithObject:result]
+                                     forKey:kMBProjectBenchmarkResults];
+}
+
+@implementation MBProjectBenchmarkTest
+
+- (void)testRun {
+  MBProjectBenchmark *b = [[[MBProjectBenchmark alloc]
+                             initWithDirectory:ScratchDirectory()]
+                            autorelease];
+  [b setRepeats:20];
+  NSArray *counts = [NSArray arrayWithObjects:[NSNumber numberWithInt:1],
+                     [NSNumber numberWithInt:25], nil];
+  NSDictionary *results = [b runWithProjectCounts:counts];
+  NSArray *runs = [results objectForKey:kMBProjectBenchmarkResults];
+  STAssertEquals([runs count], (NSUInteger)2, nil);
+  STAssertEqualObjects([[runs objectAtIndex:1]
+                         objectForKey:kMBProjectBenchmarkProjects],
+                       [NSNumber numberWithInt:25], nil);
+
+  NSEnumerator *runEnumerator = [runs objectEnumerator];
+  NSDictionary *run = nil;
+  while ((run = [runEnumerator nextObject])) {
+    NSEnumerator *operationEnumerator =
+      [[MBProjectBenchmark operations] objectEnumerator];
+    NSString *operation = nil;
+    while ((operation = [operationEnumerator nextObject])) {
+      NSNumber *seconds = [run objectForKey:operation];
+      STAssertNotNil(seconds, operation);
+      STAssertTrue([seconds doubleValue] >= 0, operation);
+    }
+  }
+
+  // It cleans up after itself, and the results survive a round trip.
+  STAssertFalse([[NSFileManager defaultManager]
+                  fileExistsAtPath:ScratchDirectory()], nil);
+  NSString *saved = [ScratchDirectory() stringByAppendingString:@".plist"];
+  STAssertTrue([results writeToFile:saved atomically:NO], nil);
+  STAssertEqualObjects([NSDictionary dictionaryWithContentsOfFile:saved],
+                       results, nil);
+  [[NSFileManager defaultManager] removeFileAtPath:saved handler:nil];
+
+  STAssertNil([[[MBProjectBenchmark alloc] initWithDirectory:nil]
+                autorelease], nil);
+}
+
+- (void)testTable {
+  NSString *table = [MBProjectBenchmark tableForResults:
+                       Results(100, @"save", 0.25)];
+  STAssertEqualObjects(table, @"save\t100\t0.250000000\n", nil);
+  STAssertEqualObjects([MBProjectBenchmark tableForResults:
+                          [NSDictionary dictionary]], @"", nil);
+}
+
+- (void)testCompare {
+  BOOL slower = YES;
+  NSString *comparison =
+    [MBProjectBenchmark compareResults:Results(100, @"load", 0.3)
+                            toBaseline:Results(100, @"load", 0.2)
+                                factor:2
+                                slower:&slower];
+  STAssertFalse(slower, nil);
+  STAssertTrue([comparison hasPrefix:@"load\t100\t"], comparison);
+  STAssertTrue([comparison rangeOfString:@"1.50x"].length, comparison);
+
+  comparison = [MBProjectBenchmark compareResults:Results(100, @"load", 0.5)
+                                       toBaseline:Results(100, @"load", 0.2)
+                                           factor:2
+                                           slower:&slower];
+  STAssertTrue(slower, nil);
+  STAssertTrue([comparison rangeOfString:@"SLOWER"].length, comparison);
+
+  // Different counts aren't compared.
+  comparison = [MBProjectBenchmark compareResults:Results(1000, @"load", 9)
+                                       toBaseline:Results(100, @"load", 0.2)
+                                           factor:2
+                                           slower:&slower];
+  STAssertFalse(slower, nil);
+  STAssertEqualObjects(comparison, @"", nil);
+}
+
+@end
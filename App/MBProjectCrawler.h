@@ -0,0 +1,72 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import <Foundation/Foundation.h>
+#include <pthread.h>
+
+struct MBCrawlItem;
+
+// An MBProjectCrawler walks one or more source trees looking for App
+// Engine apps (directories with an app.yaml).  Directories are read
+// by a small pool of worker threads sharing one work queue, so a large
+// tree (e.g. a repository with hundreds of services) on a network or
+// cold disk is limited by I/O latency much less than a serial walk.
+//
+// The crawl is bounded by depth, skips directories whose names match
+// any ignore pattern (fnmatch(3) style, e.g. ".*" or "node_modules"),
+// never follows symlinks, and does not descend into a directory once
+// it is known to be an app.
+@interface MBProjectCrawler : NSObject {
+ @private
+  NSArray *roots_;
+  int maxDepth_;
+  int threadCount_;
+
+  // Ignore patterns as C strings, for speed in the workers.
+  char **ignore_;
+  int ignoreCount_;
+
+  // Shared state; protected by lock_.
+  pthread_mutex_t lock_;
+  pthread_cond_t cond_;
+  struct MBCrawlItem *queue_;
+  int busy_;               // workers currently reading a directory
+  BOOL cancelled_;
+  NSMutableArray *results_;
+}
+
+// The ignore patterns used if none are given: hidden directories,
+// node_modules, bundles and the like.
++ (NSArray *)defaultIgnorePatterns;
+
+// Designated initializer.  |roots| is an array of directory paths.
+- (id)initWithRoots:(NSArray *)roots;
+
+// Defaults: 8 levels below each root and +defaultIgnorePatterns.
+- (void)setMaxDepth:(int)depth;
+- (void)setIgnorePatterns:(NSArray *)patterns;
+
+// Defaults to a few more threads than CPUs (we're I/O bound).
+- (void)setThreadCount:(int)count;
+
+// Crawl and return the app directories found, sorted.  Blocks the
+// calling thread until the crawl is done (or -cancel is called from
+// another thread).  Only call once per crawler.
+- (NSArray *)crawl;
+
+// Stop a crawl in progress; -crawl returns what was found so far.
+- (void)cancel;
+
+@end
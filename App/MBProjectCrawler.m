@@ -0,0 +1,259 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import "MBProjectCrawler.h"
+#include <dirent.h>
+#include <fnmatch.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// A directory waiting to be read.
+typedef struct MBCrawlItem {
+  char *path;
+  int depth;
+  struct MBCrawlItem *next;
+} MBCrawlItem;
+
+static MBCrawlItem *MBCrawlItemCreate(const char *path, int depth) {
+  MBCrawlItem *item = malloc(sizeof(MBCrawlItem));
+  item->path = strdup(path);
+  item->depth = depth;
+  item->next = NULL;
+  return item;
+}
+
+static void MBCrawlItemFree(MBCrawlItem *item) {
+  while (item) {
+    MBCrawlItem *next = item->next;
+    free(item->path);
+    free(item);
+    item = next;
+  }
+}
+
+@interface MBProjectCrawler (Private)
+- (BOOL)isIgnored:(const char *)name;
+- (void)readDirectory:(MBCrawlItem *)item;
+- (void)work;
+@end
+
+static void *MBCrawlerWorker(void *arg) {
+  MBProjectCrawler *crawler = (MBProjectCrawler *)arg;
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  [crawler work];
+  [pool release];
+  return NULL;
+}
+
+@implementation MBProjectCrawler
+
++ (NSArray *)defaultIgnorePatterns {
+  return [NSArray arrayWithObjects:@".*", @"node_modules", @"CVS",
+                  @"*.app", @"*.bundle", @"*.framework", @"*.xcodeproj",
+                  nil];
+}
+
+- (id)init {
+  return [self initWithRoots:nil];
+}
+
+- (id)initWithRoots:(NSArray *)roots {
+  if ((self = [super init])) {
+    roots_ = [roots copy];
+    maxDepth_ = 8;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    threadCount_ = (cpus > 0) ? (int)cpus + 2 : 4;
+    if (threadCount_ > 16)
+      threadCount_ = 16;
+    [self setIgnorePatterns:[MBProjectCrawler defaultIgnorePatterns]];
+    pthread_mutex_init(&lock_, NULL);
+    pthread_cond_init(&cond_, NULL);
+    results_ = [[NSMutableArray alloc] init];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  for (int i = 0; i < ignoreCount_; i++)
+    free(ignore_[i]);
+  free(ignore_);
+  MBCrawlItemFree(queue_);
+  pthread_mutex_destroy(&lock_);
+  pthread_cond_destroy(&cond_);
+  [roots_ release];
+  [results_ release];
+  [super dealloc];
+}
+
+- (void)setMaxDepth:(int)depth {
+  maxDepth_ = depth;
+}
+
+- (void)setThreadCount:(int)count {
+  threadCount_ = (count > 0) ? count : 1;
+}
+
+- (void)setIgnorePatterns:(NSArray *)patterns {
+  for (int i = 0; i < ignoreCount_; i++)
+    free(ignore_[i]);
+  free(ignore_);
+  ignoreCount_ = [patterns count];
+  ignore_ = calloc(ignoreCount_ + 1, sizeof(char *));
+  for (int i = 0; i < ignoreCount_; i++)
+    ignore_[i] = strdup([[patterns objectAtIndex:i] fileSystemRepresentation]);
+}
+
+- (NSArray *)crawl {
+  NSEnumerator *renum = [roots_ objectEnumerator];
+  NSString *root = nil;
+  pthread_mutex_lock(&lock_);
+  while ((root = [renum nextObject])) {
+    MBCrawlItem *item = MBCrawlItemCreate([[root stringByStandardizingPath]
+                                            fileSystemRepresentation], 0);
+    item->next = queue_;
+    queue_ = item;
+  }
+  pthread_mutex_unlock(&lock_);
+
+  pthread_t *threads = calloc(threadCount_, sizeof(pthread_t));
+  int started = 0;
+  for (int i = 0; i < threadCount_; i++) {
+    if (pthread_create(&threads[started], NULL, MBCrawlerWorker, self) == 0)
+      started++;
+  }
+  if (started == 0) {
+    // No threads to be had; do it ourselves.
+    [self work];
+  }
+  for (int i = 0; i < started; i++)
+    pthread_join(threads[i], NULL);
+  free(threads);
+
+  pthread_mutex_lock(&lock_);
+  NSArray *results = [results_ sortedArrayUsingSelector:@selector(compare:)];
+  pthread_mutex_unlock(&lock_);
+  return results;
+}
+
+- (void)cancel {
+  pthread_mutex_lock(&lock_);
+  cancelled_ = YES;
+  pthread_cond_broadcast(&cond_);
+  pthread_mutex_unlock(&lock_);
+}
+
+@end
+
+
+@implementation MBProjectCrawler (Private)
+
+- (BOOL)isIgnored:(const char *)name {
+  for (int i = 0; i < ignoreCount_; i++) {
+    if (fnmatch(ignore_[i], name, 0) == 0)
+      return YES;
+  }
+  return NO;
+}
+
+// Worker loop.  The crawl is over when the queue is empty and no
+// worker is reading a directory (which could add more work).
+- (void)work {
+  pthread_mutex_lock(&lock_);
+  for (;;) {
+    while ((queue_ == NULL) && (busy_ > 0) && !cancelled_)
+      pthread_cond_wait(&cond_, &lock_);
+    if ((queue_ == NULL) || cancelled_)
+      break;
+    MBCrawlItem *item = queue_;
+    queue_ = item->next;
+    item->next = NULL;
+    busy_++;
+    pthread_mutex_unlock(&lock_);
+
+    [self readDirectory:item];
+    MBCrawlItemFree(item);
+
+    pthread_mutex_lock(&lock_);
+    busy_--;
+    if (busy_ == 0 || queue_)
+      pthread_cond_broadcast(&cond_);
+  }
+  pthread_cond_broadcast(&cond_);
+  pthread_mutex_unlock(&lock_);
+}
+
+- (void)readDirectory:(MBCrawlItem *)item {
+  DIR *dir = opendir(item->path);
+  if (dir == NULL)
+    return;
+
+  BOOL isApp = NO;
+  MBCrawlItem *children = NULL;
+  MBCrawlItem *lastChild = NULL;
+  size_t pathLength = strlen(item->path);
+  struct dirent *entry;
+  while ((entry = readdir(dir)) != NULL) {
+    const char *name = entry->d_name;
+    if ((strcmp(name, ".") == 0) || (strcmp(name, "..") == 0))
+      continue;
+    // Only app.yaml; it's the file -[MBProject verify] reads.
+    if (strcmp(name, "app.yaml") == 0) {
+      isApp = YES;
+      break;
+    }
+    if (item->depth >= maxDepth_)
+      continue;
+
+    // Build the child path; d_type saves a stat() on most filesystems.
+    size_t length = pathLength + 1 + strlen(name) + 1;
+    char *child = malloc(length);
+    snprintf(child, length, "%s/%s", item->path, name);
+    int type = entry->d_type;
+    if (type == DT_UNKNOWN) {
+      struct stat sb;
+      if ((lstat(child, &sb) == 0) && S_ISDIR(sb.st_mode))
+        type = DT_DIR;
+    }
+    if ((type == DT_DIR) && ![self isIgnored:name]) {
+      MBCrawlItem *childItem = MBCrawlItemCreate(child, item->depth + 1);
+      if (lastChild)
+        lastChild->next = childItem;
+      else
+        children = childItem;
+      lastChild = childItem;
+    }
+    free(child);
+  }
+  closedir(dir);
+
+  if (isApp) {
+    MBCrawlItemFree(children);
+    NSString *path = [[NSFileManager defaultManager]
+                       stringWithFileSystemRepresentation:item->path
+                                                   length:pathLength];
+    pthread_mutex_lock(&lock_);
+    [results_ addObject:path];
+    pthread_mutex_unlock(&lock_);
+  } else if (children) {
+    pthread_mutex_lock(&lock_);
+    lastChild->next = queue_;
+    queue_ = children;
+    pthread_mutex_unlock(&lock_);
+  }
+}
+
+@end
@@ -0,0 +1,129 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import <SenTestingKit/SenTestingKit.h>
+#import <Cocoa/Cocoa.h>
+#import "MBProject.h"
+#import "MBProjectCrawler.h"
+#import "MBProjectCrawlerTest.h"
+
+@implementation MBProjectCrawlerTest
+
+// Make |relative| (a dir) under root_, optionally with an app.yaml.
+- (void)makeDirectory:(NSString *)relative app:(BOOL)app {
+  NSFileManager *fm = [NSFileManager defaultManager];
+  NSString *path = root_;
+  NSEnumerator *cenum = [[relative pathComponents] objectEnumerator];
+  NSString *component = nil;
+  while ((component = [cenum nextObject])) {
+    path = [path stringByAppendingPathComponent:component];
+    [fm createDirectoryAtPath:path attributes:nil];
+  }
+  if (app) {
+    NSData *data = [@"application: x\n" dataUsingEncoding:NSUTF8StringEncoding];
+    [data writeToFile:[path stringByAppendingPathComponent:@"app.yaml"]
+           atomically:NO];
+  }
+}
+
+- (void)setUp {
+  root_ = [[NSString stringWithFormat:@"/tmp/crawltest-%d",
+                     [[NSProcessInfo processInfo] processIdentifier]] retain];
+  [[NSFileManager defaultManager] createDirectoryAtPath:root_ attributes:nil];
+  [self makeDirectory:@"a" app:YES];
+  [self makeDirectory:@"a/nested" app:YES];  // inside an app; not found
+  [self makeDirectory:@"services/b" app:YES];
+  [self makeDirectory:@"services/c/d/e" app:YES];
+  [self makeDirectory:@"services/empty" app:NO];
+  [self makeDirectory:@".git/f" app:YES];
+  [self makeDirectory:@"node_modules/g" app:YES];
+}
+
+- (void)tearDown {
+  [[NSFileManager defaultManager] removeFileAtPath:root_ handler:nil];
+  [root_ release];
+  root_ = nil;
+}
+
+- (void)testCrawl {
+  MBProjectCrawler *crawler = [[[MBProjectCrawler alloc]
+                                 initWithRoots:[NSArray arrayWithObject:root_]]
+                                autorelease];
+  NSArray *found = [crawler crawl];
+  NSArray *expected = [NSArray arrayWithObjects:
+                         [root_ stringByAppendingPathComponent:@"a"],
+                         [root_ stringByAppendingPathComponent:@"services/b"],
+                         [root_ stringByAppendingPathComponent:@"services/c/d/e"],
+                         nil];
+  STAssertEqualObjects(found, expected, nil);
+
+  // Same answer with one thread.
+  crawler = [[[MBProjectCrawler alloc]
+               initWithRoots:[NSArray arrayWithObject:root_]] autorelease];
+  [crawler setThreadCount:1];
+  STAssertEqualObjects([crawler crawl], expected, nil);
+}
+
+- (void)testDepthAndPatterns {
+  MBProjectCrawler *crawler = [[[MBProjectCrawler alloc]
+                                 initWithRoots:[NSArray arrayWithObject:root_]]
+                                autorelease];
+  [crawler setMaxDepth:2];
+  [crawler setIgnorePatterns:[NSArray arrayWithObject:@"serv*"]];
+  NSArray *found = [crawler crawl];
+  // .git and node_modules are no longer ignored; services is.
+  STAssertTrue([found count] == 3, nil);
+  STAssertTrue([found containsObject:[root_ stringByAppendingPathComponent:@".git/f"]],
+               nil);
+  STAssertFalse([found containsObject:[root_ stringByAppendingPathComponent:@"services/b"]],
+                nil);
+}
+
+- (void)testEmpty {
+  MBProjectCrawler *crawler = [[[MBProjectCrawler alloc] initWithRoots:nil]
+                                autorelease];
+  STAssertTrue([[crawler crawl] count] == 0, nil);
+  crawler = [[[MBProjectCrawler alloc]
+               initWithRoots:[NSArray arrayWithObject:@"/no/such/directory"]]
+              autorelease];
+  STAssertTrue([[crawler crawl] count] == 0, nil);
+}
+
+// Whatever the crawler finds imports as a valid project.
+- (void)testFoundProjectsVerify {
+  [self makeDirectory:@"yml" app:NO];
+  NSData *data = [@"application: y\n" dataUsingEncoding:NSUTF8StringEncoding];
+  NSString *yml = [root_ stringByAppendingPathComponent:@"yml"];
+  [data writeToFile:[yml stringByAppendingPathComponent:@"app.yml"]
+         atomically:NO];
+
+  MBProjectCrawler *crawler = [[[MBProjectCrawler alloc]
+                                 initWithRoots:[NSArray arrayWithObject:root_]]
+                                autorelease];
+  NSArray *found = [crawler crawl];
+  STAssertTrue([found count] == 3, nil);
+  STAssertFalse([found containsObject:yml], nil);
+  NSEnumerator *penum = [found objectEnumerator];
+  NSString *path = nil;
+  while ((path = [penum nextObject])) {
+    MBProject *project = [MBProject projectWithName:[path lastPathComponent]
+                                               path:path
+                                               port:@"8080"];
+    STAssertTrue([project verify], path);
+    STAssertEqualObjects([project name], @"x", nil);
+  }
+}
+
+@end
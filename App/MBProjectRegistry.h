@@ -0,0 +1,67 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import <Foundation/Foundation.h>
+@class MBProject;
+
+// An MBProjectRegistry indexes a set of MBProjects by path, unique
+// identifier and port, so lookups (e.g. "is there already a project
+// at this path?" or "what port is free?") don't need to walk every
+// project.  The registry watches each project's path and port (with
+// KVO) so the indexes stay correct when they are edited in place
+// (e.g. from the Get Info dialog).
+//
+// MBProjectArrayController answers its duplicate checks (adding and
+// importing), -unusedProjectPort, -projectForPath: and
+// -projectForIdentifier: from here.  Operations on the whole list
+// (verifying, saving, reordering) still walk its content, as they
+// must.
+//
+// The registry is unordered; MBProjectArrayController owns the order
+// (and keeps the registry in sync with its content).
+@interface MBProjectRegistry : NSObject {
+ @private
+  NSMutableDictionary *byIdentifier_;  // NSNumber --> MBProject
+  NSMutableDictionary *byPath_;        // NSString --> NSMutableArray of MBProject
+  NSMutableDictionary *byPort_;        // NSNumber --> NSMutableArray of MBProject
+  int maxPort_;
+}
+
+// Add or remove a project.  Both are no-ops if the project is
+// already (or not) in the registry.
+- (void)addProject:(MBProject *)project;
+- (void)removeProject:(MBProject *)project;
+
+// Convenience for many projects.
+- (void)addProjects:(NSArray *)projects;
+- (void)removeProjects:(NSArray *)projects;
+- (void)removeAllProjects;
+
+// Number of projects registered.
+- (unsigned int)count;
+
+// Lookups.  Return nil (or an empty array) if nothing matches.  If
+// more than one project has the same path, the first one added wins.
+- (MBProject *)projectForIdentifier:(NSNumber *)identifier;
+- (MBProject *)projectForPath:(NSString *)path;
+- (NSArray *)projectsForPort:(int)port;
+
+// Return YES if |project| is in the registry.
+- (BOOL)containsProject:(MBProject *)project;
+
+// The largest port used by any project, or 0 if there are none.
+- (int)maxPort;
+
+@end
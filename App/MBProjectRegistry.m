@@ -0,0 +1,209 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import "MBProjectRegistry.h"
+#import "MBProject.h"
+
+// KVO context so we only respond to our own observations.
+static NSString *const kMBProjectRegistryContext = @"MBProjectRegistryContext";
+
+@interface MBProjectRegistry (Private)
+- (void)indexProject:(MBProject *)project
+              inDict:(NSMutableDictionary *)dict
+              forKey:(id)key;
+- (void)unindexProject:(MBProject *)project
+                inDict:(NSMutableDictionary *)dict
+                forKey:(id)key;
+- (void)addPort:(NSString *)port forProject:(MBProject *)project;
+- (void)removePort:(NSString *)port forProject:(MBProject *)project;
+@end
+
+@implementation MBProjectRegistry
+
+- (id)init {
+  if ((self = [super init])) {
+    byIdentifier_ = [[NSMutableDictionary alloc] init];
+    byPath_ = [[NSMutableDictionary alloc] init];
+    byPort_ = [[NSMutableDictionary alloc] init];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [self removeAllProjects];  // unregisters KVO
+  [byIdentifier_ release];
+  [byPath_ release];
+  [byPort_ release];
+  [super dealloc];
+}
+
+- (void)addProject:(MBProject *)project {
+  if ((project == nil) || [self containsProject:project])
+    return;
+  [byIdentifier_ setObject:project forKey:[project identifier]];
+  [self indexProject:project inDict:byPath_ forKey:[project path]];
+  [self addPort:[project port] forProject:project];
+  [project addObserver:self
+            forKeyPath:@"path"
+               options:NSKeyValueObservingOptionOld
+               context:kMBProjectRegistryContext];
+  [project addObserver:self
+            forKeyPath:@"port"
+               options:NSKeyValueObservingOptionOld
+               context:kMBProjectRegistryContext];
+}
+
+- (void)removeProject:(MBProject *)project {
+  if ((project == nil) || ([self containsProject:project] == NO))
+    return;
+  [project removeObserver:self forKeyPath:@"path"];
+  [project removeObserver:self forKeyPath:@"port"];
+  [self unindexProject:project inDict:byPath_ forKey:[project path]];
+  [self removePort:[project port] forProject:project];
+  [byIdentifier_ removeObjectForKey:[project identifier]];
+}
+
+- (void)addProjects:(NSArray *)projects {
+  NSEnumerator *penum = [projects objectEnumerator];
+  MBProject *project = nil;
+  while ((project = [penum nextObject])) {
+    [self addProject:project];
+  }
+}
+
+- (void)removeProjects:(NSArray *)projects {
+  NSEnumerator *penum = [projects objectEnumerator];
+  MBProject *project = nil;
+  while ((project = [penum nextObject])) {
+    [self removeProject:project];
+  }
+}
+
+- (void)removeAllProjects {
+  [self removeProjects:[byIdentifier_ allValues]];
+  maxPort_ = 0;
+}
+
+- (unsigned int)count {
+  return [byIdentifier_ count];
+}
+
+- (MBProject *)projectForIdentifier:(NSNumber *)identifier {
+  if (identifier == nil)
+    return nil;
+  return [byIdentifier_ objectForKey:identifier];
+}
+
+- (MBProject *)projectForPath:(NSString *)path {
+  if (path == nil)
+    return nil;
+  NSArray *projects = [byPath_ objectForKey:path];
+  return ([projects count] > 0) ? [projects objectAtIndex:0] : nil;
+}
+
+- (NSArray *)projectsForPort:(int)port {
+  NSArray *projects = [byPort_ objectForKey:[NSNumber numberWithInt:port]];
+  return projects ? [NSArray arrayWithArray:projects] : [NSArray array];
+}
+
+- (BOOL)containsProject:(MBProject *)project {
+  return [byIdentifier_ objectForKey:[project identifier]] == project;
+}
+
+- (int)maxPort {
+  return maxPort_;
+}
+
+// Keep the path and port indexes current when a project is edited.
+- (void)observeValueForKeyPath:(NSString *)keyPath
+                      ofObject:(id)object
+                        change:(NSDictionary *)change
+                       context:(void *)context {
+  if (context != kMBProjectRegistryContext) {
+    [super observeValueForKeyPath:keyPath
+                         ofObject:object
+                           change:change
+                          context:context];
+    return;
+  }
+  id old = [change objectForKey:NSKeyValueChangeOldKey];
+  if (old == [NSNull null])
+    old = nil;
+  if ([keyPath isEqual:@"path"]) {
+    [self unindexProject:object inDict:byPath_ forKey:old];
+    [self indexProject:object inDict:byPath_ forKey:[object path]];
+  } else if ([keyPath isEqual:@"port"]) {
+    [self removePort:old forProject:object];
+    [self addPort:[object port] forProject:object];
+  }
+}
+
+@end  // MBProjectRegistry
+
+
+@implementation MBProjectRegistry (Private)
+
+- (void)indexProject:(MBProject *)project
+              inDict:(NSMutableDictionary *)dict
+              forKey:(id)key {
+  if (key == nil)
+    return;
+  NSMutableArray *projects = [dict objectForKey:key];
+  if (projects == nil) {
+    projects = [NSMutableArray arrayWithCapacity:1];
+    [dict setObject:projects forKey:key];
+  }
+  [projects addObject:project];
+}
+
+- (void)unindexProject:(MBProject *)project
+                inDict:(NSMutableDictionary *)dict
+                forKey:(id)key {
+  if (key == nil)
+    return;
+  NSMutableArray *projects = [dict objectForKey:key];
+  [projects removeObjectIdenticalTo:project];
+  if (projects && ([projects count] == 0))
+    [dict removeObjectForKey:key];
+}
+
+- (void)addPort:(NSString *)port forProject:(MBProject *)project {
+  int value = [port intValue];
+  [self indexProject:project
+              inDict:byPort_
+              forKey:[NSNumber numberWithInt:value]];
+  if (value > maxPort_)
+    maxPort_ = value;
+}
+
+- (void)removePort:(NSString *)port forProject:(MBProject *)project {
+  int value = [port intValue];
+  NSNumber *key = [NSNumber numberWithInt:value];
+  [self unindexProject:project inDict:byPort_ forKey:key];
+
+  // Only rescan (the distinct ports, not the projects) if the
+  // largest port just went away.
+  if ((value == maxPort_) && ([byPort_ objectForKey:key] == nil)) {
+    maxPort_ = 0;
+    NSEnumerator *kenum = [byPort_ keyEnumerator];
+    NSNumber *p = nil;
+    while ((p = [kenum nextObject])) {
+      if ([p intValue] > maxPort_)
+        maxPort_ = [p intValue];
+    }
+  }
+}
+
+@end  // MBProjectRegistry (Private)
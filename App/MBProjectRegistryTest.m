@@ -0,0 +1,95 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import <SenTestingKit/SenTestingKit.h>
+#import <Cocoa/Cocoa.h>
+#import "MBProject.h"
+#import "MBProjectRegistry.h"
+#import "MBProjectRegistryTest.h"
+
+@implementation MBProjectRegistryTest
+
+- (void)testAddRemove {
+  MBProjectRegistry *r = [[[MBProjectRegistry alloc] init] autorelease];
+  STAssertTrue([r count] == 0, nil);
+  STAssertNil([r projectForPath:@"path0"], nil);
+  STAssertNil([r projectForPath:nil], nil);
+  STAssertNil([r projectForIdentifier:nil], nil);
+
+  MBProject *p0 = [MBProject projectWithName:@"name0" path:@"path0" port:@"8080"];
+  MBProject *p1 = [MBProject projectWithName:@"name1" path:@"path1" port:@"8081"];
+  [r addProject:p0];
+  [r addProject:p1];
+  [r addProject:p1];  // no-op
+  [r addProject:nil];  // no-op
+  STAssertTrue([r count] == 2, nil);
+  STAssertTrue([r projectForPath:@"path0"] == p0, nil);
+  STAssertTrue([r projectForPath:@"path1"] == p1, nil);
+  STAssertTrue([r projectForIdentifier:[p1 identifier]] == p1, nil);
+  STAssertTrue([r containsProject:p0], nil);
+
+  // A second project with the same path; the first one wins until removed.
+  MBProject *dup = [MBProject projectWithName:@"dup" path:@"path0" port:@"8082"];
+  [r addProject:dup];
+  STAssertTrue([r projectForPath:@"path0"] == p0, nil);
+  [r removeProject:p0];
+  STAssertTrue([r projectForPath:@"path0"] == dup, nil);
+  STAssertFalse([r containsProject:p0], nil);
+  [r removeProject:p0];  // no-op
+  STAssertTrue([r count] == 2, nil);
+
+  [r removeAllProjects];
+  STAssertTrue([r count] == 0, nil);
+  STAssertNil([r projectForPath:@"path0"], nil);
+  STAssertTrue([r maxPort] == 0, nil);
+}
+
+- (void)testPorts {
+  MBProjectRegistry *r = [[[MBProjectRegistry alloc] init] autorelease];
+  MBProject *p0 = [MBProject projectWithName:@"name0" path:@"path0" port:@"8080"];
+  MBProject *p1 = [MBProject projectWithName:@"name1" path:@"path1" port:@"8085"];
+  MBProject *p2 = [MBProject projectWithName:@"name2" path:@"path2" port:@"8085"];
+  [r addProjects:[NSArray arrayWithObjects:p0, p1, p2, nil]];
+  STAssertTrue([r maxPort] == 8085, nil);
+  STAssertTrue([[r projectsForPort:8085] count] == 2, nil);
+  STAssertTrue([[r projectsForPort:9999] count] == 0, nil);
+
+  [r removeProject:p1];
+  STAssertTrue([r maxPort] == 8085, nil);
+  [r removeProject:p2];
+  STAssertTrue([r maxPort] == 8080, nil);
+}
+
+- (void)testEdits {
+  MBProjectRegistry *r = [[[MBProjectRegistry alloc] init] autorelease];
+  MBProject *p = [MBProject projectWithName:@"name0" path:@"path0" port:@"8080"];
+  [r addProject:p];
+
+  [p setPath:@"newpath"];
+  STAssertNil([r projectForPath:@"path0"], nil);
+  STAssertTrue([r projectForPath:@"newpath"] == p, nil);
+
+  [p setPort:@"9000"];
+  STAssertTrue([r maxPort] == 9000, nil);
+  STAssertTrue([[r projectsForPort:8080] count] == 0, nil);
+  STAssertTrue([[r projectsForPort:9000] count] == 1, nil);
+
+  // Once removed, edits no longer affect the registry.
+  [r removeProject:p];
+  [p setPath:@"path0"];
+  STAssertNil([r projectForPath:@"path0"], nil);
+}
+
+@end  // MBProjectRegistryTest
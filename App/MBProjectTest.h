@@ -24,5 +24,6 @@ limitations under the License.
 - (void)testCommandLineFlags;
 - (void)testCoder;
 - (void)testVerify;
+- (void)testAppConfig;
 
 @end
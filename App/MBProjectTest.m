@@ -17,6 +17,7 @@ limitations under the License.
 #import <Cocoa/Cocoa.h>
 #import <unistd.h>
 #import "MBProject.h"
+#import "MBAppConfig.h"
 #import "MBProjectTest.h"
 
 @implementation MBProjectTest
@@ -128,6 +129,13 @@ limitations under the License.
   STAssertTrue([[dest commandLineFlags] isEqual:[p commandLineFlags]], nil);
   STAssertFalse([[dest identifier] isEqual:[p identifier]], nil);
   STAssertTrue([dest runState] == kMBProjectStop, nil);
+  STAssertNil([dest runtime], nil);
+
+  // A pinned runtime survives the trip.
+  [p setRuntime:@"GoogleAppEngine-1.2.3"];
+  data = [NSKeyedArchiver archivedDataWithRootObject:p];
+  dest = [NSKeyedUnarchiver unarchiveObjectWithData:data];
+  STAssertEqualObjects([dest runtime], @"GoogleAppEngine-1.2.3", nil);
 }
 
 - (void)testVerify {
@@ -165,6 +173,68 @@ limitations under the License.
   STAssertTrue([valid boolValue] == NO, nil);
 }
 
+- (void)testAppConfig {
+  NSString *unique = [NSString stringWithFormat:@"project-config-test-%d-%f",
+                               (int)getpid(),
+                               (float)[NSDate timeIntervalSinceReferenceDate]];
+  NSString *dir = [@"/tmp" stringByAppendingPathComponent:unique];
+  [[NSFileManager defaultManager] createDirectoryAtPath:dir attributes:nil];
+  NSString *appYaml = [dir stringByAppendingPathComponent:@"app.yaml"];
+
+  MBProject *p = [MBProject projectWithName:unique path:dir port:@"8000"];
+  STAssertNil([p appConfig], nil);
+
+  NSString *yaml = @"application: foo\n"
+                    "version: 2\n"
+                    "runtime: python\n"
+                    "handlers:\n"
+                    "- url: /css\n"
+                    "  static_dir: css\n"
+                    "- url: /.*\n"
+                    "  script: main.py\n";
+  [[NSFileManager defaultManager] createFileAtPath:appYaml
+                                          contents:[yaml dataUsingEncoding:NSUTF8StringEncoding]
+                                        attributes:nil];
+  STAssertTrue([p verify], nil);
+  MBAppConfig *config = [p appConfig];
+  STAssertNotNil(config, nil);
+  STAssertEqualObjects([config application], @"foo", nil);
+  STAssertEqualObjects([config version], @"2", nil);
+  STAssertEqualObjects([config runtime], @"python", nil);
+  STAssertTrue([[config handlers] count] == 2, nil);
+  STAssertEqualObjects([config staticDirs], [NSArray arrayWithObject:@"css"], nil);
+
+  // Unchanged file; the cached config is reused.
+  STAssertTrue([p verify], nil);
+  STAssertTrue([p appConfig] == config, nil);
+  // It still resets the name.
+  [p setName:@"edited"];
+  STAssertTrue([p verify], nil);
+  STAssertTrue([p appConfig] == config, nil);
+  STAssertEqualObjects([p name], @"foo", nil);
+
+  // Changed file; reparsed.
+  yaml = @"application: barbaz\nversion: 3\n";
+  [[NSFileManager defaultManager] removeFileAtPath:appYaml handler:nil];
+  [[NSFileManager defaultManager] createFileAtPath:appYaml
+                                          contents:[yaml dataUsingEncoding:NSUTF8StringEncoding]
+                                        attributes:nil];
+  STAssertTrue([p verify], nil);
+  STAssertEqualObjects([[p appConfig] version], @"3", nil);
+  STAssertEqualObjects([p name], @"barbaz", nil);
+
+  // No application: present but invalid.
+  [[NSFileManager defaultManager] removeFileAtPath:appYaml handler:nil];
+  [[NSFileManager defaultManager] createFileAtPath:appYaml
+                                          contents:[@"version: 1\n" dataUsingEncoding:NSUTF8StringEncoding]
+                                        attributes:nil];
+  STAssertFalse([p verify], nil);
+  STAssertNotNil([p appConfig], nil);
+
+  [[NSFileManager defaultManager] removeFileAtPath:dir handler:nil];
+  STAssertFalse([p verify], nil);
+  STAssertNil([p appConfig], nil);
+}
 
 
 @end  // MBProjectTest
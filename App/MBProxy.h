@@ -0,0 +1,116 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import <Foundation/Foundation.h>
+#import <pthread.h>
+
+@class MBMetrics;
+@class MBProject;
+
+// MBProxy is an HTTP reverse proxy in front of every running project, so
+// one port reaches them all:
+//
+//   defaults write com.google.GoogleAppEngineLauncher MBProxyPort 8000
+//
+//   http://guestbook.localhost:8000/sign   by Host (first label)
+//   http://localhost:8000/guestbook/sign   by path prefix, sent on as /sign
+//
+// Projects are named by their lowercased name, with anything but letters,
+// digits and '-' made a '-'. Only projects which are starting or running
+// are routed. A path-routed request gets an X-Forwarded-Prefix header;
+// absolute redirects from the app won't know about the prefix, so Host
+// routing (*.localhost resolves to 127.0.0.1 in most browsers) is the
+// more faithful of the two.
+//
+// Each client connection gets a thread, which reads a request, forwards
+// it, and streams the response back, for as many requests as the client
+// keeps the connection open. Connections to dev_appserver are kept in a
+// pool per port and reused when the response allows it (HTTP/1.1, or
+// keep-alive with a length), so a burst of requests doesn't pay for a
+// connection each. Bodies are streamed either way, plain, by length or
+// chunked; upgrades (e.g. WebSockets) aren't supported.
+//
+// Each request's time is split into the time spent connecting to and
+// waiting on dev_appserver, and the rest (reading the request, writing
+// the response), and published through MBMetrics as
+// launcher_proxy_request_seconds{project,part="backend"|"proxy"}.
+//
+// The proxy listens on 127.0.0.1 only.
+@interface MBProxy : NSObject {
+ @private
+  MBMetrics *metrics_;
+  pthread_mutex_t lock_;
+  NSDictionary *routes_;          // route name -> NSNumber port; |lock_|
+  NSMutableDictionary *owners_;   // NSNumber project identifier -> the
+                                  // route name it holds; |lock_|
+  NSMutableDictionary *idle_;     // NSNumber port -> NSMutableArray of
+                                  // NSNumber fds; |lock_|
+  int listener_;
+  int port_;
+  int wake_[2];                   // pipe to stop the accept thread
+  pthread_t acceptThread_;
+  BOOL running_;
+}
+
+// The launcher's proxy. Only listens once started.
++ (MBProxy *)sharedProxy;
+
+// Starts the shared proxy on the MBProxyPort default's port, if it's set.
++ (void)startFromDefaults;
+
+// The name a project is routed by, e.g. "My App" -> "my-app".
++ (NSString *)routeNameForProjectName:(NSString *)name;
+
+// Designated initializer.
+- (id)initWithMetrics:(MBMetrics *)metrics;
+
+// Listens on 127.0.0.1:|port|; 0 picks a free port (see -port).
+- (BOOL)listenOnPort:(int)port;
+
+// The port listened on, or 0.
+- (int)port;
+
+// YES between a successful -listenOnPort: and -stop.
+- (BOOL)isRunning;
+
+// Stops accepting connections and closes the idle pool. Requests in
+// flight finish.
+- (void)stop;
+
+// Routes to every starting or running project in |projects| (MBProjects).
+- (void)setRoutesForProjects:(NSArray *)projects;
+
+// Brings |project|'s route up to date after its run state, name or port
+// changed: drops the route it held, if any, and adds one under its
+// current name and port if it's starting or running (unless another
+// project holds that name). Touches no other route.
+- (void)updateRouteForProject:(MBProject *)project;
+
+// Route name -> NSNumber port.
+- (void)setRoutes:(NSDictionary *)routes;
+- (NSDictionary *)routes;
+
+// Which route a request is for, by |host| then by the first component of
+// |target|. Returns the port, or 0 if none; |name| and |backendTarget|
+// (the request target to send on) are set if it's found.
+- (int)portForHost:(NSString *)host
+            target:(NSString *)target
+         routeName:(NSString **)name
+     backendTarget:(NSString **)backendTarget;
+
+// Connections to dev_appservers waiting to be reused.
+- (unsigned)idleConnectionCount;
+
+@end
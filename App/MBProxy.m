@@ -0,0 +1,991 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import "MBProxy.h"
+#import "MBMetrics.h"
+#import "MBProject.h"
+#import <errno.h>
+#import <mach/mach_time.h>
+#import <netinet/in.h>
+#import <netinet/tcp.h>
+#import <poll.h>
+#import <stdlib.h>
+#import <string.h>
+#import <sys/socket.h>
+#import <sys/time.h>
+#import <unistd.h>
+
+static NSString *const kMBProxyPortKey = @"MBProxyPort";
+
+#define kMBProxyBufferSize (16 * 1024)
+
+// Longest head (request or status line and headers) accepted.
+#define kMBProxyMaxHead (64 * 1024)
+
+// Idle connections kept for each dev_appserver.
+#define kMBProxyMaxIdle 8
+
+// Seconds a client can keep a connection open without sending anything.
+static const int kMBProxyClientTimeout = 60;
+
+// Seconds to wait on dev_appserver; a first request can import a lot.
+static const int kMBProxyBackendTimeout = 300;
+
+// Buffered reads from a socket.
+typedef struct {
+  int fd;
+  size_t start;
+  size_t end;
+  double *waited;  // if set, seconds spent blocked in read() are added
+  BOOL closed;     // the last read found the connection closed by the peer
+  char buffer[kMBProxyBufferSize];
+} MBProxyReader;
+
+// What follows a message's head.
+typedef enum {
+  kMBProxyBodyNone = 0,
+  kMBProxyBodyLength,
+  kMBProxyBodyChunked,
+  kMBProxyBodyUntilClose
+} MBProxyBodyType;
+
+typedef struct {
+  MBProxy *proxy;  // retained
+  int fd;
+} MBProxyClient;
+
+@interface MBProxy (PrivateMethods)
+- (void)acceptLoop;
+- (void)serveClient:(int)fd;
+- (BOOL)proxyRequestFrom:(MBProxyReader *)client;
+- (int)backendForPort:(int)port pooled:(BOOL)pooled reused:(BOOL *)reused;
+- (void)reuseBackend:(int)fd port:(int)port;
+- (NSString *)routeList;
+- (void)countRequest:(NSString *)name status:(int)status;
+@end
+
+static double MBProxySeconds(uint64_t ticks) {
+  static mach_timebase_info_data_t timebase;
+  if (timebase.denom == 0)
+    mach_timebase_info(&timebase);
+  return (double)ticks * timebase.numer / timebase.denom / 1e9;
+}
+
+// No SIGPIPE, no Nagle delay (requests and responses are small), and
+// reads which give up after |timeout| seconds.
+static void MBProxyConfigureSocket(int fd, int timeout) {
+  int yes = 1;
+  setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &yes, sizeof(yes));
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+  struct timeval limit = { timeout, 0 };
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &limit, sizeof(limit));
+}
+
+// Only projects which are starting or running are routed.
+static BOOL MBProxyIsRouted(MBProject *project) {
+  MBRunState state = [project runState];
+  return (state == kMBProjectStarting || state == kMBProjectRun ||
+          state == kMBProjectProductionRun);
+}
+
+// Refills an empty |reader|. Returns NO on EOF, error or timeout.
+static BOOL MBProxyFill(MBProxyReader *reader) {
+  uint64_t start = mach_absolute_time();
+  ssize_t count;
+  do {
+    count = read(reader->fd, reader->buffer, sizeof(reader->buffer));
+  } while (count < 0 && errno == EINTR);
+  if (reader->waited)
+    *reader->waited += MBProxySeconds(mach_absolute_time() - start);
+  if (count <= 0) {
+    // Not a timeout: the other end went away.
+    reader->closed = (count == 0 || errno == ECONNRESET);
+    return NO;
+  }
+  reader->start = 0;
+  reader->end = count;
+  return YES;
+}
+
+static BOOL MBProxyWrite(int fd, const void *bytes, size_t length) {
+  const char *next = bytes;
+  while (length > 0) {
+    ssize_t count = write(fd, next, length);
+    if (count < 0) {
+      if (errno == EINTR)
+        continue;
+      return NO;
+    }
+    next += count;
+    length -= count;
+  }
+  return YES;
+}
+
+// Reads a head, up to and including the blank line after it, onto
+// |head|. Returns NO if the connection ends first or the head is too long.
+static BOOL MBProxyReadHead(MBProxyReader *reader, NSMutableData *head) {
+  BOOL lineStart = NO;  // just after a "\n", ignoring "\r"s
+  while (YES) {
+    if (reader->start == reader->end && !MBProxyFill(reader))
+      return NO;
+    size_t i = reader->start;
+    BOOL done = NO;
+    for (; i < reader->end && !done; i++) {
+      char c = reader->buffer[i];
+      if (c == '\n') {
+        done = lineStart;
+        lineStart = YES;
+      } else if (c != '\r') {
+        lineStart = NO;
+      }
+    }
+    [head appendBytes:reader->buffer + reader->start length:i - reader->start];
+    reader->start = i;
+    if (done)
+      return YES;
+    if ([head length] > kMBProxyMaxHead)
+      return NO;
+  }
+}
+
+// Reads a line, with its "\n", onto |line|.
+static BOOL MBProxyReadLine(MBProxyReader *reader, NSMutableData *line) {
+  while (YES) {
+    if (reader->start == reader->end && !MBProxyFill(reader))
+      return NO;
+    char *from = reader->buffer + reader->start;
+    char *newline = memchr(from, '\n', reader->end - reader->start);
+    size_t length = newline ? (newline - from) + 1 : reader->end - reader->start;
+    [line appendBytes:from length:length];
+    reader->start += length;
+    if (newline)
+      return YES;
+    if ([line length] > kMBProxyMaxHead)
+      return NO;
+  }
+}
+
+static BOOL MBProxyCopyLength(MBProxyReader *reader, int fd,
+                              unsigned long long length) {
+  while (length > 0) {
+    if (reader->start == reader->end && !MBProxyFill(reader))
+      return NO;
+    size_t count = reader->end - reader->start;
+    if (count > length)
+      count = (size_t)length;
+    if (!MBProxyWrite(fd, reader->buffer + reader->start, count))
+      return NO;
+    reader->start += count;
+    length -= count;
+  }
+  return YES;
+}
+
+// Copies a chunked body as it is, chunk sizes, trailers and all.
+static BOOL MBProxyCopyChunked(MBProxyReader *reader, int fd) {
+  while (YES) {
+    NSMutableData *line = [NSMutableData data];
+    if (!MBProxyReadLine(reader, line) ||
+        !MBProxyWrite(fd, [line bytes], [line length]))
+      return NO;
+    char size[32];
+    size_t length = [line length] < sizeof(size) ? [line length]
+                                                 : sizeof(size) - 1;
+    memcpy(size, [line bytes], length);
+    size[length] = '\0';
+    char *end = NULL;
+    unsigned long long count = strtoull(size, &end, 16);
+    if (end == size)
+      return NO;
+    if (count == 0)
+      break;
+    // The data and the "\r\n" after it.
+    if (!MBProxyCopyLength(reader, fd, count + 2))
+      return NO;
+  }
+  while (YES) {
+    NSMutableData *line = [NSMutableData data];
+    if (!MBProxyReadLine(reader, line) ||
+        !MBProxyWrite(fd, [line bytes], [line length]))
+      return NO;
+    const char *bytes = [line bytes];
+    if ([line length] == 1 || ([line length] == 2 && bytes[0] == '\r'))
+      return YES;
+  }
+}
+
+static BOOL MBProxyCopyBody(MBProxyReader *reader, int fd,
+                            MBProxyBodyType type, unsigned long long length) {
+  switch (type) {
+    case kMBProxyBodyNone:
+      return YES;
+    case kMBProxyBodyLength:
+      return MBProxyCopyLength(reader, fd, length);
+    case kMBProxyBodyChunked:
+      return MBProxyCopyChunked(reader, fd);
+    case kMBProxyBodyUntilClose:
+      while (reader->start < reader->end || MBProxyFill(reader)) {
+        if (!MBProxyWrite(fd, reader->buffer + reader->start,
+                          reader->end - reader->start))
+          return NO;
+        reader->start = reader->end;
+      }
+      return YES;
+  }
+  return NO;
+}
+
+// The lines of a head, without their line ends or the blank line.
+static NSArray *MBProxyHeadLines(NSData *head) {
+  NSString *text = [[[NSString alloc] initWithData:head
+                                          encoding:NSISOLatin1StringEncoding]
+                     autorelease];
+  NSMutableArray *lines = [NSMutableArray array];
+  NSEnumerator *lineEnumerator =
+    [[text componentsSeparatedByString:@"\n"] objectEnumerator];
+  NSString *line = nil;
+  while ((line = [lineEnumerator nextObject])) {
+    if ([line hasSuffix:@"\r"])
+      line = [line substringToIndex:[line length] - 1];
+    if ([line length])
+      [lines addObject:line];
+  }
+  return lines;
+}
+
+static NSString *MBProxyHeaderName(NSString *line) {
+  NSRange colon = [line rangeOfString:@":"];
+  if (colon.location == NSNotFound)
+    return nil;
+  return [[line substringToIndex:colon.location]
+           stringByTrimmingCharactersInSet:
+             [NSCharacterSet whitespaceCharacterSet]];
+}
+
+// The first |name| header's value, or nil.
+static NSString *MBProxyHeaderValue(NSArray *lines, NSString *name) {
+  for (unsigned i = 1; i < [lines count]; i++) {
+    NSString *line = [lines objectAtIndex:i];
+    NSString *lineName = MBProxyHeaderName(line);
+    if (lineName && [lineName caseInsensitiveCompare:name] == NSOrderedSame) {
+      NSRange colon = [line rangeOfString:@":"];
+      return [[line substringFromIndex:NSMaxRange(colon)]
+               stringByTrimmingCharactersInSet:
+                 [NSCharacterSet whitespaceCharacterSet]];
+    }
+  }
+  return nil;
+}
+
+// Whether any |name| header lists |token| (e.g. Connection: close).
+static BOOL MBProxyHeaderHasToken(NSArray *lines, NSString *name,
+                                  NSString *token) {
+  for (unsigned i = 1; i < [lines count]; i++) {
+    NSString *line = [lines objectAtIndex:i];
+    NSString *lineName = MBProxyHeaderName(line);
+    if (lineName == nil || [lineName caseInsensitiveCompare:name] != NSOrderedSame)
+      continue;
+    NSRange colon = [line rangeOfString:@":"];
+    NSArray *values = [[line substringFromIndex:NSMaxRange(colon)]
+                        componentsSeparatedByString:@","];
+    NSEnumerator *valueEnumerator = [values objectEnumerator];
+    NSString *value = nil;
+    while ((value = [valueEnumerator nextObject])) {
+      value = [value stringByTrimmingCharactersInSet:
+                       [NSCharacterSet whitespaceCharacterSet]];
+      if ([value caseInsensitiveCompare:token] == NSOrderedSame)
+        return YES;
+    }
+  }
+  return NO;
+}
+
+// Headers which describe one connection, not the message; the proxy sets
+// its own.
+static BOOL MBProxyIsHopByHop(NSString *name) {
+  static NSString *const kNames[] = {
+    @"Connection", @"Keep-Alive", @"Proxy-Connection", @"TE", @"Trailer",
+    @"Upgrade"
+  };
+  for (size_t i = 0; i < sizeof(kNames) / sizeof(kNames[0]); i++) {
+    if ([name caseInsensitiveCompare:kNames[i]] == NSOrderedSame)
+      return YES;
+  }
+  return NO;
+}
+
+// How the body after |lines| is delimited. Without a length, a request
+// has no body and a response runs until the connection closes.
+static MBProxyBodyType MBProxyBodyTypeOf(NSArray *lines,
+                                         unsigned long long *length,
+                                         BOOL isResponse) {
+  if (MBProxyHeaderHasToken(lines, @"Transfer-Encoding", @"chunked"))
+    return kMBProxyBodyChunked;
+  NSString *value = MBProxyHeaderValue(lines, @"Content-Length");
+  if (value) {
+    *length = strtoull([value UTF8String], NULL, 10);
+    return kMBProxyBodyLength;
+  }
+  return isResponse ? kMBProxyBodyUntilClose : kMBProxyBodyNone;
+}
+
+static BOOL MBProxyKeepsAlive(NSString *version, NSArray *lines) {
+  if (MBProxyHeaderHasToken(lines, @"Connection", @"close"))
+    return NO;
+  if ([version isEqualToString:@"HTTP/1.1"])
+    return YES;
+  return MBProxyHeaderHasToken(lines, @"Connection", @"keep-alive");
+}
+
+// The head of |lines| without hop-by-hop headers, and with |extra|.
+static NSData *MBProxyRewriteHead(NSString *firstLine, NSArray *lines,
+                                  NSString *extra) {
+  NSMutableString *head = [NSMutableString stringWithFormat:@"%@\r\n",
+                           firstLine];
+  for (unsigned i = 1; i < [lines count]; i++) {
+    NSString *line = [lines objectAtIndex:i];
+    NSString *name = MBProxyHeaderName(line);
+    if (name && !MBProxyIsHopByHop(name))
+      [head appendFormat:@"%@\r\n", line];
+  }
+  [head appendString:extra];
+  [head appendString:@"\r\n"];
+  return [head dataUsingEncoding:NSISOLatin1StringEncoding
+            allowLossyConversion:YES];
+}
+
+// A response of the proxy's own.
+static void MBProxyRespond(int fd, NSString *status, NSString *body,
+                           BOOL keepAlive) {
+  NSData *bodyData = [body dataUsingEncoding:NSUTF8StringEncoding];
+  NSString *head = [NSString stringWithFormat:
+                    @"HTTP/1.1 %@\r\n"
+                    @"Content-Type: text/plain; charset=utf-8\r\n"
+                    @"Content-Length: %u\r\n"
+                    @"Connection: %@\r\n"
+                    @"\r\n",
+                    status, (unsigned)[bodyData length],
+                    (keepAlive ? @"keep-alive" : @"close")];
+  NSMutableData *response =
+    [NSMutableData dataWithData:[head dataUsingEncoding:NSUTF8StringEncoding]];
+  [response appendData:bodyData];
+  MBProxyWrite(fd, [response bytes], [response length]);
+}
+
+static void *MBProxyAcceptThread(void *arg) {
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  [(MBProxy *)arg acceptLoop];
+  [pool release];
+  return NULL;
+}
+
+static void *MBProxyClientThread(void *arg) {
+  MBProxyClient *client = arg;
+  [client->proxy serveClient:client->fd];
+  [client->proxy release];
+  free(client);
+  return NULL;
+}
+
+static MBProxy *gSharedProxy = nil;
+
+@implementation MBProxy
+
++ (MBProxy *)sharedProxy {
+  @synchronized(self) {
+    if (gSharedProxy == nil)
+      gSharedProxy = [[self alloc] initWithMetrics:[MBMetrics sharedMetrics]];
+  }
+  return gSharedProxy;
+}
+
++ (void)startFromDefaults {
+  int port = [[NSUserDefaults standardUserDefaults] integerForKey:kMBProxyPortKey];
+  if (port <= 0)
+    return;
+  if ([[self sharedProxy] listenOnPort:port])
+    GMLoggerInfo(@"Proxying projects at http://localhost:%d/", port);
+  else
+    GMLoggerError(@"Can't proxy projects on port %d", port);
+}
+
++ (NSString *)routeNameForProjectName:(NSString *)name {
+  NSMutableString *route = [NSMutableString stringWithString:[name lowercaseString]];
+  NSCharacterSet *allowed = [NSCharacterSet characterSetWithCharactersInString:
+                             @"abcdefghijklmnopqrstuvwxyz0123456789-"];
+  for (unsigned i = 0; i < [route length]; i++) {
+    if (![allowed characterIsMember:[route characterAtIndex:i]])
+      [route replaceCharactersInRange:NSMakeRange(i, 1) withString:@"-"];
+  }
+  return route;
+}
+
+- (id)init {
+  return [self initWithMetrics:nil];
+}
+
+- (id)initWithMetrics:(MBMetrics *)metrics {
+  if ((self = [super init])) {
+    metrics_ = [metrics retain];
+    pthread_mutex_init(&lock_, NULL);
+    routes_ = [[NSDictionary alloc] init];
+    owners_ = [[NSMutableDictionary alloc] init];
+    idle_ = [[NSMutableDictionary alloc] init];
+    listener_ = -1;
+    wake_[0] = wake_[1] = -1;
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [self stop];
+  [metrics_ release];
+  [routes_ release];
+  [owners_ release];
+  [idle_ release];
+  pthread_mutex_destroy(&lock_);
+  [super dealloc];
+}
+
+- (BOOL)listenOnPort:(int)port {
+  if (running_)
+    return NO;
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0)
+    return NO;
+  int yes = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_len = sizeof(addr);
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t length = sizeof(addr);
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+      listen(fd, 64) != 0 ||
+      getsockname(fd, (struct sockaddr *)&addr, &length) != 0 ||
+      pipe(wake_) != 0) {
+    close(fd);
+    return NO;
+  }
+  listener_ = fd;
+  port_ = ntohs(addr.sin_port);
+  running_ = (pthread_create(&acceptThread_, NULL, MBProxyAcceptThread, self) == 0);
+  if (!running_)
+    [self stop];
+  return running_;
+}
+
+- (int)port {
+  return port_;
+}
+
+- (BOOL)isRunning {
+  return running_;
+}
+
+- (void)stop {
+  if (running_) {
+    write(wake_[1], "x", 1);
+    pthread_join(acceptThread_, NULL);
+    running_ = NO;
+  }
+  for (int i = 0; i < 2; i++) {
+    if (wake_[i] >= 0)
+      close(wake_[i]);
+    wake_[i] = -1;
+  }
+  if (listener_ >= 0)
+    close(listener_);
+  listener_ = -1;
+  port_ = 0;
+
+  pthread_mutex_lock(&lock_);
+  NSEnumerator *poolEnumerator = [idle_ objectEnumerator];
+  NSArray *pool = nil;
+  while ((pool = [poolEnumerator nextObject])) {
+    NSEnumerator *fdEnumerator = [pool objectEnumerator];
+    NSNumber *fd = nil;
+    while ((fd = [fdEnumerator nextObject]))
+      close([fd intValue]);
+  }
+  [idle_ removeAllObjects];
+  pthread_mutex_unlock(&lock_);
+}
+
+- (void)setRoutesForProjects:(NSArray *)projects {
+  NSMutableDictionary *routes = [NSMutableDictionary dictionary];
+  NSMutableDictionary *owners = [NSMutableDictionary dictionary];
+  NSEnumerator *projectEnumerator = [projects objectEnumerator];
+  MBProject *project = nil;
+  while ((project = [projectEnumerator nextObject])) {
+    if (!MBProxyIsRouted(project))
+      continue;
+    NSString *name = [[self class] routeNameForProjectName:[project name]];
+    int port = [[project port] intValue];
+    // The first of two projects with the same name wins.
+    if ([name length] && port > 0 && [routes objectForKey:name] == nil) {
+      [routes setObject:[NSNumber numberWithInt:port] forKey:name];
+      [owners setObject:name forKey:[project identifier]];
+    }
+  }
+  NSDictionary *copy = [routes copy];
+  pthread_mutex_lock(&lock_);
+  [routes_ release];
+  routes_ = copy;
+  [owners_ setDictionary:owners];
+  pthread_mutex_unlock(&lock_);
+}
+
+- (void)updateRouteForProject:(MBProject *)project {
+  NSNumber *identifier = [project identifier];
+  NSString *name = nil;
+  int port = [[project port] intValue];
+  if (MBProxyIsRouted(project) && port > 0)
+    name = [[self class] routeNameForProjectName:[project name]];
+  if ([name length] == 0)
+    name = nil;
+
+  pthread_mutex_lock(&lock_);
+  NSString *held = [owners_ objectForKey:identifier];
+  NSNumber *heldPort = held ? [routes_ objectForKey:held] : nil;
+  BOOL unchanged = (held == nil && name == nil) ||
+      ([held isEqual:name] && [heldPort intValue] == port);
+  if (!unchanged) {
+    // Copy on write: request threads may still hold the old table.
+    NSMutableDictionary *routes = [[routes_ mutableCopy] autorelease];
+    if (held) {
+      [routes removeObjectForKey:held];
+      [owners_ removeObjectForKey:identifier];
+    }
+    if (name && [routes objectForKey:name] == nil) {
+      [routes setObject:[NSNumber numberWithInt:port] forKey:name];
+      [owners_ setObject:name forKey:identifier];
+    }
+    [routes_ release];
+    routes_ = [routes copy];
+  }
+  pthread_mutex_unlock(&lock_);
+}
+
+- (void)setRoutes:(NSDictionary *)routes {
+  NSDictionary *copy = [routes copy];
+  pthread_mutex_lock(&lock_);
+  [routes_ release];
+  routes_ = copy;
+  // No projects hold these.
+  [owners_ removeAllObjects];
+  pthread_mutex_unlock(&lock_);
+}
+
+- (NSDictionary *)routes {
+  pthread_mutex_lock(&lock_);
+  NSDictionary *routes = [[routes_ retain] autorelease];
+  pthread_mutex_unlock(&lock_);
+  return routes;
+}
+
+- (int)portForHost:(NSString *)host
+            target:(NSString *)target
+         routeName:(NSString **)name
+     backendTarget:(NSString **)backendTarget {
+  NSDictionary *routes = [self routes];
+  NSString *found = nil;
+  NSString *rest = target;
+
+  // "guestbook.localhost:8000"
+  NSString *hostname = [[[host componentsSeparatedByString:@":"]
+                          objectAtIndex:0] lowercaseString];
+  NSRange dot = [hostname rangeOfString:@"."];
+  if (dot.location != NSNotFound) {
+    NSString *label = [hostname substringToIndex:dot.location];
+    if ([routes objectForKey:label])
+      found = label;
+  }
+
+  // "/guestbook/sign?x=1" -> "/sign?x=1"
+  if (found == nil && [target hasPrefix:@"/"] && [target length] > 1) {
+    NSCharacterSet *ends = [NSCharacterSet characterSetWithCharactersInString:@"/?"];
+    NSRange end = [target rangeOfCharacterFromSet:ends
+                                          options:0
+                                            range:NSMakeRange(1, [target length] - 1)];
+    unsigned stop = (end.location == NSNotFound) ? [target length] : end.location;
+    NSString *component =
+      [[target substringWithRange:NSMakeRange(1, stop - 1)] lowercaseString];
+    if ([routes objectForKey:component]) {
+      found = component;
+      rest = [target substringFromIndex:stop];
+      if (![rest hasPrefix:@"/"])
+        rest = [@"/" stringByAppendingString:rest];
+    }
+  }
+
+  if (found == nil)
+    return 0;
+  if (name)
+    *name = found;
+  if (backendTarget)
+    *backendTarget = rest;
+  return [[routes objectForKey:found] intValue];
+}
+
+- (unsigned)idleConnectionCount {
+  unsigned count = 0;
+  pthread_mutex_lock(&lock_);
+  NSEnumerator *poolEnumerator = [idle_ objectEnumerator];
+  NSArray *pool = nil;
+  while ((pool = [poolEnumerator nextObject]))
+    count += [pool count];
+  pthread_mutex_unlock(&lock_);
+  return count;
+}
+
+@end  // MBProxy
+
+
+@implementation MBProxy (PrivateMethods)
+
+- (void)acceptLoop {
+  while (YES) {
+    struct pollfd fds[2] = {
+      { listener_, POLLIN, 0 },
+      { wake_[0], POLLIN, 0 }
+    };
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    if (fds[1].revents)
+      break;  // -stop
+    if ((fds[0].revents & POLLIN) == 0)
+      continue;
+    int fd = accept(listener_, NULL, NULL);
+    if (fd < 0)
+      continue;
+    MBProxyConfigureSocket(fd, kMBProxyClientTimeout);
+
+    MBProxyClient *client = malloc(sizeof(MBProxyClient));
+    pthread_attr_t attributes;
+    pthread_attr_init(&attributes);
+    pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+    pthread_t thread;
+    if (client) {
+      client->proxy = [self retain];
+      client->fd = fd;
+      if (pthread_create(&thread, &attributes, MBProxyClientThread, client) != 0) {
+        [self release];
+        free(client);
+        client = NULL;
+      }
+    }
+    pthread_attr_destroy(&attributes);
+    if (client == NULL)
+      close(fd);
+  }
+}
+
+// On the connection's own thread.
+- (void)serveClient:(int)fd {
+  MBProxyReader *client = malloc(sizeof(MBProxyReader));
+  if (client) {
+    client->fd = fd;
+    client->start = client->end = 0;
+    client->waited = NULL;
+    client->closed = NO;
+    BOOL more = YES;
+    while (more) {
+      NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+      more = [self proxyRequestFrom:client];
+      [pool release];
+    }
+    free(client);
+  }
+  close(fd);
+}
+
+// Passes one request from |client| to its dev_appserver and the response
+// back. Returns YES if the client's connection can take another request.
+- (BOOL)proxyRequestFrom:(MBProxyReader *)client {
+  NSMutableData *head = [NSMutableData data];
+  if (!MBProxyReadHead(client, head))
+    return NO;  // closed, idle too long, or garbage
+  uint64_t started = mach_absolute_time();
+
+  NSArray *lines = MBProxyHeadLines(head);
+  NSArray *words = [lines count]
+    ? [[lines objectAtIndex:0] componentsSeparatedByString:@" "] : nil;
+  if ([words count] != 3) {
+    MBProxyRespond(client->fd, @"400 Bad Request", @"Bad request.\n", NO);
+    return NO;
+  }
+  NSString *method = [words objectAtIndex:0];
+  NSString *target = [words objectAtIndex:1];
+  NSString *version = [words objectAtIndex:2];
+  BOOL keepAlive = MBProxyKeepsAlive(version, lines);
+  unsigned long long requestLength = 0;
+  MBProxyBodyType requestBody = MBProxyBodyTypeOf(lines, &requestLength, NO);
+  // A request refused before its body is read leaves the connection
+  // unusable, unless there's no body.
+  BOOL bodiless = requestBody == kMBProxyBodyNone ||
+    (requestBody == kMBProxyBodyLength && requestLength == 0);
+  BOOL canContinue = keepAlive && bodiless;
+
+  NSString *host = MBProxyHeaderValue(lines, @"Host");
+  NSString *name = nil;
+  NSString *backendTarget = nil;
+  int port = [self portForHost:host
+                        target:target
+                     routeName:&name
+                 backendTarget:&backendTarget];
+  if (port == 0) {
+    MBProxyRespond(client->fd, @"404 Not Found", [self routeList], canContinue);
+    [self countRequest:@"" status:404];
+    return canContinue;
+  }
+
+  NSMutableString *extra = [NSMutableString stringWithString:
+                            @"Connection: keep-alive\r\n"
+                            @"X-Forwarded-For: 127.0.0.1\r\n"];
+  if (host)
+    [extra appendFormat:@"X-Forwarded-Host: %@\r\n", host];
+  if (![backendTarget isEqualToString:target])
+    [extra appendFormat:@"X-Forwarded-Prefix: /%@\r\n", name];
+  NSData *forward = MBProxyRewriteHead(
+    [NSString stringWithFormat:@"%@ %@ %@", method, backendTarget, version],
+    lines, extra);
+
+  // Waiting for a connection is the backend's time. A pooled connection
+  // may turn out to have been closed as we took it: the write fails, or
+  // the connection ends before a byte of the response. Either way a
+  // fresh connection can be tried; in the second case the request has
+  // been sent, so only if it's a GET or HEAD without a body.
+  BOOL retryable = bodiless &&
+    ([method isEqualToString:@"GET"] || [method isEqualToString:@"HEAD"]);
+  MBProxyReader *response = malloc(sizeof(MBProxyReader));
+  if (response == NULL)
+    return NO;
+  double backendTime = 0;
+  BOOL reused = NO;
+  BOOL reached = NO;
+  BOOL ok = NO;
+  int backend = -1;
+  NSArray *responseLines = nil;
+  NSArray *status = nil;
+  for (int attempt = 0; attempt < 2 && !ok; attempt++) {
+    uint64_t connecting = mach_absolute_time();
+    // The second try, if there is one, is on a new connection.
+    backend = [self backendForPort:port pooled:(attempt == 0) reused:&reused];
+    backendTime += MBProxySeconds(mach_absolute_time() - connecting);
+    if (backend < 0)
+      break;
+    if (!MBProxyWrite(backend, [forward bytes], [forward length])) {
+      close(backend);
+      backend = -1;
+      if (!reused)
+        break;
+      continue;
+    }
+    reached = YES;
+    [metrics_ addValue:1
+             toCounter:@"launcher_proxy_backend_connections_total"
+                labels:[NSDictionary dictionaryWithObjectsAndKeys:
+                        name, @"project",
+                        (reused ? @"true" : @"false"), @"reused",
+                        nil]];
+    if (!MBProxyCopyBody(client, backend, requestBody, requestLength)) {
+      close(backend);
+      free(response);
+      MBProxyRespond(client->fd, @"502 Bad Gateway", @"Request failed.\n", NO);
+      [self countRequest:name status:502];
+      return NO;
+    }
+
+    // Blocking on dev_appserver from here on is backend time.
+    response->fd = backend;
+    response->start = response->end = 0;
+    response->closed = NO;
+    response->waited = &backendTime;
+    while (YES) {
+      NSMutableData *responseHead = [NSMutableData data];
+      ok = MBProxyReadHead(response, responseHead);
+      if (!ok)
+        break;
+      responseLines = MBProxyHeadLines(responseHead);
+      status = [responseLines count]
+        ? [[responseLines objectAtIndex:0] componentsSeparatedByString:@" "] : nil;
+      if ([status count] < 2) {
+        ok = NO;
+        break;
+      }
+      // Interim responses (100 Continue) go straight through.
+      int code = [[status objectAtIndex:1] intValue];
+      if (code < 100 || code >= 200 || code == 101)
+        break;
+      ok = MBProxyWrite(client->fd, [responseHead bytes], [responseHead length]);
+      if (!ok)
+        break;
+    }
+    if (!ok) {
+      BOOL stale = reused && retryable && response->closed && response->end == 0;
+      close(backend);
+      backend = -1;
+      if (!stale)
+        break;
+    }
+  }
+  if (!ok) {
+    free(response);
+    if (!reached) {
+      MBProxyRespond(client->fd, @"502 Bad Gateway",
+                     [NSString stringWithFormat:@"Can't reach %@ on port %d.\n",
+                      name, port],
+                     canContinue);
+      [self countRequest:name status:502];
+      return canContinue;
+    }
+    MBProxyRespond(client->fd, @"502 Bad Gateway",
+                   [NSString stringWithFormat:@"No response from %@.\n", name],
+                   NO);
+    [self countRequest:name status:502];
+    return NO;
+  }
+
+  int code = [[status objectAtIndex:1] intValue];
+  unsigned long long responseLength = 0;
+  MBProxyBodyType responseBody = kMBProxyBodyNone;
+  if (![method isEqualToString:@"HEAD"] && code != 204 && code != 304)
+    responseBody = MBProxyBodyTypeOf(responseLines, &responseLength, YES);
+  BOOL backendKeepAlive = responseBody != kMBProxyBodyUntilClose &&
+    MBProxyKeepsAlive([status objectAtIndex:0], responseLines);
+  // Only the end of the connection marks the end of such a body.
+  if (responseBody == kMBProxyBodyUntilClose)
+    keepAlive = NO;
+
+  NSData *reply = MBProxyRewriteHead(
+    [responseLines objectAtIndex:0], responseLines,
+    (keepAlive ? @"Connection: keep-alive\r\n" : @"Connection: close\r\n"));
+  ok = MBProxyWrite(client->fd, [reply bytes], [reply length]) &&
+       MBProxyCopyBody(response, client->fd, responseBody, responseLength);
+
+  if (ok && backendKeepAlive && response->start == response->end)
+    [self reuseBackend:backend port:port];
+  else
+    close(backend);
+  free(response);
+
+  double total = MBProxySeconds(mach_absolute_time() - started);
+  double proxyTime = (total > backendTime) ? total - backendTime : 0;
+  [metrics_ observeValue:backendTime
+             inHistogram:@"launcher_proxy_request_seconds"
+                  labels:[NSDictionary dictionaryWithObjectsAndKeys:
+                          name, @"project", @"backend", @"part", nil]];
+  [metrics_ observeValue:proxyTime
+             inHistogram:@"launcher_proxy_request_seconds"
+                  labels:[NSDictionary dictionaryWithObjectsAndKeys:
+                          name, @"project", @"proxy", @"part", nil]];
+  [self countRequest:name status:code];
+  GMLoggerDebug(@"%@ %@ -> %@:%d %d (backend %.1fms, proxy %.1fms)",
+                method, target, name, port, code,
+                backendTime * 1e3, proxyTime * 1e3);
+  return ok && keepAlive;
+}
+
+// An idle connection to |port| if |pooled| and there's one, else a new
+// one; -1 if dev_appserver can't be reached.
+- (int)backendForPort:(int)port pooled:(BOOL)pooled reused:(BOOL *)reused {
+  int fd = -1;
+  pthread_mutex_lock(&lock_);
+  NSMutableArray *pool =
+    pooled ? [idle_ objectForKey:[NSNumber numberWithInt:port]] : nil;
+  while (fd < 0 && [pool count]) {
+    int candidate = [[pool lastObject] intValue];
+    [pool removeLastObject];
+    // An idle connection shouldn't have anything to read; if it does,
+    // it's been closed (or is confused).
+    struct pollfd check = { candidate, POLLIN, 0 };
+    if (poll(&check, 1, 0) == 0)
+      fd = candidate;
+    else
+      close(candidate);
+  }
+  pthread_mutex_unlock(&lock_);
+  *reused = (fd >= 0);
+  if (fd >= 0)
+    return fd;
+
+  fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0)
+    return -1;
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_len = sizeof(addr);
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+  MBProxyConfigureSocket(fd, kMBProxyBackendTimeout);
+  return fd;
+}
+
+- (void)reuseBackend:(int)fd port:(int)port {
+  NSNumber *key = [NSNumber numberWithInt:port];
+  pthread_mutex_lock(&lock_);
+  NSMutableArray *pool = [idle_ objectForKey:key];
+  if (pool == nil && running_) {
+    pool = [NSMutableArray array];
+    [idle_ setObject:pool forKey:key];
+  }
+  if (pool && [pool count] < kMBProxyMaxIdle) {
+    [pool addObject:[NSNumber numberWithInt:fd]];
+    fd = -1;
+  }
+  pthread_mutex_unlock(&lock_);
+  if (fd >= 0)
+    close(fd);
+}
+
+// The body of a 404: where the running projects are.
+- (NSString *)routeList {
+  NSDictionary *routes = [self routes];
+  NSMutableString *text = [NSMutableString stringWithString:
+                           @"No running project matches this request.\n"];
+  if ([routes count])
+    [text appendString:@"Running projects:\n"];
+  NSArray *names = [[routes allKeys] sortedArrayUsingSelector:@selector(compare:)];
+  NSEnumerator *nameEnumerator = [names objectEnumerator];
+  NSString *name = nil;
+  while ((name = [nameEnumerator nextObject])) {
+    [text appendFormat:@"  http://%@.localhost:%d/  or  http://localhost:%d/%@/\n",
+          name, port_, port_, name];
+  }
+  return text;
+}
+
+- (void)countRequest:(NSString *)name status:(int)status {
+  [metrics_ addValue:1
+           toCounter:@"launcher_proxy_requests_total"
+              labels:[NSDictionary dictionaryWithObjectsAndKeys:
+                      name, @"project",
+                      [NSString stringWithFormat:@"%d", status], @"code",
+                      nil]];
+}
+
+@end  // PrivateMethods
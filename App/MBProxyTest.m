@@ -0,0 +1,364 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import <SenTestingKit/SenTestingKit.h>
+#import <Cocoa/Cocoa.h>
+#import <netinet/in.h>
+#import <poll.h>
+#import <pthread.h>
+#import <sys/socket.h>
+#import <unistd.h>
+#import "MBMetrics.h"
+#import "MBProject.h"
+#import "MBProxy.h"
+#import "MBProxyTest.h"
+
+// A dev_appserver stand-in: HTTP/1.1 with keep-alive, answering every
+// request with its target.
+typedef struct {
+  int listener;
+  int port;
+  volatile int connections;
+  volatile BOOL done;
+  int answers;  // per connection, after which it closes unanswered; 0: any
+  pthread_t thread;
+} MBProxyTestBackend;
+
+static void MBProxyTestServe(int fd, int answers) {
+  char buffer[4096];
+  size_t length = 0;
+  int answered = 0;
+  while (YES) {
+    ssize_t count = read(fd, buffer + length, sizeof(buffer) - length - 1);
+    if (count <= 0)
+      return;
+    length += count;
+    buffer[length] = '\0';
+    char *end = strstr(buffer, "\r\n\r\n");
+    if (end == NULL)
+      continue;
+    // Like a server closing an idle connection just as it's reused.
+    if (answers > 0 && answered++ == answers)
+      return;
+    char target[1024] = "";
+    sscanf(buffer, "%*s %1023s", target);
+    char response[2048];
+    int size = snprintf(response, sizeof(response),
+                        "HTTP/1.1 200 OK\r\nContent-Length: %d\r\n\r\n%s",
+                        (int)strlen(target), target);
+    write(fd, response, size);
+    // Requests in the test have no body.
+    size_t used = end + 4 - buffer;
+    memmove(buffer, buffer + used, length - used);
+    length -= used;
+  }
+}
+
+static void *MBProxyTestBackendThread(void *arg) {
+  MBProxyTestBackend *backend = arg;
+  while (!backend->done) {
+    struct pollfd check = { backend->listener, POLLIN, 0 };
+    if (poll(&check, 1, 100) <= 0)
+      continue;
+    int fd = accept(backend->listener, NULL, NULL);
+    if (fd < 0)
+      continue;
+    backend->connections++;
+    MBProxyTestServe(fd, backend->answers);
+    close(fd);
+  }
+  return NULL;
+}
+
+static int MBProxyTestListen(int *port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_len = sizeof(addr);
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t length = sizeof(addr);
+  bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+  listen(fd, 8);
+  getsockname(fd, (struct sockaddr *)&addr, &length);
+  *port = ntohs(addr.sin_port);
+  return fd;
+}
+
+static int MBProxyTestConnect(int port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_len = sizeof(addr);
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  struct timeval limit = { 5, 0 };
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &limit, sizeof(limit));
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Sends |request| and returns the response: head and Content-Length body.
+static NSString *MBProxyTestFetch(int fd, NSString *request) {
+  const char *bytes = [request UTF8String];
+  write(fd, bytes, strlen(bytes));
+  NSMutableData *data = [NSMutableData data];
+  char buffer[1024];
+  while (YES) {
+    NSString *text = [[[NSString alloc] initWithData:data
+                                            encoding:NSUTF8StringEncoding]
+                       autorelease];
+    NSRange end = [text rangeOfString:@"\r\n\r\n"];
+    if (end.location != NSNotFound) {
+      NSRange length = [text rangeOfString:@"Content-Length: "];
+      int body = [[text substringFromIndex:NSMaxRange(length)] intValue];
+      if ([text length] >= NSMaxRange(end) + body)
+        return text;
+    }
+    ssize_t count = read(fd, buffer, sizeof(buffer));
+    if (count <= 0)
+      return text;
+    [data appendBytes:buffer length:count];
+  }
+}
+
+@implementation MBProxyTest
+
+- (void)testRouteNames {
+  STAssertEqualObjects([MBProxy routeNameForProjectName:@"guestbook"],
+                       @"guestbook", nil);
+  STAssertEqualObjects([MBProxy routeNameForProjectName:@"My App_2"],
+                       @"my-app-2", nil);
+}
+
+- (void)testRouting {
+  MBProxy *proxy = [[[MBProxy alloc] initWithMetrics:nil] autorelease];
+  [proxy setRoutes:[NSDictionary dictionaryWithObjectsAndKeys:
+                    [NSNumber numberWithInt:8080], @"guestbook",
+                    [NSNumber numberWithInt:8081], @"wiki",
+                    nil]];
+  NSString *name = nil;
+  NSString *target = nil;
+
+  STAssertEquals([proxy portForHost:@"wiki.localhost:8000"
+                             target:@"/guestbook/sign"
+                          routeName:&name
+                      backendTarget:&target], 8081, nil);
+  STAssertEqualObjects(name, @"wiki", nil);
+  STAssertEqualObjects(target, @"/guestbook/sign", nil);
+
+  STAssertEquals([proxy portForHost:@"localhost:8000"
+                             target:@"/Guestbook/sign?x=1"
+                          routeName:&name
+                      backendTarget:&target], 8080, nil);
+  STAssertEqualObjects(name, @"guestbook", nil);
+  STAssertEqualObjects(target, @"/sign?x=1", nil);
+
+  STAssertEquals([proxy portForHost:@"localhost"
+                             target:@"/guestbook?x=1"
+                          routeName:&name
+                      backendTarget:&target], 8080, nil);
+  STAssertEqualObjects(target, @"/?x=1", nil);
+
+  STAssertEquals([proxy portForHost:@"localhost"
+                             target:@"/guestbook"
+                          routeName:&name
+                      backendTarget:&target], 8080, nil);
+  STAssertEqualObjects(target, @"/", nil);
+
+  STAssertEquals([proxy portForHost:nil
+                             target:@"/other/"
+                          routeName:&name
+                      backendTarget:&target], 0, nil);
+  STAssertEquals([proxy portForHost:@"localhost"
+                             target:@"/"
+                          routeName:NULL
+                      backendTarget:NULL], 0, nil);
+}
+
+- (void)testRoutesForProjects {
+  MBProject *running = [MBProject projectWithName:@"Guest Book"
+                                             path:@"/tmp/a" port:@"8080"];
+  [running setRunState:kMBProjectRun];
+  MBProject *duplicate = [MBProject projectWithName:@"guest book"
+                                               path:@"/tmp/b" port:@"8081"];
+  [duplicate setRunState:kMBProjectStarting];
+  MBProject *stopped = [MBProject projectWithName:@"wiki"
+                                             path:@"/tmp/c" port:@"8082"];
+  [stopped setRunState:kMBProjectStop];
+
+  MBProxy *proxy = [[[MBProxy alloc] initWithMetrics:nil] autorelease];
+  [proxy setRoutesForProjects:[NSArray arrayWithObjects:running, duplicate,
+                               stopped, nil]];
+  NSDictionary *expected = [NSDictionary dictionaryWithObject:
+                            [NSNumber numberWithInt:8080]
+                                                       forKey:@"guest-book"];
+  STAssertEqualObjects([proxy routes], expected, nil);
+}
+
+- (void)testUpdateRoute {
+  MBProxy *proxy = [[[MBProxy alloc] initWithMetrics:nil] autorelease];
+  MBProject *wiki = [MBProject projectWithName:@"wiki" path:@"/tmp/a" port:@"8080"];
+  MBProject *other = [MBProject projectWithName:@"Wiki" path:@"/tmp/b" port:@"8081"];
+  [proxy updateRouteForProject:wiki];  // stopped
+  STAssertEquals([[proxy routes] count], (NSUInteger)0, nil);
+
+  [wiki setRunState:kMBProjectStarting];
+  [proxy updateRouteForProject:wiki];
+  STAssertEqualObjects([[proxy routes] objectForKey:@"wiki"],
+                       [NSNumber numberWithInt:8080], nil);
+
+  // The name is taken, so this one isn't routed, and doesn't disturb it.
+  [other setRunState:kMBProjectRun];
+  [proxy updateRouteForProject:other];
+  STAssertEqualObjects([[proxy routes] objectForKey:@"wiki"],
+                       [NSNumber numberWithInt:8080], nil);
+  [other setRunState:kMBProjectStop];
+  [proxy updateRouteForProject:other];
+  STAssertEqualObjects([[proxy routes] objectForKey:@"wiki"],
+                       [NSNumber numberWithInt:8080], nil);
+
+  // Renamed and moved while running: the old name goes.
+  [wiki setName:@"Notes"];
+  [wiki setPort:@"8090"];
+  [proxy updateRouteForProject:wiki];
+  NSDictionary *expected = [NSDictionary dictionaryWithObject:
+                            [NSNumber numberWithInt:8090]
+                                                       forKey:@"notes"];
+  STAssertEqualObjects([proxy routes], expected, nil);
+
+  [wiki setRunState:kMBProjectStop];
+  [proxy updateRouteForProject:wiki];
+  STAssertEquals([[proxy routes] count], (NSUInteger)0, nil);
+  STAssertFalse([proxy isRunning], nil);
+}
+
+- (void)testProxyKeepAlive {
+  MBProxyTestBackend backend;
+  memset(&backend, 0, sizeof(backend));
+  backend.listener = MBProxyTestListen(&backend.port);
+  pthread_create(&backend.thread, NULL, MBProxyTestBackendThread, &backend);
+
+  MBMetrics *metrics = [[[MBMetrics alloc] init] autorelease];
+  MBProxy *proxy = [[[MBProxy alloc] initWithMetrics:metrics] autorelease];
+  [proxy setRoutes:[NSDictionary dictionaryWithObject:
+                    [NSNumber numberWithInt:backend.port]
+                                               forKey:@"guestbook"]];
+  STAssertTrue([proxy listenOnPort:0], nil);
+  STAssertTrue([proxy isRunning], nil);
+
+  int fd = MBProxyTestConnect([proxy port]);
+  STAssertTrue(fd >= 0, nil);
+  NSString *first = MBProxyTestFetch(fd,
+    @"GET /guestbook/sign HTTP/1.1\r\nHost: localhost\r\n\r\n");
+  STAssertTrue([first hasPrefix:@"HTTP/1.1 200 OK\r\n"], first);
+  STAssertTrue([first hasSuffix:@"\r\n\r\n/sign"], first);
+  STAssertTrue([first rangeOfString:@"Connection: keep-alive"].length > 0,
+               first);
+  NSString *second = MBProxyTestFetch(fd,
+    @"GET /list HTTP/1.1\r\nHost: guestbook.localhost\r\n\r\n");
+  STAssertTrue([second hasSuffix:@"\r\n\r\n/list"], second);
+  close(fd);
+
+  // The proxy counts a request just after answering it.
+  NSDictionary *ok = [NSDictionary dictionaryWithObjectsAndKeys:
+                      @"guestbook", @"project", @"200", @"code", nil];
+  for (int i = 0; i < 100; i++) {
+    if ([metrics valueForMetric:@"launcher_proxy_requests_total"
+                         labels:ok] >= 2)
+      break;
+    usleep(10000);
+  }
+
+  // Both went over one backend connection, which is waiting for more.
+  STAssertEquals((int)backend.connections, 1, nil);
+  STAssertEquals([proxy idleConnectionCount], 1U, nil);
+  STAssertEquals([metrics valueForMetric:@"launcher_proxy_requests_total"
+                                  labels:ok], 2.0, nil);
+  NSDictionary *reused = [NSDictionary dictionaryWithObjectsAndKeys:
+                          @"guestbook", @"project", @"true", @"reused", nil];
+  STAssertEquals([metrics valueForMetric:
+                  @"launcher_proxy_backend_connections_total"
+                                  labels:reused], 1.0, nil);
+  NSString *text = [metrics exposition];
+  STAssertTrue([text rangeOfString:
+                @"launcher_proxy_request_seconds_count{part=\"backend\","
+                @"project=\"guestbook\"} 2"].length > 0, text);
+
+  [proxy stop];
+  STAssertEquals([proxy idleConnectionCount], 0U, nil);
+  backend.done = YES;
+  pthread_join(backend.thread, NULL);
+  close(backend.listener);
+}
+
+- (void)testStaleBackendRetry {
+  MBProxyTestBackend backend;
+  memset(&backend, 0, sizeof(backend));
+  backend.answers = 1;
+  backend.listener = MBProxyTestListen(&backend.port);
+  pthread_create(&backend.thread, NULL, MBProxyTestBackendThread, &backend);
+
+  MBProxy *proxy = [[[MBProxy alloc] initWithMetrics:nil] autorelease];
+  [proxy setRoutes:[NSDictionary dictionaryWithObject:
+                    [NSNumber numberWithInt:backend.port]
+                                               forKey:@"guestbook"]];
+  STAssertTrue([proxy listenOnPort:0], nil);
+  int fd = MBProxyTestConnect([proxy port]);
+  NSString *first = MBProxyTestFetch(fd,
+    @"GET /one HTTP/1.1\r\nHost: guestbook.localhost\r\n\r\n");
+  STAssertTrue([first hasSuffix:@"\r\n\r\n/one"], first);
+
+  // The pooled connection is closed without an answer; a GET is tried
+  // again on a new one.
+  NSString *second = MBProxyTestFetch(fd,
+    @"GET /two HTTP/1.1\r\nHost: guestbook.localhost\r\n\r\n");
+  STAssertTrue([second hasSuffix:@"\r\n\r\n/two"], second);
+  STAssertEquals((int)backend.connections, 2, nil);
+
+  // A POST might have done something, so it isn't.
+  NSString *third = MBProxyTestFetch(fd,
+    @"POST /three HTTP/1.1\r\nHost: guestbook.localhost\r\n"
+    @"Content-Length: 0\r\n\r\n");
+  STAssertTrue([third hasPrefix:@"HTTP/1.1 502 "], third);
+  STAssertEquals((int)backend.connections, 2, nil);
+  close(fd);
+
+  [proxy stop];
+  backend.done = YES;
+  pthread_join(backend.thread, NULL);
+  close(backend.listener);
+}
+
+- (void)testUnknownRoute {
+  MBProxy *proxy = [[[MBProxy alloc] initWithMetrics:nil] autorelease];
+  [proxy setRoutes:[NSDictionary dictionaryWithObject:
+                    [NSNumber numberWithInt:8080]
+                                               forKey:@"guestbook"]];
+  STAssertTrue([proxy listenOnPort:0], nil);
+  int fd = MBProxyTestConnect([proxy port]);
+  NSString *response = MBProxyTestFetch(fd,
+    @"GET /wiki/ HTTP/1.1\r\nHost: localhost\r\n\r\n");
+  STAssertTrue([response hasPrefix:@"HTTP/1.1 404 Not Found\r\n"], response);
+  STAssertTrue([response rangeOfString:@"/guestbook/"].length > 0, response);
+  close(fd);
+  [proxy stop];
+}
+
+@end
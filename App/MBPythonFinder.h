@@ -0,0 +1,87 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import <Foundation/Foundation.h>
+#include <stdint.h>
+
+struct MBPythonProbe;
+
+// Keys for the interpreter descriptions returned by MBPythonFinder.
+#define kMBPythonPathKey     @"path"     // NSString, as found
+#define kMBPythonVersionKey  @"version"  // NSString, e.g. "2.5.4"
+#define kMBPythonMachineKey  @"machine"  // NSString, e.g. "i386"
+#define kMBPythonBitsKey     @"bits"     // NSNumber, pointer size in bits
+#define kMBPythonSDKKey      @"sdk"      // NSNumber (BOOL); can import the SDK
+
+// MBPythonFinder looks for python interpreters on $PATH and in the
+// usual install locations, runs each one once to ask for its version,
+// architecture and whether it can import the App Engine SDK, and picks
+// the best.  Candidates are run in parallel.
+//
+// Results are cached on disk by the identity (device, inode, size and
+// modification time) of each binary, so a later launch only runs
+// interpreters which are new or have changed.  Symlinks to the same
+// binary are only run once.
+@interface MBPythonFinder : NSObject {
+ @private
+  NSString *cachePath_;
+  NSArray *candidates_;
+  NSString *sdkDirectory_;
+  int spawnCount_;
+
+  // Shared by the workers while probing.
+  struct MBPythonProbe *probes_;
+  int probeCount_;
+  volatile int32_t nextProbe_;
+}
+
+// ~/Library/Caches/GoogleAppEngineLauncher/Pythons.plist
++ (NSString *)defaultCachePath;
+
+// Well known locations followed by python, python2.6 and python2.5 in
+// each $PATH directory, best guesses first.
++ (NSArray *)defaultCandidates;
+
+// Parse what our probe prints.  Returns nil if |output| isn't from a
+// python we can use (2.5 or later, but not 3).
++ (NSDictionary *)interpreterFromProbeOutput:(NSString *)output
+                                        path:(NSString *)path;
+
+// Sort |interpreters| best first: those which can import the SDK,
+// then by version (2.5, 2.6, 2.7, then anything newer), then in
+// their original order.
++ (NSArray *)sortedInterpreters:(NSArray *)interpreters;
+
+// Designated initializer.  A nil |path| disables the cache.
+- (id)initWithCachePath:(NSString *)path;
+
+// Paths to try.  Defaults to +defaultCandidates.
+- (void)setCandidates:(NSArray *)candidates;
+
+// The directory containing the SDK's "google" package, or nil to
+// skip the import check.
+- (void)setSDKDirectory:(NSString *)directory;
+
+// Every usable interpreter, best first.  Runs whichever candidates
+// aren't cached.  Blocks; safe to call from any thread.
+- (NSArray *)interpreters;
+
+// The first of -interpreters, or nil.
+- (NSDictionary *)bestInterpreter;
+
+// How many interpreters the last -interpreters ran.
+- (int)spawnCount;
+
+@end
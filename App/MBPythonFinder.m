@@ -0,0 +1,420 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import "MBPythonFinder.h"
+#import "MBRuntimeProbeCache.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <libkern/OSAtomic.h>
+
+// Prints version, machine, pointer bits and whether the SDK (argv[1])
+// imports, one per line.  Must run on any python from 2.3 on.
+static const char *kProbeScript =
+  "import sys\n"
+  "sys.stdout.write(sys.version.split()[0] + '\\n')\n"
+  "try:\n"
+  "  import platform\n"
+  "  sys.stdout.write(platform.machine() + '\\n')\n"
+  "except Exception:\n"
+  "  sys.stdout.write('\\n')\n"
+  "import struct\n"
+  "try:\n"
+  "  bits = struct.calcsize('P') * 8\n"
+  "except Exception:\n"
+  "  bits = struct.calcsize('l') * 8\n"
+  "sys.stdout.write('%d\\n' % bits)\n"
+  "ok = 0\n"
+  "if len(sys.argv) > 1:\n"
+  "  sys.path.insert(0, sys.argv[1])\n"
+  "  try:\n"
+  "    import google.appengine\n"
+  "    ok = 1\n"
+  "  except Exception:\n"
+  "    pass\n"
+  "sys.stdout.write('%d\\n' % ok)\n";
+
+// A hung interpreter shouldn't hang the launch.
+static const int kProbeTimeoutSeconds = 10;
+static const int kMaxProbeThreads = 8;
+
+typedef struct MBPythonProbe {
+  char *path;
+  char output[256];
+  BOOL exited;       // exited 0 (output is valid)
+} MBPythonProbe;
+
+@interface MBPythonFinder (Private)
+- (NSDictionary *)readCache;
+- (void)writeCache:(NSDictionary *)cache;
+- (NSDictionary *)sdkIdentity;
+- (void)work;
+@end
+
+// Run |probe|'s interpreter and collect its output.  Only
+// async-signal-safe calls between fork() and exec().
+static void MBRunProbe(MBPythonProbe *probe, const char *sdk) {
+  int fds[2];
+  if (pipe(fds) != 0)
+    return;
+  pid_t pid = fork();
+  if (pid < 0) {
+    close(fds[0]);
+    close(fds[1]);
+    return;
+  }
+  if (pid == 0) {
+    int devnull = open("/dev/null", O_RDWR);
+    dup2(devnull, STDIN_FILENO);
+    dup2(fds[1], STDOUT_FILENO);
+    dup2(devnull, STDERR_FILENO);
+    // Don't hold other workers' pipes open.
+    int maxfd = getdtablesize();
+    for (int fd = STDERR_FILENO + 1; fd < maxfd; fd++)
+      close(fd);
+    execl(probe->path, probe->path, "-E", "-c", kProbeScript, sdk, (char *)NULL);
+    _exit(127);
+  }
+  close(fds[1]);
+
+  struct timeval deadline;
+  gettimeofday(&deadline, NULL);
+  deadline.tv_sec += kProbeTimeoutSeconds;
+  size_t length = 0;
+  BOOL timedOut = NO;
+  for (;;) {
+    struct timeval now, wait;
+    gettimeofday(&now, NULL);
+    timersub(&deadline, &now, &wait);
+    if (wait.tv_sec < 0) {
+      timedOut = YES;
+      break;
+    }
+    fd_set readable;
+    FD_ZERO(&readable);
+    FD_SET(fds[0], &readable);
+    int ready = select(fds[0] + 1, &readable, NULL, NULL, &wait);
+    if ((ready < 0) && (errno == EINTR))
+      continue;
+    if (ready <= 0) {
+      timedOut = (ready == 0);
+      break;
+    }
+    ssize_t count = read(fds[0], probe->output + length,
+                         sizeof(probe->output) - 1 - length);
+    if ((count < 0) && (errno == EINTR))
+      continue;
+    if (count <= 0)
+      break;
+    length += count;
+    if (length == sizeof(probe->output) - 1)
+      break;  // more than we asked for; not ours
+  }
+  probe->output[length] = '\0';
+  close(fds[0]);
+
+  if (timedOut)
+    kill(pid, SIGKILL);
+  int status = 0;
+  while ((waitpid(pid, &status, 0) < 0) && (errno == EINTR))
+    ;
+  probe->exited = (!timedOut && WIFEXITED(status) && (WEXITSTATUS(status) == 0));
+}
+
+static void *MBPythonFinderWorker(void *arg) {
+  MBPythonFinder *finder = (MBPythonFinder *)arg;
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  [finder work];
+  [pool release];
+  return NULL;
+}
+
+@implementation MBPythonFinder
+
++ (NSString *)defaultCachePath {
+  return [NSHomeDirectory() stringByAppendingPathComponent:
+                             @"Library/Caches/GoogleAppEngineLauncher/Pythons.plist"];
+}
+
++ (NSArray *)defaultCandidates {
+  NSMutableArray *candidates = [NSMutableArray arrayWithObjects:
+      @"/usr/bin/python2.6",  /* 10.6 */
+      @"/usr/bin/python2.5",  /* 10.5 */
+      @"/usr/local/bin/python2.5",  /* a guess */
+      @"/Library/Frameworks/Python.framework/Versions/Current/bin/python2.5", /* MacPython.org */
+      @"/opt/local/bin/python2.5",  /* macports? */
+      @"/sw/bin/python2.5",         /* fink? */
+      nil];
+  NSArray *names = [NSArray arrayWithObjects:@"python2.5", @"python2.6", @"python", nil];
+  NSString *path = [[[NSProcessInfo processInfo] environment] objectForKey:@"PATH"];
+  NSArray *dirs = [path componentsSeparatedByString:@":"];
+  NSEnumerator *denum = [dirs objectEnumerator];
+  NSString *dir = nil;
+  while ((dir = [denum nextObject])) {
+    if ([dir length] == 0)
+      continue;
+    NSEnumerator *nenum = [names objectEnumerator];
+    NSString *name = nil;
+    while ((name = [nenum nextObject])) {
+      NSString *candidate = [dir stringByAppendingPathComponent:name];
+      if (![candidates containsObject:candidate])
+        [candidates addObject:candidate];
+    }
+  }
+  if (![candidates containsObject:@"/usr/bin/python"])
+    [candidates addObject:@"/usr/bin/python"];
+  return candidates;
+}
+
++ (NSDictionary *)interpreterFromProbeOutput:(NSString *)output
+                                        path:(NSString *)path {
+  NSArray *lines = [output componentsSeparatedByString:@"\n"];
+  if ([lines count] < 4)
+    return nil;
+  // The SDK needs python 2.5 or later, but not 3.
+  NSString *version = [lines objectAtIndex:0];
+  NSArray *parts = [version componentsSeparatedByString:@"."];
+  if (([parts count] < 2) ||
+      ([[parts objectAtIndex:0] intValue] != 2) ||
+      ([[parts objectAtIndex:1] intValue] < 5))
+    return nil;
+  return [NSDictionary dictionaryWithObjectsAndKeys:
+                         path, kMBPythonPathKey,
+                         version, kMBPythonVersionKey,
+                         [lines objectAtIndex:1], kMBPythonMachineKey,
+                         [NSNumber numberWithInt:[[lines objectAtIndex:2] intValue]],
+                         kMBPythonBitsKey,
+                         [NSNumber numberWithBool:([[lines objectAtIndex:3] intValue] != 0)],
+                         kMBPythonSDKKey,
+                         nil];
+}
+
+// Lower is better.
+static int MBVersionRank(NSString *version) {
+  if ([version hasPrefix:@"2.5"])
+    return 0;
+  if ([version hasPrefix:@"2.6"])
+    return 1;
+  if ([version hasPrefix:@"2.7"])
+    return 2;
+  return 3;
+}
+
+static int MBCompareInterpreters(id a, id b, void *context) {
+  NSArray *original = (NSArray *)context;
+  BOOL sdkA = [[a objectForKey:kMBPythonSDKKey] boolValue];
+  BOOL sdkB = [[b objectForKey:kMBPythonSDKKey] boolValue];
+  if (sdkA != sdkB)
+    return sdkA ? NSOrderedAscending : NSOrderedDescending;
+  int rankA = MBVersionRank([a objectForKey:kMBPythonVersionKey]);
+  int rankB = MBVersionRank([b objectForKey:kMBPythonVersionKey]);
+  if (rankA != rankB)
+    return (rankA < rankB) ? NSOrderedAscending : NSOrderedDescending;
+  unsigned indexA = [original indexOfObjectIdenticalTo:a];
+  unsigned indexB = [original indexOfObjectIdenticalTo:b];
+  if (indexA == indexB)
+    return NSOrderedSame;
+  return (indexA < indexB) ? NSOrderedAscending : NSOrderedDescending;
+}
+
++ (NSArray *)sortedInterpreters:(NSArray *)interpreters {
+  return [interpreters sortedArrayUsingFunction:MBCompareInterpreters
+                                        context:interpreters];
+}
+
+- (id)init {
+  return [self initWithCachePath:[MBPythonFinder defaultCachePath]];
+}
+
+- (id)initWithCachePath:(NSString *)path {
+  if ((self = [super init])) {
+    cachePath_ = [path copy];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [cachePath_ release];
+  [candidates_ release];
+  [sdkDirectory_ release];
+  [super dealloc];
+}
+
+- (void)setCandidates:(NSArray *)candidates {
+  [candidates_ autorelease];
+  candidates_ = [candidates copy];
+}
+
+- (void)setSDKDirectory:(NSString *)directory {
+  [sdkDirectory_ autorelease];
+  sdkDirectory_ = [directory copy];
+}
+
+- (int)spawnCount {
+  return spawnCount_;
+}
+
+- (NSArray *)interpreters {
+  NSArray *candidates = candidates_ ? candidates_ : [MBPythonFinder defaultCandidates];
+  NSDictionary *oldCache = [self readCache];
+  NSMutableDictionary *cache = [NSMutableDictionary dictionary];
+  NSString *sdk = sdkDirectory_ ? sdkDirectory_ : @"";
+  NSDictionary *sdkIdentity = [self sdkIdentity];
+
+  // Weed out duplicates and the missing, and pull what we can from
+  // the cache.
+  NSMutableArray *identities = [NSMutableArray array];
+  NSMutableArray *toProbe = [NSMutableArray array];
+  NSMutableArray *probed = [NSMutableArray array];  // in candidate order
+  NSEnumerator *cenum = [candidates objectEnumerator];
+  NSString *path = nil;
+  while ((path = [cenum nextObject])) {
+    if (access([path fileSystemRepresentation], X_OK) != 0)
+      continue;
+    NSDictionary *identity = [MBRuntimeProbeCache identityOfFileAtPath:path];
+    if ((identity == nil) || [identities containsObject:identity])
+      continue;
+    [identities addObject:identity];
+
+    NSDictionary *entry = [oldCache objectForKey:path];
+    if ([[entry objectForKey:@"identity"] isEqual:identity] &&
+        [[entry objectForKey:@"sdk"] isEqual:sdk] &&
+        [[entry objectForKey:@"sdkIdentity"] isEqual:sdkIdentity]) {
+      [cache setObject:entry forKey:path];
+      [probed addObject:path];
+    } else {
+      [toProbe addObject:path];
+      [probed addObject:path];
+    }
+  }
+
+  // Run what's left, in parallel.
+  spawnCount_ = (int)[toProbe count];
+  if (spawnCount_ > 0) {
+    probeCount_ = spawnCount_;
+    probes_ = calloc(probeCount_, sizeof(MBPythonProbe));
+    for (int i = 0; i < probeCount_; i++)
+      probes_[i].path = strdup([[toProbe objectAtIndex:i] fileSystemRepresentation]);
+    nextProbe_ = 0;
+
+    int threads = (probeCount_ < kMaxProbeThreads) ? probeCount_ : kMaxProbeThreads;
+    pthread_t *workers = calloc(threads, sizeof(pthread_t));
+    int started = 0;
+    for (int i = 0; i < threads; i++) {
+      if (pthread_create(&workers[started], NULL, MBPythonFinderWorker, self) == 0)
+        started++;
+    }
+    if (started == 0)
+      [self work];
+    for (int i = 0; i < started; i++)
+      pthread_join(workers[i], NULL);
+    free(workers);
+
+    for (int i = 0; i < probeCount_; i++) {
+      NSString *candidate = [toProbe objectAtIndex:i];
+      NSDictionary *interpreter = nil;
+      if (probes_[i].exited) {
+        NSString *output = [NSString stringWithUTF8String:probes_[i].output];
+        interpreter = [MBPythonFinder interpreterFromProbeOutput:output
+                                                            path:candidate];
+      }
+      NSDictionary *identity = [MBRuntimeProbeCache identityOfFileAtPath:candidate];
+      // Unusable interpreters are cached too, so they aren't rerun.
+      NSDictionary *entry = [NSDictionary dictionaryWithObjectsAndKeys:
+                                            identity, @"identity",
+                                            sdk, @"sdk",
+                                            sdkIdentity, @"sdkIdentity",
+                                            (interpreter ? interpreter : [NSDictionary dictionary]),
+                                            @"interpreter",
+                                            nil];
+      if (identity)
+        [cache setObject:entry forKey:candidate];
+      free(probes_[i].path);
+    }
+    free(probes_);
+    probes_ = NULL;
+    probeCount_ = 0;
+  }
+
+  if (![cache isEqual:oldCache])
+    [self writeCache:cache];
+
+  NSMutableArray *interpreters = [NSMutableArray array];
+  NSEnumerator *penum = [probed objectEnumerator];
+  while ((path = [penum nextObject])) {
+    NSDictionary *interpreter = [[cache objectForKey:path] objectForKey:@"interpreter"];
+    if ([interpreter count] > 0)
+      [interpreters addObject:interpreter];
+  }
+  return [MBPythonFinder sortedInterpreters:interpreters];
+}
+
+- (NSDictionary *)bestInterpreter {
+  NSArray *interpreters = [self interpreters];
+  return ([interpreters count] > 0) ? [interpreters objectAtIndex:0] : nil;
+}
+
+@end
+
+
+@implementation MBPythonFinder (Private)
+
+- (NSDictionary *)readCache {
+  if (cachePath_ == nil)
+    return nil;
+  return [NSDictionary dictionaryWithContentsOfFile:cachePath_];
+}
+
+- (void)writeCache:(NSDictionary *)cache {
+  if (cachePath_ == nil)
+    return;
+  NSFileManager *fm = [NSFileManager defaultManager];
+  NSString *dir = [cachePath_ stringByDeletingLastPathComponent];
+  if (![fm fileExistsAtPath:dir]) {
+    NSString *parent = [dir stringByDeletingLastPathComponent];
+    if (![fm fileExistsAtPath:parent])
+      [fm createDirectoryAtPath:parent attributes:nil];
+    [fm createDirectoryAtPath:dir attributes:nil];
+  }
+  [cache writeToFile:cachePath_ atomically:YES];
+}
+
+// Changes when the SDK is extracted (or replaced), so we recheck
+// whether it can be imported.
+- (NSDictionary *)sdkIdentity {
+  NSString *init = [sdkDirectory_ stringByAppendingPathComponent:
+                                    @"google/appengine/__init__.py"];
+  NSDictionary *identity = [MBRuntimeProbeCache identityOfFileAtPath:init];
+  return identity ? identity : [NSDictionary dictionary];
+}
+
+- (void)work {
+  const char *sdk = sdkDirectory_ ? [sdkDirectory_ fileSystemRepresentation] : NULL;
+  for (;;) {
+    int32_t index = OSAtomicIncrement32Barrier(&nextProbe_) - 1;
+    if (index >= probeCount_)
+      break;
+    MBRunProbe(&probes_[index], sdk);
+  }
+}
+
+@end
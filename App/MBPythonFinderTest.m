@@ -0,0 +1,161 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import <SenTestingKit/SenTestingKit.h>
+#import <Cocoa/Cocoa.h>
+#import "MBPythonFinder.h"
+#import "MBPythonFinderTest.h"
+
+@implementation MBPythonFinderTest
+
+// Write a fake python to |path| which claims to be |version|.  If
+// |sdk|, it can import the SDK when the directory it's given has one.
+- (void)writePython:(NSString *)path version:(NSString *)version sdk:(BOOL)sdk {
+  // Run as: python -E -c <script> <sdk directory>
+  NSString *import = sdk
+    ? @"test -f \"$4/google/appengine/__init__.py\" && echo 1 || echo 0"
+    : @"echo 0";
+  NSString *script = [NSString stringWithFormat:
+                                 @"#!/bin/sh\necho %@\necho i386\necho 32\n%@\n",
+                               version, import];
+  [script writeToFile:path atomically:NO encoding:NSUTF8StringEncoding error:NULL];
+  NSDictionary *attrs = [NSDictionary dictionaryWithObject:[NSNumber numberWithInt:0755]
+                                                    forKey:NSFilePosixPermissions];
+  [[NSFileManager defaultManager] changeFileAttributes:attrs atPath:path];
+}
+
+- (void)testProbeOutput {
+  NSDictionary *python = [MBPythonFinder interpreterFromProbeOutput:@"2.5.4\ni386\n32\n1\n"
+                                                              path:@"/a/python"];
+  STAssertEqualObjects([python objectForKey:kMBPythonPathKey], @"/a/python", nil);
+  STAssertEqualObjects([python objectForKey:kMBPythonVersionKey], @"2.5.4", nil);
+  STAssertEqualObjects([python objectForKey:kMBPythonMachineKey], @"i386", nil);
+  STAssertEquals([[python objectForKey:kMBPythonBitsKey] intValue], 32, nil);
+  STAssertTrue([[python objectForKey:kMBPythonSDKKey] boolValue], nil);
+
+  python = [MBPythonFinder interpreterFromProbeOutput:@"2.6.1\nx86_64\n64\n0\n"
+                                                 path:@"/a/python"];
+  STAssertFalse([[python objectForKey:kMBPythonSDKKey] boolValue], nil);
+
+  // Too old, too new, or not a python at all.
+  STAssertNil([MBPythonFinder interpreterFromProbeOutput:@"2.3.5\nppc\n32\n0\n"
+                                                    path:@"/a"], nil);
+  STAssertNil([MBPythonFinder interpreterFromProbeOutput:@"3.1\ni386\n32\n0\n"
+                                                    path:@"/a"], nil);
+  STAssertNil([MBPythonFinder interpreterFromProbeOutput:@"hello\n" path:@"/a"], nil);
+  STAssertNil([MBPythonFinder interpreterFromProbeOutput:@"" path:@"/a"], nil);
+}
+
+- (void)testSort {
+  NSDictionary *a = [MBPythonFinder interpreterFromProbeOutput:@"2.6.1\ni386\n32\n0\n"
+                                                          path:@"/a"];
+  NSDictionary *b = [MBPythonFinder interpreterFromProbeOutput:@"2.5.1\ni386\n32\n0\n"
+                                                          path:@"/b"];
+  NSDictionary *c = [MBPythonFinder interpreterFromProbeOutput:@"2.7\ni386\n32\n1\n"
+                                                          path:@"/c"];
+  NSDictionary *d = [MBPythonFinder interpreterFromProbeOutput:@"2.5.4\ni386\n32\n0\n"
+                                                          path:@"/d"];
+  NSArray *sorted = [MBPythonFinder sortedInterpreters:
+                                      [NSArray arrayWithObjects:a, b, c, d, nil]];
+  // SDK first, then 2.5 (in original order), then 2.6.
+  NSArray *expected = [NSArray arrayWithObjects:c, b, d, a, nil];
+  STAssertEqualObjects(sorted, expected, nil);
+  STAssertEquals([[MBPythonFinder sortedInterpreters:[NSArray array]] count],
+                 (unsigned)0, nil);
+}
+
+- (void)testDefaultCandidates {
+  NSArray *candidates = [MBPythonFinder defaultCandidates];
+  STAssertEqualObjects([candidates objectAtIndex:0], @"/usr/bin/python2.6", nil);
+  STAssertTrue([candidates containsObject:@"/usr/bin/python"], nil);
+  STAssertEquals([candidates count],
+                 [[[NSSet setWithArray:candidates] allObjects] count], nil);
+}
+
+- (void)testFindAndCache {
+  NSFileManager *fm = [NSFileManager defaultManager];
+  int pid = [[NSProcessInfo processInfo] processIdentifier];
+  NSString *dir = [NSString stringWithFormat:@"/tmp/pythonfinder-%d", pid];
+  [fm createDirectoryAtPath:dir attributes:nil];
+  NSString *python25 = [dir stringByAppendingPathComponent:@"python2.5"];
+  NSString *python26 = [dir stringByAppendingPathComponent:@"python2.6"];
+  NSString *python3 = [dir stringByAppendingPathComponent:@"python3"];
+  NSString *link = [dir stringByAppendingPathComponent:@"python"];
+  NSString *notExecutable = [dir stringByAppendingPathComponent:@"python2.4"];
+  [self writePython:python26 version:@"2.6.1" sdk:NO];
+  [self writePython:python25 version:@"2.5.4" sdk:YES];
+  [self writePython:python3 version:@"3.1" sdk:NO];
+  [fm createSymbolicLinkAtPath:link pathContent:python25];
+  [@"nope" writeToFile:notExecutable atomically:NO
+              encoding:NSUTF8StringEncoding error:NULL];
+  NSArray *candidates = [NSArray arrayWithObjects:python26, python25, link,
+                                 python3, notExecutable,
+                                 [dir stringByAppendingPathComponent:@"missing"],
+                                 nil];
+  NSString *cachePath = [dir stringByAppendingPathComponent:@"Cache/Pythons.plist"];
+
+  MBPythonFinder *finder = [[[MBPythonFinder alloc] initWithCachePath:cachePath]
+                             autorelease];
+  [finder setCandidates:candidates];
+  NSArray *interpreters = [finder interpreters];
+  STAssertEquals([interpreters count], (unsigned)2, nil);
+  STAssertEqualObjects([[finder bestInterpreter] objectForKey:kMBPythonPathKey],
+                       python25, nil);
+  // The symlink is the same binary; only run once.
+  STAssertEquals([finder spawnCount], 3, nil);
+  STAssertTrue([fm fileExistsAtPath:cachePath], nil);
+
+  // Next time it's all cached.
+  finder = [[[MBPythonFinder alloc] initWithCachePath:cachePath] autorelease];
+  [finder setCandidates:candidates];
+  STAssertEqualObjects([finder interpreters], interpreters, nil);
+  STAssertEquals([finder spawnCount], 0, nil);
+
+  // Only a changed binary is rerun.  (A different length, so the
+  // change shows even within the same second.)
+  [self writePython:python26 version:@"2.6.10" sdk:YES];
+  finder = [[[MBPythonFinder alloc] initWithCachePath:cachePath] autorelease];
+  [finder setCandidates:candidates];
+  interpreters = [finder interpreters];
+  STAssertEquals([finder spawnCount], 1, nil);
+  STAssertEqualObjects([[interpreters objectAtIndex:1] objectForKey:kMBPythonVersionKey],
+                       @"2.6.10", nil);
+
+  // A different SDK means asking again.  Laid out as in the runtime
+  // bundle: Resources/google_appengine/google/appengine.
+  NSString *sdk = [dir stringByAppendingPathComponent:
+                         @"Resources/google_appengine"];
+  NSString *package = [sdk stringByAppendingPathComponent:@"google/appengine"];
+  NSString *parent = dir;
+  NSEnumerator *penum = [[[package substringFromIndex:[dir length] + 1]
+                           pathComponents] objectEnumerator];
+  NSString *component = nil;
+  while ((component = [penum nextObject])) {
+    parent = [parent stringByAppendingPathComponent:component];
+    [fm createDirectoryAtPath:parent attributes:nil];
+  }
+  [@"" writeToFile:[package stringByAppendingPathComponent:@"__init__.py"]
+        atomically:NO encoding:NSUTF8StringEncoding error:NULL];
+  [finder setSDKDirectory:sdk];
+  [finder interpreters];
+  STAssertEquals([finder spawnCount], 3, nil);
+  NSDictionary *best = [finder bestInterpreter];
+  STAssertEqualObjects([best objectForKey:kMBPythonPathKey], python25, nil);
+  STAssertTrue([[best objectForKey:kMBPythonSDKKey] boolValue], nil);
+
+  [fm removeFileAtPath:dir handler:nil];
+}
+
+@end
@@ -0,0 +1,82 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import <Foundation/Foundation.h>
+#import "MBProject.h"
+
+// Number of distinct MBRunStates.
+#define kMBRunStateCount 5
+
+// An MBRunStateModel counts how many projects are in each run state,
+// both overall and within a selection, so questions like "is anything
+// selected running?" (asked by every toolbar and menu validation) don't
+// walk the projects.  The counts are kept up to date by watching each
+// project's runState with KVO, so a change costs the same however many
+// projects there are; only changing the selection itself touches every
+// selected project.
+//
+// The delegate is told which project changed, so a view can redraw just
+// that project's row.  It's also told when a project's name or port
+// changes, which is where a running project can be reached.
+//
+// Like MBProjectRegistry, MBProjectArrayController keeps one of these in
+// sync with its content and selection.
+@interface MBRunStateModel : NSObject {
+ @private
+  NSMutableSet *projects_;
+  NSMutableSet *selection_;  // a subset of projects_
+  unsigned counts_[kMBRunStateCount];
+  unsigned selectedCounts_[kMBRunStateCount];
+  id delegate_;  // weak
+}
+
+// Add or remove a project.  Both are no-ops if the project is
+// already (or not) in the model.  Removing a project deselects it.
+- (void)addProject:(MBProject *)project;
+- (void)removeProject:(MBProject *)project;
+
+// Convenience for many projects.
+- (void)addProjects:(NSArray *)projects;
+- (void)removeProjects:(NSArray *)projects;
+
+// Replace all projects with |projects|, keeping what's still selected.
+- (void)setProjects:(NSArray *)projects;
+
+// Replace the selection.  Projects not in the model are ignored.
+- (void)setSelectedProjects:(NSArray *)projects;
+
+// Counts.  All constant time.
+- (unsigned)count;
+- (unsigned)countOfProjectsInState:(MBRunState)state;
+- (unsigned)countOfSelectedProjects;
+- (unsigned)countOfSelectedProjectsInState:(MBRunState)state;
+
+// Return YES if |project| is in the model.
+- (BOOL)containsProject:(MBProject *)project;
+
+// The delegate is not retained.
+- (id)delegate;
+- (void)setDelegate:(id)delegate;
+
+@end
+
+// Optional MBRunStateModel delegate methods.  The first is called after
+// the counts have been updated.
+@interface NSObject (MBRunStateModelDelegate)
+- (void)runStateModel:(MBRunStateModel *)model
+    didChangeRunStateOfProject:(MBProject *)project;
+- (void)runStateModel:(MBRunStateModel *)model
+    didChangeAddressOfProject:(MBProject *)project;
+@end
@@ -0,0 +1,205 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import "MBRunStateModel.h"
+
+// KVO context so we only respond to our own observations.
+static NSString *const kMBRunStateModelContext = @"MBRunStateModelContext";
+
+// Index into the count arrays.  Unknown states count as died, which is
+// also how MBRunStateToImageTransformer shows them.
+static int MBRunStateIndex(int state) {
+  if ((state < kMBProjectDied) || (state > kMBProjectProductionRun))
+    state = kMBProjectDied;
+  return state - kMBProjectDied;
+}
+
+@interface MBRunStateModel (Private)
+- (void)selectProject:(MBProject *)project;
+- (void)deselectProject:(MBProject *)project;
+@end
+
+@implementation MBRunStateModel
+
+- (id)init {
+  if ((self = [super init])) {
+    projects_ = [[NSMutableSet alloc] init];
+    selection_ = [[NSMutableSet alloc] init];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [self removeProjects:[projects_ allObjects]];  // unregisters KVO
+  [projects_ release];
+  [selection_ release];
+  [super dealloc];
+}
+
+- (void)addProject:(MBProject *)project {
+  if ((project == nil) || [projects_ containsObject:project])
+    return;
+  [projects_ addObject:project];
+  counts_[MBRunStateIndex([project runState])]++;
+  [project addObserver:self
+            forKeyPath:@"runState"
+               options:(NSKeyValueObservingOptionOld |
+                        NSKeyValueObservingOptionNew)
+               context:kMBRunStateModelContext];
+  [project addObserver:self
+            forKeyPath:@"name"
+               options:0
+               context:kMBRunStateModelContext];
+  [project addObserver:self
+            forKeyPath:@"port"
+               options:0
+               context:kMBRunStateModelContext];
+}
+
+- (void)removeProject:(MBProject *)project {
+  if ((project == nil) || ([projects_ containsObject:project] == NO))
+    return;
+  [project removeObserver:self forKeyPath:@"runState"];
+  [project removeObserver:self forKeyPath:@"name"];
+  [project removeObserver:self forKeyPath:@"port"];
+  [self deselectProject:project];
+  counts_[MBRunStateIndex([project runState])]--;
+  [projects_ removeObject:project];
+}
+
+- (void)addProjects:(NSArray *)projects {
+  NSEnumerator *penum = [projects objectEnumerator];
+  MBProject *project = nil;
+  while ((project = [penum nextObject])) {
+    [self addProject:project];
+  }
+}
+
+- (void)removeProjects:(NSArray *)projects {
+  NSEnumerator *penum = [projects objectEnumerator];
+  MBProject *project = nil;
+  while ((project = [penum nextObject])) {
+    [self removeProject:project];
+  }
+}
+
+- (void)setProjects:(NSArray *)projects {
+  NSSet *wanted = [NSSet setWithArray:projects];
+  NSEnumerator *penum = [[projects_ allObjects] objectEnumerator];
+  MBProject *project = nil;
+  while ((project = [penum nextObject])) {
+    if ([wanted containsObject:project] == NO)
+      [self removeProject:project];
+  }
+  [self addProjects:projects];
+}
+
+- (void)setSelectedProjects:(NSArray *)projects {
+  NSEnumerator *penum = [[selection_ allObjects] objectEnumerator];
+  MBProject *project = nil;
+  while ((project = [penum nextObject])) {
+    [self deselectProject:project];
+  }
+  penum = [projects objectEnumerator];
+  while ((project = [penum nextObject])) {
+    [self selectProject:project];
+  }
+}
+
+- (unsigned)count {
+  return [projects_ count];
+}
+
+- (unsigned)countOfProjectsInState:(MBRunState)state {
+  return counts_[MBRunStateIndex(state)];
+}
+
+- (unsigned)countOfSelectedProjects {
+  return [selection_ count];
+}
+
+- (unsigned)countOfSelectedProjectsInState:(MBRunState)state {
+  return selectedCounts_[MBRunStateIndex(state)];
+}
+
+- (BOOL)containsProject:(MBProject *)project {
+  return [projects_ containsObject:project];
+}
+
+- (id)delegate {
+  return delegate_;
+}
+
+- (void)setDelegate:(id)delegate {
+  delegate_ = delegate;
+}
+
+// Move the project from its old state's counts to its new one; pass
+// on name and port changes.
+- (void)observeValueForKeyPath:(NSString *)keyPath
+                      ofObject:(id)object
+                        change:(NSDictionary *)change
+                       context:(void *)context {
+  if (context != kMBRunStateModelContext) {
+    [super observeValueForKeyPath:keyPath
+                         ofObject:object
+                           change:change
+                          context:context];
+    return;
+  }
+  if (![keyPath isEqual:@"runState"]) {
+    if ([delegate_ respondsToSelector:
+                     @selector(runStateModel:didChangeAddressOfProject:)])
+      [delegate_ runStateModel:self didChangeAddressOfProject:object];
+    return;
+  }
+  int oldIndex = MBRunStateIndex([[change objectForKey:NSKeyValueChangeOldKey]
+                                   intValue]);
+  int newIndex = MBRunStateIndex([[change objectForKey:NSKeyValueChangeNewKey]
+                                   intValue]);
+  if (oldIndex == newIndex)
+    return;
+  counts_[oldIndex]--;
+  counts_[newIndex]++;
+  if ([selection_ containsObject:object]) {
+    selectedCounts_[oldIndex]--;
+    selectedCounts_[newIndex]++;
+  }
+  if ([delegate_ respondsToSelector:
+                   @selector(runStateModel:didChangeRunStateOfProject:)])
+    [delegate_ runStateModel:self didChangeRunStateOfProject:object];
+}
+
+@end  // MBRunStateModel
+
+
+@implementation MBRunStateModel (Private)
+
+- (void)selectProject:(MBProject *)project {
+  if ([projects_ containsObject:project] &&
+      ([selection_ containsObject:project] == NO)) {
+    [selection_ addObject:project];
+    selectedCounts_[MBRunStateIndex([project runState])]++;
+  }
+}
+
+- (void)deselectProject:(MBProject *)project {
+  if ([selection_ containsObject:project]) {
+    selectedCounts_[MBRunStateIndex([project runState])]--;
+    [selection_ removeObject:project];
+  }
+}
+
+@end  // MBRunStateModel (Private)
@@ -0,0 +1,162 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import <SenTestingKit/SenTestingKit.h>
+#import <Cocoa/Cocoa.h>
+#import "MBProject.h"
+#import "MBRunStateModel.h"
+#import "MBRunStateModelTest.h"
+
+@implementation MBRunStateModelTest
+
+- (void)runStateModel:(MBRunStateModel *)model
+    didChangeRunStateOfProject:(MBProject *)project {
+  changes_++;
+}
+
+- (void)runStateModel:(MBRunStateModel *)model
+    didChangeAddressOfProject:(MBProject *)project {
+  addressChanges_++;
+}
+
+- (void)observeValueForKeyPath:(NSString *)keyPath
+                      ofObject:(id)object
+                        change:(NSDictionary *)change
+                       context:(void *)context {
+  changes_++;
+}
+
+- (void)testCounts {
+  MBRunStateModel *m = [[[MBRunStateModel alloc] init] autorelease];
+  MBProject *p0 = [MBProject project];
+  MBProject *p1 = [MBProject project];
+  [p1 setRunState:kMBProjectRun];
+  [m addProject:p0];
+  [m addProject:p1];
+  [m addProject:p1];  // no-op
+  [m addProject:nil];  // no-op
+  STAssertEquals([m count], (unsigned)2, nil);
+  STAssertEquals([m countOfProjectsInState:kMBProjectStop], (unsigned)1, nil);
+  STAssertEquals([m countOfProjectsInState:kMBProjectRun], (unsigned)1, nil);
+  STAssertEquals([m countOfProjectsInState:kMBProjectDied], (unsigned)0, nil);
+
+  [p0 setRunState:kMBProjectStarting];
+  [p0 setRunState:kMBProjectProductionRun];
+  [p1 setRunState:kMBProjectDied];
+  STAssertEquals([m countOfProjectsInState:kMBProjectStop], (unsigned)0, nil);
+  STAssertEquals([m countOfProjectsInState:kMBProjectStarting], (unsigned)0, nil);
+  STAssertEquals([m countOfProjectsInState:kMBProjectProductionRun],
+                 (unsigned)1, nil);
+  STAssertEquals([m countOfProjectsInState:kMBProjectDied], (unsigned)1, nil);
+
+  [m removeProject:p1];
+  [m removeProject:p1];  // no-op
+  STAssertEquals([m count], (unsigned)1, nil);
+  STAssertFalse([m containsProject:p1], nil);
+  STAssertEquals([m countOfProjectsInState:kMBProjectDied], (unsigned)0, nil);
+
+  // No longer watched.
+  [p1 setRunState:kMBProjectRun];
+  STAssertEquals([m countOfProjectsInState:kMBProjectRun], (unsigned)0, nil);
+}
+
+- (void)testSelection {
+  MBRunStateModel *m = [[[MBRunStateModel alloc] init] autorelease];
+  MBProject *p0 = [MBProject project];
+  MBProject *p1 = [MBProject project];
+  MBProject *outside = [MBProject project];
+  [m addProjects:[NSArray arrayWithObjects:p0, p1, nil]];
+  STAssertEquals([m countOfSelectedProjects], (unsigned)0, nil);
+
+  [m setSelectedProjects:[NSArray arrayWithObjects:p0, outside, nil]];
+  STAssertEquals([m countOfSelectedProjects], (unsigned)1, nil);
+  STAssertEquals([m countOfSelectedProjectsInState:kMBProjectStop],
+                 (unsigned)1, nil);
+
+  [p0 setRunState:kMBProjectRun];
+  [p1 setRunState:kMBProjectRun];
+  STAssertEquals([m countOfSelectedProjectsInState:kMBProjectStop],
+                 (unsigned)0, nil);
+  STAssertEquals([m countOfSelectedProjectsInState:kMBProjectRun],
+                 (unsigned)1, nil);
+  STAssertEquals([m countOfProjectsInState:kMBProjectRun], (unsigned)2, nil);
+
+  [m setSelectedProjects:[NSArray arrayWithObject:p1]];
+  STAssertEquals([m countOfSelectedProjectsInState:kMBProjectRun],
+                 (unsigned)1, nil);
+  [m removeProject:p1];
+  STAssertEquals([m countOfSelectedProjects], (unsigned)0, nil);
+  STAssertEquals([m countOfSelectedProjectsInState:kMBProjectRun],
+                 (unsigned)0, nil);
+
+  [m setSelectedProjects:nil];
+  STAssertEquals([m countOfSelectedProjects], (unsigned)0, nil);
+}
+
+- (void)testSetProjects {
+  MBRunStateModel *m = [[[MBRunStateModel alloc] init] autorelease];
+  MBProject *p0 = [MBProject project];
+  MBProject *p1 = [MBProject project];
+  MBProject *p2 = [MBProject project];
+  [m setProjects:[NSArray arrayWithObjects:p0, p1, nil]];
+  [m setSelectedProjects:[NSArray arrayWithObjects:p0, p1, nil]];
+  [m setProjects:[NSArray arrayWithObjects:p1, p2, nil]];
+  STAssertEquals([m count], (unsigned)2, nil);
+  STAssertFalse([m containsProject:p0], nil);
+  STAssertTrue([m containsProject:p2], nil);
+  STAssertEquals([m countOfSelectedProjects], (unsigned)1, nil);
+  STAssertEquals([m countOfProjectsInState:kMBProjectStop], (unsigned)2, nil);
+}
+
+- (void)testDelegate {
+  MBRunStateModel *m = [[[MBRunStateModel alloc] init] autorelease];
+  MBProject *p = [MBProject project];
+  [m addProject:p];
+  [m setDelegate:self];
+  STAssertEquals([m delegate], (id)self, nil);
+
+  changes_ = 0;
+  [p setRunState:kMBProjectRun];
+  STAssertEquals(changes_, 1, nil);
+  [p setRunState:kMBProjectRun];  // not a change
+  STAssertEquals(changes_, 1, nil);
+  [p setRunState:kMBProjectStop];
+  STAssertEquals(changes_, 2, nil);
+
+  // Name and port changes are passed on separately.
+  addressChanges_ = 0;
+  [p setName:@"renamed"];
+  [p setPort:@"9090"];
+  STAssertEquals(addressChanges_, 2, nil);
+  STAssertEquals(changes_, 2, nil);
+  [m removeProject:p];
+  [p setName:@"gone"];
+  STAssertEquals(addressChanges_, 2, nil);
+  [m setDelegate:nil];
+}
+
+- (void)testRunStateAsObjectNotifies {
+  // The table is bound to runStateAsObject, so that's what needs to
+  // change for its row to be redrawn.
+  MBProject *p = [MBProject project];
+  [p addObserver:self forKeyPath:@"runStateAsObject" options:0 context:NULL];
+  changes_ = 0;
+  [p setRunState:kMBProjectStarting];
+  [p setRunState:kMBProjectStarting];
+  STAssertEquals(changes_, 1, nil);
+  [p removeObserver:self forKeyPath:@"runStateAsObject"];
+}
+
+@end
@@ -34,15 +34,21 @@ limitations under the License.
   return NO;
 }
 
-// TODO(jrg): perhaps use -[NSImage setName:] in combination with
-// +[NSImage imageNamed:@"string] to cache them.  Or do they get
-// cached automatically inside NSImageCell when the object is an
-// NSString?
+// Image paths for each run state (indexed by state - kMBProjectDied),
+// looked up in the bundle the first time each is needed.  Rows are
+// drawn far more often than run states change.
+static NSString *gImagePaths[kMBProjectProductionRun - kMBProjectDied + 1];
+
 - (id)transformedValue:(id)value {
   if ([value respondsToSelector:@selector(intValue)] == NO)
     return nil;
 
   MBRunState e = [value intValue];
+  if ((e < kMBProjectDied) || (e > kMBProjectProductionRun))
+    e = kMBProjectDied;
+  NSString **cached = &gImagePaths[e - kMBProjectDied];
+  if (*cached)
+    return *cached;
 
   // By being more explict than [NSBundle mainBundle],
   // unit tests are much happier.
@@ -67,9 +73,9 @@ limitations under the License.
       path = [bundle pathForResource:@"Died" ofType:@"tiff"];
       break;
   }
+  // Transformers are only used on the main thread, so no lock.
+  *cached = [path copy];
   return path;
 }
 
-
-
 @end
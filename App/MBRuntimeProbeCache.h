@@ -0,0 +1,64 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import <Foundation/Foundation.h>
+
+// An MBRuntimeProbeCache remembers the results of probing a runtime
+// (which python to use, the PYTHONPATH, whether extraction is done,
+// where dev_appserver.py lives) across launches, so a cold start
+// doesn't need to spawn python to rediscover them.
+//
+// Results are stored in a property list along with a key and the
+// identity (device, inode, size and modification time) of each file
+// they depend on.  Results are only returned if the key matches and
+// none of those files have changed.
+@interface MBRuntimeProbeCache : NSObject {
+ @private
+  NSString *path_;
+}
+
+// ~/Library/Caches/GoogleAppEngineLauncher/RuntimeProbe.plist
++ (NSString *)defaultCachePath;
+
+// Where to cache results for the runtime called |name|, so runtimes
+// don't invalidate each other.  Returns the default path if |name|
+// is nil.
++ (NSString *)cachePathForRuntime:(NSString *)name;
+
+// Return a plist-able description of the file at |path| which changes
+// whenever the file is replaced or modified, or nil if there is no
+// such file.  Symlinks are followed.
++ (NSDictionary *)identityOfFileAtPath:(NSString *)path;
+
+// Designated initializer.
+- (id)initWithPath:(NSString *)path;
+
+- (NSString *)path;
+
+// Return the cached results if they were stored with an equal |key|
+// and their files are unchanged; else nil.
+- (NSDictionary *)resultsForKey:(NSDictionary *)key;
+
+// Store |results| (a plist-able dictionary) for |key|.  |files| is an
+// array of paths whose modification invalidates the results.  Returns
+// NO if the cache couldn't be written.
+- (BOOL)setResults:(NSDictionary *)results
+            forKey:(NSDictionary *)key
+  dependingOnFiles:(NSArray *)files;
+
+// Throw away whatever is cached.
+- (void)removeResults;
+
+@end
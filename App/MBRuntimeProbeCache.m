@@ -0,0 +1,124 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import "MBRuntimeProbeCache.h"
+#include <sys/stat.h>
+
+// Keys for the cache file.
+static NSString *const kMBProbeCacheKeyKey = @"key";
+static NSString *const kMBProbeCacheResultsKey = @"results";
+static NSString *const kMBProbeCacheFilesKey = @"files";  // path --> identity
+
+@implementation MBRuntimeProbeCache
+
++ (NSString *)defaultCachePath {
+  return [NSHomeDirectory() stringByAppendingPathComponent:
+                             @"Library/Caches/GoogleAppEngineLauncher/RuntimeProbe.plist"];
+}
+
++ (NSString *)cachePathForRuntime:(NSString *)name {
+  NSString *path = [MBRuntimeProbeCache defaultCachePath];
+  if (name == nil)
+    return path;
+  NSString *file = [NSString stringWithFormat:@"RuntimeProbe-%@.plist", name];
+  return [[path stringByDeletingLastPathComponent]
+           stringByAppendingPathComponent:file];
+}
+
++ (NSDictionary *)identityOfFileAtPath:(NSString *)path {
+  struct stat sb;
+  if ((path == nil) || (stat([path fileSystemRepresentation], &sb) != 0))
+    return nil;
+  // Plain numbers so the identity survives a round trip through a plist.
+  return [NSDictionary dictionaryWithObjectsAndKeys:
+                         [NSNumber numberWithLongLong:(long long)sb.st_dev], @"dev",
+                         [NSNumber numberWithLongLong:(long long)sb.st_ino], @"inode",
+                         [NSNumber numberWithLongLong:(long long)sb.st_size], @"size",
+                         [NSNumber numberWithLongLong:(long long)sb.st_mtimespec.tv_sec], @"mtime",
+                         [NSNumber numberWithLong:sb.st_mtimespec.tv_nsec], @"mtimensec",
+                         nil];
+}
+
+- (id)init {
+  return [self initWithPath:[MBRuntimeProbeCache defaultCachePath]];
+}
+
+- (id)initWithPath:(NSString *)path {
+  if ((self = [super init])) {
+    path_ = [path copy];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [path_ release];
+  [super dealloc];
+}
+
+- (NSString *)path {
+  return [[path_ copy] autorelease];
+}
+
+- (NSDictionary *)resultsForKey:(NSDictionary *)key {
+  NSDictionary *cache = [NSDictionary dictionaryWithContentsOfFile:path_];
+  if (cache == nil)
+    return nil;
+  if ([[cache objectForKey:kMBProbeCacheKeyKey] isEqual:key] == NO)
+    return nil;
+
+  NSDictionary *files = [cache objectForKey:kMBProbeCacheFilesKey];
+  NSEnumerator *fenum = [files keyEnumerator];
+  NSString *file = nil;
+  while ((file = [fenum nextObject])) {
+    NSDictionary *identity = [MBRuntimeProbeCache identityOfFileAtPath:file];
+    if ([identity isEqual:[files objectForKey:file]] == NO)
+      return nil;
+  }
+  return [cache objectForKey:kMBProbeCacheResultsKey];
+}
+
+- (BOOL)setResults:(NSDictionary *)results
+            forKey:(NSDictionary *)key
+  dependingOnFiles:(NSArray *)files {
+  NSMutableDictionary *identities = [NSMutableDictionary dictionary];
+  NSEnumerator *fenum = [files objectEnumerator];
+  NSString *file = nil;
+  while ((file = [fenum nextObject])) {
+    NSDictionary *identity = [MBRuntimeProbeCache identityOfFileAtPath:file];
+    if (identity == nil) {
+      // Can't vouch for results depending on a missing file.
+      [self removeResults];
+      return NO;
+    }
+    [identities setObject:identity forKey:file];
+  }
+
+  NSDictionary *cache = [NSDictionary dictionaryWithObjectsAndKeys:
+                                        key, kMBProbeCacheKeyKey,
+                                        results, kMBProbeCacheResultsKey,
+                                        identities, kMBProbeCacheFilesKey,
+                                        nil];
+  NSFileManager *fm = [NSFileManager defaultManager];
+  NSString *dir = [path_ stringByDeletingLastPathComponent];
+  if ([fm fileExistsAtPath:dir] == NO)
+    [fm createDirectoryAtPath:dir attributes:nil];
+  return [cache writeToFile:path_ atomically:YES];
+}
+
+- (void)removeResults {
+  [[NSFileManager defaultManager] removeFileAtPath:path_ handler:nil];
+}
+
+@end
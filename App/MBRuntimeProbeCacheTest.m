@@ -0,0 +1,82 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import <SenTestingKit/SenTestingKit.h>
+#import <Cocoa/Cocoa.h>
+#import "MBRuntimeProbeCache.h"
+#import "MBRuntimeProbeCacheTest.h"
+
+@implementation MBRuntimeProbeCacheTest
+
+- (void)testIdentity {
+  STAssertNil([MBRuntimeProbeCache identityOfFileAtPath:nil], nil);
+  STAssertNil([MBRuntimeProbeCache identityOfFileAtPath:@"/no/such/file"], nil);
+  NSDictionary *identity = [MBRuntimeProbeCache identityOfFileAtPath:@"/bin/sh"];
+  STAssertNotNil(identity, nil);
+  STAssertEqualObjects(identity,
+                       [MBRuntimeProbeCache identityOfFileAtPath:@"/bin/sh"], nil);
+  STAssertTrue([[MBRuntimeProbeCache defaultCachePath] length] > 0, nil);
+}
+
+- (void)testCache {
+  int pid = [[NSProcessInfo processInfo] processIdentifier];
+  NSString *dir = [NSString stringWithFormat:@"/tmp/probetest-%d", pid];
+  NSString *path = [dir stringByAppendingPathComponent:@"Probe.plist"];
+  NSString *file = [NSString stringWithFormat:@"/tmp/probetest-file-%d", pid];
+  [[@"one" dataUsingEncoding:NSUTF8StringEncoding] writeToFile:file atomically:NO];
+
+  MBRuntimeProbeCache *cache = [[[MBRuntimeProbeCache alloc] initWithPath:path]
+                                 autorelease];
+  STAssertEqualObjects([cache path], path, nil);
+  NSDictionary *key = [NSDictionary dictionaryWithObject:@"1.2.3" forKey:@"version"];
+  NSDictionary *results = [NSDictionary dictionaryWithObject:@"/usr/bin/python"
+                                                      forKey:@"python"];
+  STAssertNil([cache resultsForKey:key], nil);
+
+  STAssertTrue([cache setResults:results
+                          forKey:key
+                dependingOnFiles:[NSArray arrayWithObject:file]], nil);
+  STAssertEqualObjects([cache resultsForKey:key], results, nil);
+
+  // A fresh cache object reads what was written.
+  MBRuntimeProbeCache *other = [[[MBRuntimeProbeCache alloc] initWithPath:path]
+                                 autorelease];
+  STAssertEqualObjects([other resultsForKey:key], results, nil);
+
+  // Different key; no results.
+  NSDictionary *key2 = [NSDictionary dictionaryWithObject:@"1.2.4" forKey:@"version"];
+  STAssertNil([cache resultsForKey:key2], nil);
+
+  // Changing a file invalidates.
+  [[@"two!" dataUsingEncoding:NSUTF8StringEncoding] writeToFile:file atomically:YES];
+  STAssertNil([cache resultsForKey:key], nil);
+
+  // Missing files can't be depended on.
+  STAssertFalse([cache setResults:results
+                           forKey:key
+                 dependingOnFiles:[NSArray arrayWithObject:@"/no/such/file"]], nil);
+  STAssertNil([cache resultsForKey:key], nil);
+
+  STAssertTrue([cache setResults:results forKey:key dependingOnFiles:nil], nil);
+  STAssertNotNil([cache resultsForKey:key], nil);
+  [cache removeResults];
+  STAssertNil([cache resultsForKey:key], nil);
+
+  NSFileManager *fm = [NSFileManager defaultManager];
+  [fm removeFileAtPath:dir handler:nil];
+  [fm removeFileAtPath:file handler:nil];
+}
+
+@end
@@ -0,0 +1,80 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import <Foundation/Foundation.h>
+@class MBEngineRuntime;
+@class MBProject;
+
+// MBRuntimeRegistry knows about every installed Engine runtime (a
+// GoogleAppEngine-*.bundle), so projects written against different
+// SDK versions can live side by side.  Bundles are indexed by name
+// (e.g. "GoogleAppEngine-default") when the registry is created; an
+// MBEngineRuntime is only created, and its contents (python, PYTHONPATH,
+// extraction...) only found, the first time a project asks for it.
+// Each runtime keeps its own probe cache, so a launch only pays for
+// the runtimes actually in use.
+//
+// Runtimes are looked for in the Launcher's Resources directory and in
+// ~/Library/Application Support/GoogleAppEngineLauncher/Runtimes.
+@interface MBRuntimeRegistry : NSObject {
+ @private
+  NSMutableArray *directories_;       // where to look for bundles
+  NSMutableDictionary *bundlePaths_;  // runtime name --> bundle path
+  NSMutableDictionary *runtimes_;     // runtime name --> MBEngineRuntime
+  NSString *defaultRuntimeName_;
+}
+
+// The registry used by the app.
++ (MBRuntimeRegistry *)sharedRegistry;
+
+// Return the name of the runtime in the bundle at |path|
+// (e.g. "GoogleAppEngine-default"), or nil if it isn't a runtime bundle.
++ (NSString *)runtimeNameForBundlePath:(NSString *)path;
+
+// Designated initializer.  |directories| are searched in order; if
+// two contain a runtime of the same name the first one wins.  The
+// default runtime is the first one found in the first directory.
+- (id)initWithDirectories:(NSArray *)directories;
+
+// Look for runtimes again (e.g. after an SDK was installed).  Runtimes
+// already created are kept.
+- (void)rescan;
+
+// Sorted names of every installed runtime.
+- (NSArray *)runtimeNames;
+
+// The runtime used by projects which aren't pinned to one (or are
+// pinned to one which is no longer installed).
+- (NSString *)defaultRuntimeName;
+- (MBEngineRuntime *)defaultRuntime;
+
+// Where the runtime called |name| is installed, or nil.
+- (NSString *)bundlePathForRuntime:(NSString *)name;
+
+// Return the (shared) runtime called |name|, creating it if needed,
+// or nil if there is no such runtime.  Its contents are not found
+// yet; see -[MBEngineRuntime findRuntimeContentsIfNeeded].
+- (MBEngineRuntime *)runtimeNamed:(NSString *)name;
+
+// Return the runtime |project| is pinned to, falling back to the
+// default runtime.  Like -runtimeNamed: this doesn't find its contents
+// (which may mean extracting it); callers on the main thread use
+// -[MBEngineRuntime findRuntimeContentsInBackgroundForTarget:selector:].
+- (MBEngineRuntime *)runtimeForProject:(MBProject *)project;
+
+// YES if the runtime called |name| has been created.
+- (BOOL)isRuntimeLoaded:(NSString *)name;
+
+@end
@@ -0,0 +1,170 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import "MBRuntimeRegistry.h"
+#import "MBEngineRuntime.h"
+#import "MBProject.h"
+
+static NSString *const kRuntimePrefix = @"GoogleAppEngine-";
+static NSString *const kRuntimeExtension = @"bundle";
+
+@implementation MBRuntimeRegistry
+
+static MBRuntimeRegistry *gSharedRegistry = nil;
+
++ (MBRuntimeRegistry *)sharedRegistry {
+  @synchronized(self) {
+    if (gSharedRegistry == nil) {
+      NSBundle *bundle = [NSBundle bundleForClass:[MBEngineRuntime class]];
+      NSString *support = [NSHomeDirectory() stringByAppendingPathComponent:
+                             @"Library/Application Support/GoogleAppEngineLauncher/Runtimes"];
+      NSArray *dirs = [NSArray arrayWithObjects:[bundle resourcePath], support, nil];
+      gSharedRegistry = [[self alloc] initWithDirectories:dirs];
+    }
+  }
+  return gSharedRegistry;
+}
+
++ (NSString *)runtimeNameForBundlePath:(NSString *)path {
+  NSString *file = [path lastPathComponent];
+  if (![file hasPrefix:kRuntimePrefix] ||
+      ![[file pathExtension] isEqual:kRuntimeExtension])
+    return nil;
+  return [file stringByDeletingPathExtension];
+}
+
+- (id)init {
+  return [self initWithDirectories:[NSArray array]];
+}
+
+- (id)initWithDirectories:(NSArray *)directories {
+  if ((self = [super init])) {
+    directories_ = [directories mutableCopy];
+    bundlePaths_ = [[NSMutableDictionary alloc] init];
+    runtimes_ = [[NSMutableDictionary alloc] init];
+    [self rescan];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [directories_ release];
+  [bundlePaths_ release];
+  [runtimes_ release];
+  [defaultRuntimeName_ release];
+  [super dealloc];
+}
+
+// Only looks at directory entries; bundles aren't opened until used.
+- (void)rescan {
+  NSFileManager *fm = [NSFileManager defaultManager];
+  NSMutableDictionary *paths = [NSMutableDictionary dictionary];
+  NSString *defaultName = nil;
+
+  NSEnumerator *dirEnum = [directories_ objectEnumerator];
+  NSString *dir = nil;
+  while ((dir = [dirEnum nextObject])) {
+    // Sorted so the default doesn't depend on the file system.
+    NSArray *contents = [[fm directoryContentsAtPath:dir]
+                          sortedArrayUsingSelector:@selector(compare:)];
+    NSEnumerator *fileEnum = [contents objectEnumerator];
+    NSString *file = nil;
+    while ((file = [fileEnum nextObject])) {
+      NSString *path = [dir stringByAppendingPathComponent:file];
+      NSString *name = [MBRuntimeRegistry runtimeNameForBundlePath:path];
+      if ((name == nil) || [paths objectForKey:name])
+        continue;
+      BOOL isDir = NO;
+      if (![fm fileExistsAtPath:path isDirectory:&isDir] || !isDir)
+        continue;
+      [paths setObject:path forKey:name];
+      if (defaultName == nil)
+        defaultName = name;
+    }
+  }
+
+  @synchronized(self) {
+    [bundlePaths_ setDictionary:paths];
+    [defaultRuntimeName_ autorelease];
+    defaultRuntimeName_ = [defaultName copy];
+  }
+}
+
+- (NSArray *)runtimeNames {
+  @synchronized(self) {
+    return [[bundlePaths_ allKeys] sortedArrayUsingSelector:@selector(compare:)];
+  }
+  return nil;  // not reached
+}
+
+- (NSString *)defaultRuntimeName {
+  @synchronized(self) {
+    return [[defaultRuntimeName_ retain] autorelease];
+  }
+  return nil;  // not reached
+}
+
+- (MBEngineRuntime *)defaultRuntime {
+  return [self runtimeNamed:[self defaultRuntimeName]];
+}
+
+- (NSString *)bundlePathForRuntime:(NSString *)name {
+  if (name == nil)
+    return nil;
+  @synchronized(self) {
+    return [[[bundlePaths_ objectForKey:name] retain] autorelease];
+  }
+  return nil;  // not reached
+}
+
+- (MBEngineRuntime *)runtimeNamed:(NSString *)name {
+  if (name == nil)
+    return nil;
+  @synchronized(self) {
+    MBEngineRuntime *runtime = [runtimes_ objectForKey:name];
+    if (runtime == nil) {
+      NSString *path = [bundlePaths_ objectForKey:name];
+      NSBundle *bundle = path ? [NSBundle bundleWithPath:path] : nil;
+      if (bundle == nil)
+        return nil;
+      runtime = [[[MBEngineRuntime alloc] initWithBundle:bundle] autorelease];
+      [runtimes_ setObject:runtime forKey:name];
+    }
+    return [[runtime retain] autorelease];
+  }
+  return nil;  // not reached
+}
+
+- (MBEngineRuntime *)runtimeForProject:(MBProject *)project {
+  NSString *name = [project runtime];
+  MBEngineRuntime *runtime = [self runtimeNamed:name];
+  if (runtime == nil) {
+    if (name != nil) {
+      GMLoggerInfo(@"Runtime %@ for %@ is not installed; using %@",
+                   name, [project name], [self defaultRuntimeName]);
+    }
+    runtime = [self defaultRuntime];
+  }
+  return runtime;
+}
+
+- (BOOL)isRuntimeLoaded:(NSString *)name {
+  @synchronized(self) {
+    return ([runtimes_ objectForKey:name] != nil);
+  }
+  return NO;  // not reached
+}
+
+@end
@@ -0,0 +1,132 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import <SenTestingKit/SenTestingKit.h>
+#import <Cocoa/Cocoa.h>
+#import "MBRuntimeRegistry.h"
+#import "MBRuntimeProbeCache.h"
+#import "MBEngineRuntime.h"
+#import "MBProject.h"
+#import "MBRuntimeRegistryTest.h"
+
+@implementation MBRuntimeRegistryTest
+
+// Make an empty runtime bundle called |name| in |dir|.
+- (void)makeBundle:(NSString *)name inDirectory:(NSString *)dir {
+  NSFileManager *fm = [NSFileManager defaultManager];
+  NSString *path = [dir stringByAppendingPathComponent:name];
+  [fm createDirectoryAtPath:path attributes:nil];
+  [fm createDirectoryAtPath:[path stringByAppendingPathComponent:@"Contents"]
+                 attributes:nil];
+}
+
+- (void)testNames {
+  STAssertEqualObjects([MBRuntimeRegistry runtimeNameForBundlePath:
+                                            @"/a/GoogleAppEngine-default.bundle"],
+                       @"GoogleAppEngine-default", nil);
+  STAssertNil([MBRuntimeRegistry runtimeNameForBundlePath:@"/a/Foo.bundle"], nil);
+  STAssertNil([MBRuntimeRegistry runtimeNameForBundlePath:
+                                   @"/a/GoogleAppEngine-default.zip"], nil);
+  STAssertNil([MBRuntimeRegistry runtimeNameForBundlePath:nil], nil);
+
+  NSString *path = [MBRuntimeProbeCache cachePathForRuntime:@"GoogleAppEngine-1.2"];
+  STAssertEqualObjects([path lastPathComponent],
+                       @"RuntimeProbe-GoogleAppEngine-1.2.plist", nil);
+  STAssertEqualObjects([MBRuntimeProbeCache cachePathForRuntime:nil],
+                       [MBRuntimeProbeCache defaultCachePath], nil);
+}
+
+- (void)testScan {
+  NSFileManager *fm = [NSFileManager defaultManager];
+  int pid = [[NSProcessInfo processInfo] processIdentifier];
+  NSString *top = [NSString stringWithFormat:@"/tmp/registrytest-%d", pid];
+  NSString *first = [top stringByAppendingPathComponent:@"first"];
+  NSString *second = [top stringByAppendingPathComponent:@"second"];
+  [fm createDirectoryAtPath:top attributes:nil];
+  [fm createDirectoryAtPath:first attributes:nil];
+  [fm createDirectoryAtPath:second attributes:nil];
+  [self makeBundle:@"GoogleAppEngine-1.2.bundle" inDirectory:first];
+  [self makeBundle:@"GoogleAppEngine-1.1.bundle" inDirectory:first];
+  [self makeBundle:@"GoogleAppEngine-1.1.bundle" inDirectory:second];
+  [self makeBundle:@"GoogleAppEngine-0.9.bundle" inDirectory:second];
+  [self makeBundle:@"Unrelated.bundle" inDirectory:second];
+  // Not a directory; ignored.
+  [[NSData data] writeToFile:[second stringByAppendingPathComponent:
+                                       @"GoogleAppEngine-0.1.bundle"]
+                  atomically:NO];
+
+  NSArray *dirs = [NSArray arrayWithObjects:first, second, nil];
+  MBRuntimeRegistry *registry = [[[MBRuntimeRegistry alloc]
+                                   initWithDirectories:dirs] autorelease];
+  NSArray *expected = [NSArray arrayWithObjects:@"GoogleAppEngine-0.9",
+                               @"GoogleAppEngine-1.1",
+                               @"GoogleAppEngine-1.2", nil];
+  STAssertEqualObjects([registry runtimeNames], expected, nil);
+  STAssertEqualObjects([registry defaultRuntimeName], @"GoogleAppEngine-1.1", nil);
+  // The first directory wins.
+  STAssertEqualObjects([registry bundlePathForRuntime:@"GoogleAppEngine-1.1"],
+                       [first stringByAppendingPathComponent:
+                                @"GoogleAppEngine-1.1.bundle"], nil);
+
+  // Nothing is created until asked for, and then only once.
+  STAssertFalse([registry isRuntimeLoaded:@"GoogleAppEngine-0.9"], nil);
+  MBEngineRuntime *runtime = [registry runtimeNamed:@"GoogleAppEngine-0.9"];
+  STAssertNotNil(runtime, nil);
+  STAssertEqualObjects([runtime name], @"GoogleAppEngine-0.9", nil);
+  STAssertFalse([runtime contentsFound], nil);
+  STAssertTrue([registry isRuntimeLoaded:@"GoogleAppEngine-0.9"], nil);
+  STAssertFalse([registry isRuntimeLoaded:@"GoogleAppEngine-1.2"], nil);
+  STAssertTrue(runtime == [registry runtimeNamed:@"GoogleAppEngine-0.9"], nil);
+  STAssertNil([registry runtimeNamed:@"GoogleAppEngine-2.0"], nil);
+  STAssertNil([registry runtimeNamed:nil], nil);
+
+  // Runtimes keep their probe results apart.
+  NSString *cachePath = [[runtime probeCache] path];
+  STAssertFalse([cachePath isEqual:[[[registry runtimeNamed:@"GoogleAppEngine-1.2"]
+                                      probeCache] path]], nil);
+
+  // A new install shows up on rescan; existing runtimes survive.
+  [self makeBundle:@"GoogleAppEngine-2.0.bundle" inDirectory:second];
+  STAssertNil([registry runtimeNamed:@"GoogleAppEngine-2.0"], nil);
+  [registry rescan];
+  STAssertNotNil([registry runtimeNamed:@"GoogleAppEngine-2.0"], nil);
+  STAssertTrue(runtime == [registry runtimeNamed:@"GoogleAppEngine-0.9"], nil);
+
+  [fm removeFileAtPath:top handler:nil];
+}
+
+- (void)testProjectRuntime {
+  MBRuntimeRegistry *registry = [MBRuntimeRegistry sharedRegistry];
+  MBProject *p = [MBProject projectWithName:@"name" path:@"/tmp" port:@"8000"];
+
+  // Unpinned, or pinned to something gone: the default.
+  MBEngineRuntime *runtime = [registry runtimeForProject:p];
+  STAssertTrue(runtime == [registry defaultRuntime], nil);
+  [p setRuntime:@"GoogleAppEngine-not-installed"];
+  STAssertTrue([registry runtimeForProject:p] == [registry defaultRuntime], nil);
+
+  [p setRuntime:[registry defaultRuntimeName]];
+  STAssertTrue([registry runtimeForProject:p] == [registry defaultRuntime], nil);
+}
+
+- (void)testSharedRegistry {
+  MBRuntimeRegistry *registry = [MBRuntimeRegistry sharedRegistry];
+  STAssertTrue(registry == [MBRuntimeRegistry sharedRegistry], nil);
+  STAssertNotNil([registry defaultRuntimeName], nil);
+  STAssertTrue([[registry runtimeNames] containsObject:[registry defaultRuntimeName]], nil);
+  STAssertTrue([MBEngineRuntime defaultRuntime] == [registry defaultRuntime], nil);
+}
+
+@end
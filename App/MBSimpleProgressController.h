@@ -31,5 +31,9 @@ limitations under the License.
 // Start the progress indicator running
 - (void)startAnimation;
 
+// Switch to a determinate progress bar and show |fraction| (0.0 -- 1.0)
+// of the work as done.
+- (void)setProgress:(double)fraction;
+
 @end
 
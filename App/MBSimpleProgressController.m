@@ -37,6 +37,17 @@ limitations under the License.
   [progressIndicator_ startAnimation:self];
 }
 
+- (void)setProgress:(double)fraction {
+  [self window];  // make sure nib is loaded (desired only for side effect)
+  if ([progressIndicator_ isIndeterminate]) {
+    [progressIndicator_ stopAnimation:self];
+    [progressIndicator_ setIndeterminate:NO];
+    [progressIndicator_ setMinValue:0.0];
+    [progressIndicator_ setMaxValue:1.0];
+  }
+  [progressIndicator_ setDoubleValue:fraction];
+}
+
 
 @end
 
@@ -35,6 +35,8 @@ limitations under the License.
   }
 
   [c startAnimation];  // not confirmed :-(
+  [c setProgress:0.5];
+  [c setProgress:1.0];
 }
 
 
@@ -0,0 +1,120 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import <Foundation/Foundation.h>
+#import <mach/mach.h>
+#import <pthread.h>
+#import "MBMetrics.h"
+
+struct MBStallPulse;
+
+// An MBStallWatchdog notices when the main thread stops servicing its
+// run loop for longer than a threshold (a "stall"), and writes a report
+// about each one to a file:
+//
+//   STALL<tab>action<tab>milliseconds<tab>date
+//     14 samples of the main thread; 11 like this:
+//        0 libSystem.B.dylib          __semwait_signal + 10
+//        1 Foundation                 -[NSConcreteTask waitUntilExit] + 151
+//        ...
+//
+// so "grep ^STALL" gives one line per stall, ready for ranking.
+//
+// A run loop observer on the main thread marks it busy from the time
+// the run loop wakes until it next waits.  A background thread checks
+// every |sampleInterval|.  Once the main thread has been busy in one
+// piece of work for |threshold|, the watchdog suspends the main thread
+// for a moment each check, copies the return addresses off its stack
+// and resumes it.  Stacks are symbolized after the stall is over (or,
+// for long ones, after 10 seconds so that a hang the user force-quits
+// still leaves a report).  Only i386 and x86_64 stacks are sampled;
+// elsewhere the reports have no stack.
+//
+// Only the default run loop mode counts as "servicing": a modal panel
+// stalls task output as surely as a blocking call does, so it is
+// reported as one.  Menu tracking and drags aren't.
+//
+// "action" is what the main thread was doing: the selector of the last
+// menu item chosen, or whatever was passed to MBStallWatchdogSetAction().
+// It's cleared whenever the main run loop goes idle.
+//
+// While running, the watchdog also publishes its stall count and times
+// as MBMetrics.
+@interface MBStallWatchdog : NSObject <MBMetricsCollector> {
+ @private
+  NSString *path_;
+  NSTimeInterval threshold_;
+  NSTimeInterval sampleInterval_;
+
+  // The main thread, as set up by -start.
+  struct MBStallPulse *pulse_;
+  CFRunLoopObserverRef observer_;
+  thread_act_t mainThread_;
+  uintptr_t stackLow_;
+  uintptr_t stackHigh_;
+
+  // Sampled stacks for the current stall.  Watchdog thread only.
+  uintptr_t *frames_;  // kMBStallMaxSamples * kMBStallMaxFrames
+  int *depths_;
+  int sampleCount_;
+
+  pthread_t thread_;
+  BOOL running_;
+  pthread_mutex_t lock_;
+  pthread_cond_t wake_;
+  BOOL stopping_;                   // guarded by |lock_|
+  NSMutableDictionary *stallTimes_;  // action -> NSNumber; |lock_|
+  unsigned stallCount_;              // guarded by |lock_|
+}
+
+// The watchdog the launcher uses: stalls of half a second or more,
+// reported to +defaultReportPath.
++ (MBStallWatchdog *)sharedWatchdog;
+
+// ~/Library/Logs/GoogleAppEngineLauncher/Stalls.log
++ (NSString *)defaultReportPath;
+
+// Designated initializer.  Appends reports to |path|.
+- (id)initWithPath:(NSString *)path
+         threshold:(NSTimeInterval)threshold
+    sampleInterval:(NSTimeInterval)sampleInterval;
+
+// Starts watching.  Must be called on the main thread.
+- (void)start;
+
+// Stops watching, and waits for the background thread.  A stall in
+// progress is not reported.
+- (void)stop;
+
+- (NSString *)path;
+
+// How many stalls have been reported, and their total length in
+// seconds by action.
+- (unsigned)stallCount;
+- (NSDictionary *)stallTimesByAction;
+
+@end
+
+// Names what the main thread is doing, for stall reports; NULL for
+// nothing in particular.  |action| must stay valid for the life of the
+// app (a string literal, __func__ or a selector name).  Returns the
+// previous action, so callers can put it back.  Does nothing (and
+// returns NULL) off the main thread, so code which runs on either can
+// use it freely:
+//
+//   const char *previous = MBStallWatchdogSetAction(__func__);
+//   ... something which may block ...
+//   MBStallWatchdogSetAction(previous);
+const char *MBStallWatchdogSetAction(const char *action);
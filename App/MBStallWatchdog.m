@@ -0,0 +1,432 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import "MBStallWatchdog.h"
+#import <AppKit/AppKit.h>
+#import <dlfcn.h>
+#import <errno.h>
+#import <libkern/OSAtomic.h>
+#import <mach/mach_time.h>
+#import <stdio.h>
+#import <string.h>
+#import <sys/stat.h>
+#import <sys/time.h>
+#import <time.h>
+
+enum {
+  kMBStallMaxSamples = 200,  // 10 seconds' worth at the default interval
+  kMBStallMaxFrames = 64,
+  kMBStallStacksReported = 3,
+};
+
+// A stall this long is reported while still going on.
+static const NSTimeInterval kMBStallOngoingReport = 10.0;
+
+// What the main run loop observer writes and the watchdog thread reads.
+struct MBStallPulse {
+  volatile int32_t activity;  // bumped on every main run loop activity
+  volatile int32_t busy;      // 0 while the main run loop waits
+};
+
+static const char *volatile gMBStallAction = NULL;
+
+const char *MBStallWatchdogSetAction(const char *action) {
+  if (!pthread_main_np())
+    return NULL;  // only the main thread's actions matter
+  const char *previous = gMBStallAction;
+  gMBStallAction = action;
+  return previous;
+}
+
+static void MBStallObserve(CFRunLoopObserverRef observer,
+                           CFRunLoopActivity activity, void *info) {
+  struct MBStallPulse *pulse = info;
+  if (activity == kCFRunLoopBeforeWaiting) {
+    pulse->busy = 0;
+    gMBStallAction = NULL;
+  } else {
+    pulse->busy = 1;
+  }
+  OSAtomicIncrement32Barrier(&pulse->activity);
+}
+
+static NSTimeInterval MBStallNow(void) {
+  static mach_timebase_info_data_t timebase;
+  if (timebase.denom == 0)
+    mach_timebase_info(&timebase);
+  return (double)mach_absolute_time() * timebase.numer / timebase.denom / 1e9;
+}
+
+// Registers differ in name between SDKs.
+#if __DARWIN_UNIX03
+#define MB_THREAD_REG(state, reg) ((state).__##reg)
+#else
+#define MB_THREAD_REG(state, reg) ((state).reg)
+#endif
+
+// Copies up to |max| return addresses from |thread|'s stack, which lies
+// in [low, high), into |frames|.  |thread| must be suspended.  No
+// allocation or locking, since the suspended thread may hold the locks.
+static int MBStallBacktrace(thread_act_t thread, uintptr_t low, uintptr_t high,
+                            uintptr_t *frames, int max) {
+  uintptr_t pc = 0, fp = 0;
+#if defined(__x86_64__)
+  x86_thread_state64_t state;
+  mach_msg_type_number_t count = x86_THREAD_STATE64_COUNT;
+  if (thread_get_state(thread, x86_THREAD_STATE64,
+                       (thread_state_t)&state, &count) != KERN_SUCCESS)
+    return 0;
+  pc = MB_THREAD_REG(state, rip);
+  fp = MB_THREAD_REG(state, rbp);
+#elif defined(__i386__)
+  i386_thread_state_t state;
+  mach_msg_type_number_t count = i386_THREAD_STATE_COUNT;
+  if (thread_get_state(thread, i386_THREAD_STATE,
+                       (thread_state_t)&state, &count) != KERN_SUCCESS)
+    return 0;
+  pc = MB_THREAD_REG(state, eip);
+  fp = MB_THREAD_REG(state, ebp);
+#else
+  return 0;
+#endif
+
+  int depth = 0;
+  frames[depth++] = pc;
+  // Each frame starts with the caller's frame pointer, then the
+  // return address.  Stop at anything that doesn't look like a frame.
+  while (depth < max) {
+    if ((fp < low) || (fp + 2 * sizeof(uintptr_t) > high) ||
+        (fp & (sizeof(uintptr_t) - 1)))
+      break;
+    uintptr_t next = ((uintptr_t *)fp)[0];
+    uintptr_t ret = ((uintptr_t *)fp)[1];
+    if (ret == 0)
+      break;
+    frames[depth++] = ret;
+    if (next <= fp)
+      break;
+    fp = next;
+  }
+  return depth;
+}
+
+@interface MBStallWatchdog (PrivateMethods)
+- (void)run;
+- (void)sample;
+- (void)reportStallOfAction:(const char *)action
+                   duration:(NSTimeInterval)duration
+                    ongoing:(BOOL)ongoing;
+- (void)menuWillSendAction:(NSNotification *)notification;
+@end
+
+static void *MBStallWatchdogThread(void *arg) {
+  [(MBStallWatchdog *)arg run];
+  return NULL;
+}
+
+static MBStallWatchdog *gSharedWatchdog = nil;
+
+@implementation MBStallWatchdog
+
++ (MBStallWatchdog *)sharedWatchdog {
+  @synchronized(self) {
+    if (gSharedWatchdog == nil) {
+      gSharedWatchdog = [[self alloc] initWithPath:[self defaultReportPath]
+                                         threshold:0.5
+                                    sampleInterval:0.05];
+    }
+  }
+  return gSharedWatchdog;
+}
+
++ (NSString *)defaultReportPath {
+  return [NSHomeDirectory() stringByAppendingPathComponent:
+                             @"Library/Logs/GoogleAppEngineLauncher/Stalls.log"];
+}
+
+- (id)init {
+  return [self initWithPath:[[self class] defaultReportPath]
+                  threshold:0.5
+             sampleInterval:0.05];
+}
+
+- (id)initWithPath:(NSString *)path
+         threshold:(NSTimeInterval)threshold
+    sampleInterval:(NSTimeInterval)sampleInterval {
+  if ((self = [super init])) {
+    path_ = [path copy];
+    threshold_ = threshold;
+    sampleInterval_ = sampleInterval;
+    pulse_ = calloc(1, sizeof(*pulse_));
+    pulse_->busy = 1;  // until the run loop says otherwise
+    frames_ = calloc(kMBStallMaxSamples * kMBStallMaxFrames, sizeof(*frames_));
+    depths_ = calloc(kMBStallMaxSamples, sizeof(*depths_));
+    pthread_mutex_init(&lock_, NULL);
+    pthread_cond_init(&wake_, NULL);
+    stallTimes_ = [[NSMutableDictionary alloc] init];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [self stop];
+  pthread_mutex_destroy(&lock_);
+  pthread_cond_destroy(&wake_);
+  free(pulse_);
+  free(frames_);
+  free(depths_);
+  [stallTimes_ release];
+  [path_ release];
+  [super dealloc];
+}
+
+- (void)start {
+  GMAssert(pthread_main_np(), @"MBStallWatchdog must be started on the main thread");
+  if (running_)
+    return;
+  pthread_t main = pthread_self();
+  mainThread_ = pthread_mach_thread_np(main);
+  stackHigh_ = (uintptr_t)pthread_get_stackaddr_np(main);
+  stackLow_ = stackHigh_ - pthread_get_stacksize_np(main);
+
+  CFRunLoopObserverContext context = { 0, pulse_, NULL, NULL, NULL };
+  observer_ = CFRunLoopObserverCreate(kCFAllocatorDefault,
+                                      kCFRunLoopAllActivities,
+                                      YES, 0, MBStallObserve, &context);
+  CFRunLoopRef runLoop = CFRunLoopGetCurrent();
+  CFRunLoopAddObserver(runLoop, observer_, kCFRunLoopDefaultMode);
+  CFRunLoopAddObserver(runLoop, observer_,
+                       (CFStringRef)NSEventTrackingRunLoopMode);
+  [[NSNotificationCenter defaultCenter]
+    addObserver:self
+       selector:@selector(menuWillSendAction:)
+           name:NSMenuWillSendActionNotification
+         object:nil];
+
+  stopping_ = NO;
+  running_ = (pthread_create(&thread_, NULL, MBStallWatchdogThread, self) == 0);
+  [[MBMetrics sharedMetrics] addCollector:self];
+}
+
+- (void)stop {
+  [[MBMetrics sharedMetrics] removeCollector:self];
+  if (observer_) {
+    CFRunLoopObserverInvalidate(observer_);
+    CFRelease(observer_);
+    observer_ = NULL;
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
+  }
+  if (running_) {
+    pthread_mutex_lock(&lock_);
+    stopping_ = YES;
+    pthread_cond_signal(&wake_);
+    pthread_mutex_unlock(&lock_);
+    pthread_join(thread_, NULL);
+    running_ = NO;
+  }
+}
+
+- (NSString *)path {
+  return [[path_ retain] autorelease];
+}
+
+- (unsigned)stallCount {
+  pthread_mutex_lock(&lock_);
+  unsigned count = stallCount_;
+  pthread_mutex_unlock(&lock_);
+  return count;
+}
+
+- (NSDictionary *)stallTimesByAction {
+  pthread_mutex_lock(&lock_);
+  NSDictionary *times = [[stallTimes_ copy] autorelease];
+  pthread_mutex_unlock(&lock_);
+  return times;
+}
+
+- (void)collectMetrics:(MBMetrics *)metrics {
+  [metrics setValue:[self stallCount]
+          forMetric:@"launcher_main_thread_stalls_total"
+             labels:nil];
+  NSDictionary *times = [self stallTimesByAction];
+  NSEnumerator *actionEnumerator = [times keyEnumerator];
+  NSString *action = nil;
+  while ((action = [actionEnumerator nextObject])) {
+    [metrics setValue:[[times objectForKey:action] doubleValue]
+            forMetric:@"launcher_main_thread_stall_seconds_total"
+               labels:[NSDictionary dictionaryWithObject:action
+                                                  forKey:@"action"]];
+  }
+}
+
+@end  // MBStallWatchdog
+
+
+@implementation MBStallWatchdog (PrivateMethods)
+
+- (void)run {
+  int32_t lastActivity = pulse_->activity;
+  NSTimeInterval lastChange = MBStallNow();
+  BOOL stalled = NO;
+  BOOL reportedOngoing = NO;
+  const char *action = NULL;
+
+  pthread_mutex_lock(&lock_);
+  while (!stopping_) {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    double wake = now.tv_sec + now.tv_usec / 1e6 + sampleInterval_;
+    struct timespec deadline;
+    deadline.tv_sec = (time_t)wake;
+    deadline.tv_nsec = (long)((wake - deadline.tv_sec) * 1e9);
+    pthread_cond_timedwait(&wake_, &lock_, &deadline);
+    if (stopping_)
+      break;
+    pthread_mutex_unlock(&lock_);
+
+    NSTimeInterval t = MBStallNow();
+    int32_t activity = pulse_->activity;
+    if ((activity != lastActivity) || !pulse_->busy) {
+      if (stalled) {
+        NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+        [self reportStallOfAction:action duration:t - lastChange ongoing:NO];
+        [pool release];
+      }
+      stalled = NO;
+      lastActivity = activity;
+      lastChange = t;
+    } else if (!stalled && (t - lastChange >= threshold_)) {
+      stalled = YES;
+      reportedOngoing = NO;
+      action = gMBStallAction;
+      sampleCount_ = 0;
+    }
+    if (stalled) {
+      [self sample];
+      if (!reportedOngoing && (t - lastChange >= kMBStallOngoingReport)) {
+        NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+        [self reportStallOfAction:action duration:t - lastChange ongoing:YES];
+        [pool release];
+        reportedOngoing = YES;
+      }
+    }
+
+    pthread_mutex_lock(&lock_);
+  }
+  pthread_mutex_unlock(&lock_);
+}
+
+// Keep the first samples of a long stall; they're as good as any.
+- (void)sample {
+  if (sampleCount_ >= kMBStallMaxSamples)
+    return;
+  if (thread_suspend(mainThread_) != KERN_SUCCESS)
+    return;
+  int depth = MBStallBacktrace(mainThread_, stackLow_, stackHigh_,
+                               frames_ + sampleCount_ * kMBStallMaxFrames,
+                               kMBStallMaxFrames);
+  thread_resume(mainThread_);
+  depths_[sampleCount_++] = depth;
+}
+
+- (void)reportStallOfAction:(const char *)action
+                   duration:(NSTimeInterval)duration
+                    ongoing:(BOOL)ongoing {
+  NSString *name = action ? [NSString stringWithUTF8String:action]
+                          : @"(unknown)";
+  if (!ongoing) {
+    pthread_mutex_lock(&lock_);
+    stallCount_++;
+    NSNumber *total = [stallTimes_ objectForKey:name];
+    [stallTimes_ setObject:[NSNumber numberWithDouble:
+                                      [total doubleValue] + duration]
+                    forKey:name];
+    pthread_mutex_unlock(&lock_);
+  }
+
+  const char *path = [path_ fileSystemRepresentation];
+  NSString *dir = [path_ stringByDeletingLastPathComponent];
+  mkdir([dir fileSystemRepresentation], 0755);
+  FILE *out = fopen(path, "a");
+  if (out == NULL)
+    return;
+
+  // We're on the watchdog thread; localtime()'s buffer is shared.
+  char date[64];
+  time_t now = time(NULL);
+  struct tm local;
+  localtime_r(&now, &local);
+  strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", &local);
+  fprintf(out, "STALL\t%s\t%.0f\t%s%s\n", [name UTF8String], duration * 1000,
+          date, ongoing ? "\tongoing" : "");
+
+  // The most common stacks first.  There are few enough samples to
+  // compare them all.
+  int counts[kMBStallMaxSamples];
+  for (int i = 0; i < sampleCount_; i++) {
+    counts[i] = 0;
+    for (int j = 0; j < sampleCount_; j++) {
+      if ((depths_[i] == depths_[j]) &&
+          (memcmp(frames_ + i * kMBStallMaxFrames, frames_ + j * kMBStallMaxFrames,
+                  depths_[i] * sizeof(*frames_)) == 0))
+        counts[i]++;
+    }
+  }
+  BOOL shown[kMBStallMaxSamples];
+  memset(shown, 0, sizeof(shown));
+  for (int n = 0; n < kMBStallStacksReported; n++) {
+    int best = -1;
+    for (int i = 0; i < sampleCount_; i++) {
+      if (!shown[i] && (depths_[i] > 0) &&
+          ((best < 0) || (counts[i] > counts[best])))
+        best = i;
+    }
+    if (best < 0)
+      break;
+    // Don't show this stack again.
+    for (int i = 0; i < sampleCount_; i++) {
+      if ((depths_[i] == depths_[best]) &&
+          (memcmp(frames_ + i * kMBStallMaxFrames,
+                  frames_ + best * kMBStallMaxFrames,
+                  depths_[i] * sizeof(*frames_)) == 0))
+        shown[i] = YES;
+    }
+    fprintf(out, "  %d samples of the main thread; %d like this:\n",
+            sampleCount_, counts[best]);
+    for (int f = 0; f < depths_[best]; f++) {
+      uintptr_t pc = frames_[best * kMBStallMaxFrames + f];
+      Dl_info info;
+      if (dladdr((void *)pc, &info) && info.dli_sname) {
+        const char *image = strrchr(info.dli_fname, '/');
+        fprintf(out, "    %2d %-26s %s + %lu\n", f,
+                image ? image + 1 : info.dli_fname, info.dli_sname,
+                (unsigned long)(pc - (uintptr_t)info.dli_saddr));
+      } else {
+        fprintf(out, "    %2d %-26s 0x%lx\n", f, "???", (unsigned long)pc);
+      }
+    }
+  }
+  fputc('\n', out);
+  fclose(out);
+}
+
+- (void)menuWillSendAction:(NSNotification *)notification {
+  NSMenuItem *item = [[notification userInfo] objectForKey:@"MenuItem"];
+  SEL action = [item action];
+  if (action)
+    MBStallWatchdogSetAction(sel_getName(action));
+}
+
+@end  // PrivateMethods
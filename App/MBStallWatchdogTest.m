@@ -0,0 +1,93 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import <SenTestingKit/SenTestingKit.h>
+#import <Cocoa/Cocoa.h>
+#import "MBStallWatchdog.h"
+#import "MBStallWatchdogTest.h"
+
+@implementation MBStallWatchdogTest
+
+- (void)setUp {
+  path_ = [[NSTemporaryDirectory() stringByAppendingPathComponent:
+            [NSString stringWithFormat:@"MBStallWatchdogTest-%d.log",
+             getpid()]] retain];
+  [[NSFileManager defaultManager] removeFileAtPath:path_ handler:nil];
+}
+
+- (void)tearDown {
+  [[NSFileManager defaultManager] removeFileAtPath:path_ handler:nil];
+  [path_ release];
+}
+
+- (void)runLoopFor:(NSTimeInterval)seconds {
+  [[NSRunLoop currentRunLoop]
+    runUntilDate:[NSDate dateWithTimeIntervalSinceNow:seconds]];
+}
+
+- (void)stallForTest {
+  const char *previous = MBStallWatchdogSetAction("stallForTest");
+  usleep(500 * 1000);
+  MBStallWatchdogSetAction(previous);
+}
+
+- (void)testSetAction {
+  const char *saved = MBStallWatchdogSetAction("one");
+  STAssertTrue(strcmp(MBStallWatchdogSetAction("two"), "one") == 0, nil);
+  STAssertTrue(strcmp(MBStallWatchdogSetAction(saved), "two") == 0, nil);
+}
+
+- (void)testNoStallWhenIdle {
+  MBStallWatchdog *watchdog = [[[MBStallWatchdog alloc]
+                                 initWithPath:path_
+                                    threshold:0.1
+                               sampleInterval:0.01] autorelease];
+  [watchdog start];
+  // Waiting in the run loop isn't stalling it.
+  [self runLoopFor:0.5];
+  [watchdog stop];
+  STAssertEquals([watchdog stallCount], (unsigned)0, nil);
+  STAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:path_], nil);
+}
+
+- (void)testStallReport {
+  MBStallWatchdog *watchdog = [[[MBStallWatchdog alloc]
+                                 initWithPath:path_
+                                    threshold:0.1
+                               sampleInterval:0.01] autorelease];
+  [watchdog start];
+  [self performSelector:@selector(stallForTest) withObject:nil afterDelay:0.1];
+  [self runLoopFor:1.0];
+  [watchdog stop];
+
+  STAssertEquals([watchdog stallCount], (unsigned)1, nil);
+  NSNumber *seconds = [[watchdog stallTimesByAction]
+                        objectForKey:@"stallForTest"];
+  STAssertNotNil(seconds, [[watchdog stallTimesByAction] description]);
+  STAssertTrue([seconds doubleValue] >= 0.3 && [seconds doubleValue] < 1.0,
+               [seconds description]);
+
+  NSString *report = [NSString stringWithContentsOfFile:path_];
+  STAssertTrue([report hasPrefix:@"STALL\tstallForTest\t"], report);
+#if defined(__i386__) || defined(__x86_64__)
+  // The stack shows where we were stuck.
+  STAssertTrue([report rangeOfString:@"samples of the main thread"].location !=
+               NSNotFound, report);
+  STAssertTrue([report rangeOfString:@"stallForTest]"].location !=
+               NSNotFound, report);
+#endif
+}
+
+@end
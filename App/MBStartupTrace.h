@@ -0,0 +1,119 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import <Foundation/Foundation.h>
+#import "MBTraceRecorder.h"
+
+struct MBTraceBuffer;
+
+// An MBStartupTrace records how long each phase of the launcher's start
+// up takes, as nested spans, and prints them as a timeline:
+//
+//   process start to main: 180.2ms
+//      start   length  thread  phase
+//      0.000 2912.441  main    startup
+//      0.010  640.102  main      loadMainNib
+//      2.311  402.816  main        -[MBProjectArrayController loadProjects]
+//   ...
+//   slowest (own time, without the phases inside them):
+//   1630.177ms  extract
+//
+// Spans are begun and ended with MBTraceBegin() and MBTraceEnd(), or
+// MB_TRACE_SCOPE() (or MB_TRACE_EVENT_SCOPE() from MBTraceRecorder.h,
+// which goes to both) for the rest of a block. Each thread keeps its own
+// stack of open spans, so spans nest per thread and threads can be told
+// apart. Times come from mach_absolute_time(), which doesn't jump with
+// the wall clock. Only the trace which has been started and not yet
+// finished records anything; the rest of the time MBTraceBegin() just
+// checks a pointer, so the calls can stay in code which runs long after
+// start up.
+//
+// At launch, main() calls +traceLaunch and -[MBTaskArrayController
+// didFinishLaunching] calls +launchFinished once the run loop next goes
+// round. The summary is logged (at info level) every launch. The whole
+// timeline is written to +defaultTimelinePath when the MBStartupTrace
+// default is set, and, with the timeline also going to stdout, when
+// MBExitAfterStartup is set, which quits once start up is over:
+//
+//   .../Contents/MacOS/GoogleAppEngineLauncher -MBExitAfterStartup YES
+//
+// For a running app, MBStartupTraceDump() prints the last timeline to
+// stderr, e.g. from gdb: "call (void)MBStartupTraceDump()".
+@interface MBStartupTrace : NSObject {
+ @private
+  struct MBTraceBuffer *buffer_;
+  int rootSpan_;
+  int nibSpan_;
+  double preMain_;  // milliseconds from process start to -start, or -1
+  BOOL finished_;
+}
+
+// The trace of this launch.
++ (MBStartupTrace *)sharedTrace;
+
+// ~/Library/Logs/GoogleAppEngineLauncher/Startup.log
++ (NSString *)defaultTimelinePath;
+
+// Starts the shared trace, with a "loadMainNib" span lasting until
+// NSApplicationWillFinishLaunchingNotification. Call first thing in main().
++ (void)traceLaunch;
+
+// Finishes the shared trace, logs its summary and writes or prints the
+// timeline, and quits, as the defaults above say.
++ (void)launchFinished;
+
+// Starts recording into this trace, with a root span named "startup".
+// Only one trace records at a time; starting another finishes this one.
+- (void)start;
+
+// Ends the root span (and any still open on this thread) and stops
+// recording. Spans left open on other threads show as unfinished.
+- (void)finish;
+- (BOOL)isFinished;
+
+// The timeline shown above, spans in order of starting.
+- (NSString *)timeline;
+
+// The slowest few phases, one line.
+- (NSString *)summary;
+
+// Writes -timeline to |path|. Returns NO if it can't.
+- (BOOL)writeTimelineToPath:(NSString *)path;
+
+@end
+
+// Opens a span named |name| (copied) on this thread and returns it, or -1
+// if nothing is being recorded.
+int MBTraceBegin(const char *name);
+
+// Closes |span| and any spans opened inside it on this thread and not
+// closed. Does nothing for -1.
+void MBTraceEnd(int span);
+
+// Opens a span which closes when the enclosing block is left, however it
+// is left (except by an exception):
+//
+//   - (void)verifyAllProjects:(id)sender {
+//     MB_TRACE_SCOPE(__func__);
+//     ...
+//
+// The span is also recorded by MBTraceRecorder, in the "launcher"
+// category, so |name| must be a string constant. A site which wants a
+// category of its own uses MB_TRACE_EVENT_SCOPE() instead; it doesn't
+// need both.
+#define MB_TRACE_SCOPE(name) MB_TRACE_EVENT_SCOPE("launcher", name)
+
+// Prints the shared trace's timeline to stderr.
+void MBStartupTraceDump(void);
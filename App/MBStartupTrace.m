@@ -0,0 +1,449 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import <Cocoa/Cocoa.h>
+#import "MBStartupTrace.h"
+#import <libkern/OSAtomic.h>
+#import <mach/mach_time.h>
+#import <pthread.h>
+#import <stdio.h>
+#import <stdlib.h>
+#import <string.h>
+#import <sys/stat.h>
+#import <sys/sysctl.h>
+#import <sys/time.h>
+#import <unistd.h>
+
+static NSString *const kMBStartupTraceKey = @"MBStartupTrace";
+static NSString *const kMBExitAfterStartupKey = @"MBExitAfterStartup";
+
+#define kMBTraceMaxSpans 1024
+#define kMBTraceNameLength 64
+#define kMBTraceMaxDepth 32
+#define kMBTraceSlowest 5
+
+typedef struct {
+  char name[kMBTraceNameLength];
+  uint64_t start;      // mach_absolute_time(); 0 until set
+  uint64_t end;        // 0 while open
+  int parent;          // index of the span it's inside, or -1
+  int depth;
+  mach_port_t thread;
+  int mainThread;
+} MBTraceSpan;
+
+struct MBTraceBuffer {
+  int32_t generation;
+  volatile int32_t count;  // spans handed out; may pass kMBTraceMaxSpans
+  MBTraceSpan spans[kMBTraceMaxSpans];
+};
+
+// Each thread's open spans, innermost last.
+typedef struct {
+  int32_t generation;  // of the buffer |spans| index; others are stale
+  int depth;
+  int spans[kMBTraceMaxDepth];
+} MBTraceStack;
+
+// The buffer last started, and whether it's still recording. A span is
+// its buffer's generation * kMBTraceMaxSpans + its index, so ends meant
+// for an older buffer are ignored.
+static struct MBTraceBuffer *volatile gBuffer = NULL;
+static volatile int32_t gRecording = 0;
+static volatile int32_t gGeneration = 0;
+
+static pthread_key_t gStackKey;
+static pthread_once_t gStackKeyOnce = PTHREAD_ONCE_INIT;
+
+static void MBTraceCreateStackKey(void) {
+  pthread_key_create(&gStackKey, free);
+}
+
+static MBTraceStack *MBTraceCurrentStack(struct MBTraceBuffer *buffer) {
+  pthread_once(&gStackKeyOnce, MBTraceCreateStackKey);
+  MBTraceStack *stack = pthread_getspecific(gStackKey);
+  if (stack == NULL) {
+    stack = calloc(1, sizeof(MBTraceStack));
+    if (stack == NULL)
+      return NULL;
+    pthread_setspecific(gStackKey, stack);
+  }
+  if (stack->generation != buffer->generation) {
+    stack->generation = buffer->generation;
+    stack->depth = 0;
+  }
+  return stack;
+}
+
+int MBTraceBegin(const char *name) {
+  struct MBTraceBuffer *buffer = gBuffer;
+  if (!gRecording || buffer == NULL)
+    return -1;
+  int index = OSAtomicIncrement32Barrier(&buffer->count) - 1;
+  if (index >= kMBTraceMaxSpans)
+    return -1;
+  MBTraceStack *stack = MBTraceCurrentStack(buffer);
+  if (stack == NULL)
+    return -1;
+
+  MBTraceSpan *span = &buffer->spans[index];
+  strlcpy(span->name, name ? name : "?", sizeof(span->name));
+  span->parent = stack->depth ? stack->spans[stack->depth - 1] : -1;
+  span->depth = stack->depth;
+  span->thread = pthread_mach_thread_np(pthread_self());
+  span->mainThread = pthread_main_np();
+  span->end = 0;
+  if (stack->depth < kMBTraceMaxDepth)
+    stack->spans[stack->depth++] = index;
+  OSMemoryBarrier();
+  span->start = mach_absolute_time();
+  return buffer->generation * kMBTraceMaxSpans + index;
+}
+
+void MBTraceEnd(int span) {
+  struct MBTraceBuffer *buffer = gBuffer;
+  if (span < 0 || buffer == NULL ||
+      span / kMBTraceMaxSpans != buffer->generation)
+    return;
+  int index = span % kMBTraceMaxSpans;
+  uint64_t now = mach_absolute_time();
+  buffer->spans[index].end = now;
+
+  MBTraceStack *stack = MBTraceCurrentStack(buffer);
+  if (stack == NULL)
+    return;
+  for (int d = stack->depth - 1; d >= 0; d--) {
+    if (stack->spans[d] != index)
+      continue;
+    // Anything opened inside it and left open ends with it.
+    for (int inner = d + 1; inner < stack->depth; inner++) {
+      if (buffer->spans[stack->spans[inner]].end == 0)
+        buffer->spans[stack->spans[inner]].end = now;
+    }
+    stack->depth = d;
+    break;
+  }
+}
+
+void MBStartupTraceDump(void) {
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  fputs([[[MBStartupTrace sharedTrace] timeline] UTF8String], stderr);
+  [pool release];
+}
+
+static double MBTraceMilliseconds(uint64_t ticks) {
+  static mach_timebase_info_data_t timebase;
+  if (timebase.denom == 0)
+    mach_timebase_info(&timebase);
+  return (double)ticks * timebase.numer / timebase.denom / 1e6;
+}
+
+// Milliseconds from this process starting to now, or -1.
+static double MBTraceTimeSinceProcessStart(void) {
+  int mib[4] = { CTL_KERN, KERN_PROC, KERN_PROC_PID, getpid() };
+  struct kinfo_proc info;
+  size_t size = sizeof(info);
+  if (sysctl(mib, 4, &info, &size, NULL, 0) != 0 || size == 0)
+    return -1;
+  struct timeval started = info.kp_proc.p_starttime;
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return (now.tv_sec - started.tv_sec) * 1e3 +
+         (now.tv_usec - started.tv_usec) / 1e3;
+}
+
+// For sorting span indexes by start time; guarded by @synchronized on the
+// class.
+static MBTraceSpan *gSortSpans = NULL;
+
+static int MBTraceCompareStarts(const void *a, const void *b) {
+  uint64_t x = gSortSpans[*(const int *)a].start;
+  uint64_t y = gSortSpans[*(const int *)b].start;
+  return (x < y) ? -1 : (x > y);
+}
+
+@interface MBStartupTrace (PrivateMethods)
+- (void)willFinishLaunching:(NSNotification *)notification;
+- (int)copySpans:(MBTraceSpan *)spans sorted:(int *)order;
+@end
+
+static MBStartupTrace *gSharedTrace = nil;
+
+@implementation MBStartupTrace
+
++ (MBStartupTrace *)sharedTrace {
+  @synchronized(self) {
+    if (gSharedTrace == nil)
+      gSharedTrace = [[self alloc] init];
+  }
+  return gSharedTrace;
+}
+
++ (NSString *)defaultTimelinePath {
+  return [NSHomeDirectory() stringByAppendingPathComponent:
+                             @"Library/Logs/GoogleAppEngineLauncher/Startup.log"];
+}
+
++ (void)traceLaunch {
+  MBStartupTrace *trace = [self sharedTrace];
+  trace->preMain_ = MBTraceTimeSinceProcessStart();
+  [trace start];
+  trace->nibSpan_ = MBTraceBegin("loadMainNib");
+  [[NSNotificationCenter defaultCenter]
+    addObserver:trace
+       selector:@selector(willFinishLaunching:)
+           name:NSApplicationWillFinishLaunchingNotification
+         object:nil];
+}
+
++ (void)launchFinished {
+  MBStartupTrace *trace = [self sharedTrace];
+  if ([trace isFinished])
+    return;
+  [trace finish];
+  GMLoggerInfo(@"Startup: %@", [trace summary]);
+
+  NSUserDefaults *defaults = [NSUserDefaults standardUserDefaults];
+  BOOL exitAfterStartup = [defaults boolForKey:kMBExitAfterStartupKey];
+  if (exitAfterStartup || [defaults boolForKey:kMBStartupTraceKey]) {
+    NSString *path = [self defaultTimelinePath];
+    mkdir([[path stringByDeletingLastPathComponent] fileSystemRepresentation],
+          0755);
+    if (![trace writeTimelineToPath:path])
+      GMLoggerInfo(@"Can't write the startup timeline to %@", path);
+  }
+  if (exitAfterStartup) {
+    fputs([[trace timeline] UTF8String], stdout);
+    fflush(stdout);
+    [NSApp terminate:nil];
+  }
+}
+
+- (id)init {
+  if ((self = [super init])) {
+    buffer_ = calloc(1, sizeof(struct MBTraceBuffer));
+    if (buffer_ == NULL) {
+      [self release];
+      return nil;
+    }
+    rootSpan_ = nibSpan_ = -1;
+    preMain_ = -1;
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [[NSNotificationCenter defaultCenter] removeObserver:self];
+  if (gBuffer == buffer_) {
+    gRecording = 0;
+    gBuffer = NULL;
+    OSMemoryBarrier();
+  }
+  free(buffer_);
+  [super dealloc];
+}
+
+- (void)start {
+  buffer_->generation = OSAtomicIncrement32Barrier(&gGeneration);
+  buffer_->count = 0;
+  finished_ = NO;
+  gBuffer = buffer_;
+  OSMemoryBarrier();
+  gRecording = 1;
+  rootSpan_ = MBTraceBegin("startup");
+}
+
+- (void)finish {
+  if (gBuffer != buffer_ || finished_)
+    return;
+  MBTraceEnd(rootSpan_);
+  gRecording = 0;
+  OSMemoryBarrier();
+  finished_ = YES;
+}
+
+- (BOOL)isFinished {
+  return finished_;
+}
+
+- (NSString *)timeline {
+  MBTraceSpan *spans = calloc(kMBTraceMaxSpans, sizeof(MBTraceSpan));
+  int *order = calloc(kMBTraceMaxSpans, sizeof(int));
+  if (spans == NULL || order == NULL) {
+    free(spans);
+    free(order);
+    return @"";
+  }
+  int count = [self copySpans:spans sorted:order];
+  NSMutableString *timeline = [NSMutableString string];
+  if (preMain_ >= 0)
+    [timeline appendFormat:@"process start to main: %.1fms\n", preMain_];
+  if (count == 0) {
+    [timeline appendString:@"no spans recorded\n"];
+    free(spans);
+    free(order);
+    return timeline;
+  }
+
+  // Times are from the first span's start; open ones run up to now.
+  uint64_t origin = spans[order[0]].start;
+  uint64_t now = mach_absolute_time();
+  mach_port_t threads[kMBTraceMaxSpans];
+  int threadCount = 0;
+  [timeline appendString:@"   start   length  thread  phase\n"];
+  for (int i = 0; i < count; i++) {
+    MBTraceSpan *span = &spans[order[i]];
+    char thread[16] = "main";
+    if (!span->mainThread) {
+      int t = 0;
+      while (t < threadCount && threads[t] != span->thread)
+        t++;
+      if (t == threadCount)
+        threads[threadCount++] = span->thread;
+      snprintf(thread, sizeof(thread), "#%d", t + 1);
+    }
+    uint64_t end = span->end ? span->end : now;
+    NSString *indent = [@"" stringByPaddingToLength:span->depth * 2
+                                         withString:@" "
+                                    startingAtIndex:0];
+    [timeline appendFormat:@"%8.3f %8.3f  %-6s  %@%s%s\n",
+              MBTraceMilliseconds(span->start - origin),
+              MBTraceMilliseconds(end - span->start),
+              thread, indent, span->name,
+              (span->end ? "" : " (unfinished)")];
+  }
+  int recorded = buffer_->count;
+  if (recorded > kMBTraceMaxSpans)
+    [timeline appendFormat:@"(%d more spans not recorded)\n",
+              recorded - kMBTraceMaxSpans];
+
+  // Own time: each finished span less the spans directly inside it.
+  double *own = calloc(kMBTraceMaxSpans, sizeof(double));
+  if (own) {
+    for (int i = 0; i < count; i++) {
+      MBTraceSpan *span = &spans[order[i]];
+      if (span->end == 0)
+        continue;
+      double length = MBTraceMilliseconds(span->end - span->start);
+      own[order[i]] += length;
+      if (span->parent >= 0)
+        own[span->parent] -= length;
+    }
+    [timeline appendString:@"slowest (own time, without the phases inside "
+                           @"them):\n"];
+    BOOL *shown = calloc(kMBTraceMaxSpans, sizeof(BOOL));
+    for (int n = 0; shown && n < kMBTraceSlowest; n++) {
+      int slowest = -1;
+      for (int i = 0; i < count; i++) {
+        int index = order[i];
+        if (!shown[index] && spans[index].end &&
+            (slowest < 0 || own[index] > own[slowest]))
+          slowest = index;
+      }
+      if (slowest < 0)
+        break;
+      shown[slowest] = YES;
+      [timeline appendFormat:@"%9.3fms  %s\n", own[slowest],
+                spans[slowest].name];
+    }
+    free(shown);
+    free(own);
+  }
+  free(spans);
+  free(order);
+  return timeline;
+}
+
+- (NSString *)summary {
+  MBTraceSpan *spans = calloc(kMBTraceMaxSpans, sizeof(MBTraceSpan));
+  int *order = calloc(kMBTraceMaxSpans, sizeof(int));
+  int count = (spans && order) ? [self copySpans:spans sorted:order] : 0;
+  NSMutableString *summary = [NSMutableString string];
+  if (count == 0) {
+    [summary appendString:@"not traced"];
+  } else {
+    MBTraceSpan *root = &spans[order[0]];
+    if (root->end)
+      [summary appendFormat:@"%s %.0fms", root->name,
+               MBTraceMilliseconds(root->end - root->start)];
+    else
+      [summary appendFormat:@"%s unfinished", root->name];
+    // The longest phases just inside the root.
+    BOOL *shown = calloc(kMBTraceMaxSpans, sizeof(BOOL));
+    for (int n = 0; shown && n < 3; n++) {
+      int slowest = -1;
+      uint64_t slowestLength = 0;
+      for (int i = 1; i < count; i++) {
+        MBTraceSpan *span = &spans[order[i]];
+        uint64_t length = span->end ? span->end - span->start : 0;
+        if (!shown[order[i]] && span->parent == order[0] &&
+            length > slowestLength) {
+          slowest = order[i];
+          slowestLength = length;
+        }
+      }
+      if (slowest < 0)
+        break;
+      shown[slowest] = YES;
+      [summary appendFormat:@"%@%s %.0fms", (n == 0 ? @"; slowest: " : @", "),
+               spans[slowest].name, MBTraceMilliseconds(slowestLength)];
+    }
+    free(shown);
+  }
+  free(spans);
+  free(order);
+  return summary;
+}
+
+- (BOOL)writeTimelineToPath:(NSString *)path {
+  return [[self timeline] writeToFile:path
+                           atomically:YES
+                             encoding:NSUTF8StringEncoding
+                                error:NULL];
+}
+
+@end  // MBStartupTrace
+
+
+@implementation MBStartupTrace (PrivateMethods)
+
+- (void)willFinishLaunching:(NSNotification *)notification {
+  MBTraceEnd(nibSpan_);
+  nibSpan_ = -1;
+  [[NSNotificationCenter defaultCenter]
+    removeObserver:self
+              name:NSApplicationWillFinishLaunchingNotification
+            object:nil];
+}
+
+// Copies the spans which have started into |spans| (by index) and puts
+// their indexes, in order of starting, in |order|. Returns how many.
+- (int)copySpans:(MBTraceSpan *)spans sorted:(int *)order {
+  int available = MIN(buffer_->count, kMBTraceMaxSpans);
+  memcpy(spans, buffer_->spans, available * sizeof(MBTraceSpan));
+  int count = 0;
+  for (int i = 0; i < available; i++) {
+    if (spans[i].start)
+      order[count++] = i;
+  }
+  @synchronized([MBStartupTrace class]) {
+    gSortSpans = spans;
+    qsort(order, count, sizeof(int), MBTraceCompareStarts);
+    gSortSpans = NULL;
+  }
+  return count;
+}
+
+@end  // PrivateMethods
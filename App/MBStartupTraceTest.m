@@ -0,0 +1,172 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import <SenTestingKit/SenTestingKit.h>
+#import <Cocoa/Cocoa.h>
+#import <unistd.h>
+#import "MBStartupTrace.h"
+#import "MBStartupTraceTest.h"
+
+// The timeline line for |phase|, or nil.
+static NSString *LineForPhase(NSString *timeline, NSString *phase) {
+  NSEnumerator *lineEnumerator =
+    [[timeline componentsSeparatedByString:@"\n"] objectEnumerator];
+  NSString *line = nil;
+  while ((line = [lineEnumerator nextObject])) {
+    if ([line hasSuffix:[@" " stringByAppendingString:phase]])
+      return line;
+  }
+  return nil;
+}
+
+static void TracedScope(void) {
+  MB_TRACE_SCOPE("scoped");
+  usleep(1000);
+}
+
+@implementation MBStartupTraceTest
+
+- (void)tracedThread:(id)ignored {
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  MBTraceEnd(MBTraceBegin("worker"));
+  [pool release];
+}
+
+- (void)testNesting {
+  MBStartupTrace *trace = [[[MBStartupTrace alloc] init] autorelease];
+  [trace start];
+  int outer = MBTraceBegin("outer");
+  int inner = MBTraceBegin("inner");
+  usleep(2000);
+  MBTraceEnd(inner);
+  MBTraceEnd(outer);
+  int after = MBTraceBegin("after");
+  MBTraceEnd(after);
+  [trace finish];
+  STAssertTrue([trace isFinished], nil);
+
+  NSString *timeline = [trace timeline];
+  NSString *startup = LineForPhase(timeline, @"startup");
+  NSString *outerLine = LineForPhase(timeline, @"outer");
+  NSString *innerLine = LineForPhase(timeline, @"inner");
+  STAssertNotNil(startup, timeline);
+  STAssertNotNil(outerLine, timeline);
+  STAssertNotNil(innerLine, timeline);
+  STAssertNotNil(LineForPhase(timeline, @"after"), timeline);
+  // Nested spans are indented under their parents, in order of starting.
+  STAssertTrue([outerLine rangeOfString:@"main      outer"].length, outerLine);
+  STAssertTrue([innerLine rangeOfString:@"main        inner"].length, innerLine);
+  STAssertTrue([timeline rangeOfString:@"outer"].location <
+               [timeline rangeOfString:@"inner"].location, timeline);
+  STAssertTrue([timeline rangeOfString:@"inner"].location <
+               [timeline rangeOfString:@"after"].location, timeline);
+  STAssertTrue([timeline rangeOfString:@"slowest"].length, timeline);
+  STAssertEquals([timeline rangeOfString:@"unfinished"].length,
+                 (NSUInteger)0, timeline);
+}
+
+- (void)testScope {
+  MBStartupTrace *trace = [[[MBStartupTrace alloc] init] autorelease];
+  [trace start];
+  TracedScope();
+  int next = MBTraceBegin("next");
+  MBTraceEnd(next);
+  [trace finish];
+  NSString *timeline = [trace timeline];
+  // "next" isn't inside "scoped", so the scope was closed.
+  STAssertTrue([LineForPhase(timeline, @"scoped")
+                 rangeOfString:@"main      scoped"].length, timeline);
+  STAssertTrue([LineForPhase(timeline, @"next")
+                 rangeOfString:@"main      next"].length, timeline);
+}
+
+- (void)testFinishClosesOpenSpans {
+  MBStartupTrace *trace = [[[MBStartupTrace alloc] init] autorelease];
+  [trace start];
+  MBTraceBegin("left open");
+  [trace finish];
+  STAssertEquals([[trace timeline] rangeOfString:@"unfinished"].length,
+                 (NSUInteger)0, [trace timeline]);
+}
+
+- (void)testNotRecording {
+  MBStartupTrace *trace = [[[MBStartupTrace alloc] init] autorelease];
+  STAssertEqualObjects([trace summary], @"not traced", nil);
+  [trace start];
+  [trace finish];
+  STAssertEquals(MBTraceBegin("late"), -1, nil);
+  MBTraceEnd(-1);  // harmless
+  STAssertNil(LineForPhase([trace timeline], @"late"), nil);
+
+  // Starting another trace stops this one being finished twice over.
+  MBStartupTrace *other = [[[MBStartupTrace alloc] init] autorelease];
+  [other start];
+  int span = MBTraceBegin("other");
+  [trace finish];
+  MBTraceEnd(span);
+  [other finish];
+  STAssertNotNil(LineForPhase([other timeline], @"other"), nil);
+}
+
+- (void)testThreads {
+  MBStartupTrace *trace = [[[MBStartupTrace alloc] init] autorelease];
+  [trace start];
+  int span = MBTraceBegin("waiting");
+  [NSThread detachNewThreadSelector:@selector(tracedThread:)
+                           toTarget:self
+                         withObject:nil];
+  NSDate *giveUp = [NSDate dateWithTimeIntervalSinceNow:5];
+  while (!LineForPhase([trace timeline], @"worker") &&
+         [giveUp timeIntervalSinceNow] > 0)
+    usleep(10000);
+  MBTraceEnd(span);
+  [trace finish];
+  NSString *worker = LineForPhase([trace timeline], @"worker");
+  // Not nested under the main thread's span.
+  STAssertTrue([worker rangeOfString:@"#1      worker"].length,
+               [trace timeline]);
+}
+
+- (void)testSummary {
+  MBStartupTrace *trace = [[[MBStartupTrace alloc] init] autorelease];
+  [trace start];
+  int fast = MBTraceBegin("fast");
+  MBTraceEnd(fast);
+  int slow = MBTraceBegin("slow");
+  usleep(20000);
+  MBTraceEnd(slow);
+  [trace finish];
+  NSString *summary = [trace summary];
+  STAssertTrue([summary hasPrefix:@"startup "], summary);
+  STAssertTrue([summary rangeOfString:@"slowest: slow "].length, summary);
+}
+
+- (void)testWriteTimeline {
+  MBStartupTrace *trace = [[[MBStartupTrace alloc] init] autorelease];
+  [trace start];
+  [trace finish];
+  NSString *path = [NSString stringWithFormat:@"/tmp/startuptrace-%d",
+                    [[NSProcessInfo processInfo] processIdentifier]];
+  STAssertTrue([trace writeTimelineToPath:path], nil);
+  NSString *written = [NSString stringWithContentsOfFile:path
+                                                encoding:NSUTF8StringEncoding
+                                                   error:NULL];
+  STAssertEqualObjects(written, [trace timeline], nil);
+  [[NSFileManager defaultManager] removeFileAtPath:path handler:nil];
+  STAssertTrue([[MBStartupTrace defaultTimelinePath]
+                 hasSuffix:@"Startup.log"], nil);
+}
+
+@end
@@ -15,23 +15,26 @@ limitations under the License.
 
 #import <Cocoa/Cocoa.h>
 #import "MBProject.h"
+#import "MBMetrics.h"
 
 @class MBProjectArrayController;
 @class MBEngineRuntime;
 @class MBEngineTask;
 @class MBConsoleController;
+@class MBTaskRegistry;
+@class MBTaskJournal;
+@class MBSimpleProgressController;
 
 // This is the 2nd main controller for the launcher.  Our data (model) is
 // a list of running tasks (MBEngineTasks).  Our view is the
-// console windows, one per task.
-@interface MBTaskArrayController : NSArrayController {
+// console windows, one per task.  As an MBMetricsCollector it reports
+// the memory and CPU time of each running task.
+@interface MBTaskArrayController : NSArrayController <MBMetricsCollector> {
   IBOutlet MBProjectArrayController *projectController_;
   IBOutlet NSMenuItem *demoMenu_;
 
-  // In the future projects will have a choice of runtime.  This
-  // field, which will become an array, will probably move to
-  // MBProjectArrayController (for selection in "New Project", "Get
-  // Info", etc.  Until then it's convenient to have in here.
+  // The default runtime, set up at launch.  Projects pinned to
+  // another runtime get theirs from MBRuntimeRegistry.
   MBEngineRuntime *launcherRuntime_;
 
   // Array of MBConsoleControllers indexed by an MBProject's unique ID.
@@ -39,6 +42,30 @@ limitations under the License.
   // exist for the lifetime of an MBProject, not the lifetime of it's
   // task (So stop/start doesn't clear the log.)
   NSMutableDictionary *consoleWindows_;
+
+  // Running tasks indexed by project identifier and pid.  Kept in
+  // sync with our content; see -addEngineTask: and -removeEngineTask:.
+  MBTaskRegistry *taskRegistry_;
+
+  // History of task lifecycle events (spawn, ready, signal, exit).
+  MBTaskJournal *journal_;
+
+  // The demo menu is filled in when first opened.
+  BOOL demosAdded_;
+
+  // Starts (and the end of launch) waiting for a runtime's contents
+  // to be found in the background, as NSInvocations keyed by runtime
+  // name.  A name is present while its runtime is being found.
+  NSMutableDictionary *pendingStarts_;
+
+  // Runtimes being extracted, oldest first, and the progress sheet
+  // (with the timer which keeps it up to date) for the first of them.
+  NSMutableArray *extractingRuntimes_;
+  MBSimpleProgressController *extractionController_;
+  NSTimer *extractionTimer_;
+
+  // -didFinishLaunching's startup span; open until the runtime is ready.
+  int launchSpan_;
 }
 
 // Try and exit gracefully.  Called from awakeFromNib
@@ -49,17 +76,29 @@ limitations under the License.
 - (MBEngineTask *)findEngineTaskForProject:(MBProject *)project;
 - (MBEngineTask *)findEngineTaskForTask:(NSTask *)task;
 
+// The lifecycle history of our tasks.
+- (MBTaskJournal *)journal;
+
 // Triggered by IBActions.
 // If callback is not nil, it will be added as the hook in MBLogFilter to be
 // called when the project is fully running.
+// If the project's runtime hasn't been set up yet (which may mean
+// extracting it) the task starts once it has; YES means started or
+// queued.
 - (BOOL)runTaskForProject:(MBProject *)project
       callbackWhenRunning:(NSInvocation *)callback;
 - (BOOL)productionRunTaskForProject:(MBProject *)project
                 callbackWhenRunning:(NSInvocation *)callback;
+// Also drops a run or deploy still waiting for the runtime.
 - (BOOL)stopTaskForProject:(MBProject *)project;
 
+// Drops any run or deploy of |project| waiting for its runtime.
+// Returns YES if there was one.
+- (BOOL)cancelPendingRunsForProject:(MBProject *)project;
+
 // Triggered by an IBAction once removed (called from MBDeployController)
-// Command defaults to "update" if otherwise nil.
+// Command defaults to "update" if otherwise nil.  Like the above, waits
+// for the project's runtime if need be.
 // TODO(jrg): abstraction issues!
 - (BOOL)runDeployForProject:(MBProject *)project
                    username:(NSString *)username
@@ -85,7 +124,8 @@ limitations under the License.
 - (NSString *)fullpathForDemo:(NSString *)title;
 
 // Tell the project array controller what demos we have in our
-// runtime, and where they live.
+// runtime, and where they live.  The demo menu items aren't created
+// until the menu is first opened (see -menuNeedsUpdate:).
 - (void)addDemos;
 
 @end
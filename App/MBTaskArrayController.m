@@ -18,13 +18,40 @@ limitations under the License.
 #include <sys/types.h>
 #include <sys/event.h>
 #include <sys/time.h>
+#include <libproc.h>
+#include <mach/mach_time.h>
 #import "MBProjectArrayController.h"
 #import "MBEngineRuntime.h"
+#import "MBRuntimeRegistry.h"
 #import "MBAlertWriter.h"
+#import "GMLogLevelControl.h"
+#import "MBStallWatchdog.h"
+#import "MBStartupTrace.h"
 #import "MBEngineTask.h"
 #import "MBConsoleController.h"
 #import "MBSimpleProgressController.h"
 #import "MBLogFilter.h"
+#import "MBTaskRegistry.h"
+#import "MBTaskJournal.h"
+#import "MBMetricsServer.h"
+#import "MBTraceRecorder.h"
+#import "MBProxy.h"
+
+@interface MBTaskArrayController (Private)
+- (void)addEngineTask:(MBEngineTask *)task;
+- (void)removeEngineTask:(MBEngineTask *)task;
+- (void)taskDidLaunch:(MBEngineTask *)task;
+- (void)deployDidLaunch:(MBEngineTask *)task;
+- (void)taskBecameReady:(NSNumber *)identifier;
+- (void)recordExitOfTask:(MBEngineTask *)task;
+- (MBEngineRuntime *)runtimeForProject:(MBProject *)project;
+- (void)whenRuntimeReady:(MBEngineRuntime *)runtime invoke:(NSInvocation *)invocation;
+- (NSInvocation *)retryOfSelector:(SEL)selector;
+- (void)runtimeReady:(MBEngineRuntime *)runtime;
+- (void)beginExtractionProgressForRuntime:(MBEngineRuntime *)runtime;
+- (void)endExtractionProgressForRuntime:(MBEngineRuntime *)runtime;
+- (void)launcherRuntimeReady:(MBEngineRuntime *)runtime;
+@end
 
 @implementation MBTaskArrayController
 
@@ -103,18 +130,37 @@ static void do_nothing(int sig) { }
                                         object:nil];
   [self handleSignal:SIGINT];   // ctrl-c
   [self handleSignal:SIGTERM];  // logout
+  // "kill -USR1 <pid>" switches debug logging on (and off) in a running app.
+  [[GMLogLevelControl sharedControl] toggleVerboseOnSignal:SIGUSR1];
 }
 
 - (void)awakeFromNib {
+  MB_TRACE_SCOPE(__func__);
   // Make sure MBLogger is setup before we call something which may use it.
   // XXX - there has got to be a better way to do this.
   // TODO(jrg): obsolete, since this class is now recycled!
   if (gLauncherSignalFD == 0) {  // once-only
     [MBAlertWriter install];
     [self installCleanupHandlers];
+    [[MBStallWatchdog sharedWatchdog] start];
+    [MBMetricsServer startFromDefaults];
+    [MBTraceRecorder writeOnTerminateFromDefaults];
+    [MBProxy startFromDefaults];
   }
+  [[MBMetrics sharedMetrics] addCollector:self];
+  [[MBMetrics sharedMetrics] addCollector:projectController_];
   launcherRuntime_ = [[MBEngineRuntime defaultRuntime] retain];
   consoleWindows_ = [[NSMutableDictionary alloc] init];
+  if (taskRegistry_ == nil)
+    taskRegistry_ = [[MBTaskRegistry alloc] init];
+  if (journal_ == nil) {
+    journal_ = [[MBTaskJournal alloc] init];
+    [journal_ writeOnTerminateFromDefaults];
+  }
+  if (pendingStarts_ == nil)
+    pendingStarts_ = [[NSMutableDictionary alloc] init];
+  if (extractingRuntimes_ == nil)
+    extractingRuntimes_ = [[NSMutableArray alloc] init];
 
   // too early
   // [self addDemos];
@@ -128,60 +174,258 @@ static void do_nothing(int sig) { }
   setenv("NSUnbufferedIO", "YES", 1);
 }
 
-// called at NSApplicationDidFinishLaunchingNotification time
-- (void)didFinishLaunching {
-  BOOL extracting = [launcherRuntime_ extractionNeeded];
-  MBSimpleProgressController *controller = nil;
-
-  if (extracting) {
-    controller = [[[MBSimpleProgressController alloc] init] autorelease];
-    [NSApp beginSheet:[controller window]
-       modalForWindow:[projectController_ mainProjectWindow]
-        modalDelegate:nil
-       didEndSelector:nil
-          contextInfo:nil];
-    [controller startAnimation];
-  }
-
-  [launcherRuntime_ findRuntimeContents];
-
-  if (extracting) {
-    [NSApp endSheet:[controller window]];
-    [controller close];
-    [projectController_ makeCommandLineSymlinks:self];
-  }
+- (void)updateExtractionProgress:(NSTimer *)timer {
+  double progress = [(MBEngineRuntime *)[timer userInfo] extractionProgress];
+  if (progress >= 0.0)
+    [extractionController_ setProgress:progress];
+}
 
-  [self addDemos];
+// called at NSApplicationDidFinishLaunchingNotification time.  The
+// runtime is probed (and extracted) on a worker thread, so the main
+// thread is free to draw the progress sheet; -launcherRuntimeReady:
+// finishes up.
+- (void)didFinishLaunching {
+  launchSpan_ = MBTraceBegin(__func__);
+  NSInvocation *ready = [self retryOfSelector:@selector(launcherRuntimeReady:)];
+  [ready setArgument:&launcherRuntime_ atIndex:2];
+  [self whenRuntimeReady:launcherRuntime_ invoke:ready];
 }
 
 - (void)dealloc {
+  [[MBMetrics sharedMetrics] removeCollector:self];
   [self stopAllTasks];
   [launcherRuntime_ release];
   // TODO(jrg): stop tasks?  Close windows?
   [consoleWindows_ release];
+  [taskRegistry_ release];
+  [journal_ release];
+  [pendingStarts_ release];
+  [extractingRuntimes_ release];
   [super dealloc];
 }
 
 - (MBEngineTask *)findEngineTaskForProject:(MBProject *)project {
+  return [taskRegistry_ taskForProject:project];
+}
+
+- (MBEngineTask *)findEngineTaskForTask:(NSTask *)task {
+  MBEngineTask *mbtask = [taskRegistry_ taskForPid:[task processIdentifier]];
+  // Paranoia: pids are recycled.
+  if ([[mbtask task] isEqual:task] == NO)
+    return nil;
+  return mbtask;
+}
+
+// MBMetricsCollector.  Memory and CPU time of each running task; tasks
+// which have gone are forgotten.
+- (void)collectMetrics:(MBMetrics *)metrics {
+  static mach_timebase_info_data_t timebase;
+  if (timebase.denom == 0)
+    mach_timebase_info(&timebase);
+
+  [metrics removeSamplesForMetric:@"launcher_task_resident_memory_bytes"];
+  [metrics removeSamplesForMetric:@"launcher_task_cpu_seconds_total"];
   NSEnumerator *tenum = [[self content] objectEnumerator];
   MBEngineTask *task = nil;
   while ((task = [tenum nextObject])) {
-    if ([[task project] isEqual:project]) {
-      return task;
-    }
+    int pid = [task processIdentifier];
+    struct proc_taskinfo info;
+    if (pid <= 0 || ![task isRunning] ||
+        proc_pidinfo(pid, PROC_PIDTASKINFO, 0,
+                     &info, sizeof(info)) != sizeof(info))
+      continue;
+    NSString *name = [[task project] name];
+    NSDictionary *labels =
+      [NSDictionary dictionaryWithObject:(name ? name : @"") forKey:@"project"];
+    // Task times are in Mach absolute time units.
+    double cpu = (double)(info.pti_total_user + info.pti_total_system) *
+                 timebase.numer / timebase.denom / 1e9;
+    [metrics setValue:info.pti_resident_size
+            forMetric:@"launcher_task_resident_memory_bytes"
+               labels:labels];
+    [metrics setValue:cpu
+            forMetric:@"launcher_task_cpu_seconds_total"
+               labels:labels];
   }
-  return nil;
 }
 
-- (MBEngineTask *)findEngineTaskForTask:(NSTask *)task {
-  NSEnumerator *tenum = [[self content] objectEnumerator];
-  MBEngineTask *mbtask = nil;
-  while ((mbtask = [tenum nextObject])) {
-    if ([[mbtask task] isEqual:task]) {
-      return mbtask;
+- (MBTaskJournal *)journal {
+  return journal_;
+}
+
+// The runtime |project| is pinned to.  A runtime other than ours is
+// set up the first time one of its projects is run; its contents may
+// not be found yet.
+- (MBEngineRuntime *)runtimeForProject:(MBProject *)project {
+  MBEngineRuntime *runtime = [[MBRuntimeRegistry sharedRegistry]
+                               runtimeForProject:project];
+  return runtime ? runtime : launcherRuntime_;
+}
+
+// Sends |invocation| once |runtime|'s contents are found, finding them
+// on a worker thread (behind a progress sheet if that means extracting)
+// so the main thread never blocks on it.  Only the first request for a
+// runtime starts the search; the rest just wait.
+- (void)whenRuntimeReady:(MBEngineRuntime *)runtime invoke:(NSInvocation *)invocation {
+  [invocation retainArguments];
+  NSString *name = [runtime name];
+  NSMutableArray *waiters = [pendingStarts_ objectForKey:name];
+  if (waiters) {
+    [waiters addObject:invocation];
+    return;
+  }
+  if ([runtime contentsFound]) {
+    [invocation invoke];
+    return;
+  }
+  [pendingStarts_ setObject:[NSMutableArray arrayWithObject:invocation]
+                     forKey:name];
+  [runtime findRuntimeContentsInBackgroundForTarget:self
+                                           selector:@selector(runtimeReady:)];
+}
+
+// An invocation of |selector| on us, for -whenRuntimeReady:invoke:.
+// The caller sets the arguments; they're retained when it's queued.
+- (NSInvocation *)retryOfSelector:(SEL)selector {
+  NSInvocation *retry = [NSInvocation invocationWithMethodSignature:
+                                        [self methodSignatureForSelector:selector]];
+  [retry setTarget:self];
+  [retry setSelector:selector];
+  return retry;
+}
+
+- (BOOL)cancelPendingRunsForProject:(MBProject *)project {
+  BOOL cancelled = NO;
+  NSEnumerator *wenum = [pendingStarts_ objectEnumerator];
+  NSMutableArray *waiters = nil;
+  while ((waiters = [wenum nextObject])) {
+    // Backwards, so removing doesn't skip anything.
+    for (int i = (int)[waiters count] - 1; i >= 0; i--) {
+      NSInvocation *waiter = [waiters objectAtIndex:i];
+      if ([[waiter methodSignature] numberOfArguments] < 3)
+        continue;
+      id first = nil;
+      [waiter getArgument:&first atIndex:2];
+      if (first == project) {
+        [waiters removeObjectAtIndex:i];
+        cancelled = YES;
+      }
     }
   }
-  return nil;
+  return cancelled;
+}
+
+- (void)runtimeWillExtract:(MBEngineRuntime *)runtime {
+  [extractingRuntimes_ addObject:runtime];
+  [self beginExtractionProgressForRuntime:runtime];
+}
+
+- (void)runtimeReady:(MBEngineRuntime *)runtime {
+  NSString *name = [runtime name];
+  NSArray *waiters = [[[pendingStarts_ objectForKey:name] retain] autorelease];
+  [pendingStarts_ removeObjectForKey:name];
+  if ([extractingRuntimes_ containsObject:runtime]) {
+    [self endExtractionProgressForRuntime:runtime];
+    // First run of a freshly installed launcher.
+    if (runtime == launcherRuntime_)
+      [projectController_ makeCommandLineSymlinks:self];
+  }
+  NSEnumerator *wenum = [waiters objectEnumerator];
+  NSInvocation *waiter = nil;
+  while ((waiter = [wenum nextObject])) {
+    [waiter invoke];
+  }
+}
+
+// Puts up a sheet showing how far |runtime|'s extraction has got.
+// One sheet at a time; a runtime queued behind another gets the sheet
+// when that one is done.
+- (void)beginExtractionProgressForRuntime:(MBEngineRuntime *)runtime {
+  if (extractionController_)
+    return;
+  extractionController_ = [[MBSimpleProgressController alloc] init];
+  [NSApp beginSheet:[extractionController_ window]
+     modalForWindow:[projectController_ mainProjectWindow]
+      modalDelegate:nil
+     didEndSelector:nil
+        contextInfo:nil];
+  [extractionController_ startAnimation];
+  extractionTimer_ = [[NSTimer scheduledTimerWithTimeInterval:0.1
+                                                       target:self
+                                                     selector:@selector(updateExtractionProgress:)
+                                                     userInfo:runtime
+                                                      repeats:YES] retain];
+}
+
+- (void)endExtractionProgressForRuntime:(MBEngineRuntime *)runtime {
+  [extractingRuntimes_ removeObject:runtime];
+  if ((extractionController_ == nil) || ([extractionTimer_ userInfo] != runtime))
+    return;
+  [extractionTimer_ invalidate];
+  [extractionTimer_ release];
+  extractionTimer_ = nil;
+  [NSApp endSheet:[extractionController_ window]];
+  [extractionController_ close];
+  [extractionController_ release];
+  extractionController_ = nil;
+  if ([extractingRuntimes_ count])
+    [self beginExtractionProgressForRuntime:[extractingRuntimes_ objectAtIndex:0]];
+}
+
+// The rest of -didFinishLaunching, once the default runtime is ready.
+- (void)launcherRuntimeReady:(MBEngineRuntime *)runtime {
+  [self addDemos];
+
+  GMLoggerInfo(@"Startup: runtime probe %@",
+               [runtime probeTimingSummary]);
+  MBTraceEnd(launchSpan_);
+  // Start up is over once whatever else was queued behind it has run.
+  [MBStartupTrace performSelector:@selector(launchFinished)
+                       withObject:nil
+                       afterDelay:0];
+}
+
+// All additions and removals of tasks go through these two so the
+// registry stays in sync with our content.
+- (void)addEngineTask:(MBEngineTask *)task {
+  [[self content] addObject:task];
+  [taskRegistry_ addTask:task];
+}
+
+- (void)removeEngineTask:(MBEngineTask *)task {
+  [taskRegistry_ removeTask:task];
+  [[self content] removeObject:task];
+}
+
+- (void)taskDidLaunch:(MBEngineTask *)task {
+  [taskRegistry_ taskDidLaunch:task];
+  [journal_ recordEvent:kMBTaskEventSpawn
+                forTask:task
+                 detail:[[[task task] arguments] componentsJoinedByString:@" "]];
+}
+
+// Not a spawn: appcfg.py never becomes ready, and isn't a restart of
+// the project's dev_appserver.
+- (void)deployDidLaunch:(MBEngineTask *)task {
+  [taskRegistry_ taskDidLaunch:task];
+  [journal_ recordEvent:kMBTaskEventDeploy
+                forTask:task
+                 detail:[[[task task] arguments] componentsJoinedByString:@" "]];
+}
+
+// Invoked by the log filter.  We're handed the project identifier
+// (not the task) so the filter doesn't retain the task that owns it.
+- (void)taskBecameReady:(NSNumber *)identifier {
+  MBEngineTask *task = [taskRegistry_ taskForProjectIdentifier:identifier];
+  if (task)
+    [journal_ recordEvent:kMBTaskEventReady forTask:task detail:nil];
+}
+
+- (void)recordExitOfTask:(MBEngineTask *)task {
+  NSString *detail = nil;
+  if ([task isRunning] == NO)
+    detail = [NSString stringWithFormat:@"status %d", [task terminationStatus]];
+  [journal_ recordEvent:kMBTaskEventExit forTask:task detail:detail];
 }
 
 // Common "run task" method which accepts extra args
@@ -193,12 +437,20 @@ static void do_nothing(int sig) { }
     return NO;
   }
 
-  // assert(launcherRuntime_);
-  NSString *python = [launcherRuntime_ pythonCommand];
+  MBEngineRuntime *runtime = [self runtimeForProject:project];
+  if (![runtime contentsFound]) {
+    NSInvocation *retry = [self retryOfSelector:_cmd];
+    [retry setArgument:&project atIndex:2];
+    [retry setArgument:&callback atIndex:3];
+    [retry setArgument:&extraFlags atIndex:4];
+    [self whenRuntimeReady:runtime invoke:retry];
+    return YES;
+  }
+  NSString *python = [runtime pythonCommand];
   NSMutableArray *args = [NSMutableArray array]; // full command line
   NSMutableArray *moreargs = [NSMutableArray array]; // all except das, project
 
-  [moreargs addObjectsFromArray:[launcherRuntime_ extraCommandLineFlags]];
+  [moreargs addObjectsFromArray:[runtime extraCommandLineFlags]];
   [moreargs addObject:[NSString stringWithFormat:@"--port=%@", [project port]]];
 
   NSMutableArray *projectFlags = [NSMutableArray arrayWithArray:[project commandLineFlags]];
@@ -208,14 +460,14 @@ static void do_nothing(int sig) { }
     [moreargs addObjectsFromArray:extraFlags];
 
   // args = (dev_appserver.py + <args...> + <project>)
-  [args addObject:[launcherRuntime_ devAppServer]];
+  [args addObject:[runtime devAppServer]];
   [args addObjectsFromArray:moreargs];
   [args addObject:[project path]];
 
-  NSString *dir = [launcherRuntime_ devAppDirectory];
+  NSString *dir = [runtime devAppDirectory];
   NSMutableDictionary *environment = [NSMutableDictionary dictionary];
   [environment addEntriesFromDictionary:[[NSProcessInfo processInfo] environment]];
-  [environment addEntriesFromDictionary:[launcherRuntime_ pythonExtraEnvironment]];
+  [environment addEntriesFromDictionary:[runtime pythonExtraEnvironment]];
 
   // ALWAYS create a console window, even if never seen, so we have a
   // history of log output.
@@ -234,7 +486,7 @@ static void do_nothing(int sig) { }
   [task setArguments:args];
   [task setCurrentDirectoryPath:dir];
   [task setEnvironment:environment];
-  [[self content] addObject:task];
+  [self addEngineTask:task];
 
   // Listen for an early death.
   [[NSNotificationCenter defaultCenter]
@@ -247,11 +499,23 @@ static void do_nothing(int sig) { }
     [[task logFilter] addProjectLaunchCompleteCallback:callback];
   }
 
+  // Note when it's up for the journal.
+  NSNumber *identifier = [project identifier];
+  SEL readySelector = @selector(taskBecameReady:);
+  NSInvocation *ready = [NSInvocation invocationWithMethodSignature:
+                                        [self methodSignatureForSelector:readySelector]];
+  [ready setTarget:self];
+  [ready setSelector:readySelector];
+  [ready setArgument:&identifier atIndex:2];
+  [ready retainArguments];
+  [[task logFilter] addProjectLaunchCompleteCallback:ready];
+
   // Hook it up
   [console setEngineTask:task];
 
   // Finally, launch!
   [task launch];
+  [self taskDidLaunch:task];
 
   return YES;
 }
@@ -265,7 +529,16 @@ static void do_nothing(int sig) { }
 
 - (BOOL)productionRunTaskForProject:(MBProject *)project
                 callbackWhenRunning:(NSInvocation *)callback {
-  NSArray *flags = [launcherRuntime_ productionCommandLineFlags];
+  // The flags come from the runtime, so it has to be ready first.
+  MBEngineRuntime *runtime = [self runtimeForProject:project];
+  if (![runtime contentsFound]) {
+    NSInvocation *retry = [self retryOfSelector:_cmd];
+    [retry setArgument:&project atIndex:2];
+    [retry setArgument:&callback atIndex:3];
+    [self whenRuntimeReady:runtime invoke:retry];
+    return YES;
+  }
+  NSArray *flags = [runtime productionCommandLineFlags];
   return [self genericRunTaskForProject:project
                     callbackWhenRunning:callback
                              extraFlags:flags];
@@ -292,7 +565,8 @@ static void do_nothing(int sig) { }
                               status];
   [console appendString:final];
 
-  [[self content] removeObject:mbtask];
+  [self recordExitOfTask:mbtask];
+  [self removeEngineTask:mbtask];
   if (status == 0)
     [projectController_ deathForProject:[mbtask project]];
   else
@@ -325,8 +599,16 @@ static void do_nothing(int sig) { }
     return NO;
   }
 
-  // assert(launcherRuntime_);
-  NSString *python = [launcherRuntime_ pythonCommand];
+  MBEngineRuntime *runtime = [self runtimeForProject:project];
+  if (![runtime contentsFound]) {
+    NSInvocation *retry = [self retryOfSelector:_cmd];
+    [retry setArgument:&project atIndex:2];
+    [retry setArgument:&username atIndex:3];
+    [retry setArgument:&password atIndex:4];
+    [self whenRuntimeReady:runtime invoke:retry];
+    return YES;
+  }
+  NSString *python = [runtime pythonCommand];
   NSMutableArray *args = [NSMutableArray array]; // full command line
   NSMutableArray *moreargs = [NSMutableArray array]; // all except das, project
 
@@ -345,14 +627,14 @@ static void do_nothing(int sig) { }
 
 
   // args = (appcfg.py + <args...> + <project>)
-  [args addObject:[launcherRuntime_ deployCommand]];  // NOT C&P
+  [args addObject:[runtime deployCommand]];  // NOT C&P
   [args addObjectsFromArray:moreargs];
   [args addObject:[project path]];
 
-  NSString *dir = [launcherRuntime_ devAppDirectory];
+  NSString *dir = [runtime devAppDirectory];
   NSMutableDictionary *environment = [NSMutableDictionary dictionary];
   [environment addEntriesFromDictionary:[[NSProcessInfo processInfo] environment]];
-  [environment addEntriesFromDictionary:[launcherRuntime_ pythonExtraEnvironment]];
+  [environment addEntriesFromDictionary:[runtime pythonExtraEnvironment]];
 
   // ALWAYS create a console window, even if never seen, so we have a
   // history of log output.
@@ -372,7 +654,7 @@ static void do_nothing(int sig) { }
   [task setEnvironment:environment];
   [task setStandardInput:[NSString stringWithFormat:@"%@\n", password]];
 
-  [[self content] addObject:task];
+  [self addEngineTask:task];
 
 #if 0
   // Listen for an early death.
@@ -398,6 +680,7 @@ static void do_nothing(int sig) { }
 
   // Finally, launch!
   [task launch];
+  [self deployDidLaunch:task];
 
   return YES;
 }
@@ -408,14 +691,16 @@ static void do_nothing(int sig) { }
   if (mbtask) {
     [self disconnectConsoleFromTask:mbtask];
     [projectController_ unexpectedDeathForProject:[mbtask project]];
-    [[self content] removeObject:mbtask];
+    [self recordExitOfTask:mbtask];
+    [self removeEngineTask:mbtask];
   }
 }
 
 - (BOOL)stopTaskForProject:(MBProject *)project {
+  BOOL cancelled = [self cancelPendingRunsForProject:project];
   MBEngineTask *task = [self findEngineTaskForProject:project];
   if (task == nil) {
-    return NO;
+    return cancelled;
   }
 
   // Clean stop so we turn off the notification.
@@ -424,10 +709,14 @@ static void do_nothing(int sig) { }
               name:NSTaskDidTerminateNotification
             object:[task task]];
 
+  [journal_ recordEvent:kMBTaskEventSignal forTask:task detail:@"SIGINT"];
   [task interrupt];
+  const char *previous = MBStallWatchdogSetAction(__func__);
   [task waitUntilExit];  // in a seperate thread?
+  MBStallWatchdogSetAction(previous);
   [self disconnectConsoleFromTask:task];
-  [[self content] removeObject:task];
+  [self recordExitOfTask:task];
+  [self removeEngineTask:task];
 
   return YES;
 }
@@ -436,6 +725,7 @@ static void do_nothing(int sig) { }
   NSEnumerator *tenum = [[self content] objectEnumerator];
   MBEngineTask *task = nil;
   while ((task = [tenum nextObject])) {
+    [journal_ recordEvent:kMBTaskEventSignal forTask:task detail:@"SIGINT"];
     [task interrupt];
   }
 }
@@ -443,11 +733,16 @@ static void do_nothing(int sig) { }
 - (void)stopAllTasks {
   NSEnumerator *tenum = [[self content] objectEnumerator];
   MBEngineTask *task = nil;
+  const char *previous = MBStallWatchdogSetAction(__func__);
   while ((task = [tenum nextObject])) {
+    [journal_ recordEvent:kMBTaskEventSignal forTask:task detail:@"SIGINT"];
     [task interrupt];
     [task waitUntilExit];
     [self disconnectConsoleFromTask:task];
+    [self recordExitOfTask:task];
   }
+  MBStallWatchdogSetAction(previous);
+  [taskRegistry_ removeAllTasks];
   [[self content] removeAllObjects];
 }
 
@@ -498,12 +793,22 @@ static void do_nothing(int sig) { }
 
 
 - (void)addDemos {
+  MB_TRACE_SCOPE(__func__);
+  demosAdded_ = NO;
+  [[demoMenu_ submenu] setDelegate:self];
+}
+
+// NSMenu delegate method.  Enumerating the demos directory is put off
+// until someone actually looks.
+- (void)menuNeedsUpdate:(NSMenu *)submenu {
+  if (demosAdded_)
+    return;
+  demosAdded_ = YES;
   NSArray *demos = [launcherRuntime_ demos];
   if (demos) {
     NSEnumerator *senum = [demos objectEnumerator];
     NSString *fullpath = nil;
     while ((fullpath = [senum nextObject])) {
-      NSMenu *submenu = [demoMenu_ submenu];
       NSMenuItem *item = [[[NSMenuItem alloc] initWithTitle:fullpath
                                                      action:@selector(addDemoApp:)
                                               keyEquivalent:@""] autorelease];
@@ -16,8 +16,10 @@ limitations under the License.
 #import <SenTestingKit/SenTestingKit.h>
 #import <Cocoa/Cocoa.h>
 #import "GMLogger.h"
+#import "MBEngineRuntime.h"
 #import "MBProject.h"
 #import "MBTaskArrayController.h"
+#import "MBTaskJournal.h"
 #import "MBTaskArrayControllerTest.h"
 
 
@@ -46,6 +48,13 @@ limitations under the License.
 
   [c addDemos];
   STAssertTrue([[c fullpathForDemo:@"foo"] length] > 0, nil);
+
+  // Demo menu items show up when the menu is first opened, once.
+  NSMenu *menu = [[[NSMenu alloc] initWithTitle:@"Demos"] autorelease];
+  [c menuNeedsUpdate:menu];
+  int count = [menu numberOfItems];
+  [c menuNeedsUpdate:menu];
+  STAssertTrue([menu numberOfItems] == count, nil);
 }
 
 - (void)testRun {
@@ -53,6 +62,10 @@ limitations under the License.
   [c awakeFromNib];
   [c installCleanupHandlers];
 
+  // With the runtime ready, tasks start right away rather than
+  // waiting for it in the background.
+  [[MBEngineRuntime defaultRuntime] extractionNeeded];
+  [[MBEngineRuntime defaultRuntime] findRuntimeContentsIfNeeded];
   MBProject *p = [MBProject projectWithName:@"name0" path:@"path0" port:@"8000"];
   BOOL worked = [c runTaskForProject:p callbackWhenRunning:nil];
   STAssertTrue(worked, nil);
@@ -68,7 +81,13 @@ limitations under the License.
   [c stopTaskForProject:p];
   STAssertNil([c findEngineTaskForProject:p], nil);
 
-
+  // Each run was journaled from spawn through exit.
+  NSArray *events = [[c journal] eventsForProject:p];
+  STAssertTrue([events count] >= 4, nil);
+  STAssertEqualObjects([[events objectAtIndex:0] objectForKey:kMBTaskEventTypeKey],
+                       @"spawn", nil);
+  STAssertEqualObjects([[events lastObject] objectForKey:kMBTaskEventTypeKey],
+                       @"exit", nil);
 }
 
 // TODO(jrg): this is a little threadbare.  Once the UI settles down,
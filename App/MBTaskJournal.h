@@ -0,0 +1,83 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import <Foundation/Foundation.h>
+@class MBEngineTask;
+@class MBProject;
+
+// Lifecycle events recorded for a task.
+typedef enum {
+  kMBTaskEventSpawn = 0,   // launched
+  kMBTaskEventReady,       // dev_appserver says it's serving
+  kMBTaskEventSignal,      // we sent it a signal (e.g. stop)
+  kMBTaskEventExit,        // it's gone
+  kMBTaskEventDeploy       // launched appcfg.py (not a dev_appserver)
+} MBTaskEventType;
+
+// Keys for an event dictionary (see -events).
+#define kMBTaskEventTypeKey        @"type"        // NSString, e.g. "spawn"
+#define kMBTaskEventDateKey        @"date"        // NSDate
+#define kMBTaskEventProjectKey     @"project"     // NSString project name
+#define kMBTaskEventIdentifierKey  @"identifier"  // NSNumber project ID
+#define kMBTaskEventPidKey         @"pid"         // NSNumber
+#define kMBTaskEventDetailKey      @"detail"      // NSString; optional
+
+// An MBTaskJournal is an in-memory history of task lifecycle events
+// (spawn, ready, signal, exit) with timestamps.  Events are kept in
+// the order recorded.  The journal is bounded; once full, the oldest
+// events are dropped.  It can be exported as a property list.
+//
+// Each event also updates the launcher's MBMetrics: spawns, restarts
+// (spawns of a project already spawned once), deploys and dev_appserver
+// exits per project, and the time from spawn to ready.  They go to
+// MBTraceRecorder too.
+@interface MBTaskJournal : NSObject {
+ @private
+  NSMutableArray *events_;  // of NSDictionary
+  unsigned int capacity_;
+  NSMutableDictionary *spawnDates_;  // NSNumber pid --> NSDate, until ready
+  NSMutableSet *spawnedProjects_;    // of project identifiers
+  NSMutableSet *deployPids_;         // of NSNumber, until they exit
+  BOOL writesOnTerminate_;
+}
+
+// Designated initializer.  |capacity| is the maximum number of events
+// kept (0 means a reasonable default).
+- (id)initWithCapacity:(unsigned int)capacity;
+
+// Record an event for |task| now.  |detail| may be nil.
+- (void)recordEvent:(MBTaskEventType)type
+            forTask:(MBEngineTask *)task
+             detail:(NSString *)detail;
+
+// All events, oldest first.
+- (NSArray *)events;
+
+// Events for just one project, oldest first.
+- (NSArray *)eventsForProject:(MBProject *)project;
+
+- (void)removeAllEvents;
+
+// Export all events as an XML property list.  Returns YES on success.
+- (BOOL)writeToFile:(NSString *)path;
+
+// Exports the journal to the MBTaskJournalFile default's path, if it's
+// set, when the application terminates.
+- (void)writeOnTerminateFromDefaults;
+
+// The name used for |type| in exported events (e.g. "spawn").
++ (NSString *)nameForEventType:(MBTaskEventType)type;
+
+@end
@@ -0,0 +1,231 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import <Cocoa/Cocoa.h>
+#import "MBTaskJournal.h"
+#import "MBEngineTask.h"
+#import "MBProject.h"
+#import "MBMetrics.h"
+#import "MBTraceRecorder.h"
+
+// A few hours of a busy launcher.
+static const unsigned int kMBTaskJournalDefaultCapacity = 4096;
+
+// Where -writeOnTerminateFromDefaults exports to.
+static NSString *const kMBTaskJournalFileKey = @"MBTaskJournalFile";
+
+// Event names for MBTraceRecordTask(), by MBTaskEventType.
+static const char *const kMBTaskJournalTraceNames[] = {
+  "spawn", "ready", "signal", "exit", "deploy"
+};
+
+@interface MBTaskJournal (PrivateMethods)
+- (void)updateMetricsForEvent:(NSDictionary *)event type:(MBTaskEventType)type;
+- (void)applicationWillTerminate:(NSNotification *)notification;
+@end
+
+@implementation MBTaskJournal
+
+- (id)init {
+  return [self initWithCapacity:0];
+}
+
+- (id)initWithCapacity:(unsigned int)capacity {
+  if ((self = [super init])) {
+    capacity_ = capacity ? capacity : kMBTaskJournalDefaultCapacity;
+    events_ = [[NSMutableArray alloc] init];
+    spawnDates_ = [[NSMutableDictionary alloc] init];
+    spawnedProjects_ = [[NSMutableSet alloc] init];
+    deployPids_ = [[NSMutableSet alloc] init];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  if (writesOnTerminate_)
+    [[NSNotificationCenter defaultCenter] removeObserver:self];
+  [events_ release];
+  [spawnDates_ release];
+  [spawnedProjects_ release];
+  [deployPids_ release];
+  [super dealloc];
+}
+
++ (NSString *)nameForEventType:(MBTaskEventType)type {
+  switch (type) {
+    case kMBTaskEventSpawn:
+      return @"spawn";
+    case kMBTaskEventReady:
+      return @"ready";
+    case kMBTaskEventSignal:
+      return @"signal";
+    case kMBTaskEventExit:
+      return @"exit";
+    case kMBTaskEventDeploy:
+      return @"deploy";
+  }
+  return @"unknown";
+}
+
+- (void)recordEvent:(MBTaskEventType)type
+            forTask:(MBEngineTask *)task
+             detail:(NSString *)detail {
+  MBProject *project = [task project];
+  NSMutableDictionary *event = [NSMutableDictionary dictionaryWithCapacity:6];
+  [event setObject:[MBTaskJournal nameForEventType:type] forKey:kMBTaskEventTypeKey];
+  [event setObject:[NSDate date] forKey:kMBTaskEventDateKey];
+  [event setObject:[NSNumber numberWithInt:[task processIdentifier]]
+            forKey:kMBTaskEventPidKey];
+  if ([project name])
+    [event setObject:[project name] forKey:kMBTaskEventProjectKey];
+  if ([project identifier])
+    [event setObject:[project identifier] forKey:kMBTaskEventIdentifierKey];
+  if (detail)
+    [event setObject:detail forKey:kMBTaskEventDetailKey];
+  MBTraceRecordTask(kMBTaskJournalTraceNames[type], [task processIdentifier],
+                    [[project name] UTF8String]);
+
+  @synchronized(self) {
+    [events_ addObject:event];
+    // Trim in chunks so a full journal doesn't shift the array on
+    // every event.
+    if ([events_ count] > capacity_ + capacity_ / 4) {
+      [events_ removeObjectsInRange:NSMakeRange(0, [events_ count] - capacity_)];
+    }
+    [self updateMetricsForEvent:event type:type];
+  }
+}
+
+- (NSArray *)events {
+  @synchronized(self) {
+    unsigned int count = [events_ count];
+    if (count > capacity_) {
+      NSRange range = NSMakeRange(count - capacity_, capacity_);
+      return [events_ subarrayWithRange:range];
+    }
+    return [NSArray arrayWithArray:events_];
+  }
+  return nil;  // not reached
+}
+
+- (NSArray *)eventsForProject:(MBProject *)project {
+  NSNumber *identifier = [project identifier];
+  NSMutableArray *array = [NSMutableArray array];
+  NSEnumerator *eenum = [[self events] objectEnumerator];
+  NSDictionary *event = nil;
+  while ((event = [eenum nextObject])) {
+    if ([[event objectForKey:kMBTaskEventIdentifierKey] isEqual:identifier])
+      [array addObject:event];
+  }
+  return array;
+}
+
+- (void)removeAllEvents {
+  @synchronized(self) {
+    [events_ removeAllObjects];
+  }
+}
+
+- (BOOL)writeToFile:(NSString *)path {
+  NSString *error = nil;
+  NSData *data = [NSPropertyListSerialization
+                   dataFromPropertyList:[self events]
+                                 format:NSPropertyListXMLFormat_v1_0
+                       errorDescription:&error];
+  if (data == nil) {
+    GMLoggerError(@"Can't export task journal: %@", error);
+    [error release];
+    return NO;
+  }
+  return [data writeToFile:path atomically:YES];
+}
+
+- (void)writeOnTerminateFromDefaults {
+  if (writesOnTerminate_ ||
+      [[[NSUserDefaults standardUserDefaults]
+         stringForKey:kMBTaskJournalFileKey] length] == 0)
+    return;
+  writesOnTerminate_ = YES;
+  [[NSNotificationCenter defaultCenter]
+    addObserver:self
+       selector:@selector(applicationWillTerminate:)
+           name:NSApplicationWillTerminateNotification
+         object:nil];
+}
+
+@end  // MBTaskJournal
+
+
+@implementation MBTaskJournal (PrivateMethods)
+
+// Called with the journal locked.
+- (void)updateMetricsForEvent:(NSDictionary *)event type:(MBTaskEventType)type {
+  MBMetrics *metrics = [MBMetrics sharedMetrics];
+  NSString *name = [event objectForKey:kMBTaskEventProjectKey];
+  NSDictionary *labels =
+    [NSDictionary dictionaryWithObject:(name ? name : @"") forKey:@"project"];
+  NSNumber *pid = [event objectForKey:kMBTaskEventPidKey];
+  NSDate *date = [event objectForKey:kMBTaskEventDateKey];
+
+  switch (type) {
+    case kMBTaskEventSpawn: {
+      [metrics addValue:1 toCounter:@"launcher_task_spawns_total" labels:labels];
+      id identifier = [event objectForKey:kMBTaskEventIdentifierKey];
+      if (identifier) {
+        if ([spawnedProjects_ containsObject:identifier])
+          [metrics addValue:1
+                  toCounter:@"launcher_task_restarts_total"
+                     labels:labels];
+        else
+          [spawnedProjects_ addObject:identifier];
+      }
+      [spawnDates_ setObject:date forKey:pid];
+      break;
+    }
+    case kMBTaskEventReady: {
+      NSDate *spawned = [spawnDates_ objectForKey:pid];
+      if (spawned) {
+        [metrics observeValue:[date timeIntervalSinceDate:spawned]
+                  inHistogram:@"launcher_task_ready_seconds"
+                       labels:labels];
+        [spawnDates_ removeObjectForKey:pid];
+      }
+      break;
+    }
+    case kMBTaskEventSignal:
+      break;
+    case kMBTaskEventExit:
+      if ([deployPids_ containsObject:pid])
+        [deployPids_ removeObject:pid];
+      else
+        [metrics addValue:1 toCounter:@"launcher_task_exits_total" labels:labels];
+      [spawnDates_ removeObjectForKey:pid];
+      break;
+    case kMBTaskEventDeploy:
+      [metrics addValue:1 toCounter:@"launcher_task_deploys_total" labels:labels];
+      [deployPids_ addObject:pid];
+      break;
+  }
+}
+
+- (void)applicationWillTerminate:(NSNotification *)notification {
+  NSString *path = [[[NSUserDefaults standardUserDefaults]
+                      stringForKey:kMBTaskJournalFileKey]
+                     stringByExpandingTildeInPath];
+  if ([path length] && ![self writeToFile:path])
+    GMLoggerError(@"Can't write task journal to %@", path);
+}
+
+@end  // PrivateMethods
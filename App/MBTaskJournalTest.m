@@ -0,0 +1,141 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import <SenTestingKit/SenTestingKit.h>
+#import <Cocoa/Cocoa.h>
+#import "MBProject.h"
+#import "MBEngineTask.h"
+#import "MBTaskJournal.h"
+#import "MBMetrics.h"
+#import "MBTaskJournalTest.h"
+
+@implementation MBTaskJournalTest
+
+- (void)testRecord {
+  MBTaskJournal *j = [[[MBTaskJournal alloc] init] autorelease];
+  STAssertTrue([[j events] count] == 0, nil);
+
+  MBProject *p0 = [MBProject projectWithName:@"name0" path:@"path0" port:@"8080"];
+  MBProject *p1 = [MBProject projectWithName:@"name1" path:@"path1" port:@"8081"];
+  MBEngineTask *t0 = [MBEngineTask taskWithProject:p0];
+  MBEngineTask *t1 = [MBEngineTask taskWithProject:p1];
+  [j recordEvent:kMBTaskEventSpawn forTask:t0 detail:@"args"];
+  [j recordEvent:kMBTaskEventSpawn forTask:t1 detail:nil];
+  [j recordEvent:kMBTaskEventReady forTask:t0 detail:nil];
+  [j recordEvent:kMBTaskEventSignal forTask:t0 detail:@"SIGINT"];
+  [j recordEvent:kMBTaskEventExit forTask:t0 detail:@"status 0"];
+
+  NSArray *events = [j events];
+  STAssertTrue([events count] == 5, nil);
+  NSDictionary *first = [events objectAtIndex:0];
+  STAssertEqualObjects([first objectForKey:kMBTaskEventTypeKey], @"spawn", nil);
+  STAssertEqualObjects([first objectForKey:kMBTaskEventProjectKey], @"name0", nil);
+  STAssertEqualObjects([first objectForKey:kMBTaskEventDetailKey], @"args", nil);
+  STAssertNotNil([first objectForKey:kMBTaskEventDateKey], nil);
+  STAssertNil([[events objectAtIndex:1] objectForKey:kMBTaskEventDetailKey], nil);
+
+  NSArray *mine = [j eventsForProject:p0];
+  STAssertTrue([mine count] == 4, nil);
+  STAssertEqualObjects([[mine lastObject] objectForKey:kMBTaskEventTypeKey],
+                       @"exit", nil);
+  STAssertTrue([[j eventsForProject:p1] count] == 1, nil);
+
+  [j removeAllEvents];
+  STAssertTrue([[j events] count] == 0, nil);
+}
+
+- (void)testCapacity {
+  MBTaskJournal *j = [[[MBTaskJournal alloc] initWithCapacity:10] autorelease];
+  MBProject *p = [MBProject projectWithName:@"name0" path:@"path0" port:@"8080"];
+  MBEngineTask *t = [MBEngineTask taskWithProject:p];
+  for (int i = 0; i < 100; i++) {
+    [j recordEvent:kMBTaskEventSpawn
+           forTask:t
+            detail:[NSString stringWithFormat:@"%d", i]];
+  }
+  NSArray *events = [j events];
+  STAssertTrue([events count] == 10, nil);
+  // Oldest are dropped.
+  STAssertEqualObjects([[events objectAtIndex:0] objectForKey:kMBTaskEventDetailKey],
+                       @"90", nil);
+  STAssertEqualObjects([[events lastObject] objectForKey:kMBTaskEventDetailKey],
+                       @"99", nil);
+}
+
+- (void)testExport {
+  MBTaskJournal *j = [[[MBTaskJournal alloc] init] autorelease];
+  MBProject *p = [MBProject projectWithName:@"name0" path:@"path0" port:@"8080"];
+  MBEngineTask *t = [MBEngineTask taskWithProject:p];
+  [j recordEvent:kMBTaskEventSpawn forTask:t detail:nil];
+  [j recordEvent:kMBTaskEventExit forTask:t detail:@"status 1"];
+
+  NSString *path = [NSTemporaryDirectory()
+                     stringByAppendingPathComponent:@"MBTaskJournalTest.plist"];
+  STAssertTrue([j writeToFile:path], nil);
+  NSArray *read = [NSArray arrayWithContentsOfFile:path];
+  STAssertTrue([read count] == 2, nil);
+  STAssertEqualObjects([[read lastObject] objectForKey:kMBTaskEventTypeKey],
+                       @"exit", nil);
+  [[NSFileManager defaultManager] removeFileAtPath:path handler:nil];
+
+  STAssertEqualObjects([MBTaskJournal nameForEventType:kMBTaskEventReady],
+                       @"ready", nil);
+}
+
+- (void)testMetrics {
+  MBTaskJournal *j = [[[MBTaskJournal alloc] init] autorelease];
+  MBProject *p = [MBProject projectWithName:@"MBTaskJournalTest-metrics"
+                                       path:@"path0"
+                                       port:@"8080"];
+  MBEngineTask *t = [MBEngineTask taskWithProject:p];
+  MBMetrics *m = [MBMetrics sharedMetrics];
+  NSDictionary *labels = [NSDictionary dictionaryWithObject:[p name]
+                                                     forKey:@"project"];
+
+  [j recordEvent:kMBTaskEventSpawn forTask:t detail:nil];
+  [j recordEvent:kMBTaskEventReady forTask:t detail:nil];
+  [j recordEvent:kMBTaskEventReady forTask:t detail:nil];  // counted once
+  [j recordEvent:kMBTaskEventExit forTask:t detail:nil];
+  STAssertEquals([m valueForMetric:@"launcher_task_spawns_total"
+                            labels:labels], 1.0, nil);
+  STAssertEquals([m valueForMetric:@"launcher_task_restarts_total"
+                            labels:labels], 0.0, nil);
+  STAssertEquals([m valueForMetric:@"launcher_task_ready_seconds"
+                            labels:labels], 1.0, nil);
+  STAssertEquals([m valueForMetric:@"launcher_task_exits_total"
+                            labels:labels], 1.0, nil);
+
+  [j recordEvent:kMBTaskEventSpawn forTask:t detail:nil];
+  STAssertEquals([m valueForMetric:@"launcher_task_spawns_total"
+                            labels:labels], 2.0, nil);
+  STAssertEquals([m valueForMetric:@"launcher_task_restarts_total"
+                            labels:labels], 1.0, nil);
+
+  // A deploy is neither a spawn nor a dev_appserver exit.
+  [j recordEvent:kMBTaskEventDeploy forTask:t detail:nil];
+  [j recordEvent:kMBTaskEventExit forTask:t detail:nil];
+  STAssertEquals([m valueForMetric:@"launcher_task_deploys_total"
+                            labels:labels], 1.0, nil);
+  STAssertEquals([m valueForMetric:@"launcher_task_spawns_total"
+                            labels:labels], 2.0, nil);
+  STAssertEquals([m valueForMetric:@"launcher_task_restarts_total"
+                            labels:labels], 1.0, nil);
+  STAssertEquals([m valueForMetric:@"launcher_task_exits_total"
+                            labels:labels], 1.0, nil);
+  STAssertEqualObjects([[[j events] lastObject] objectForKey:kMBTaskEventTypeKey],
+                       @"exit", nil);
+}
+
+@end
@@ -0,0 +1,47 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import <Foundation/Foundation.h>
+@class MBEngineTask;
+@class MBProject;
+
+// An MBTaskRegistry indexes running MBEngineTasks by their project's
+// unique identifier and (once launched) by process ID, so the task
+// controller can find the task for a project or for a death
+// notification without walking every task.  It does not own the
+// order of tasks; MBTaskArrayController's content still does.
+@interface MBTaskRegistry : NSObject {
+ @private
+  NSMutableDictionary *byProject_;  // project identifier --> MBEngineTask
+  NSMutableDictionary *byPid_;      // NSNumber pid --> MBEngineTask
+}
+
+// Register |task| under its project.  Call -taskDidLaunch: once it
+// has a pid.
+- (void)addTask:(MBEngineTask *)task;
+- (void)taskDidLaunch:(MBEngineTask *)task;
+
+// Forget |task| (a no-op if it isn't registered).
+- (void)removeTask:(MBEngineTask *)task;
+- (void)removeAllTasks;
+
+// Lookups; nil if not found.
+- (MBEngineTask *)taskForProject:(MBProject *)project;
+- (MBEngineTask *)taskForProjectIdentifier:(NSNumber *)identifier;
+- (MBEngineTask *)taskForPid:(int)pid;
+
+- (unsigned int)count;
+
+@end
@@ -0,0 +1,86 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import "MBTaskRegistry.h"
+#import "MBEngineTask.h"
+#import "MBProject.h"
+
+@implementation MBTaskRegistry
+
+- (id)init {
+  if ((self = [super init])) {
+    byProject_ = [[NSMutableDictionary alloc] init];
+    byPid_ = [[NSMutableDictionary alloc] init];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [byProject_ release];
+  [byPid_ release];
+  [super dealloc];
+}
+
+- (void)addTask:(MBEngineTask *)task {
+  NSNumber *identifier = [[task project] identifier];
+  if (identifier)
+    [byProject_ setObject:task forKey:identifier];
+}
+
+- (void)taskDidLaunch:(MBEngineTask *)task {
+  int pid = [task processIdentifier];
+  if (pid > 0)
+    [byPid_ setObject:task forKey:[NSNumber numberWithInt:pid]];
+}
+
+- (void)removeTask:(MBEngineTask *)task {
+  if (task == nil)
+    return;
+  // Retain across removal; the dictionaries may hold the last reference.
+  [[task retain] autorelease];
+  NSNumber *identifier = [[task project] identifier];
+  if (identifier && ([byProject_ objectForKey:identifier] == task))
+    [byProject_ removeObjectForKey:identifier];
+  NSNumber *pid = [NSNumber numberWithInt:[task processIdentifier]];
+  if ([byPid_ objectForKey:pid] == task)
+    [byPid_ removeObjectForKey:pid];
+}
+
+- (void)removeAllTasks {
+  [byProject_ removeAllObjects];
+  [byPid_ removeAllObjects];
+}
+
+- (MBEngineTask *)taskForProject:(MBProject *)project {
+  return [self taskForProjectIdentifier:[project identifier]];
+}
+
+- (MBEngineTask *)taskForProjectIdentifier:(NSNumber *)identifier {
+  if (identifier == nil)
+    return nil;
+  return [byProject_ objectForKey:identifier];
+}
+
+- (MBEngineTask *)taskForPid:(int)pid {
+  if (pid <= 0)
+    return nil;
+  return [byPid_ objectForKey:[NSNumber numberWithInt:pid]];
+}
+
+- (unsigned int)count {
+  return [byProject_ count];
+}
+
+@end
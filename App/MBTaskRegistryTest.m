@@ -0,0 +1,79 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import <SenTestingKit/SenTestingKit.h>
+#import <Cocoa/Cocoa.h>
+#import "MBProject.h"
+#import "MBEngineTask.h"
+#import "MBTaskRegistry.h"
+#import "MBTaskRegistryTest.h"
+
+@implementation MBTaskRegistryTest
+
+- (void)testProjects {
+  MBTaskRegistry *r = [[[MBTaskRegistry alloc] init] autorelease];
+  STAssertTrue([r count] == 0, nil);
+  STAssertNil([r taskForProject:nil], nil);
+  STAssertNil([r taskForPid:0], nil);
+
+  MBProject *p0 = [MBProject projectWithName:@"name0" path:@"path0" port:@"8080"];
+  MBProject *p1 = [MBProject projectWithName:@"name1" path:@"path1" port:@"8081"];
+  MBEngineTask *t0 = [MBEngineTask taskWithProject:p0];
+  MBEngineTask *t1 = [MBEngineTask taskWithProject:p1];
+  [r addTask:t0];
+  [r addTask:t1];
+  [r taskDidLaunch:t0];  // no pid yet; no-op
+  STAssertTrue([r count] == 2, nil);
+  STAssertTrue([r taskForProject:p0] == t0, nil);
+  STAssertTrue([r taskForProject:p1] == t1, nil);
+  STAssertTrue([r taskForProjectIdentifier:[p1 identifier]] == t1, nil);
+  STAssertNil([r taskForProjectIdentifier:nil], nil);
+
+  // Removing a task that was replaced doesn't remove its replacement.
+  MBEngineTask *t2 = [MBEngineTask taskWithProject:p1];
+  [r addTask:t2];
+  [r removeTask:t1];
+  STAssertTrue([r taskForProject:p1] == t2, nil);
+
+  [r removeTask:t0];
+  [r removeTask:nil];  // no-op
+  STAssertNil([r taskForProject:p0], nil);
+  STAssertTrue([r count] == 1, nil);
+
+  [r removeAllTasks];
+  STAssertTrue([r count] == 0, nil);
+}
+
+- (void)testPids {
+  MBTaskRegistry *r = [[[MBTaskRegistry alloc] init] autorelease];
+  MBProject *p = [MBProject projectWithName:@"name0" path:@"path0" port:@"8080"];
+  MBEngineTask *t = [MBEngineTask taskWithProject:p];
+  [t setLaunchPath:@"/bin/echo"];
+  [t setArguments:[NSArray arrayWithObject:@"hi"]];
+  [r addTask:t];
+  [t launch];
+  [r taskDidLaunch:t];
+  int pid = [t processIdentifier];
+  STAssertTrue(pid > 0, nil);
+  STAssertTrue([r taskForPid:pid] == t, nil);
+  [t waitUntilExit];
+  STAssertTrue([t terminationStatus] == 0, nil);
+
+  [r removeTask:t];
+  STAssertNil([r taskForPid:pid], nil);
+  STAssertNil([r taskForProject:p], nil);
+}
+
+@end
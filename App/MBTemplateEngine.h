@@ -0,0 +1,84 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import <Foundation/Foundation.h>
+#include <stdint.h>
+
+struct MBTemplateFile;
+
+// An MBTemplateEngine makes a new project from a template directory
+// (such as a runtime's new_project_template), replacing placeholders
+// like "new-project-template" in the files that need it.
+//
+// Where the file system supports it (APFS), the whole template is
+// cloned copy-on-write with clonefile(2), which takes about the same
+// time whatever the template's size.  Otherwise directories are
+// created first and files are copied in parallel.  Either way the
+// result is writable by the user, and placeholder files are rewritten
+// in a single streaming pass, not read into memory.
+//
+// Files are never hard linked: projects are edited in place, and an
+// edit must not reach back into the Launcher's bundle.
+@interface MBTemplateEngine : NSObject {
+ @private
+  NSString *template_;
+  NSString *destination_;
+  NSDictionary *substitutions_;  // placeholder --> replacement
+  NSArray *substitutionFiles_;   // relative to the template
+  int threadCount_;
+  BOOL allowsCloning_;
+  BOOL cloned_;
+
+  // Files to copy when we can't clone.  Shared between workers.
+  struct MBTemplateFile *files_;
+  int fileCount_;
+  int fileCapacity_;
+  volatile int32_t nextFile_;
+  volatile int32_t failed_;
+  char errorMessage_[512];      // set by whoever first sets failed_
+}
+
+// Copy |source| to |destination| (which must not exist), replacing
+// each key of |substitutions| with its value as it goes.  The new
+// file gets |source|'s permissions plus u+w.
++ (BOOL)copyFile:(NSString *)source
+          toFile:(NSString *)destination
+   substitutions:(NSDictionary *)substitutions;
+
+// Designated initializer.
+- (id)initWithTemplate:(NSString *)templateDirectory
+           destination:(NSString *)destination;
+
+// Replace the keys of |substitutions| with their values in |files|
+// (paths relative to the template).
+- (void)setSubstitutions:(NSDictionary *)substitutions
+                forFiles:(NSArray *)files;
+
+// Copy threads when we can't clone.  Defaults to the number of CPUs.
+- (void)setThreadCount:(int)count;
+
+// Defaults to YES.  For testing the copy.
+- (void)setAllowsCloning:(BOOL)allowsCloning;
+
+// Make the project.  Fails if the destination exists.  On failure
+// anything we made is removed; see -error.
+- (BOOL)materialize;
+
+// YES if the last -materialize cloned the template.
+- (BOOL)cloned;
+
+- (NSString *)error;
+
+@end
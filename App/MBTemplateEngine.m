@@ -0,0 +1,506 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import "MBTemplateEngine.h"
+#include <dirent.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <libkern/OSAtomic.h>
+
+#ifndef CLONE_NOFOLLOW
+#define CLONE_NOFOLLOW 0x0001
+#endif
+
+static const size_t kCopyChunk = 64 * 1024;
+
+typedef struct MBTemplateFile {
+  char *source;
+  char *destination;
+  mode_t mode;
+  BOOL isLink;
+} MBTemplateFile;
+
+// clonefile(2) is only on 10.12 and later, so look it up at runtime.
+typedef int (*MBCloneFileFunc)(const char *, const char *, uint32_t);
+
+static MBCloneFileFunc MBCloneFile(void) {
+  static MBCloneFileFunc cloneFile = NULL;
+  static BOOL looked = NO;
+  if (!looked) {
+    cloneFile = (MBCloneFileFunc)dlsym(RTLD_DEFAULT, "clonefile");
+    looked = YES;
+  }
+  return cloneFile;
+}
+
+static BOOL MBWriteAll(int fd, const char *bytes, size_t length) {
+  while (length > 0) {
+    ssize_t count = write(fd, bytes, length);
+    if (count < 0) {
+      if (errno == EINTR)
+        continue;
+      return NO;
+    }
+    bytes += count;
+    length -= count;
+  }
+  return YES;
+}
+
+// Copy |in| to |out|, replacing keys[i] with values[i].  Keeps just
+// enough of each chunk back to catch a key split across two reads.
+static BOOL MBStreamReplace(int in, int out, const char **keys,
+                            const char **values, int count) {
+  size_t longest = 0;
+  for (int k = 0; k < count; k++) {
+    size_t length = strlen(keys[k]);
+    if (length > longest)
+      longest = length;
+  }
+  char *buffer = malloc(kCopyChunk + longest);
+  if (buffer == NULL)
+    return NO;
+
+  size_t pending = 0;
+  BOOL worked = YES;
+  for (;;) {
+    ssize_t got = read(in, buffer + pending, kCopyChunk);
+    if (got < 0) {
+      if (errno == EINTR)
+        continue;
+      worked = NO;
+      break;
+    }
+    BOOL atEnd = (got == 0);
+    size_t available = pending + got;
+    // Before |limit| every key fits in what we have.
+    size_t keep = longest ? longest - 1 : 0;
+    size_t limit = available;
+    if (!atEnd)
+      limit = (available > keep) ? available - keep : 0;
+
+    size_t flushed = 0;
+    size_t i = 0;
+    while (i < limit) {
+      int match = -1;
+      for (int k = 0; k < count && match < 0; k++) {
+        size_t length = strlen(keys[k]);
+        if ((length > 0) && (length <= available - i) &&
+            (memcmp(buffer + i, keys[k], length) == 0))
+          match = k;
+      }
+      if (match < 0) {
+        i++;
+        continue;
+      }
+      if (!MBWriteAll(out, buffer + flushed, i - flushed) ||
+          !MBWriteAll(out, values[match], strlen(values[match]))) {
+        worked = NO;
+        break;
+      }
+      i += strlen(keys[match]);
+      flushed = i;
+    }
+    if (!worked || !MBWriteAll(out, buffer + flushed, i - flushed)) {
+      worked = NO;
+      break;
+    }
+    pending = available - i;
+    memmove(buffer, buffer + i, pending);
+    if (atEnd)
+      break;
+  }
+  free(buffer);
+  return worked;
+}
+
+static void *MBTemplateWorker(void *arg);
+
+@interface MBTemplateEngine (Private)
+- (void)fail:(const char *)format, ...;
+- (BOOL)cloneTemplate;
+- (BOOL)makeWritable:(const char *)path;
+- (BOOL)collectDirectory:(const char *)source into:(const char *)destination;
+- (BOOL)copyFiles;
+- (BOOL)copyFile:(MBTemplateFile *)file buffer:(char *)buffer;
+- (BOOL)substitute;
+- (void)work;
+@end
+
+static void *MBTemplateWorker(void *arg) {
+  MBTemplateEngine *engine = (MBTemplateEngine *)arg;
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  [engine work];
+  [pool release];
+  return NULL;
+}
+
+@implementation MBTemplateEngine
+
++ (BOOL)copyFile:(NSString *)source
+          toFile:(NSString *)destination
+   substitutions:(NSDictionary *)substitutions {
+  int count = (int)[substitutions count];
+  const char **keys = calloc(count + 1, sizeof(char *));
+  const char **values = calloc(count + 1, sizeof(char *));
+  NSEnumerator *kenum = [substitutions keyEnumerator];
+  NSString *key = nil;
+  int i = 0;
+  while ((key = [kenum nextObject])) {
+    keys[i] = [key UTF8String];
+    values[i] = [[substitutions objectForKey:key] UTF8String];
+    i++;
+  }
+
+  BOOL worked = NO;
+  int in = open([source fileSystemRepresentation], O_RDONLY);
+  struct stat sb;
+  if ((in >= 0) && (fstat(in, &sb) == 0)) {
+    int out = open([destination fileSystemRepresentation],
+                   O_WRONLY | O_CREAT | O_EXCL, (sb.st_mode & 07777) | S_IWUSR);
+    if (out >= 0) {
+      worked = MBStreamReplace(in, out, keys, values, count);
+      if (close(out) != 0)
+        worked = NO;
+      if (!worked)
+        unlink([destination fileSystemRepresentation]);
+    }
+  }
+  if (in >= 0)
+    close(in);
+  free(keys);
+  free(values);
+  return worked;
+}
+
+- (id)init {
+  return [self initWithTemplate:nil destination:nil];
+}
+
+- (id)initWithTemplate:(NSString *)templateDirectory
+           destination:(NSString *)destination {
+  if ((self = [super init])) {
+    template_ = [templateDirectory copy];
+    destination_ = [destination copy];
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    threadCount_ = (cpus > 0) ? (int)cpus : 2;
+    allowsCloning_ = YES;
+  }
+  return self;
+}
+
+- (void)dealloc {
+  for (int i = 0; i < fileCount_; i++) {
+    free(files_[i].source);
+    free(files_[i].destination);
+  }
+  free(files_);
+  [template_ release];
+  [destination_ release];
+  [substitutions_ release];
+  [substitutionFiles_ release];
+  [super dealloc];
+}
+
+- (void)setSubstitutions:(NSDictionary *)substitutions
+                forFiles:(NSArray *)files {
+  [substitutions_ autorelease];
+  substitutions_ = [substitutions copy];
+  [substitutionFiles_ autorelease];
+  substitutionFiles_ = [files copy];
+}
+
+- (void)setThreadCount:(int)count {
+  threadCount_ = (count > 0) ? count : 1;
+}
+
+- (void)setAllowsCloning:(BOOL)allowsCloning {
+  allowsCloning_ = allowsCloning;
+}
+
+- (BOOL)cloned {
+  return cloned_;
+}
+
+- (NSString *)error {
+  if (!failed_)
+    return nil;
+  return [NSString stringWithUTF8String:errorMessage_];
+}
+
+- (BOOL)materialize {
+  const char *source = [template_ fileSystemRepresentation];
+  const char *destination = [destination_ fileSystemRepresentation];
+  struct stat sb;
+  if ((source == NULL) || (stat(source, &sb) != 0) || !S_ISDIR(sb.st_mode)) {
+    [self fail:"No template at %s", source ? source : "(nil)"];
+    return NO;
+  }
+  if ((destination == NULL) || (lstat(destination, &sb) == 0)) {
+    [self fail:"%s already exists", destination ? destination : "(nil)"];
+    return NO;
+  }
+
+  cloned_ = NO;
+  BOOL worked = NO;
+  if (allowsCloning_ && [self cloneTemplate]) {
+    cloned_ = YES;
+    worked = [self makeWritable:destination];
+  } else {
+    worked = [self collectDirectory:source into:destination] && [self copyFiles];
+  }
+  if (worked)
+    worked = [self substitute];
+
+  if (!worked)
+    [[NSFileManager defaultManager] removeFileAtPath:destination_ handler:nil];
+  return worked;
+}
+
+@end
+
+
+@implementation MBTemplateEngine (Private)
+
+- (void)fail:(const char *)format, ... {
+  // First failure wins.
+  if (!OSAtomicCompareAndSwap32Barrier(0, 1, &failed_))
+    return;
+  va_list args;
+  va_start(args, format);
+  vsnprintf(errorMessage_, sizeof(errorMessage_), format, args);
+  va_end(args);
+}
+
+// Clone the whole tree in one call.  Fails (quietly) if the file
+// system can't, or the destination is on another volume.
+- (BOOL)cloneTemplate {
+  MBCloneFileFunc cloneFile = MBCloneFile();
+  if (cloneFile == NULL)
+    return NO;
+  return (cloneFile([template_ fileSystemRepresentation],
+                    [destination_ fileSystemRepresentation],
+                    CLONE_NOFOLLOW) == 0);
+}
+
+// chmod -R u+w, without the chmod.  Clones keep the template's
+// (read-only) permissions.
+- (BOOL)makeWritable:(const char *)path {
+  struct stat sb;
+  if (lstat(path, &sb) != 0) {
+    [self fail:"Can't stat %s: %s", path, strerror(errno)];
+    return NO;
+  }
+  if (S_ISLNK(sb.st_mode))
+    return YES;
+  if (!(sb.st_mode & S_IWUSR) && (chmod(path, (sb.st_mode & 07777) | S_IWUSR) != 0)) {
+    [self fail:"Can't make %s writable: %s", path, strerror(errno)];
+    return NO;
+  }
+  if (!S_ISDIR(sb.st_mode))
+    return YES;
+
+  DIR *dir = opendir(path);
+  if (dir == NULL) {
+    [self fail:"Can't read %s: %s", path, strerror(errno)];
+    return NO;
+  }
+  BOOL worked = YES;
+  size_t pathLength = strlen(path);
+  struct dirent *entry;
+  while (worked && ((entry = readdir(dir)) != NULL)) {
+    if ((strcmp(entry->d_name, ".") == 0) || (strcmp(entry->d_name, "..") == 0))
+      continue;
+    size_t length = pathLength + 1 + strlen(entry->d_name) + 1;
+    char *child = malloc(length);
+    snprintf(child, length, "%s/%s", path, entry->d_name);
+    worked = [self makeWritable:child];
+    free(child);
+  }
+  closedir(dir);
+  return worked;
+}
+
+// Make |destination| and every directory below it now, and remember
+// the files so they can be copied in parallel.
+- (BOOL)collectDirectory:(const char *)source into:(const char *)destination {
+  struct stat sb;
+  if ((stat(source, &sb) != 0) ||
+      (mkdir(destination, (sb.st_mode & 07777) | S_IRWXU) != 0)) {
+    [self fail:"Can't create %s: %s", destination, strerror(errno)];
+    return NO;
+  }
+
+  DIR *dir = opendir(source);
+  if (dir == NULL) {
+    [self fail:"Can't read %s: %s", source, strerror(errno)];
+    return NO;
+  }
+  BOOL worked = YES;
+  size_t sourceLength = strlen(source);
+  size_t destinationLength = strlen(destination);
+  struct dirent *entry;
+  while (worked && ((entry = readdir(dir)) != NULL)) {
+    const char *name = entry->d_name;
+    if ((strcmp(name, ".") == 0) || (strcmp(name, "..") == 0))
+      continue;
+    size_t length = sourceLength + 1 + strlen(name) + 1;
+    char *childSource = malloc(length);
+    snprintf(childSource, length, "%s/%s", source, name);
+    length = destinationLength + 1 + strlen(name) + 1;
+    char *childDestination = malloc(length);
+    snprintf(childDestination, length, "%s/%s", destination, name);
+
+    struct stat child;
+    if (lstat(childSource, &child) != 0) {
+      [self fail:"Can't stat %s: %s", childSource, strerror(errno)];
+      worked = NO;
+    } else if (S_ISDIR(child.st_mode)) {
+      worked = [self collectDirectory:childSource into:childDestination];
+    } else if (S_ISREG(child.st_mode) || S_ISLNK(child.st_mode)) {
+      if (fileCount_ == fileCapacity_) {
+        fileCapacity_ = fileCapacity_ ? fileCapacity_ * 2 : 64;
+        files_ = realloc(files_, fileCapacity_ * sizeof(MBTemplateFile));
+      }
+      MBTemplateFile *file = &files_[fileCount_++];
+      file->source = childSource;
+      file->destination = childDestination;
+      file->mode = (child.st_mode & 07777) | S_IWUSR;
+      file->isLink = S_ISLNK(child.st_mode);
+      continue;  // |file| owns the paths now
+    }
+    free(childSource);
+    free(childDestination);
+  }
+  closedir(dir);
+  return worked;
+}
+
+- (BOOL)copyFiles {
+  if (fileCount_ == 0)
+    return YES;
+  nextFile_ = 0;
+  int threads = threadCount_;
+  if (threads > fileCount_)
+    threads = fileCount_;
+  pthread_t *workers = calloc(threads, sizeof(pthread_t));
+  int started = 0;
+  for (int i = 0; i < threads; i++) {
+    if (pthread_create(&workers[started], NULL, MBTemplateWorker, self) == 0)
+      started++;
+  }
+  if (started == 0)
+    [self work];
+  for (int i = 0; i < started; i++)
+    pthread_join(workers[i], NULL);
+  free(workers);
+  return !failed_;
+}
+
+- (BOOL)copyFile:(MBTemplateFile *)file buffer:(char *)buffer {
+  if (file->isLink) {
+    char target[PATH_MAX];
+    ssize_t length = readlink(file->source, target, sizeof(target) - 1);
+    if (length < 0) {
+      [self fail:"Can't read link %s: %s", file->source, strerror(errno)];
+      return NO;
+    }
+    target[length] = '\0';
+    if (symlink(target, file->destination) != 0) {
+      [self fail:"Can't create %s: %s", file->destination, strerror(errno)];
+      return NO;
+    }
+    return YES;
+  }
+
+  int in = open(file->source, O_RDONLY);
+  if (in < 0) {
+    [self fail:"Can't open %s: %s", file->source, strerror(errno)];
+    return NO;
+  }
+  int out = open(file->destination, O_WRONLY | O_CREAT | O_EXCL, file->mode);
+  if (out < 0) {
+    [self fail:"Can't create %s: %s", file->destination, strerror(errno)];
+    close(in);
+    return NO;
+  }
+  BOOL worked = YES;
+  for (;;) {
+    ssize_t count = read(in, buffer, kCopyChunk);
+    if ((count < 0) && (errno == EINTR))
+      continue;
+    if (count <= 0) {
+      worked = (count == 0);
+      break;
+    }
+    if (!MBWriteAll(out, buffer, count)) {
+      worked = NO;
+      break;
+    }
+  }
+  if (close(out) != 0)
+    worked = NO;
+  close(in);
+  if (!worked)
+    [self fail:"Can't copy %s: %s", file->source, strerror(errno)];
+  return worked;
+}
+
+// Rewrite each placeholder file from the template, then swap it in.
+- (BOOL)substitute {
+  if ([substitutions_ count] == 0)
+    return YES;
+  NSEnumerator *fenum = [substitutionFiles_ objectEnumerator];
+  NSString *file = nil;
+  while ((file = [fenum nextObject])) {
+    NSString *source = [template_ stringByAppendingPathComponent:file];
+    NSString *destination = [destination_ stringByAppendingPathComponent:file];
+    NSString *temp = [destination stringByAppendingPathExtension:@"mbtmp"];
+    if (![[NSFileManager defaultManager] fileExistsAtPath:source])
+      continue;
+    if (![MBTemplateEngine copyFile:source
+                             toFile:temp
+                      substitutions:substitutions_] ||
+        (rename([temp fileSystemRepresentation],
+                [destination fileSystemRepresentation]) != 0)) {
+      [self fail:"Can't set up %s", [destination fileSystemRepresentation]];
+      unlink([temp fileSystemRepresentation]);
+      return NO;
+    }
+  }
+  return YES;
+}
+
+- (void)work {
+  char *buffer = malloc(kCopyChunk);
+  for (;;) {
+    int32_t index = OSAtomicIncrement32Barrier(&nextFile_) - 1;
+    if ((index >= fileCount_) || failed_)
+      break;
+    if (![self copyFile:&files_[index] buffer:buffer])
+      break;
+  }
+  free(buffer);
+}
+
+@end
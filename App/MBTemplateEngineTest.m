@@ -0,0 +1,199 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import <SenTestingKit/SenTestingKit.h>
+#import <Cocoa/Cocoa.h>
+#import "MBTemplateEngine.h"
+#import "MBTemplateEngineTest.h"
+#include <sys/stat.h>
+
+@implementation MBTemplateEngineTest
+
+- (NSString *)scratchDirectory {
+  int pid = [[NSProcessInfo processInfo] processIdentifier];
+  NSString *dir = [NSString stringWithFormat:@"/tmp/templatetest-%d", pid];
+  [[NSFileManager defaultManager] createDirectoryAtPath:dir attributes:nil];
+  return dir;
+}
+
+- (void)writeString:(NSString *)string toFile:(NSString *)path mode:(int)mode {
+  [string writeToFile:path atomically:NO encoding:NSUTF8StringEncoding error:NULL];
+  chmod([path fileSystemRepresentation], mode);
+}
+
+// A small read-only template, like the one in a runtime bundle.
+- (NSString *)makeTemplateIn:(NSString *)dir {
+  NSFileManager *fm = [NSFileManager defaultManager];
+  NSString *template = [dir stringByAppendingPathComponent:@"template"];
+  NSString *lib = [template stringByAppendingPathComponent:@"lib"];
+  [fm createDirectoryAtPath:template attributes:nil];
+  [fm createDirectoryAtPath:lib attributes:nil];
+  [self writeString:@"application: new-project-template\nversion: 1\n"
+             toFile:[template stringByAppendingPathComponent:@"app.yaml"]
+               mode:0444];
+  [self writeString:@"print 'new-project-template'\n"
+             toFile:[template stringByAppendingPathComponent:@"main.py"]
+               mode:0555];
+  NSMutableString *big = [NSMutableString string];
+  for (int i = 0; i < 20000; i++)
+    [big appendString:@"# vendored library line\n"];
+  for (int i = 0; i < 20; i++) {
+    NSString *name = [NSString stringWithFormat:@"module%d.py", i];
+    [self writeString:big toFile:[lib stringByAppendingPathComponent:name] mode:0444];
+  }
+  [fm createSymbolicLinkAtPath:[template stringByAppendingPathComponent:@"link.py"]
+                   pathContent:@"main.py"];
+  chmod([lib fileSystemRepresentation], 0555);
+  return template;
+}
+
+- (void)removeDirectory:(NSString *)dir {
+  // Our templates are read-only.
+  NSTask *task = [NSTask launchedTaskWithLaunchPath:@"/bin/chmod"
+                                          arguments:[NSArray arrayWithObjects:
+                                                               @"-R", @"u+w", dir, nil]];
+  [task waitUntilExit];
+  [[NSFileManager defaultManager] removeFileAtPath:dir handler:nil];
+}
+
+- (void)checkProject:(NSString *)project template:(NSString *)template {
+  NSFileManager *fm = [NSFileManager defaultManager];
+  NSString *yaml = [NSString stringWithContentsOfFile:
+                               [project stringByAppendingPathComponent:@"app.yaml"]
+                                             encoding:NSUTF8StringEncoding
+                                                error:NULL];
+  STAssertEqualObjects(yaml, @"application: myapp\nversion: 1\n", nil);
+  // Only the files asked for are changed.
+  NSString *main = [project stringByAppendingPathComponent:@"main.py"];
+  STAssertTrue([fm contentsEqualAtPath:main
+                               andPath:[template stringByAppendingPathComponent:@"main.py"]],
+               nil);
+  STAssertTrue([fm contentsEqualAtPath:[project stringByAppendingPathComponent:@"lib"]
+                               andPath:[template stringByAppendingPathComponent:@"lib"]],
+               nil);
+  STAssertEqualObjects([fm pathContentOfSymbolicLinkAtPath:
+                             [project stringByAppendingPathComponent:@"link.py"]],
+                       @"main.py", nil);
+
+  // Everything is writable; modes are otherwise kept.
+  struct stat sb;
+  STAssertEquals(stat([main fileSystemRepresentation], &sb), 0, nil);
+  STAssertEquals((int)(sb.st_mode & 0777), 0755, nil);
+  NSString *module = [project stringByAppendingPathComponent:@"lib/module3.py"];
+  STAssertEquals(stat([module fileSystemRepresentation], &sb), 0, nil);
+  STAssertTrue((sb.st_mode & S_IWUSR) != 0, nil);
+  STAssertEquals(stat([[project stringByAppendingPathComponent:@"lib"]
+                        fileSystemRepresentation], &sb), 0, nil);
+  STAssertTrue((sb.st_mode & S_IWUSR) != 0, nil);
+  STAssertFalse([fm fileExistsAtPath:[project stringByAppendingPathComponent:
+                                                @"app.yaml.mbtmp"]], nil);
+
+  // Editing the project leaves the template alone.
+  [self writeString:@"changed" toFile:module mode:0644];
+  STAssertFalse([fm contentsEqualAtPath:module
+                                andPath:[template stringByAppendingPathComponent:
+                                                    @"lib/module3.py"]], nil);
+}
+
+- (void)testCopyFile {
+  NSString *dir = [self scratchDirectory];
+  NSString *source = [dir stringByAppendingPathComponent:@"in"];
+  NSString *dest = [dir stringByAppendingPathComponent:@"out"];
+  NSMutableString *input = [NSMutableString string];
+  NSMutableString *expected = [NSMutableString string];
+  // Big enough that placeholders straddle reads.
+  for (int i = 0; i < 10000; i++) {
+    [input appendFormat:@"%d: new-project-template and OLD\n", i];
+    [expected appendFormat:@"%d: myapp and NEW\n", i];
+  }
+  [self writeString:input toFile:source mode:0444];
+  NSDictionary *subs = [NSDictionary dictionaryWithObjectsAndKeys:
+                                       @"myapp", @"new-project-template",
+                                       @"NEW", @"OLD", nil];
+  STAssertTrue([MBTemplateEngine copyFile:source toFile:dest substitutions:subs], nil);
+  STAssertEqualObjects([NSString stringWithContentsOfFile:dest
+                                                 encoding:NSUTF8StringEncoding
+                                                    error:NULL],
+                       expected, nil);
+  struct stat sb;
+  STAssertEquals(stat([dest fileSystemRepresentation], &sb), 0, nil);
+  STAssertEquals((int)(sb.st_mode & 0777), 0644, nil);
+
+  // Won't overwrite.
+  STAssertFalse([MBTemplateEngine copyFile:source toFile:dest substitutions:subs], nil);
+
+  [self removeDirectory:dir];
+}
+
+- (void)testCopy {
+  NSString *dir = [self scratchDirectory];
+  NSString *template = [self makeTemplateIn:dir];
+  NSString *project = [dir stringByAppendingPathComponent:@"project"];
+  MBTemplateEngine *engine = [[[MBTemplateEngine alloc] initWithTemplate:template
+                                                             destination:project]
+                               autorelease];
+  [engine setAllowsCloning:NO];
+  [engine setThreadCount:4];
+  [engine setSubstitutions:[NSDictionary dictionaryWithObject:@"myapp"
+                                                       forKey:@"new-project-template"]
+                  forFiles:[NSArray arrayWithObjects:@"app.yaml", @"missing.yaml", nil]];
+  STAssertTrue([engine materialize], [engine error]);
+  STAssertFalse([engine cloned], nil);
+  STAssertNil([engine error], nil);
+  [self checkProject:project template:template];
+  [self removeDirectory:dir];
+}
+
+// Clones where it can (APFS); either way the result is the same.
+- (void)testClone {
+  NSString *dir = [self scratchDirectory];
+  NSString *template = [self makeTemplateIn:dir];
+  NSString *project = [dir stringByAppendingPathComponent:@"project"];
+  MBTemplateEngine *engine = [[[MBTemplateEngine alloc] initWithTemplate:template
+                                                             destination:project]
+                               autorelease];
+  [engine setSubstitutions:[NSDictionary dictionaryWithObject:@"myapp"
+                                                       forKey:@"new-project-template"]
+                  forFiles:[NSArray arrayWithObject:@"app.yaml"]];
+  STAssertTrue([engine materialize], [engine error]);
+  [self checkProject:project template:template];
+  [self removeDirectory:dir];
+}
+
+- (void)testFailure {
+  NSString *dir = [self scratchDirectory];
+  NSString *template = [self makeTemplateIn:dir];
+
+  // Destination exists.
+  MBTemplateEngine *engine = [[[MBTemplateEngine alloc] initWithTemplate:template
+                                                             destination:dir]
+                               autorelease];
+  STAssertFalse([engine materialize], nil);
+  STAssertNotNil([engine error], nil);
+  STAssertTrue([[NSFileManager defaultManager] fileExistsAtPath:template], nil);
+
+  // No template.
+  NSString *project = [dir stringByAppendingPathComponent:@"project"];
+  engine = [[[MBTemplateEngine alloc]
+              initWithTemplate:[dir stringByAppendingPathComponent:@"none"]
+                   destination:project] autorelease];
+  STAssertFalse([engine materialize], nil);
+  STAssertNotNil([engine error], nil);
+  STAssertFalse([[NSFileManager defaultManager] fileExistsAtPath:project], nil);
+
+  [self removeDirectory:dir];
+}
+
+@end
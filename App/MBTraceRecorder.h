@@ -0,0 +1,111 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import <Foundation/Foundation.h>
+
+// MBTraceRecorder keeps a rolling record of what the launcher has been
+// doing -- UI actions, project saves, and the life of every dev_appserver
+// -- and exports it as Chrome trace event JSON, which chrome://tracing,
+// Perfetto and other trace viewers open:
+//
+//   curl http://127.0.0.1:9119/trace > launcher.json  (see MBMetricsServer)
+//
+// Each dev_appserver gets its own row, split into phases by its
+// lifecycle events:
+//
+//   spawn -> starting -> output -> loading -> ready -> serving
+//         -> signal -> stopping -> exit
+//
+// so a slow start-all shows which servers were still importing (before
+// their first output), loading (before "Running application") or hung.
+// Launcher threads get a row each for the spans and instants recorded
+// on them.
+//
+// Recording never takes a lock. Each thread appends to its own ring
+// buffer (the last kMBTraceRecorderCapacity events; older ones are
+// overwritten), and publishes each event with a memory barrier. Buffers
+// are allocated on a thread's first event and handed on to later threads
+// when it exits. Exporting copies every buffer without stopping the
+// threads, skipping any event which was overwritten while it was copied.
+//
+// Names and categories must be string constants (string literals,
+// __func__ or selector names): only the pointer is kept. Details are
+// copied, and truncated to a few dozen bytes.
+//
+// If the MBTraceFile default is set, the trace is written there when the
+// launcher quits; MBTraceRecorderDump(path) writes it from gdb.
+
+#define kMBTraceRecorderCapacity 8192
+
+@interface MBTraceRecorder : NSObject
+
+// Every event recorded (and not yet overwritten), as Chrome trace event
+// dictionaries ("name", "cat", "ph", "ts", "pid", "tid", ...), oldest
+// first, followed by metadata naming the processes and threads.
++ (NSArray *)traceEvents;
+
+// +traceEvents as JSON: {"traceEvents": [...], "displayTimeUnit": "ms"}.
++ (NSData *)chromeTraceData;
+
+// Writes +chromeTraceData to |path|. Returns NO if it can't.
++ (BOOL)writeChromeTraceToPath:(NSString *)path;
+
+// Writes the trace to the MBTraceFile default's path, if it's set, when
+// the application terminates.
++ (void)writeOnTerminateFromDefaults;
+
+@end
+
+// A span on this thread: "B" and "E" events.
+void MBTraceRecordBegin(const char *category, const char *name);
+void MBTraceRecordEnd(const char *category, const char *name);
+
+// A moment on this thread. |detail| may be NULL.
+void MBTraceRecordInstant(const char *category, const char *name,
+                          const char *detail);
+
+// A lifecycle event of child process |pid|: "spawn", "output", "ready",
+// "signal" or "exit". |project| (copied) names its row.
+void MBTraceRecordTask(const char *event, int pid, const char *project);
+
+// Writes the trace to |path|; for gdb.
+void MBTraceRecorderDump(const char *path);
+
+// For MB_TRACE_EVENT_SCOPE().
+typedef struct {
+  const char *category;
+  const char *name;
+  int span;  // in the startup trace, or -1
+} MBTraceEventScope;
+MBTraceEventScope MBTraceEventScopeBegin(const char *category,
+                                         const char *name);
+void MBTraceEventScopeEnd(MBTraceEventScope *scope);
+
+// Records a span for the rest of the enclosing block:
+//
+//   - (IBAction)stopCurrentProjects:(id)sender {
+//     MB_TRACE_EVENT_SCOPE("ui", __func__);
+//     ...
+//
+// While MBStartupTrace is recording, the span goes into its timeline
+// too (see MB_TRACE_SCOPE()).
+#define MB_TRACE_EVENT_SCOPE(category, name) \
+  MB_TRACE_EVENT_SCOPE_AT_LINE(category, name, __LINE__)
+#define MB_TRACE_EVENT_SCOPE_AT_LINE(category, name, line) \
+  MB_TRACE_EVENT_SCOPE_VARIABLE(category, name, line)
+#define MB_TRACE_EVENT_SCOPE_VARIABLE(category, name, line) \
+  MBTraceEventScope MBTraceEventScope##line \
+    __attribute__((cleanup(MBTraceEventScopeEnd), unused)) = \
+    MBTraceEventScopeBegin(category, name)
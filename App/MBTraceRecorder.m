@@ -0,0 +1,458 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import <Cocoa/Cocoa.h>
+#import "MBTraceRecorder.h"
+#import "MBStartupTrace.h"
+#import <libkern/OSAtomic.h>
+#import <mach/mach_time.h>
+#import <pthread.h>
+#import <stdio.h>
+#import <stdlib.h>
+#import <string.h>
+#import <unistd.h>
+
+static NSString *const kMBTraceFileKey = @"MBTraceFile";
+
+@interface MBTraceRecorder (PrivateMethods)
++ (void)applicationWillTerminate:(NSNotification *)notification;
+@end
+
+// Internal phase for MBTraceRecordTask(); exported as "i" plus "X" spans.
+#define kMBTraceTaskPhase 'T'
+
+// 64 bytes.
+typedef struct {
+  uint64_t time;         // mach_absolute_time()
+  const char *name;      // constant
+  const char *category;  // constant
+  int32_t pid;           // the child, for task events
+  mach_port_t thread;
+  char phase;            // 'B', 'E', 'i' or kMBTraceTaskPhase
+  char detail[31];
+} MBTraceEvent;
+
+// One thread's events. Only the owning thread writes; |head| counts every
+// event it has written, so event n is in slot n % kMBTraceRecorderCapacity
+// once |head| has passed n.
+typedef struct MBTraceThreadBuffer {
+  struct MBTraceThreadBuffer *next;  // all buffers; never freed
+  volatile int32_t inUse;            // owned by a live thread
+  volatile int32_t head;              // one word, so it's read whole
+  MBTraceEvent events[kMBTraceRecorderCapacity];
+} MBTraceThreadBuffer;
+
+static MBTraceThreadBuffer *volatile gBuffers = NULL;
+static mach_port_t gMainThread = 0;
+
+static pthread_key_t gBufferKey;
+static pthread_once_t gBufferKeyOnce = PTHREAD_ONCE_INIT;
+
+// Hands the buffer on to the next thread which needs one.
+static void MBTraceReleaseBuffer(void *value) {
+  OSAtomicCompareAndSwap32Barrier(1, 0, &((MBTraceThreadBuffer *)value)->inUse);
+}
+
+static void MBTraceCreateBufferKey(void) {
+  pthread_key_create(&gBufferKey, MBTraceReleaseBuffer);
+}
+
+static MBTraceThreadBuffer *MBTraceCurrentBuffer(void) {
+  pthread_once(&gBufferKeyOnce, MBTraceCreateBufferKey);
+  MBTraceThreadBuffer *buffer = pthread_getspecific(gBufferKey);
+  if (buffer)
+    return buffer;
+
+  for (buffer = gBuffers; buffer; buffer = buffer->next) {
+    if (OSAtomicCompareAndSwap32Barrier(0, 1, &buffer->inUse))
+      break;
+  }
+  if (buffer == NULL) {
+    buffer = calloc(1, sizeof(MBTraceThreadBuffer));
+    if (buffer == NULL)
+      return NULL;
+    buffer->inUse = 1;
+    do {
+      buffer->next = gBuffers;
+    } while (!OSAtomicCompareAndSwapPtrBarrier(buffer->next, buffer,
+                                               (void *volatile *)&gBuffers));
+  }
+  if (pthread_main_np())
+    gMainThread = pthread_mach_thread_np(pthread_self());
+  pthread_setspecific(gBufferKey, buffer);
+  return buffer;
+}
+
+static void MBTraceRecord(char phase, const char *category, const char *name,
+                          int pid, const char *detail) {
+  MBTraceThreadBuffer *buffer = MBTraceCurrentBuffer();
+  if (buffer == NULL)
+    return;
+  int64_t head = buffer->head;
+  MBTraceEvent *event = &buffer->events[head % kMBTraceRecorderCapacity];
+  event->time = mach_absolute_time();
+  event->name = name ? name : "?";
+  event->category = category ? category : "";
+  event->pid = pid;
+  event->thread = pthread_mach_thread_np(pthread_self());
+  event->phase = phase;
+  strlcpy(event->detail, detail ? detail : "", sizeof(event->detail));
+  // The event must be complete before it's counted.
+  OSMemoryBarrier();
+  buffer->head = head + 1;
+}
+
+void MBTraceRecordBegin(const char *category, const char *name) {
+  MBTraceRecord('B', category, name, 0, NULL);
+}
+
+void MBTraceRecordEnd(const char *category, const char *name) {
+  MBTraceRecord('E', category, name, 0, NULL);
+}
+
+void MBTraceRecordInstant(const char *category, const char *name,
+                          const char *detail) {
+  MBTraceRecord('i', category, name, 0, detail);
+}
+
+void MBTraceRecordTask(const char *event, int pid, const char *project) {
+  MBTraceRecord(kMBTraceTaskPhase, "task", event, pid, project);
+}
+
+MBTraceEventScope MBTraceEventScopeBegin(const char *category,
+                                         const char *name) {
+  MBTraceRecordBegin(category, name);
+  MBTraceEventScope scope = { category, name, MBTraceBegin(name) };
+  return scope;
+}
+
+void MBTraceEventScopeEnd(MBTraceEventScope *scope) {
+  MBTraceEnd(scope->span);
+  MBTraceRecordEnd(scope->category, scope->name);
+}
+
+void MBTraceRecorderDump(const char *path) {
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  NSString *string = [[NSFileManager defaultManager]
+                       stringWithFileSystemRepresentation:path
+                                                   length:strlen(path)];
+  if (![MBTraceRecorder writeChromeTraceToPath:string])
+    fprintf(stderr, "MBTraceRecorderDump: can't write %s\n", path);
+  [pool release];
+}
+
+static double MBTraceMicroseconds(uint64_t ticks) {
+  static mach_timebase_info_data_t timebase;
+  if (timebase.denom == 0)
+    mach_timebase_info(&timebase);
+  return (double)ticks * timebase.numer / timebase.denom / 1e3;
+}
+
+// An event copied out of its buffer, with where it came from so that
+// events recorded at the same time keep their order.
+typedef struct {
+  MBTraceEvent event;
+  int buffer;
+  int64_t sequence;
+} MBTraceCopy;
+
+static int MBTraceCompareCopies(const void *a, const void *b) {
+  const MBTraceCopy *x = a;
+  const MBTraceCopy *y = b;
+  if (x->event.time != y->event.time)
+    return (x->event.time < y->event.time) ? -1 : 1;
+  if (x->buffer != y->buffer)
+    return (x->buffer < y->buffer) ? -1 : 1;
+  if (x->sequence != y->sequence)
+    return (x->sequence < y->sequence) ? -1 : 1;
+  return 0;
+}
+
+// Copies what's in |buffer| onto the end of |copies|.
+static void MBTraceCopyBuffer(MBTraceThreadBuffer *buffer, int index,
+                              NSMutableData *copies) {
+  int64_t head = buffer->head;
+  OSMemoryBarrier();
+  int64_t first = head - kMBTraceRecorderCapacity;
+  if (first < 0)
+    first = 0;
+  NSUInteger start = [copies length];
+  [copies increaseLengthBy:(head - first) * sizeof(MBTraceCopy)];
+  MBTraceCopy *out = (MBTraceCopy *)((char *)[copies mutableBytes] + start);
+  for (int64_t n = first; n < head; n++, out++) {
+    out->event = buffer->events[n % kMBTraceRecorderCapacity];
+    out->buffer = index;
+    out->sequence = n;
+  }
+  OSMemoryBarrier();
+
+  // The thread may have gone on writing while we copied; anything it
+  // could have been overwriting meanwhile is dropped. (The slot for the
+  // event being written now is the one for |after| - capacity.)
+  int64_t after = buffer->head;
+  int64_t valid = after - kMBTraceRecorderCapacity + 1;
+  if (valid > first) {
+    int64_t skip = (valid < head ? valid : head) - first;
+    MBTraceCopy *copied = (MBTraceCopy *)((char *)[copies mutableBytes] + start);
+    memmove(copied, copied + skip, (head - first - skip) * sizeof(MBTraceCopy));
+    [copies setLength:start + (head - first - skip) * sizeof(MBTraceCopy)];
+  }
+}
+
+// The phase a task is in after |event|.
+static NSString *MBTracePhaseAfter(const char *event) {
+  static const char *const kEvents[] = { "spawn", "output", "ready", "signal" };
+  static NSString *const kPhases[] = {
+    @"starting", @"loading", @"serving", @"stopping"
+  };
+  for (size_t i = 0; i < sizeof(kEvents) / sizeof(kEvents[0]); i++) {
+    if (strcmp(event, kEvents[i]) == 0)
+      return kPhases[i];
+  }
+  return nil;
+}
+
+static NSString *MBTraceString(const char *string) {
+  NSString *result = [NSString stringWithUTF8String:string];
+  // A detail truncated in the middle of a character isn't UTF-8.
+  if (result == nil)
+    result = [NSString stringWithCString:string
+                                encoding:NSISOLatin1StringEncoding];
+  return result;
+}
+
+static NSMutableDictionary *MBTraceEventDictionary(NSString *name,
+                                                   NSString *category,
+                                                   NSString *phase,
+                                                   double ts,
+                                                   int pid,
+                                                   int tid) {
+  return [NSMutableDictionary dictionaryWithObjectsAndKeys:
+          name, @"name",
+          category, @"cat",
+          phase, @"ph",
+          [NSNumber numberWithDouble:ts], @"ts",
+          [NSNumber numberWithInt:pid], @"pid",
+          [NSNumber numberWithInt:tid], @"tid",
+          nil];
+}
+
+static NSDictionary *MBTraceMetadata(NSString *name, int pid, int tid,
+                                     NSString *value) {
+  return [NSDictionary dictionaryWithObjectsAndKeys:
+          name, @"name",
+          @"M", @"ph",
+          [NSNumber numberWithInt:pid], @"pid",
+          [NSNumber numberWithInt:tid], @"tid",
+          [NSDictionary dictionaryWithObject:value forKey:@"name"], @"args",
+          nil];
+}
+
+static void MBTraceAppendJSON(NSMutableString *json, id object) {
+  if ([object isKindOfClass:[NSDictionary class]]) {
+    [json appendString:@"{"];
+    NSArray *keys = [[object allKeys] sortedArrayUsingSelector:@selector(compare:)];
+    NSEnumerator *keyEnumerator = [keys objectEnumerator];
+    NSString *key = nil;
+    BOOL first = YES;
+    while ((key = [keyEnumerator nextObject])) {
+      if (!first)
+        [json appendString:@","];
+      first = NO;
+      MBTraceAppendJSON(json, key);
+      [json appendString:@":"];
+      MBTraceAppendJSON(json, [object objectForKey:key]);
+    }
+    [json appendString:@"}"];
+  } else if ([object isKindOfClass:[NSArray class]]) {
+    [json appendString:@"["];
+    NSEnumerator *itemEnumerator = [object objectEnumerator];
+    id item = nil;
+    BOOL first = YES;
+    while ((item = [itemEnumerator nextObject])) {
+      // One event per line, so the file can be read (and diffed).
+      [json appendString:(first ? @"\n" : @",\n")];
+      first = NO;
+      MBTraceAppendJSON(json, item);
+    }
+    [json appendString:@"]"];
+  } else if ([object isKindOfClass:[NSNumber class]]) {
+    [json appendFormat:@"%.15g", [object doubleValue]];
+  } else {
+    NSString *string = [object description];
+    [json appendString:@"\""];
+    unsigned length = [string length];
+    for (unsigned i = 0; i < length; i++) {
+      unichar c = [string characterAtIndex:i];
+      if (c == '"' || c == '\\')
+        [json appendFormat:@"\\%C", c];
+      else if (c < 0x20)
+        [json appendFormat:@"\\u%04x", c];
+      else
+        [json appendFormat:@"%C", c];
+    }
+    [json appendString:@"\""];
+  }
+}
+
+@implementation MBTraceRecorder
+
++ (NSArray *)traceEvents {
+  NSMutableData *copies = [NSMutableData data];
+  int index = 0;
+  for (MBTraceThreadBuffer *buffer = gBuffers; buffer; buffer = buffer->next)
+    MBTraceCopyBuffer(buffer, index++, copies);
+  unsigned count = [copies length] / sizeof(MBTraceCopy);
+  MBTraceCopy *sorted = [copies mutableBytes];
+  qsort(sorted, count, sizeof(MBTraceCopy), MBTraceCompareCopies);
+
+  NSMutableArray *events = [NSMutableArray arrayWithCapacity:count];
+  if (count == 0)
+    return events;
+  uint64_t base = sorted[0].event.time;
+  int launcher = getpid();
+  NSMutableSet *threads = [NSMutableSet set];
+  NSMutableDictionary *tasks = [NSMutableDictionary dictionary];  // pid -> name
+  // Each running task's current phase: pid -> [phase, NSNumber start].
+  NSMutableDictionary *phases = [NSMutableDictionary dictionary];
+
+  for (unsigned i = 0; i < count; i++) {
+    MBTraceEvent *event = &sorted[i].event;
+    double ts = MBTraceMicroseconds(event->time - base);
+    NSString *name = MBTraceString(event->name);
+    NSString *category = MBTraceString(event->category);
+    NSString *detail = event->detail[0] ? MBTraceString(event->detail) : nil;
+
+    if (event->phase != kMBTraceTaskPhase) {
+      NSMutableDictionary *dict =
+        MBTraceEventDictionary(name, category,
+                               [NSString stringWithFormat:@"%c", event->phase],
+                               ts, launcher, event->thread);
+      if (event->phase == 'i')
+        [dict setObject:@"t" forKey:@"s"];
+      if (detail)
+        [dict setObject:[NSDictionary dictionaryWithObject:detail
+                                                    forKey:@"detail"]
+                 forKey:@"args"];
+      [events addObject:dict];
+      [threads addObject:[NSNumber numberWithUnsignedInt:event->thread]];
+      continue;
+    }
+
+    // A task: close the phase it was in and start the next.
+    NSNumber *pid = [NSNumber numberWithInt:event->pid];
+    if (detail)
+      [tasks setObject:detail forKey:pid];
+    else if ([tasks objectForKey:pid] == nil)
+      [tasks setObject:@"" forKey:pid];
+    NSArray *current = [phases objectForKey:pid];
+    if (current) {
+      double start = [[current objectAtIndex:1] doubleValue];
+      NSMutableDictionary *span =
+        MBTraceEventDictionary([current objectAtIndex:0], @"task", @"X",
+                               start, event->pid, event->pid);
+      [span setObject:[NSNumber numberWithDouble:ts - start] forKey:@"dur"];
+      [events addObject:span];
+      [phases removeObjectForKey:pid];
+    }
+    NSMutableDictionary *instant =
+      MBTraceEventDictionary(name, @"task", @"i", ts, event->pid, event->pid);
+    [instant setObject:@"t" forKey:@"s"];
+    [events addObject:instant];
+    NSString *next = MBTracePhaseAfter(event->name);
+    if (next)
+      [phases setObject:[NSArray arrayWithObjects:
+                         next, [NSNumber numberWithDouble:ts], nil]
+                 forKey:pid];
+  }
+
+  // Whatever tasks are still doing, they're doing it now.
+  double now = MBTraceMicroseconds(mach_absolute_time() - base);
+  NSEnumerator *pidEnumerator = [phases keyEnumerator];
+  NSNumber *pid = nil;
+  while ((pid = [pidEnumerator nextObject])) {
+    NSArray *current = [phases objectForKey:pid];
+    double start = [[current objectAtIndex:1] doubleValue];
+    NSMutableDictionary *span =
+      MBTraceEventDictionary([current objectAtIndex:0], @"task", @"X",
+                             start, [pid intValue], [pid intValue]);
+    [span setObject:[NSNumber numberWithDouble:now - start] forKey:@"dur"];
+    [events addObject:span];
+  }
+
+  NSString *launcherName = [[NSProcessInfo processInfo] processName];
+  [events addObject:MBTraceMetadata(@"process_name", launcher, 0,
+                                    launcherName)];
+  NSEnumerator *threadEnumerator = [threads objectEnumerator];
+  NSNumber *thread = nil;
+  while ((thread = [threadEnumerator nextObject])) {
+    NSString *threadName = ([thread unsignedIntValue] == gMainThread)
+      ? @"main"
+      : [NSString stringWithFormat:@"thread %@", thread];
+    [events addObject:MBTraceMetadata(@"thread_name", launcher,
+                                      [thread intValue], threadName)];
+  }
+  pidEnumerator = [tasks keyEnumerator];
+  while ((pid = [pidEnumerator nextObject])) {
+    NSString *project = [tasks objectForKey:pid];
+    NSString *taskName = [project length]
+      ? [NSString stringWithFormat:@"dev_appserver %@ (%@)", project, pid]
+      : [NSString stringWithFormat:@"dev_appserver (%@)", pid];
+    [events addObject:MBTraceMetadata(@"process_name", [pid intValue], 0,
+                                      taskName)];
+  }
+  return events;
+}
+
++ (NSData *)chromeTraceData {
+  NSDictionary *trace = [NSDictionary dictionaryWithObjectsAndKeys:
+                         [self traceEvents], @"traceEvents",
+                         @"ms", @"displayTimeUnit",
+                         nil];
+  NSMutableString *json = [NSMutableString string];
+  MBTraceAppendJSON(json, trace);
+  [json appendString:@"\n"];
+  return [json dataUsingEncoding:NSUTF8StringEncoding];
+}
+
++ (BOOL)writeChromeTraceToPath:(NSString *)path {
+  return [[self chromeTraceData] writeToFile:path atomically:YES];
+}
+
++ (void)writeOnTerminateFromDefaults {
+  if ([[[NSUserDefaults standardUserDefaults]
+         stringForKey:kMBTraceFileKey] length] == 0)
+    return;
+  [[NSNotificationCenter defaultCenter]
+    addObserver:self
+       selector:@selector(applicationWillTerminate:)
+           name:NSApplicationWillTerminateNotification
+         object:nil];
+}
+
+@end  // MBTraceRecorder
+
+
+@implementation MBTraceRecorder (PrivateMethods)
+
++ (void)applicationWillTerminate:(NSNotification *)notification {
+  NSString *path = [[[NSUserDefaults standardUserDefaults]
+                      stringForKey:kMBTraceFileKey]
+                     stringByExpandingTildeInPath];
+  if ([path length] && ![self writeChromeTraceToPath:path])
+    GMLoggerError(@"Can't write trace to %@", path);
+}
+
+@end  // PrivateMethods
@@ -0,0 +1,214 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import <SenTestingKit/SenTestingKit.h>
+#import <Cocoa/Cocoa.h>
+#import <pthread.h>
+#import "MBStartupTrace.h"
+#import "MBTraceRecorder.h"
+#import "MBTraceRecorderTest.h"
+
+// Events named |name|, oldest first.
+static NSArray *EventsNamed(NSString *name) {
+  NSMutableArray *events = [NSMutableArray array];
+  NSEnumerator *eventEnumerator = [[MBTraceRecorder traceEvents] objectEnumerator];
+  NSDictionary *event = nil;
+  while ((event = [eventEnumerator nextObject])) {
+    if ([[event objectForKey:@"name"] isEqual:name])
+      [events addObject:event];
+  }
+  return events;
+}
+
+// Events for child process |pid|, oldest first.
+static NSArray *EventsForPid(int pid) {
+  NSMutableArray *events = [NSMutableArray array];
+  NSEnumerator *eventEnumerator = [[MBTraceRecorder traceEvents] objectEnumerator];
+  NSDictionary *event = nil;
+  while ((event = [eventEnumerator nextObject])) {
+    if ([[event objectForKey:@"pid"] intValue] == pid)
+      [events addObject:event];
+  }
+  return events;
+}
+
+static void *RecordOnThread(void *arg) {
+  MBTraceRecordInstant("test", "MBTraceRecorderTest-thread", NULL);
+  return NULL;
+}
+
+static void *RecordMany(void *arg) {
+  for (int i = 0; i < kMBTraceRecorderCapacity + 10; i++)
+    MBTraceRecordInstant("test", "MBTraceRecorderTest-many", NULL);
+  return NULL;
+}
+
+@implementation MBTraceRecorderTest
+
+- (void)testSpans {
+  {
+    MB_TRACE_EVENT_SCOPE("test", "MBTraceRecorderTest-outer");
+    MBTraceRecordInstant("test", "MBTraceRecorderTest-instant", "a \"detail\"");
+  }
+  NSArray *outer = EventsNamed(@"MBTraceRecorderTest-outer");
+  STAssertEquals([outer count], (NSUInteger)2, nil);
+  NSDictionary *begin = [outer objectAtIndex:0];
+  NSDictionary *end = [outer objectAtIndex:1];
+  STAssertEqualObjects([begin objectForKey:@"ph"], @"B", nil);
+  STAssertEqualObjects([end objectForKey:@"ph"], @"E", nil);
+  STAssertEqualObjects([begin objectForKey:@"cat"], @"test", nil);
+  STAssertEqualObjects([begin objectForKey:@"tid"], [end objectForKey:@"tid"], nil);
+  STAssertEquals([[begin objectForKey:@"pid"] intValue], getpid(), nil);
+  STAssertTrue([[end objectForKey:@"ts"] doubleValue] >=
+               [[begin objectForKey:@"ts"] doubleValue], nil);
+
+  NSArray *instants = EventsNamed(@"MBTraceRecorderTest-instant");
+  STAssertEquals([instants count], (NSUInteger)1, nil);
+  NSDictionary *instant = [instants lastObject];
+  STAssertEqualObjects([instant objectForKey:@"ph"], @"i", nil);
+  STAssertEqualObjects([[instant objectForKey:@"args"] objectForKey:@"detail"],
+                       @"a \"detail\"", nil);
+}
+
+- (void)testStartupSpans {
+  // One macro feeds both the recorder and the startup timeline.
+  MBStartupTrace *trace = [[[MBStartupTrace alloc] init] autorelease];
+  [trace start];
+  {
+    MB_TRACE_SCOPE("MBTraceRecorderTest-launcher");
+    MB_TRACE_EVENT_SCOPE("test", "MBTraceRecorderTest-both");
+  }
+  [trace finish];
+  NSString *timeline = [trace timeline];
+  STAssertTrue([timeline rangeOfString:@"MBTraceRecorderTest-launcher"].length > 0,
+               timeline);
+  STAssertTrue([timeline rangeOfString:@"MBTraceRecorderTest-both"].length > 0,
+               timeline);
+  NSArray *launcher = EventsNamed(@"MBTraceRecorderTest-launcher");
+  STAssertEquals([launcher count], (NSUInteger)2, nil);
+  STAssertEqualObjects([[launcher objectAtIndex:0] objectForKey:@"cat"],
+                       @"launcher", nil);
+  STAssertEquals([EventsNamed(@"MBTraceRecorderTest-both") count],
+                 (NSUInteger)2, nil);
+}
+
+- (void)testTaskPhases {
+  // Pids no real child will have.
+  const int kDone = 999991;
+  const int kRunning = 999992;
+  MBTraceRecordTask("spawn", kDone, "MBTraceRecorderTest");
+  MBTraceRecordTask("spawn", kRunning, "MBTraceRecorderTest-running");
+  MBTraceRecordTask("output", kDone, "MBTraceRecorderTest");
+  MBTraceRecordTask("ready", kDone, "MBTraceRecorderTest");
+  MBTraceRecordTask("signal", kDone, "MBTraceRecorderTest");
+  MBTraceRecordTask("exit", kDone, "MBTraceRecorderTest");
+
+  NSMutableArray *spans = [NSMutableArray array];
+  NSMutableArray *instants = [NSMutableArray array];
+  NSString *processName = nil;
+  NSEnumerator *eventEnumerator = [EventsForPid(kDone) objectEnumerator];
+  NSDictionary *event = nil;
+  while ((event = [eventEnumerator nextObject])) {
+    NSString *phase = [event objectForKey:@"ph"];
+    if ([phase isEqual:@"X"]) {
+      [spans addObject:[event objectForKey:@"name"]];
+      STAssertTrue([[event objectForKey:@"dur"] doubleValue] >= 0, nil);
+    } else if ([phase isEqual:@"i"]) {
+      [instants addObject:[event objectForKey:@"name"]];
+    } else if ([phase isEqual:@"M"]) {
+      processName = [[event objectForKey:@"args"] objectForKey:@"name"];
+    }
+  }
+  NSArray *expectedSpans = [NSArray arrayWithObjects:
+                            @"starting", @"loading", @"serving", @"stopping",
+                            nil];
+  NSArray *expectedInstants = [NSArray arrayWithObjects:
+                               @"spawn", @"output", @"ready", @"signal",
+                               @"exit", nil];
+  STAssertEqualObjects(spans, expectedSpans, nil);
+  STAssertEqualObjects(instants, expectedInstants, nil);
+  STAssertEqualObjects(processName,
+                       @"dev_appserver MBTraceRecorderTest (999991)", nil);
+
+  // Still starting: its span runs up to the export.
+  BOOL starting = NO;
+  eventEnumerator = [EventsForPid(kRunning) objectEnumerator];
+  while ((event = [eventEnumerator nextObject])) {
+    if ([[event objectForKey:@"ph"] isEqual:@"X"] &&
+        [[event objectForKey:@"name"] isEqual:@"starting"])
+      starting = YES;
+  }
+  STAssertTrue(starting, nil);
+  MBTraceRecordTask("exit", kRunning, NULL);
+}
+
+- (void)testThreads {
+  MBTraceRecordInstant("test", "MBTraceRecorderTest-main", NULL);
+  pthread_t thread;
+  STAssertEquals(pthread_create(&thread, NULL, RecordOnThread, NULL), 0, nil);
+  pthread_join(thread, NULL);
+
+  NSDictionary *main = [EventsNamed(@"MBTraceRecorderTest-main") lastObject];
+  NSDictionary *other = [EventsNamed(@"MBTraceRecorderTest-thread") lastObject];
+  STAssertNotNil(main, nil);
+  STAssertNotNil(other, nil);
+  STAssertFalse([[main objectForKey:@"tid"] isEqual:[other objectForKey:@"tid"]],
+                nil);
+
+  // Each thread is named.
+  BOOL named = NO;
+  NSEnumerator *eventEnumerator = [[MBTraceRecorder traceEvents] objectEnumerator];
+  NSDictionary *event = nil;
+  while ((event = [eventEnumerator nextObject])) {
+    if ([[event objectForKey:@"name"] isEqual:@"thread_name"] &&
+        [[event objectForKey:@"tid"] isEqual:[main objectForKey:@"tid"]]) {
+      STAssertEqualObjects([[event objectForKey:@"args"] objectForKey:@"name"],
+                           @"main", nil);
+      named = YES;
+    }
+  }
+  STAssertTrue(named, nil);
+}
+
+- (void)testOverwrite {
+  pthread_t thread;
+  STAssertEquals(pthread_create(&thread, NULL, RecordMany, NULL), 0, nil);
+  pthread_join(thread, NULL);
+  // Only the newest are kept.
+  STAssertEquals([EventsNamed(@"MBTraceRecorderTest-many") count],
+                 (NSUInteger)kMBTraceRecorderCapacity, nil);
+}
+
+- (void)testJSON {
+  MBTraceRecordInstant("test", "MBTraceRecorderTest-json", "say \"hi\"\n");
+  NSString *json = [[[NSString alloc] initWithData:[MBTraceRecorder chromeTraceData]
+                                          encoding:NSUTF8StringEncoding]
+                     autorelease];
+  STAssertTrue([json hasPrefix:@"{\"displayTimeUnit\":\"ms\",\"traceEvents\":["],
+               json);
+  STAssertTrue([json rangeOfString:
+                 @"{\"args\":{\"detail\":\"say \\\"hi\\\"\\u000a\"},"
+                 @"\"cat\":\"test\",\"name\":\"MBTraceRecorderTest-json\","
+                 @"\"ph\":\"i\","].location != NSNotFound, json);
+  STAssertTrue([json hasSuffix:@"]}\n"], nil);
+
+  NSString *path = [NSTemporaryDirectory()
+                     stringByAppendingPathComponent:@"MBTraceRecorderTest.json"];
+  STAssertTrue([MBTraceRecorder writeChromeTraceToPath:path], nil);
+  STAssertTrue([[NSFileManager defaultManager] fileExistsAtPath:path], nil);
+  [[NSFileManager defaultManager] removeFileAtPath:path handler:nil];
+}
+
+@end
@@ -0,0 +1,60 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import <Foundation/Foundation.h>
+
+// MBYamlParser parses the subset of YAML used by App Engine config
+// files (app.yaml, index.yaml, etc): block mappings and sequences,
+// compact "- key: value" sequence items, single-line flow
+// collections ([a, b] and {a: b}), plain/quoted/block (| and >)
+// scalars, comments, anchors (&name), aliases (*name) and merge keys
+// (<<: *name).
+//
+// The parser walks the raw UTF-8 bytes in a single pass without
+// splitting the input into lines first; the only objects created are
+// the ones returned.  All scalars are returned as NSStrings (no type
+// coercion), mappings as NSDictionary, sequences as NSArray, and
+// empty values as NSNull.
+@interface MBYamlParser : NSObject {
+ @private
+  NSData *data_;
+  const char *bytes_;       // start of input
+  const char *limit_;       // one past the end of input
+  // The current (significant) line.
+  const char *lineStart_;   // first non-space char
+  const char *lineEnd_;     // end of content (comments/whitespace stripped)
+  const char *lineNext_;    // start of the following line
+  int lineIndent_;
+  BOOL atEnd_;
+  NSMutableDictionary *anchors_;
+  NSString *error_;
+}
+
+// Convenience: parse |data| and return the top-level node, or nil on
+// a syntax error.  If |error| is not NULL it is set to a description
+// of the problem (autoreleased).
++ (id)parseData:(NSData *)data error:(NSString **)error;
+
+// Designated initializer.  |data| is retained for the parser's lifetime.
+- (id)initWithData:(NSData *)data;
+
+// Parse and return the top-level node (autoreleased), or nil on error.
+// An empty document returns an empty NSDictionary.
+- (id)parse;
+
+// Description of the last error, or nil.
+- (NSString *)error;
+
+@end
@@ -0,0 +1,691 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import "MBYamlParser.h"
+#include <string.h>
+
+@interface MBYamlParser (Private)
+- (void)scanLineFrom:(const char *)p;
+- (id)failWithMessage:(NSString *)msg;
+- (NSString *)stringFrom:(const char *)s to:(const char *)e;
+- (NSString *)scalarFrom:(const char *)s to:(const char *)e;
+- (NSString *)quotedScalarFrom:(const char *)s
+                            to:(const char *)e
+                          next:(const char **)next;
+- (NSString *)blockScalarWithHeader:(const char *)h
+                                end:(const char *)e
+                       parentIndent:(int)n;
+- (id)flowNodeAt:(const char **)pp end:(const char *)e isKey:(BOOL)isKey;
+- (id)blockNode;
+- (id)mappingAtIndent:(int)n;
+- (id)sequenceAtIndent:(int)n;
+- (id)valueFrom:(const char *)p
+             to:(const char *)e
+   parentIndent:(int)n
+  allowSequence:(BOOL)allowSequence;
+@end
+
+static BOOL IsBlank(char c) {
+  return (c == ' ') || (c == '\t');
+}
+
+static const char *SkipBlanks(const char *p, const char *end) {
+  while ((p < end) && IsBlank(*p))
+    p++;
+  return p;
+}
+
+static const char *TrimBlanks(const char *start, const char *p) {
+  while ((p > start) && IsBlank(p[-1]))
+    p--;
+  return p;
+}
+
+// "- foo" or a lone "-".
+static BOOL IsSequenceItem(const char *p, const char *end) {
+  return (p < end) && (*p == '-') && ((p + 1 == end) || IsBlank(p[1]));
+}
+
+// "---" and "..." separate documents; we only read the first document
+// but allow (and skip) the markers.
+static BOOL IsDocumentMarker(const char *s, const char *e) {
+  if (e - s < 3)
+    return NO;
+  if ((strncmp(s, "---", 3) != 0) && (strncmp(s, "...", 3) != 0))
+    return NO;
+  return (e - s == 3) || IsBlank(s[3]);
+}
+
+// Return the end of the significant content of the line [s, eol): a
+// '#' at the start of a token (outside of quotes) starts a comment,
+// and trailing whitespace (including a DOS \r) is dropped.
+static const char *StripComment(const char *s, const char *eol) {
+  char quote = 0;
+  const char *p;
+  for (p = s; p < eol; p++) {
+    char c = *p;
+    if (quote) {
+      if ((quote == '"') && (c == '\\') && (p + 1 < eol)) {
+        p++;
+      } else if (c == quote) {
+        if ((quote == '\'') && (p + 1 < eol) && (p[1] == '\''))
+          p++;  // '' is an escaped quote
+        else
+          quote = 0;
+      }
+      continue;
+    }
+    BOOL afterBlank = (p == s) || IsBlank(p[-1]);
+    BOOL tokenStart = afterBlank || (p[-1] == '[') || (p[-1] == '{') ||
+                      (p[-1] == ',');
+    if (((c == '"') || (c == '\'')) && tokenStart) {
+      quote = c;
+    } else if ((c == '#') && afterBlank) {
+      break;
+    }
+  }
+  while ((p > s) && (IsBlank(p[-1]) || (p[-1] == '\r')))
+    p--;
+  return p;
+}
+
+// If [p, end) starts with a mapping key, return a pointer to the ':'
+// which ends it.  Else return NULL.
+static const char *FindMappingColon(const char *p, const char *end) {
+  if ((p >= end) || (*p == '[') || (*p == '{'))
+    return NULL;
+  if ((*p == '"') || (*p == '\'')) {
+    char quote = *p++;
+    while (p < end) {
+      if ((quote == '"') && (*p == '\\') && (p + 1 < end)) {
+        p += 2;
+        continue;
+      }
+      if (*p == quote) {
+        if ((quote == '\'') && (p + 1 < end) && (p[1] == '\'')) {
+          p += 2;
+          continue;
+        }
+        p++;
+        break;
+      }
+      p++;
+    }
+    p = SkipBlanks(p, end);
+    if ((p < end) && (*p == ':') && ((p + 1 == end) || IsBlank(p[1])))
+      return p;
+    return NULL;
+  }
+  for (; p < end; p++) {
+    if ((*p == ':') && ((p + 1 == end) || IsBlank(p[1])))
+      return p;
+  }
+  return NULL;
+}
+
+static int HexValue(char c) {
+  if ((c >= '0') && (c <= '9')) return c - '0';
+  if ((c >= 'a') && (c <= 'f')) return c - 'a' + 10;
+  if ((c >= 'A') && (c <= 'F')) return c - 'A' + 10;
+  return -1;
+}
+
+// Encode |code| as UTF-8 into |out| (at least 4 bytes).  Returns the length.
+static int EncodeUTF8(unsigned int code, char *out) {
+  if (code < 0x80) {
+    out[0] = (char)code;
+    return 1;
+  } else if (code < 0x800) {
+    out[0] = (char)(0xC0 | (code >> 6));
+    out[1] = (char)(0x80 | (code & 0x3F));
+    return 2;
+  }
+  out[0] = (char)(0xE0 | (code >> 12));
+  out[1] = (char)(0x80 | ((code >> 6) & 0x3F));
+  out[2] = (char)(0x80 | (code & 0x3F));
+  return 3;
+}
+
+
+@implementation MBYamlParser
+
++ (id)parseData:(NSData *)data error:(NSString **)error {
+  MBYamlParser *parser = [[[self alloc] initWithData:data] autorelease];
+  id result = [parser parse];
+  if (error)
+    *error = [parser error];
+  return result;
+}
+
+- (id)init {
+  return [self initWithData:nil];
+}
+
+- (id)initWithData:(NSData *)data {
+  if ((self = [super init])) {
+    data_ = [data retain];
+    bytes_ = [data_ bytes];
+    limit_ = bytes_ + [data_ length];
+    // Skip a UTF-8 byte order mark.
+    if ((limit_ - bytes_ >= 3) && (strncmp(bytes_, "\xEF\xBB\xBF", 3) == 0))
+      bytes_ += 3;
+    anchors_ = [[NSMutableDictionary alloc] init];
+  }
+  return self;
+}
+
+- (void)dealloc {
+  [data_ release];
+  [anchors_ release];
+  [error_ release];
+  [super dealloc];
+}
+
+- (NSString *)error {
+  return [[error_ retain] autorelease];
+}
+
+- (id)parse {
+  [anchors_ removeAllObjects];
+  [error_ release];
+  error_ = nil;
+
+  [self scanLineFrom:bytes_];
+  if (atEnd_)
+    return [NSDictionary dictionary];
+  id root = [self blockNode];
+  if (root && !atEnd_)
+    [self failWithMessage:@"unexpected content after the document"];
+  return error_ ? nil : root;
+}
+
+@end  // MBYamlParser
+
+
+@implementation MBYamlParser (Private)
+
+// Find the next significant line (not blank, not a comment, not a
+// directive or document marker) at or after |p|.
+- (void)scanLineFrom:(const char *)p {
+  while (p < limit_) {
+    const char *eol = memchr(p, '\n', limit_ - p);
+    const char *next = eol ? eol + 1 : limit_;
+    if (eol == NULL)
+      eol = limit_;
+    int indent = 0;
+    const char *s = p;
+    while ((s < eol) && IsBlank(*s)) {
+      s++;
+      indent++;
+    }
+    const char *e = StripComment(s, eol);
+    BOOL skip = (e == s) ||
+                ((indent == 0) && ((*s == '%') || IsDocumentMarker(s, e)));
+    if (!skip) {
+      lineStart_ = s;
+      lineEnd_ = e;
+      lineNext_ = next;
+      lineIndent_ = indent;
+      atEnd_ = NO;
+      return;
+    }
+    p = next;
+  }
+  lineStart_ = lineEnd_ = lineNext_ = limit_;
+  lineIndent_ = -1;
+  atEnd_ = YES;
+}
+
+- (id)failWithMessage:(NSString *)msg {
+  if (error_ == nil) {
+    int line = 1;
+    const char *p;
+    for (p = bytes_; (p < lineStart_) && (p < limit_); p++) {
+      if (*p == '\n')
+        line++;
+    }
+    error_ = [[NSString alloc] initWithFormat:@"line %d: %@", line, msg];
+  }
+  return nil;
+}
+
+- (NSString *)stringFrom:(const char *)s to:(const char *)e {
+  NSString *str = [[[NSString alloc] initWithBytes:s
+                                            length:e - s
+                                          encoding:NSUTF8StringEncoding]
+                    autorelease];
+  if (str == nil) {
+    // Not valid UTF-8; be forgiving rather than dropping the value.
+    str = [[[NSString alloc] initWithBytes:s
+                                    length:e - s
+                                  encoding:NSISOLatin1StringEncoding]
+            autorelease];
+  }
+  return str;
+}
+
+- (NSString *)scalarFrom:(const char *)s to:(const char *)e {
+  s = SkipBlanks(s, e);
+  e = TrimBlanks(s, e);
+  if ((s < e) && ((*s == '"') || (*s == '\'')))
+    return [self quotedScalarFrom:s to:e next:NULL];
+  return [self stringFrom:s to:e];
+}
+
+// Only allocates a scratch buffer if the scalar contains escapes.
+- (NSString *)quotedScalarFrom:(const char *)s
+                            to:(const char *)e
+                          next:(const char **)next {
+  char quote = *s++;
+  const char *p = s;
+  const char *run = s;
+  NSMutableData *buffer = nil;
+
+  while (p < e) {
+    char c = *p;
+    if (c == quote) {
+      if ((quote == '\'') && (p + 1 < e) && (p[1] == '\'')) {
+        if (buffer == nil)
+          buffer = [NSMutableData data];
+        [buffer appendBytes:run length:p + 1 - run];
+        p += 2;
+        run = p;
+        continue;
+      }
+      break;
+    }
+    if ((quote == '"') && (c == '\\') && (p + 1 < e)) {
+      if (buffer == nil)
+        buffer = [NSMutableData data];
+      [buffer appendBytes:run length:p - run];
+      p++;
+      char out[4];
+      int len = 1;
+      switch (*p) {
+        case 'n': out[0] = '\n'; break;
+        case 't': out[0] = '\t'; break;
+        case 'r': out[0] = '\r'; break;
+        case '0': out[0] = '\0'; break;
+        case 'a': out[0] = '\a'; break;
+        case 'b': out[0] = '\b'; break;
+        case 'e': out[0] = 0x1b; break;
+        case 'f': out[0] = '\f'; break;
+        case 'v': out[0] = '\v'; break;
+        case 'x':
+        case 'u': {
+          int digits = (*p == 'x') ? 2 : 4;
+          unsigned int code = 0;
+          int i;
+          for (i = 0; (i < digits) && (p + 1 < e) && (HexValue(p[1]) >= 0); i++) {
+            p++;
+            code = (code << 4) | HexValue(*p);
+          }
+          len = EncodeUTF8(code, out);
+          break;
+        }
+        default:
+          // \\, \", \/, "\ " and anything unknown.
+          out[0] = *p;
+          break;
+      }
+      [buffer appendBytes:out length:len];
+      p++;
+      run = p;
+      continue;
+    }
+    p++;
+  }
+
+  NSString *str = nil;
+  if (buffer) {
+    [buffer appendBytes:run length:p - run];
+    str = [self stringFrom:[buffer bytes]
+                        to:(const char *)[buffer bytes] + [buffer length]];
+  } else {
+    str = [self stringFrom:run to:p];
+  }
+  if (p < e)
+    p++;  // closing quote; an unterminated scalar runs to the end of line
+  if (next)
+    *next = p;
+  return str;
+}
+
+// A literal (|) or folded (>) block scalar.  |h| points to the header
+// on the current line; the content is the following lines indented
+// more than |n|.  These lines are read raw, since a '#' inside a block
+// scalar is not a comment.
+- (NSString *)blockScalarWithHeader:(const char *)h
+                                end:(const char *)e
+                       parentIndent:(int)n {
+  BOOL folded = (*h == '>');
+  char chomp = 0;
+  int blockIndent = -1;
+  const char *p;
+  for (p = h + 1; p < e; p++) {
+    if ((*p == '-') || (*p == '+'))
+      chomp = *p;
+    else if ((*p >= '1') && (*p <= '9'))
+      blockIndent = n + (*p - '0');
+    else
+      break;
+  }
+
+  NSMutableString *text = [NSMutableString string];
+  int pendingNewlines = 0;
+  BOOL first = YES;
+  BOOL lastMoreIndented = NO;
+  p = lineNext_;
+  while (p < limit_) {
+    const char *eol = memchr(p, '\n', limit_ - p);
+    const char *next = eol ? eol + 1 : limit_;
+    if (eol == NULL)
+      eol = limit_;
+    const char *lineEnd = eol;
+    if ((lineEnd > p) && (lineEnd[-1] == '\r'))
+      lineEnd--;
+    int indent = 0;
+    const char *s = p;
+    while ((s < lineEnd) && (*s == ' ')) {
+      s++;
+      indent++;
+    }
+    if (SkipBlanks(s, lineEnd) == lineEnd) {
+      pendingNewlines++;
+      p = next;
+      continue;
+    }
+    if (blockIndent < 0) {
+      if (indent <= n)
+        break;
+      blockIndent = indent;
+    }
+    if (indent < blockIndent)
+      break;
+
+    BOOL moreIndented = (indent > blockIndent) || IsBlank(*s);
+    if (first) {
+      int i;
+      for (i = 0; i < pendingNewlines; i++)
+        [text appendString:@"\n"];
+    } else if (folded && !moreIndented && !lastMoreIndented) {
+      if (pendingNewlines == 0) {
+        [text appendString:@" "];
+      } else {
+        int i;
+        for (i = 0; i < pendingNewlines; i++)
+          [text appendString:@"\n"];
+      }
+    } else {
+      int i;
+      for (i = 0; i <= pendingNewlines; i++)
+        [text appendString:@"\n"];
+    }
+    [text appendString:[self stringFrom:p + blockIndent to:lineEnd]];
+    pendingNewlines = 0;
+    lastMoreIndented = moreIndented;
+    first = NO;
+    p = next;
+  }
+
+  if (!first && (chomp != '-'))
+    [text appendString:@"\n"];
+  if (chomp == '+') {
+    int i;
+    for (i = 0; i < pendingNewlines; i++)
+      [text appendString:@"\n"];
+  }
+
+  [self scanLineFrom:p];
+  return text;
+}
+
+// Parse a flow node ([...], {...} or a scalar inside one) starting at
+// *pp, leaving *pp just past it.
+- (id)flowNodeAt:(const char **)pp end:(const char *)e isKey:(BOOL)isKey {
+  const char *p = SkipBlanks(*pp, e);
+  id node = nil;
+
+  if (p >= e)
+    return [self failWithMessage:@"unterminated flow collection"];
+
+  if (*p == '[') {
+    NSMutableArray *array = [NSMutableArray array];
+    p = SkipBlanks(p + 1, e);
+    while ((p < e) && (*p != ']')) {
+      id item = [self flowNodeAt:&p end:e isKey:NO];
+      if (item == nil)
+        return nil;
+      [array addObject:item];
+      p = SkipBlanks(p, e);
+      if ((p < e) && (*p == ','))
+        p = SkipBlanks(p + 1, e);
+      else if ((p < e) && (*p != ']'))
+        return [self failWithMessage:@"expected ',' or ']'"];
+    }
+    if (p >= e)
+      return [self failWithMessage:@"unterminated flow sequence"];
+    p++;
+    node = array;
+  } else if (*p == '{') {
+    NSMutableDictionary *dict = [NSMutableDictionary dictionary];
+    p = SkipBlanks(p + 1, e);
+    while ((p < e) && (*p != '}')) {
+      id key = [self flowNodeAt:&p end:e isKey:YES];
+      if (key == nil)
+        return nil;
+      id value = [NSNull null];
+      p = SkipBlanks(p, e);
+      if ((p < e) && (*p == ':')) {
+        p = SkipBlanks(p + 1, e);
+        if ((p < e) && (*p != ',') && (*p != '}')) {
+          value = [self flowNodeAt:&p end:e isKey:NO];
+          if (value == nil)
+            return nil;
+          p = SkipBlanks(p, e);
+        }
+      }
+      if ([key isKindOfClass:[NSString class]] == NO)
+        key = [key description];
+      [dict setObject:value forKey:key];
+      if ((p < e) && (*p == ','))
+        p = SkipBlanks(p + 1, e);
+      else if ((p < e) && (*p != '}'))
+        return [self failWithMessage:@"expected ',' or '}'"];
+    }
+    if (p >= e)
+      return [self failWithMessage:@"unterminated flow mapping"];
+    p++;
+    node = dict;
+  } else if ((*p == '"') || (*p == '\'')) {
+    node = [self quotedScalarFrom:p to:e next:&p];
+  } else if (*p == '*') {
+    const char *s = ++p;
+    while ((p < e) && !IsBlank(*p) && (*p != ',') && (*p != ']') && (*p != '}'))
+      p++;
+    node = [anchors_ objectForKey:[self stringFrom:s to:p]];
+    if (node == nil)
+      return [self failWithMessage:@"unknown alias"];
+  } else {
+    const char *s = p;
+    while ((p < e) && (*p != ',') && (*p != ']') && (*p != '}')) {
+      if (isKey && (*p == ':') &&
+          ((p + 1 == e) || IsBlank(p[1]) || (p[1] == ',') || (p[1] == '}')))
+        break;
+      p++;
+    }
+    node = [self stringFrom:s to:TrimBlanks(s, p)];
+  }
+
+  *pp = p;
+  return node;
+}
+
+// Parse the node which starts on the current line.
+- (id)blockNode {
+  if (IsSequenceItem(lineStart_, lineEnd_))
+    return [self sequenceAtIndent:lineIndent_];
+  if (FindMappingColon(lineStart_, lineEnd_))
+    return [self mappingAtIndent:lineIndent_];
+  return [self valueFrom:lineStart_
+                      to:lineEnd_
+            parentIndent:lineIndent_ - 1
+           allowSequence:NO];
+}
+
+- (id)mappingAtIndent:(int)n {
+  NSMutableDictionary *dict = [NSMutableDictionary dictionary];
+  while (!atEnd_ && (lineIndent_ == n)) {
+    if (IsSequenceItem(lineStart_, lineEnd_))
+      break;
+    const char *colon = FindMappingColon(lineStart_, lineEnd_);
+    if (colon == NULL)
+      return [self failWithMessage:@"expected \"key: value\""];
+    NSString *key = [self scalarFrom:lineStart_ to:colon];
+    id value = [self valueFrom:colon + 1
+                            to:lineEnd_
+                  parentIndent:n
+                 allowSequence:YES];
+    if (value == nil)
+      return nil;
+
+    if ([key isEqual:@"<<"]) {
+      // Merge key.  Explicit keys always win, whatever their order.
+      NSArray *merges = [value isKindOfClass:[NSArray class]] ?
+          value : [NSArray arrayWithObject:value];
+      NSEnumerator *menum = [merges objectEnumerator];
+      NSDictionary *merge = nil;
+      while ((merge = [menum nextObject])) {
+        if ([merge isKindOfClass:[NSDictionary class]] == NO)
+          return [self failWithMessage:@"can only merge mappings"];
+        NSEnumerator *kenum = [merge keyEnumerator];
+        id mkey = nil;
+        while ((mkey = [kenum nextObject])) {
+          if ([dict objectForKey:mkey] == nil)
+            [dict setObject:[merge objectForKey:mkey] forKey:mkey];
+        }
+      }
+    } else {
+      [dict setObject:value forKey:key];
+    }
+  }
+  if (!atEnd_ && (lineIndent_ > n))
+    return [self failWithMessage:@"bad indentation"];
+  return dict;
+}
+
+- (id)sequenceAtIndent:(int)n {
+  NSMutableArray *array = [NSMutableArray array];
+  while (!atEnd_ && (lineIndent_ == n) && IsSequenceItem(lineStart_, lineEnd_)) {
+    const char *content = SkipBlanks(lineStart_ + 1, lineEnd_);
+    id item = nil;
+    BOOL compact = (content < lineEnd_) &&
+                   (strchr("&*|>[{", *content) == NULL) &&
+                   (IsSequenceItem(content, lineEnd_) ||
+                    FindMappingColon(content, lineEnd_));
+    if (compact) {
+      // "- key: value" or "- - item".  Reparse the rest of the line as
+      // if it started a line of its own at the column of |content|.
+      lineIndent_ = n + (int)(content - lineStart_);
+      lineStart_ = content;
+      item = [self blockNode];
+    } else {
+      item = [self valueFrom:content
+                          to:lineEnd_
+                parentIndent:n
+               allowSequence:NO];
+    }
+    if (item == nil)
+      return nil;
+    [array addObject:item];
+  }
+  if (!atEnd_ && (lineIndent_ > n))
+    return [self failWithMessage:@"bad indentation"];
+  return array;
+}
+
+// Parse the value whose text is [p, e) on the current line, plus any
+// nested block on following lines (indented more than |n|).  Leaves
+// the parser on the first line after the value.  If |allowSequence|,
+// a sequence at the same indentation as the parent key is accepted as
+// the value (e.g. "handlers:\n- url: /.*").
+- (id)valueFrom:(const char *)p
+             to:(const char *)e
+   parentIndent:(int)n
+  allowSequence:(BOOL)allowSequence {
+  p = SkipBlanks(p, e);
+
+  NSString *anchor = nil;
+  if ((p < e) && (*p == '&')) {
+    const char *s = ++p;
+    while ((p < e) && !IsBlank(*p))
+      p++;
+    anchor = [self stringFrom:s to:p];
+    p = SkipBlanks(p, e);
+  }
+
+  id value = nil;
+  if ((p < e) && (*p == '*')) {
+    NSString *alias = [self stringFrom:p + 1 to:e];
+    value = [anchors_ objectForKey:alias];
+    if (value == nil)
+      return [self failWithMessage:[NSString stringWithFormat:
+                                       @"unknown alias \"%@\"", alias]];
+    [self scanLineFrom:lineNext_];
+  } else if (p == e) {
+    [self scanLineFrom:lineNext_];
+    if (!atEnd_ &&
+        ((lineIndent_ > n) ||
+         (allowSequence && (lineIndent_ == n) &&
+          IsSequenceItem(lineStart_, lineEnd_)))) {
+      value = [self blockNode];
+    } else {
+      value = [NSNull null];
+    }
+  } else if ((*p == '|') || (*p == '>')) {
+    value = [self blockScalarWithHeader:p end:e parentIndent:n];
+  } else if ((*p == '[') || (*p == '{')) {
+    const char *q = p;
+    value = [self flowNodeAt:&q end:e isKey:NO];
+    if (value && (SkipBlanks(q, e) != e))
+      return [self failWithMessage:@"unexpected text after flow collection"];
+    [self scanLineFrom:lineNext_];
+  } else {
+    BOOL quoted = (*p == '"') || (*p == '\'');
+    value = [self scalarFrom:p to:e];
+    [self scanLineFrom:lineNext_];
+    // A plain scalar may be continued on more-indented lines.
+    if (!quoted) {
+      NSMutableString *folded = nil;
+      while (!atEnd_ && (lineIndent_ > n)) {
+        if (FindMappingColon(lineStart_, lineEnd_))
+          return [self failWithMessage:@"bad indentation"];
+        if (folded == nil)
+          folded = [NSMutableString stringWithString:value];
+        [folded appendString:@" "];
+        [folded appendString:[self stringFrom:lineStart_ to:lineEnd_]];
+        [self scanLineFrom:lineNext_];
+      }
+      if (folded)
+        value = folded;
+    }
+  }
+
+  if (value && anchor)
+    [anchors_ setObject:value forKey:anchor];
+  return value;
+}
+
+@end  // MBYamlParser (Private)
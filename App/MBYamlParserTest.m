@@ -0,0 +1,200 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import <SenTestingKit/SenTestingKit.h>
+#import <Cocoa/Cocoa.h>
+#import "MBYamlParser.h"
+#import "MBAppConfig.h"
+#import "MBYamlParserTest.h"
+
+@implementation MBYamlParserTest
+
+- (id)parse:(NSString *)yaml {
+  NSString *error = nil;
+  id result = [MBYamlParser parseData:[yaml dataUsingEncoding:NSUTF8StringEncoding]
+                                error:&error];
+  STAssertNil(error, @"%@", error);
+  return result;
+}
+
+- (void)testEmpty {
+  id result = [self parse:@""];
+  STAssertTrue([result isKindOfClass:[NSDictionary class]], nil);
+  STAssertTrue([result count] == 0, nil);
+
+  result = [self parse:@"# just a comment\n\n---\n"];
+  STAssertTrue([result count] == 0, nil);
+}
+
+- (void)testScalars {
+  NSDictionary *d = [self parse:@"a: plain text  # comment\n"
+                                 "b: 'single ''quoted'' # not comment'\n"
+                                 "c: \"double\\tquoted\\u00e9\"\n"
+                                 "d: http://localhost:8080/path\n"
+                                 "e:\n"
+                                 "f: 1.40\n"
+                                 "g: long plain\n"
+                                 "   continued here\n"];
+  STAssertEqualObjects([d objectForKey:@"a"], @"plain text", nil);
+  STAssertEqualObjects([d objectForKey:@"b"], @"single 'quoted' # not comment", nil);
+  NSString *c = [NSString stringWithFormat:@"double\tquoted%C", (unichar)0xe9];
+  STAssertEqualObjects([d objectForKey:@"c"], c, nil);
+  STAssertEqualObjects([d objectForKey:@"d"], @"http://localhost:8080/path", nil);
+  STAssertEqualObjects([d objectForKey:@"e"], [NSNull null], nil);
+  STAssertEqualObjects([d objectForKey:@"f"], @"1.40", nil);
+  STAssertEqualObjects([d objectForKey:@"g"], @"long plain continued here", nil);
+}
+
+- (void)testMappingsAndSequences {
+  NSDictionary *d = [self parse:@"outer:\n"
+                                 "  inner: 1\n"
+                                 "  list:\n"
+                                 "    - x\n"
+                                 "    - y\n"
+                                 "same_indent:\n"
+                                 "- p\n"
+                                 "- q\n"
+                                 "nested:\n"
+                                 "  - - 1\n"
+                                 "    - 2\n"
+                                 "  - k: v\n"
+                                 "    k2: v2\n"];
+  NSDictionary *outer = [d objectForKey:@"outer"];
+  STAssertEqualObjects([outer objectForKey:@"inner"], @"1", nil);
+  NSArray *list = [NSArray arrayWithObjects:@"x", @"y", nil];
+  STAssertEqualObjects([outer objectForKey:@"list"], list, nil);
+  list = [NSArray arrayWithObjects:@"p", @"q", nil];
+  STAssertEqualObjects([d objectForKey:@"same_indent"], list, nil);
+
+  NSArray *nested = [d objectForKey:@"nested"];
+  STAssertTrue([nested count] == 2, nil);
+  list = [NSArray arrayWithObjects:@"1", @"2", nil];
+  STAssertEqualObjects([nested objectAtIndex:0], list, nil);
+  NSDictionary *kv = [NSDictionary dictionaryWithObjectsAndKeys:@"v", @"k",
+                                   @"v2", @"k2", nil];
+  STAssertEqualObjects([nested objectAtIndex:1], kv, nil);
+}
+
+- (void)testAppYaml {
+  NSString *yaml =
+      @"application: helloworld\n"
+       "version: 1\n"
+       "runtime: python\n"
+       "api_version: 1\n"
+       "\n"
+       "handlers:\n"
+       "- url: /stylesheets\n"
+       "  static_dir: stylesheets\n"
+       "\n"
+       "- url: /(.*\\.(gif|png|jpg))\n"
+       "  static_files: static/\\1\n"
+       "  upload: static/(.*\\.(gif|png|jpg))\n"
+       "\n"
+       "- url: /images\n"
+       "  static_dir: static/images\n"
+       "- url: /.*\n"
+       "  script: helloworld.py\n"
+       "  login: admin\n";
+  MBAppConfig *config = [MBAppConfig configWithData:
+                                       [yaml dataUsingEncoding:NSUTF8StringEncoding]];
+  STAssertNotNil(config, nil);
+  STAssertEqualObjects([config application], @"helloworld", nil);
+  STAssertEqualObjects([config version], @"1", nil);
+  STAssertEqualObjects([config runtime], @"python", nil);
+  STAssertTrue([[config handlers] count] == 4, nil);
+  NSDictionary *last = [[config handlers] lastObject];
+  STAssertEqualObjects([last objectForKey:@"script"], @"helloworld.py", nil);
+  STAssertEqualObjects([last objectForKey:@"login"], @"admin", nil);
+  NSDictionary *second = [[config handlers] objectAtIndex:1];
+  STAssertEqualObjects([second objectForKey:@"static_files"], @"static/\\1", nil);
+  NSArray *dirs = [NSArray arrayWithObjects:@"stylesheets", @"static/images", nil];
+  STAssertEqualObjects([config staticDirs], dirs, nil);
+
+  // Not a mapping at all
+  config = [MBAppConfig configWithData:[@"- a\n- b\n" dataUsingEncoding:NSUTF8StringEncoding]];
+  STAssertNil(config, nil);
+  config = [MBAppConfig configWithData:[@"foo: bar\n" dataUsingEncoding:NSUTF8StringEncoding]];
+  STAssertNotNil(config, nil);
+  STAssertNil([config application], nil);
+  STAssertTrue([[config handlers] count] == 0, nil);
+}
+
+- (void)testBlockScalars {
+  NSDictionary *d = [self parse:@"literal: |\n"
+                                 "  line one\n"
+                                 "  # not a comment\n"
+                                 "\n"
+                                 "  line three\n"
+                                 "folded: >-\n"
+                                 "  one\n"
+                                 "  two\n"
+                                 "\n"
+                                 "  three\n"
+                                 "after: yes\n"];
+  STAssertEqualObjects([d objectForKey:@"literal"],
+                       @"line one\n# not a comment\n\nline three\n", nil);
+  STAssertEqualObjects([d objectForKey:@"folded"], @"one two\nthree", nil);
+  STAssertEqualObjects([d objectForKey:@"after"], @"yes", nil);
+}
+
+- (void)testFlow {
+  NSDictionary *d = [self parse:@"seq: [a, 'b, c', [d]]\n"
+                                 "map: {x: 1, y: [2, 3], z}\n"
+                                 "empty: []\n"];
+  NSArray *seq = [d objectForKey:@"seq"];
+  STAssertTrue([seq count] == 3, nil);
+  STAssertEqualObjects([seq objectAtIndex:1], @"b, c", nil);
+  STAssertEqualObjects([seq objectAtIndex:2], [NSArray arrayWithObject:@"d"], nil);
+  NSDictionary *map = [d objectForKey:@"map"];
+  STAssertEqualObjects([map objectForKey:@"x"], @"1", nil);
+  STAssertTrue([[map objectForKey:@"y"] count] == 2, nil);
+  STAssertEqualObjects([map objectForKey:@"z"], [NSNull null], nil);
+  STAssertTrue([[d objectForKey:@"empty"] count] == 0, nil);
+}
+
+- (void)testAnchors {
+  NSDictionary *d = [self parse:@"base: &base\n"
+                                 "  login: admin\n"
+                                 "  secure: always\n"
+                                 "name: &n bob\n"
+                                 "copy: *n\n"
+                                 "derived:\n"
+                                 "  secure: never\n"
+                                 "  <<: *base\n"];
+  STAssertEqualObjects([d objectForKey:@"copy"], @"bob", nil);
+  NSDictionary *derived = [d objectForKey:@"derived"];
+  STAssertEqualObjects([derived objectForKey:@"login"], @"admin", nil);
+  STAssertEqualObjects([derived objectForKey:@"secure"], @"never", nil);
+}
+
+- (void)testErrors {
+  NSString *error = nil;
+  NSArray *bad = [NSArray arrayWithObjects:
+                          @"a: b\n  c: d\n",      // bad indentation
+                          @"a: *missing\n",       // unknown alias
+                          @"a: [1, 2\n",          // unterminated
+                          @"a: b\njust text\n",   // not a key
+                          nil];
+  NSEnumerator *benum = [bad objectEnumerator];
+  NSString *yaml = nil;
+  while ((yaml = [benum nextObject])) {
+    id result = [MBYamlParser parseData:[yaml dataUsingEncoding:NSUTF8StringEncoding]
+                                  error:&error];
+    STAssertNil(result, yaml);
+    STAssertNotNil(error, yaml);
+  }
+}
+
+@end  // MBYamlParserTest
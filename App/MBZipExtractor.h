@@ -0,0 +1,89 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import <Foundation/Foundation.h>
+#include <pthread.h>
+#include <stdint.h>
+
+struct MBZipMember;
+
+// An MBZipExtractor unpacks a zip archive (such as the
+// google_appengine.zip in a runtime bundle) without spawning
+// anything.  The archive is mapped into memory and its members are
+// inflated in parallel, one worker thread per core, each streaming
+// straight to disk.
+//
+// Extraction can be resumed: each member is written to a temporary
+// name and renamed into place when complete, then recorded in a
+// manifest next to it.  A later run skips members already in the
+// manifest.  When every member is done the manifest is replaced by a
+// marker recording the archive's size and modification time (see
+// +isArchive:extractedTo:).
+//
+// Progress is available from any thread, in bytes of uncompressed
+// output.
+@interface MBZipExtractor : NSObject {
+ @private
+  NSString *archive_;
+  NSString *destination_;
+  int threadCount_;
+
+  // The mapped archive and its table of contents.
+  const unsigned char *bytes_;
+  size_t length_;
+  struct MBZipMember *members_;
+  int memberCount_;
+  int *order_;                  // indexes into members_, biggest first
+  NSSet *linkNames_;            // names of symlink members
+
+  // Shared between workers; updated atomically.
+  volatile int32_t nextMember_;
+  volatile int64_t bytesDone_;
+  int64_t bytesTotal_;
+  volatile int32_t failed_;
+  volatile int32_t cancelled_;
+  char errorMessage_[512];      // set by whoever first sets failed_
+
+  pthread_mutex_t manifestLock_;
+  int manifestFD_;
+}
+
+// YES if |archive| has been completely extracted into |destination|
+// (and hasn't changed since).  Just a stat and a small read.
++ (BOOL)isArchive:(NSString *)archive extractedTo:(NSString *)destination;
+
+// Designated initializer.
+- (id)initWithArchive:(NSString *)archive destination:(NSString *)destination;
+
+// Defaults to the number of CPUs.
+- (void)setThreadCount:(int)count;
+
+// Extract, blocking until done.  Returns NO on failure (see -error);
+// members already extracted are kept for next time.
+- (BOOL)extract;
+
+// Ask -extract (on another thread) to stop early.
+- (void)cancel;
+
+// Thread-safe progress.  Total is 0 until -extract has read the
+// archive's table of contents.
+- (unsigned long long)bytesTotal;
+- (unsigned long long)bytesDone;
+- (double)progress;  // 0.0 -- 1.0
+
+// Description of what went wrong, or nil.
+- (NSString *)error;
+
+@end
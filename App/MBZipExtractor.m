@@ -0,0 +1,720 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import "MBZipExtractor.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <libkern/OSAtomic.h>
+#include <libkern/OSByteOrder.h>
+#include <zlib.h>
+
+// One entry from the archive's central directory.
+typedef struct MBZipMember {
+  const char *name;       // points into the mapped archive; not terminated
+  int nameLength;
+  int method;             // 0 (stored) or 8 (deflated)
+  uint32_t crc;
+  uint32_t compressedSize;
+  uint32_t size;
+  uint32_t localHeader;   // offset
+  mode_t mode;
+  BOOL isDirectory;
+  BOOL done;              // already extracted (per the manifest)
+} MBZipMember;
+
+enum {
+  kMBZipLocalHeaderSig = 0x04034b50,
+  kMBZipCentralHeaderSig = 0x02014b50,
+  kMBZipEndSig = 0x06054b50,
+  kMBZipLocalHeaderSize = 30,
+  kMBZipCentralHeaderSize = 46,
+  kMBZipEndSize = 22,
+  kMBZipBufferSize = 64 * 1024
+};
+
+static uint16_t MBRead16(const unsigned char *p) {
+  return OSReadLittleInt16(p, 0);
+}
+
+static uint32_t MBRead32(const unsigned char *p) {
+  return OSReadLittleInt32(p, 0);
+}
+
+// mkdir -p for a C path; the last component is included.
+static BOOL MBMakeDirectories(char *path) {
+  struct stat sb;
+  if (stat(path, &sb) == 0)
+    return S_ISDIR(sb.st_mode);
+  for (char *p = path + 1; *p; p++) {
+    if (*p == '/') {
+      *p = '\0';
+      int rtn = mkdir(path, 0755);
+      *p = '/';
+      if ((rtn != 0) && (errno != EEXIST))
+        return NO;
+    }
+  }
+  return (mkdir(path, 0755) == 0) || (errno == EEXIST);
+}
+
+// A member name without empty or "." components, so "a//b/" and
+// "./a/b" compare equal to "a/b".
+static NSString *MBZipNormalName(NSString *name) {
+  NSMutableArray *parts = [NSMutableArray array];
+  NSEnumerator *penum = [[name componentsSeparatedByString:@"/"] objectEnumerator];
+  NSString *part = nil;
+  while ((part = [penum nextObject])) {
+    if ([part length] && ![part isEqual:@"."])
+      [parts addObject:part];
+  }
+  return [parts componentsJoinedByString:@"/"];
+}
+
+// YES if something on disk between |destination| and the end of
+// |path| (which must start with it) is a symlink.  Stops at the
+// first component that doesn't exist yet.
+static BOOL MBPathCrossesLink(char *path, size_t destinationLength) {
+  struct stat sb;
+  for (char *p = path + destinationLength + 1; ; p++) {
+    if ((*p != '/') && (*p != '\0'))
+      continue;
+    char c = *p;
+    *p = '\0';
+    int rtn = lstat(path, &sb);
+    *p = c;
+    if (rtn != 0)
+      return NO;
+    if (S_ISLNK(sb.st_mode))
+      return YES;
+    if (c == '\0')
+      return NO;
+  }
+}
+
+@interface MBZipExtractor (Private)
+- (void)fail:(const char *)format, ...;
+- (BOOL)mapArchive;
+- (BOOL)readDirectory;
+- (NSString *)manifestPath;
+- (NSString *)markerPath;
+- (NSString *)archiveIdentity;
+- (void)readManifest;
+- (char *)copyPathForMember:(MBZipMember *)member;
+- (BOOL)isSafeLinkTarget:(NSString *)target forMember:(MBZipMember *)member;
+- (BOOL)extractMember:(MBZipMember *)member buffer:(unsigned char *)buffer;
+- (void)work;
+@end
+
+static void *MBZipWorker(void *arg) {
+  MBZipExtractor *extractor = (MBZipExtractor *)arg;
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  [extractor work];
+  [pool release];
+  return NULL;
+}
+
+@implementation MBZipExtractor
+
++ (BOOL)isArchive:(NSString *)archive extractedTo:(NSString *)destination {
+  MBZipExtractor *extractor = [[[self alloc] initWithArchive:archive
+                                                 destination:destination]
+                                autorelease];
+  NSString *identity = [extractor archiveIdentity];
+  NSString *marker = [NSString stringWithContentsOfFile:[extractor markerPath]];
+  return (identity != nil) && [identity isEqual:marker];
+}
+
+- (id)init {
+  return [self initWithArchive:nil destination:nil];
+}
+
+- (id)initWithArchive:(NSString *)archive destination:(NSString *)destination {
+  if ((self = [super init])) {
+    archive_ = [archive copy];
+    destination_ = [destination copy];
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    threadCount_ = (cpus > 0) ? (int)cpus : 2;
+    manifestFD_ = -1;
+    pthread_mutex_init(&manifestLock_, NULL);
+  }
+  return self;
+}
+
+- (void)dealloc {
+  if (bytes_)
+    munmap((void *)bytes_, length_);
+  if (manifestFD_ >= 0)
+    close(manifestFD_);
+  free(members_);
+  free(order_);
+  [linkNames_ release];
+  pthread_mutex_destroy(&manifestLock_);
+  [archive_ release];
+  [destination_ release];
+  [super dealloc];
+}
+
+- (void)setThreadCount:(int)count {
+  threadCount_ = (count > 0) ? count : 1;
+}
+
+- (unsigned long long)bytesTotal {
+  return bytesTotal_;
+}
+
+- (unsigned long long)bytesDone {
+  // An atomic read, even on 32-bit.
+  return OSAtomicAdd64(0, (volatile int64_t *)&bytesDone_);
+}
+
+- (double)progress {
+  if (bytesTotal_ == 0)
+    return 0.0;
+  return (double)[self bytesDone] / (double)bytesTotal_;
+}
+
+- (NSString *)error {
+  if (!failed_)
+    return nil;
+  return [NSString stringWithUTF8String:errorMessage_];
+}
+
+- (void)cancel {
+  OSAtomicCompareAndSwap32Barrier(0, 1, &cancelled_);
+}
+
+- (BOOL)extract {
+  if (![self mapArchive] || ![self readDirectory])
+    return NO;
+
+  // Directories first (serially; they're cheap), so workers never
+  // race to create the same parent.
+  size_t destinationLength = strlen([destination_ fileSystemRepresentation]);
+  for (int i = 0; i < memberCount_; i++) {
+    MBZipMember *member = &members_[i];
+    if (member->isDirectory) {
+      char *path = [self copyPathForMember:member];
+      if (MBPathCrossesLink(path, destinationLength))
+        [self fail:"Unsafe path in zip archive: %s is under a symlink", path];
+      else if (!MBMakeDirectories(path))
+        [self fail:"Can't create directory %s: %s", path, strerror(errno)];
+      free(path);
+    }
+  }
+  if (failed_)
+    return NO;
+
+  [self readManifest];
+  NSString *manifest = [self manifestPath];
+  manifestFD_ = open([manifest fileSystemRepresentation],
+                     O_WRONLY | O_CREAT | O_APPEND, 0644);
+  if (manifestFD_ < 0) {
+    [self fail:"Can't write %s: %s", [manifest fileSystemRepresentation],
+          strerror(errno)];
+    return NO;
+  }
+
+  int threads = threadCount_;
+  if (threads > memberCount_)
+    threads = memberCount_;
+  pthread_t *workers = calloc(threads + 1, sizeof(pthread_t));
+  int started = 0;
+  for (int i = 0; i < threads; i++) {
+    if (pthread_create(&workers[started], NULL, MBZipWorker, self) == 0)
+      started++;
+  }
+  if (started == 0)
+    [self work];
+  for (int i = 0; i < started; i++)
+    pthread_join(workers[i], NULL);
+  free(workers);
+
+  close(manifestFD_);
+  manifestFD_ = -1;
+  if (failed_ || cancelled_)
+    return NO;
+
+  // All done; trade the manifest for the marker.
+  NSString *identity = [self archiveIdentity];
+  if (![identity writeToFile:[self markerPath] atomically:YES]) {
+    [self fail:"Can't write %s", [[self markerPath] fileSystemRepresentation]];
+    return NO;
+  }
+  unlink([manifest fileSystemRepresentation]);
+  return YES;
+}
+
+@end
+
+
+@implementation MBZipExtractor (Private)
+
+- (void)fail:(const char *)format, ... {
+  // First failure wins.
+  if (!OSAtomicCompareAndSwap32Barrier(0, 1, &failed_))
+    return;
+  va_list args;
+  va_start(args, format);
+  vsnprintf(errorMessage_, sizeof(errorMessage_), format, args);
+  va_end(args);
+}
+
+- (BOOL)mapArchive {
+  const char *path = [archive_ fileSystemRepresentation];
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    [self fail:"Can't open %s: %s", path, strerror(errno)];
+    return NO;
+  }
+  struct stat sb;
+  if ((fstat(fd, &sb) != 0) || (sb.st_size < kMBZipEndSize)) {
+    close(fd);
+    [self fail:"%s is not a zip archive", path];
+    return NO;
+  }
+  void *bytes = mmap(NULL, (size_t)sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (bytes == MAP_FAILED) {
+    [self fail:"Can't map %s: %s", path, strerror(errno)];
+    return NO;
+  }
+  bytes_ = bytes;
+  length_ = (size_t)sb.st_size;
+  return YES;
+}
+
+- (BOOL)readDirectory {
+  // The end record is within the last 64K (its comment can't be bigger).
+  const unsigned char *end = NULL;
+  size_t lowest = (length_ > 0xffff + kMBZipEndSize) ?
+      length_ - (0xffff + kMBZipEndSize) : 0;
+  for (size_t i = length_ - kMBZipEndSize; ; i--) {
+    if (MBRead32(bytes_ + i) == kMBZipEndSig) {
+      end = bytes_ + i;
+      break;
+    }
+    if (i == lowest)
+      break;
+  }
+  if (end == NULL) {
+    [self fail:"No zip directory in %s", [archive_ fileSystemRepresentation]];
+    return NO;
+  }
+
+  int count = MBRead16(end + 10);
+  uint32_t directorySize = MBRead32(end + 12);
+  uint32_t directoryOffset = MBRead32(end + 16);
+  if ((uint64_t)directoryOffset + directorySize > length_) {
+    [self fail:"Corrupt zip directory (is this a zip64 archive?)"];
+    return NO;
+  }
+
+  members_ = calloc(count + 1, sizeof(MBZipMember));
+  NSMutableArray *names = [NSMutableArray arrayWithCapacity:count];
+  NSMutableSet *links = [NSMutableSet set];
+  const unsigned char *p = bytes_ + directoryOffset;
+  const unsigned char *limit = p + directorySize;
+  for (int i = 0; i < count; i++) {
+    if ((p + kMBZipCentralHeaderSize > limit) ||
+        (MBRead32(p) != kMBZipCentralHeaderSig)) {
+      [self fail:"Corrupt zip directory entry %d", i];
+      return NO;
+    }
+    MBZipMember *member = &members_[i];
+    uint16_t madeBy = MBRead16(p + 4);
+    uint16_t flags = MBRead16(p + 8);
+    member->method = MBRead16(p + 10);
+    member->crc = MBRead32(p + 16);
+    member->compressedSize = MBRead32(p + 20);
+    member->size = MBRead32(p + 24);
+    member->nameLength = MBRead16(p + 28);
+    int extraLength = MBRead16(p + 30);
+    int commentLength = MBRead16(p + 32);
+    uint32_t external = MBRead32(p + 38);
+    member->localHeader = MBRead32(p + 42);
+    member->name = (const char *)(p + kMBZipCentralHeaderSize);
+    p += kMBZipCentralHeaderSize + member->nameLength + extraLength + commentLength;
+    if (p > limit) {
+      [self fail:"Corrupt zip directory entry %d", i];
+      return NO;
+    }
+
+    member->isDirectory = (member->nameLength > 0) &&
+        (member->name[member->nameLength - 1] == '/');
+    // Unix permissions if the archiver recorded them.
+    mode_t mode = ((madeBy >> 8) == 3) ? (mode_t)(external >> 16) : 0;
+    if ((mode & 0777) == 0)
+      mode |= member->isDirectory ? 0755 : 0644;
+    // We must be able to replace what we write.
+    member->mode = mode | S_IRUSR | S_IWUSR;
+
+    if (flags & 0x1) {
+      [self fail:"Encrypted zip archives are not supported"];
+      return NO;
+    }
+    if ((member->method != 0) && (member->method != 8)) {
+      [self fail:"Unsupported compression method %d", member->method];
+      return NO;
+    }
+    // No absolute paths and no "..", so nothing lands outside destination_.
+    NSString *name = [[[NSString alloc] initWithBytes:member->name
+                                               length:member->nameLength
+                                             encoding:NSUTF8StringEncoding]
+                       autorelease];
+    if ((name == nil) || [name hasPrefix:@"/"] ||
+        [[name pathComponents] containsObject:@".."]) {
+      [self fail:"Unsafe path in zip archive"];
+      return NO;
+    }
+    [names addObject:MBZipNormalName(name)];
+    if (S_ISLNK(member->mode))
+      [links addObject:MBZipNormalName(name)];
+    if (!member->isDirectory)
+      bytesTotal_ += member->size;
+  }
+  memberCount_ = count;
+
+  // Nothing may be written through a symlink from the archive, or
+  // "lib -> /etc" followed by "lib/passwd" would write outside
+  // destination_.  Checked up front so the answer doesn't depend on
+  // which worker gets there first.
+  if ([links count]) {
+    NSEnumerator *nenum = [names objectEnumerator];
+    NSString *name = nil;
+    while ((name = [nenum nextObject])) {
+      NSArray *parts = [name componentsSeparatedByString:@"/"];
+      for (unsigned j = 1; j < [parts count]; j++) {
+        NSString *parent = [[parts subarrayWithRange:NSMakeRange(0, j)]
+                             componentsJoinedByString:@"/"];
+        if ([links containsObject:parent]) {
+          [self fail:"Unsafe path in zip archive: %s is under a symlink",
+                [name UTF8String]];
+          return NO;
+        }
+      }
+    }
+  }
+  linkNames_ = [links copy];
+
+  // Biggest first, so one large member doesn't finish last on its own.
+  order_ = calloc(count + 1, sizeof(int));
+  int files = 0;
+  for (int i = 0; i < count; i++) {
+    if (!members_[i].isDirectory)
+      order_[files++] = i;
+  }
+  for (int i = 1; i < files; i++) {
+    int index = order_[i];
+    int j = i - 1;
+    while ((j >= 0) &&
+           (members_[order_[j]].compressedSize < members_[index].compressedSize)) {
+      order_[j + 1] = order_[j];
+      j--;
+    }
+    order_[j + 1] = index;
+  }
+  return YES;
+}
+
+- (NSString *)manifestPath {
+  NSString *name = [NSString stringWithFormat:@".%@.manifest",
+                             [archive_ lastPathComponent]];
+  return [destination_ stringByAppendingPathComponent:name];
+}
+
+- (NSString *)markerPath {
+  NSString *name = [NSString stringWithFormat:@".%@.extracted",
+                             [archive_ lastPathComponent]];
+  return [destination_ stringByAppendingPathComponent:name];
+}
+
+- (NSString *)archiveIdentity {
+  struct stat sb;
+  if ((archive_ == nil) || (stat([archive_ fileSystemRepresentation], &sb) != 0))
+    return nil;
+  return [NSString stringWithFormat:@"%lld %ld.%09ld\n",
+                   (long long)sb.st_size,
+                   (long)sb.st_mtimespec.tv_sec, (long)sb.st_mtimespec.tv_nsec];
+}
+
+// Lines are "<crc> <size> <name>".  A member is done if it's listed
+// with the same crc and size and is still on disk at that size.
+- (void)readManifest {
+  NSString *contents = [NSString stringWithContentsOfFile:[self manifestPath]];
+  if ([contents length] == 0)
+    return;
+  NSMutableSet *done = [NSMutableSet set];
+  NSEnumerator *lenum = [[contents componentsSeparatedByString:@"\n"]
+                          objectEnumerator];
+  NSString *line = nil;
+  while ((line = [lenum nextObject])) {
+    if ([line length])
+      [done addObject:line];
+  }
+
+  int files = 0;
+  for (int i = 0; i < memberCount_; i++) {
+    if (!members_[i].isDirectory)
+      files++;
+  }
+  for (int i = 0; i < files; i++) {
+    MBZipMember *member = &members_[order_[i]];
+    NSString *name = [[[NSString alloc] initWithBytes:member->name
+                                               length:member->nameLength
+                                             encoding:NSUTF8StringEncoding]
+                       autorelease];
+    NSString *line = [NSString stringWithFormat:@"%08x %u %@",
+                               member->crc, member->size, name];
+    if (![done containsObject:line])
+      continue;
+    char *path = [self copyPathForMember:member];
+    struct stat sb;
+    if ((lstat(path, &sb) == 0) &&
+        (S_ISLNK(sb.st_mode) || (sb.st_size == (off_t)member->size))) {
+      member->done = YES;
+      OSAtomicAdd64(member->size, &bytesDone_);
+    }
+    free(path);
+  }
+}
+
+- (char *)copyPathForMember:(MBZipMember *)member {
+  const char *dest = [destination_ fileSystemRepresentation];
+  size_t destLength = strlen(dest);
+  char *path = malloc(destLength + 1 + member->nameLength + 1);
+  memcpy(path, dest, destLength);
+  path[destLength] = '/';
+  memcpy(path + destLength + 1, member->name, member->nameLength);
+  path[destLength + 1 + member->nameLength] = '\0';
+  // No trailing slash for directories.
+  size_t length = destLength + 1 + member->nameLength;
+  if ((length > 1) && (path[length - 1] == '/'))
+    path[length - 1] = '\0';
+  return path;
+}
+
+// A link's target must resolve inside destination_: relative, never
+// climbing above the top with "..", and never using ".." to back out
+// of another link from the archive (only plain directories resolve
+// lexically).  Parents of the link itself are plain directories, as
+// readDirectory checked.
+- (BOOL)isSafeLinkTarget:(NSString *)target forMember:(MBZipMember *)member {
+  if (([target length] == 0) || [target hasPrefix:@"/"])
+    return NO;
+  NSString *name = [[[NSString alloc] initWithBytes:member->name
+                                             length:member->nameLength
+                                           encoding:NSUTF8StringEncoding]
+                     autorelease];
+  NSMutableArray *resolved = [NSMutableArray arrayWithArray:
+                                [MBZipNormalName(name) componentsSeparatedByString:@"/"]];
+  [resolved removeLastObject];
+  NSEnumerator *penum = [[target componentsSeparatedByString:@"/"] objectEnumerator];
+  NSString *part = nil;
+  while ((part = [penum nextObject])) {
+    if (([part length] == 0) || [part isEqual:@"."])
+      continue;
+    if ([part isEqual:@".."]) {
+      if (([resolved count] == 0) ||
+          [linkNames_ containsObject:[resolved componentsJoinedByString:@"/"]])
+        return NO;
+      [resolved removeLastObject];
+    } else {
+      [resolved addObject:part];
+    }
+  }
+  return YES;
+}
+
+- (BOOL)extractMember:(MBZipMember *)member buffer:(unsigned char *)buffer {
+  const unsigned char *local = bytes_ + member->localHeader;
+  if ((member->localHeader + (size_t)kMBZipLocalHeaderSize > length_) ||
+      (MBRead32(local) != kMBZipLocalHeaderSig)) {
+    [self fail:"Corrupt zip member %.*s", member->nameLength, member->name];
+    return NO;
+  }
+  size_t dataOffset = member->localHeader + kMBZipLocalHeaderSize +
+      MBRead16(local + 26) + MBRead16(local + 28);
+  if (dataOffset + member->compressedSize > length_) {
+    [self fail:"Truncated zip member %.*s", member->nameLength, member->name];
+    return NO;
+  }
+  const unsigned char *data = bytes_ + dataOffset;
+
+  char *path = [self copyPathForMember:member];
+  size_t tmpLength = strlen(path) + 8;
+  char *tmp = malloc(tmpLength);
+  snprintf(tmp, tmpLength, "%s.mbtmp", path);
+
+  // Parent directories normally come from directory entries, but
+  // not every archiver writes those.
+  // Those parents mustn't lead through a symlink left on disk,
+  // e.g. by an older extraction of a different archive.
+  char *slash = strrchr(path, '/');
+  if (slash) {
+    *slash = '\0';
+    size_t destinationLength = strlen([destination_ fileSystemRepresentation]);
+    BOOL crossesLink = (slash > path + destinationLength) &&
+        MBPathCrossesLink(path, destinationLength);
+    if (crossesLink) {
+      [self fail:"Unsafe path in zip archive: %s is under a symlink", path];
+      free(path);
+      free(tmp);
+      return NO;
+    }
+    MBMakeDirectories(path);
+    *slash = '/';
+  }
+
+  BOOL isLink = S_ISLNK(member->mode);
+  int fd = -1;
+  if (!isLink) {
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+      [self fail:"Can't create %s: %s", tmp, strerror(errno)];
+      free(path);
+      free(tmp);
+      return NO;
+    }
+  }
+
+  // Inflate (or copy) in chunks, checking the CRC as we go.  A
+  // symlink's "contents" is its target, which is small.
+  NSMutableData *linkTarget = isLink ? [NSMutableData data] : nil;
+  uLong crc = crc32(0L, Z_NULL, 0);
+  BOOL ok = YES;
+  if (member->method == 0) {
+    size_t offset = 0;
+    while (ok && (offset < member->compressedSize)) {
+      size_t chunk = member->compressedSize - offset;
+      if (chunk > kMBZipBufferSize)
+        chunk = kMBZipBufferSize;
+      crc = crc32(crc, data + offset, (uInt)chunk);
+      if (isLink)
+        [linkTarget appendBytes:data + offset length:chunk];
+      else if (write(fd, data + offset, chunk) != (ssize_t)chunk)
+        ok = NO;
+      OSAtomicAdd64(chunk, &bytesDone_);
+      offset += chunk;
+      if (cancelled_ || failed_)
+        ok = NO;
+    }
+  } else {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    stream.next_in = (Bytef *)data;
+    stream.avail_in = member->compressedSize;
+    // Negative window bits: raw deflate data, no zlib header.
+    if (inflateInit2(&stream, -MAX_WBITS) != Z_OK)
+      ok = NO;
+    int status = Z_OK;
+    while (ok && (status != Z_STREAM_END)) {
+      stream.next_out = buffer;
+      stream.avail_out = kMBZipBufferSize;
+      status = inflate(&stream, Z_NO_FLUSH);
+      if ((status != Z_OK) && (status != Z_STREAM_END)) {
+        ok = NO;
+        break;
+      }
+      size_t produced = kMBZipBufferSize - stream.avail_out;
+      crc = crc32(crc, buffer, (uInt)produced);
+      if (isLink)
+        [linkTarget appendBytes:buffer length:produced];
+      else if (write(fd, buffer, produced) != (ssize_t)produced)
+        ok = NO;
+      OSAtomicAdd64(produced, &bytesDone_);
+      if ((produced == 0) && (status != Z_STREAM_END) && (stream.avail_in == 0))
+        ok = NO;  // truncated
+      if (cancelled_ || failed_)
+        ok = NO;
+    }
+    inflateEnd(&stream);
+  }
+  if (ok && (crc != member->crc)) {
+    [self fail:"Bad CRC for %.*s", member->nameLength, member->name];
+    ok = NO;
+  }
+
+  if (!isLink) {
+    if (ok && (fchmod(fd, member->mode & 07777) != 0))
+      ok = NO;
+    if (close(fd) != 0)
+      ok = NO;
+  } else if (ok) {
+    NSString *target = [[[NSString alloc] initWithData:linkTarget
+                                              encoding:NSUTF8StringEncoding]
+                         autorelease];
+    if ((target == nil) || ![self isSafeLinkTarget:target forMember:member]) {
+      [self fail:"Unsafe symlink in zip archive: %.*s",
+            member->nameLength, member->name];
+      ok = NO;
+    } else {
+      ok = (symlink([target fileSystemRepresentation], tmp) == 0);
+    }
+  }
+  if (ok)
+    ok = (rename(tmp, path) == 0);
+  if (!ok) {
+    if (!cancelled_)
+      [self fail:"Can't extract %s: %s", path, strerror(errno)];
+    unlink(tmp);
+  }
+  free(path);
+  free(tmp);
+  return ok;
+}
+
+- (void)work {
+  unsigned char *buffer = malloc(kMBZipBufferSize);
+  int files = 0;
+  for (int i = 0; i < memberCount_; i++) {
+    if (!members_[i].isDirectory)
+      files++;
+  }
+  for (;;) {
+    int next = OSAtomicIncrement32Barrier(&nextMember_) - 1;
+    if ((next >= files) || failed_ || cancelled_)
+      break;
+    MBZipMember *member = &members_[order_[next]];
+    if (member->done)
+      continue;
+    if (![self extractMember:member buffer:buffer])
+      break;
+
+    // Record it, one whole line per write() so lines never interleave.
+    char prefix[32];
+    int prefixLength = snprintf(prefix, sizeof(prefix), "%08x %u ",
+                                (unsigned int)member->crc,
+                                (unsigned int)member->size);
+    size_t length = prefixLength + member->nameLength + 1;
+    char *record = malloc(length);
+    memcpy(record, prefix, prefixLength);
+    memcpy(record + prefixLength, member->name, member->nameLength);
+    record[length - 1] = '\n';
+    pthread_mutex_lock(&manifestLock_);
+    write(manifestFD_, record, length);
+    pthread_mutex_unlock(&manifestLock_);
+    free(record);
+  }
+  free(buffer);
+}
+
+@end
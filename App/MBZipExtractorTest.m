@@ -0,0 +1,296 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+#import <SenTestingKit/SenTestingKit.h>
+#import <Cocoa/Cocoa.h>
+#import "MBZipExtractor.h"
+#import "MBZipExtractorTest.h"
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+static void MBAppend16(NSMutableData *data, uint16_t value) {
+  unsigned char bytes[2] = { value & 0xff, value >> 8 };
+  [data appendBytes:bytes length:2];
+}
+
+static void MBAppend32(NSMutableData *data, uint32_t value) {
+  MBAppend16(data, value & 0xffff);
+  MBAppend16(data, value >> 16);
+}
+
+@implementation MBZipExtractorTest
+
+// Build a small archive with /usr/bin/zip: some text, a big
+// compressible file, an empty file and an executable.
+- (void)setUp {
+  NSFileManager *fm = [NSFileManager defaultManager];
+  root_ = [[NSString stringWithFormat:@"/tmp/ziptest-%d",
+                     [[NSProcessInfo processInfo] processIdentifier]] retain];
+  NSString *src = [root_ stringByAppendingPathComponent:@"src"];
+  [fm createDirectoryAtPath:root_ attributes:nil];
+  [fm createDirectoryAtPath:src attributes:nil];
+  [fm createDirectoryAtPath:[src stringByAppendingPathComponent:@"pkg/sub"]
+                 attributes:nil];
+
+  NSMutableString *big = [NSMutableString string];
+  for (int i = 0; i < 20000; i++)
+    [big appendFormat:@"line %d of a rather repetitive file\n", i];
+  [[big dataUsingEncoding:NSUTF8StringEncoding]
+    writeToFile:[src stringByAppendingPathComponent:@"pkg/big.txt"] atomically:NO];
+  [[@"hello\n" dataUsingEncoding:NSUTF8StringEncoding]
+    writeToFile:[src stringByAppendingPathComponent:@"pkg/sub/hello.txt"] atomically:NO];
+  [[NSData data] writeToFile:[src stringByAppendingPathComponent:@"pkg/empty"]
+                  atomically:NO];
+  NSString *tool = [src stringByAppendingPathComponent:@"pkg/tool.py"];
+  [[@"#!/usr/bin/python\n" dataUsingEncoding:NSUTF8StringEncoding]
+    writeToFile:tool atomically:NO];
+  chmod([tool fileSystemRepresentation], 0755);
+
+  archive_ = [[root_ stringByAppendingPathComponent:@"test.zip"] retain];
+  NSTask *task = [[[NSTask alloc] init] autorelease];
+  [task setLaunchPath:@"/usr/bin/zip"];
+  [task setCurrentDirectoryPath:src];
+  [task setArguments:[NSArray arrayWithObjects:@"-qr", archive_, @"pkg", nil]];
+  [task launch];
+  [task waitUntilExit];
+}
+
+- (void)tearDown {
+  [[NSFileManager defaultManager] removeFileAtPath:root_ handler:nil];
+  [root_ release];
+  [archive_ release];
+}
+
+// /usr/bin/zip won't write a file under a symlink, so build those
+// archives by hand: stored members from (name, contents, mode) triples.
+- (NSString *)archiveNamed:(NSString *)name members:(NSArray *)members {
+  NSMutableData *data = [NSMutableData data];
+  NSMutableData *directory = [NSMutableData data];
+  for (unsigned i = 0; i + 2 < [members count]; i += 3) {
+    NSData *memberName = [[members objectAtIndex:i]
+                           dataUsingEncoding:NSUTF8StringEncoding];
+    NSData *contents = [[members objectAtIndex:i + 1]
+                         dataUsingEncoding:NSUTF8StringEncoding];
+    uint32_t mode = [[members objectAtIndex:i + 2] unsignedIntValue];
+    uint32_t crc = crc32(crc32(0L, Z_NULL, 0), [contents bytes], [contents length]);
+    uint32_t offset = [data length];
+
+    MBAppend32(data, 0x04034b50);
+    MBAppend16(data, 10);  // version needed
+    MBAppend16(data, 0);   // flags
+    MBAppend16(data, 0);   // stored
+    MBAppend32(data, 0);   // time and date
+    MBAppend32(data, crc);
+    MBAppend32(data, [contents length]);
+    MBAppend32(data, [contents length]);
+    MBAppend16(data, [memberName length]);
+    MBAppend16(data, 0);   // extra
+    [data appendData:memberName];
+    [data appendData:contents];
+
+    MBAppend32(directory, 0x02014b50);
+    MBAppend16(directory, (3 << 8) | 20);  // made by Unix
+    MBAppend16(directory, 10);
+    MBAppend16(directory, 0);
+    MBAppend16(directory, 0);
+    MBAppend32(directory, 0);
+    MBAppend32(directory, crc);
+    MBAppend32(directory, [contents length]);
+    MBAppend32(directory, [contents length]);
+    MBAppend16(directory, [memberName length]);
+    MBAppend16(directory, 0);  // extra
+    MBAppend16(directory, 0);  // comment
+    MBAppend16(directory, 0);  // disk
+    MBAppend16(directory, 0);  // internal attributes
+    MBAppend32(directory, mode << 16);
+    MBAppend32(directory, offset);
+    [directory appendData:memberName];
+  }
+  uint32_t directoryOffset = [data length];
+  [data appendData:directory];
+  MBAppend32(data, 0x06054b50);
+  MBAppend32(data, 0);  // disks
+  MBAppend16(data, [members count] / 3);
+  MBAppend16(data, [members count] / 3);
+  MBAppend32(data, [directory length]);
+  MBAppend32(data, directoryOffset);
+  MBAppend16(data, 0);  // comment
+
+  NSString *path = [root_ stringByAppendingPathComponent:name];
+  [data writeToFile:path atomically:NO];
+  return path;
+}
+
+- (NSString *)destination {
+  NSString *dest = [root_ stringByAppendingPathComponent:@"dest"];
+  [[NSFileManager defaultManager] createDirectoryAtPath:dest attributes:nil];
+  return dest;
+}
+
+- (void)checkDestination:(NSString *)dest {
+  NSFileManager *fm = [NSFileManager defaultManager];
+  NSString *src = [root_ stringByAppendingPathComponent:@"src"];
+  NSArray *files = [NSArray arrayWithObjects:@"pkg/big.txt", @"pkg/sub/hello.txt",
+                            @"pkg/empty", @"pkg/tool.py", nil];
+  NSEnumerator *fenum = [files objectEnumerator];
+  NSString *file = nil;
+  while ((file = [fenum nextObject])) {
+    STAssertTrue([fm contentsEqualAtPath:[src stringByAppendingPathComponent:file]
+                                 andPath:[dest stringByAppendingPathComponent:file]],
+                 file);
+  }
+  STAssertTrue([fm isExecutableFileAtPath:[dest stringByAppendingPathComponent:@"pkg/tool.py"]],
+               nil);
+}
+
+- (void)testExtract {
+  NSString *dest = [self destination];
+  STAssertFalse([MBZipExtractor isArchive:archive_ extractedTo:dest], nil);
+
+  MBZipExtractor *x = [[[MBZipExtractor alloc] initWithArchive:archive_
+                                                   destination:dest] autorelease];
+  STAssertTrue([x progress] == 0.0, nil);
+  STAssertTrue([x extract], [x error]);
+  STAssertNil([x error], nil);
+  STAssertTrue([x bytesTotal] > 20000 * 30, nil);
+  STAssertTrue([x bytesDone] == [x bytesTotal], nil);
+  STAssertTrue([x progress] == 1.0, nil);
+  [self checkDestination:dest];
+  STAssertTrue([MBZipExtractor isArchive:archive_ extractedTo:dest], nil);
+
+  // Single threaded gets the same answer.
+  NSString *dest2 = [root_ stringByAppendingPathComponent:@"dest2"];
+  [[NSFileManager defaultManager] createDirectoryAtPath:dest2 attributes:nil];
+  x = [[[MBZipExtractor alloc] initWithArchive:archive_ destination:dest2] autorelease];
+  [x setThreadCount:1];
+  STAssertTrue([x extract], [x error]);
+  [self checkDestination:dest2];
+}
+
+- (void)testResume {
+  NSFileManager *fm = [NSFileManager defaultManager];
+  NSString *dest = [self destination];
+  MBZipExtractor *x = [[[MBZipExtractor alloc] initWithArchive:archive_
+                                                   destination:dest] autorelease];
+  STAssertTrue([x extract], [x error]);
+
+  // Fake an interruption after just big.txt: marker gone, the
+  // manifest lists only big.txt, hello.txt never made it.
+  NSString *marker = [dest stringByAppendingPathComponent:@".test.zip.extracted"];
+  NSString *manifest = [dest stringByAppendingPathComponent:@".test.zip.manifest"];
+  STAssertTrue([fm fileExistsAtPath:marker], nil);
+  STAssertFalse([fm fileExistsAtPath:manifest], nil);
+  [fm removeFileAtPath:marker handler:nil];
+  [fm removeFileAtPath:[dest stringByAppendingPathComponent:@"pkg/sub/hello.txt"]
+               handler:nil];
+  NSData *big = [NSData dataWithContentsOfFile:
+                          [dest stringByAppendingPathComponent:@"pkg/big.txt"]];
+  NSString *line = [NSString stringWithFormat:@"%08x %u pkg/big.txt\n",
+                             (unsigned int)crc32(crc32(0L, Z_NULL, 0),
+                                                 [big bytes], [big length]),
+                             (unsigned int)[big length]];
+  [line writeToFile:manifest atomically:NO];
+  STAssertFalse([MBZipExtractor isArchive:archive_ extractedTo:dest], nil);
+
+  x = [[[MBZipExtractor alloc] initWithArchive:archive_ destination:dest] autorelease];
+  STAssertTrue([x extract], [x error]);
+  [self checkDestination:dest];
+  STAssertTrue([MBZipExtractor isArchive:archive_ extractedTo:dest], nil);
+}
+
+- (void)testBadArchive {
+  NSString *dest = [self destination];
+  MBZipExtractor *x = [[[MBZipExtractor alloc] initWithArchive:@"/no/such.zip"
+                                                   destination:dest] autorelease];
+  STAssertFalse([x extract], nil);
+  STAssertNotNil([x error], nil);
+
+  NSString *junk = [root_ stringByAppendingPathComponent:@"junk.zip"];
+  NSMutableData *data = [NSMutableData dataWithLength:1000];
+  [data writeToFile:junk atomically:NO];
+  x = [[[MBZipExtractor alloc] initWithArchive:junk destination:dest] autorelease];
+  STAssertFalse([x extract], nil);
+  STAssertNotNil([x error], nil);
+  STAssertFalse([MBZipExtractor isArchive:junk extractedTo:dest], nil);
+}
+
+- (void)testUnsafeLinks {
+  NSFileManager *fm = [NSFileManager defaultManager];
+  NSNumber *link = [NSNumber numberWithUnsignedInt:S_IFLNK | 0755];
+  NSNumber *file = [NSNumber numberWithUnsignedInt:S_IFREG | 0644];
+  struct stat sb;
+
+  // Links may point around inside the destination.
+  NSString *dest = [self destination];
+  NSString *archive = [self archiveNamed:@"safe.zip" members:
+                         [NSArray arrayWithObjects:
+                                    @"pkg/sub/a", @"a\n", file,
+                                    @"pkg/link", @"sub", link,
+                                    @"pkg/top", @"../pkg/./sub/a", link, nil]];
+  MBZipExtractor *x = [[[MBZipExtractor alloc] initWithArchive:archive
+                                                   destination:dest] autorelease];
+  STAssertTrue([x extract], [x error]);
+  NSString *top = [dest stringByAppendingPathComponent:@"pkg/top"];
+  STAssertTrue((lstat([top fileSystemRepresentation], &sb) == 0) &&
+               S_ISLNK(sb.st_mode), nil);
+  STAssertEqualObjects([NSString stringWithContentsOfFile:top], @"a\n", nil);
+
+  // But not out of it, whether directly, by climbing out, or by
+  // climbing back out of another link.  "lib/evil" would land in
+  // root_ if lib were extracted first.
+  NSArray *archives = [NSArray arrayWithObjects:
+                         [NSArray arrayWithObjects:@"pkg/etc", @"/etc", link, nil],
+                         [NSArray arrayWithObjects:@"pkg/up", @"../..", link, nil],
+                         [NSArray arrayWithObjects:
+                                    @"pkg/d", @".", link,
+                                    @"pkg/e", @"d/../..", link, nil],
+                         [NSArray arrayWithObjects:
+                                    @"lib", @"..", link,
+                                    @"lib/evil", @"gotcha\n", file, nil],
+                         [NSArray arrayWithObjects:
+                                    @"pkg/lib", @"sub", link,
+                                    @"pkg/sub/b", @"b\n", file,
+                                    @"pkg/lib/evil", @"gotcha\n", file, nil],
+                         nil];
+  for (unsigned i = 0; i < [archives count]; i++) {
+    NSString *dest = [root_ stringByAppendingPathComponent:
+                              [NSString stringWithFormat:@"unsafe%u", i]];
+    [fm createDirectoryAtPath:dest attributes:nil];
+    archive = [self archiveNamed:[NSString stringWithFormat:@"unsafe%u.zip", i]
+                         members:[archives objectAtIndex:i]];
+    x = [[[MBZipExtractor alloc] initWithArchive:archive destination:dest]
+          autorelease];
+    STAssertFalse([x extract], archive);
+    STAssertNotNil([x error], archive);
+    STAssertFalse([MBZipExtractor isArchive:archive extractedTo:dest], archive);
+  }
+  STAssertFalse([fm fileExistsAtPath:[root_ stringByAppendingPathComponent:@"evil"]],
+                nil);
+  NSString *first = [root_ stringByAppendingPathComponent:@"unsafe0/pkg/etc"];
+  STAssertTrue(lstat([first fileSystemRepresentation], &sb) != 0, nil);
+
+  // A link already on disk counts too.
+  dest = [root_ stringByAppendingPathComponent:@"planted"];
+  [fm createDirectoryAtPath:dest attributes:nil];
+  symlink("..", [[dest stringByAppendingPathComponent:@"pkg"] fileSystemRepresentation]);
+  x = [[[MBZipExtractor alloc] initWithArchive:archive_ destination:dest] autorelease];
+  STAssertFalse([x extract], nil);
+  STAssertNotNil([x error], nil);
+  STAssertFalse([fm fileExistsAtPath:[root_ stringByAppendingPathComponent:@"pkg/big.txt"]],
+                nil);
+}
+
+@end
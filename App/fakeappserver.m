@@ -0,0 +1,177 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// fakeappserver: a stand-in for dev_appserver.py which writes realistic
+// log output at a controlled rate, for measuring how much the launcher
+// can take (see logbench).
+//
+//   fakeappserver [-n lines] [-r rate] [-b burst] [-l length] [-j jitter]
+//                 [-a access%] [-u] [-p port]
+//
+//   -n lines    how many lines to write after the startup banner (10000)
+//   -r rate     average lines per second; 0 for as fast as possible (1000)
+//   -b burst    lines written together, back to back; bursts are spaced
+//               to keep the average rate (1)
+//   -l length   typical line length in bytes (120)
+//   -j jitter   line lengths vary by up to this percent either way (50)
+//   -a access%  percent of lines which are access log lines, the rest
+//               being application logging (70)
+//   -u          put some non-ASCII (UTF-8) text in the lines
+//   -p port     the port to claim in the banner (8080)
+//
+// Like dev_appserver, it writes everything to stderr, unbuffered, and
+// starts with a "Running application" banner.  Every line after that
+// carries "#<sequence>@<microseconds>", the line number (from 1) and
+// when it was written, so the reader can count lost lines and measure
+// latency.  Each burst is one write(), so bursts arrive together.  The
+// last line says how many lines were written:
+//
+//   INFO     fakeappserver: done, wrote 10000 lines
+
+#import <stdio.h>
+#import <stdlib.h>
+#import <string.h>
+#import <sys/time.h>
+#import <time.h>
+#import <unistd.h>
+
+static void Usage(void) {
+  fprintf(stderr, "usage: fakeappserver [-n lines] [-r rate] [-b burst] "
+          "[-l length] [-j jitter] [-a access%%] [-u] [-p port]\n");
+  exit(2);
+}
+
+static unsigned long long NowMicroseconds(void) {
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return (unsigned long long)now.tv_sec * 1000000 + now.tv_usec;
+}
+
+static void WriteAll(const char *bytes, size_t length) {
+  while (length > 0) {
+    ssize_t written = write(STDERR_FILENO, bytes, length);
+    if (written <= 0)
+      exit(1);  // the launcher went away
+    bytes += written;
+    length -= written;
+  }
+}
+
+// Appends one line of roughly |length| bytes for line |seq| to |out|.
+// Returns the number of bytes added.
+static size_t FormatLine(char *out, unsigned long seq, int length,
+                         int access, int utf8) {
+  static const char *const kPaths[] = {
+    "/", "/static/style.css", "/favicon.ico", "/api/items", "/_ah/admin"
+  };
+  static const char *const kLevels[] = { "INFO    ", "DEBUG   ", "WARNING " };
+  char stamp[64];
+  time_t now = time(NULL);
+  size_t n;
+  if (access) {
+    strftime(stamp, sizeof(stamp), "%d/%b/%Y %H:%M:%S", localtime(&now));
+    n = sprintf(out, "127.0.0.1 - - [%s] \"GET %s?#%lu@%llu HTTP/1.1\" 200 -",
+                stamp, kPaths[seq % 5], seq, NowMicroseconds());
+  } else {
+    strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", localtime(&now));
+    n = sprintf(out, "%s %s,%03d main.py:%lu] #%lu@%llu handled request",
+                kLevels[seq % 3], stamp, (int)(seq % 1000), 40 + seq % 200,
+                seq, NowMicroseconds());
+  }
+  // Pad to the length asked for.
+  static const char kFiller[] = " lorem ipsum dolor sit amet";
+  static const char kUTF8Filler[] = " caf\xc3\xa9 na\xc3\xafve \xe2\x9c\x93";
+  const char *filler = utf8 ? kUTF8Filler : kFiller;
+  size_t fillerLength = strlen(filler);
+  while ((int)(n + fillerLength) < length) {
+    memcpy(out + n, filler, fillerLength);
+    n += fillerLength;
+  }
+  out[n++] = '\n';
+  return n;
+}
+
+int main(int argc, char *argv[]) {
+  unsigned long lines = 10000;
+  double rate = 1000;
+  int burst = 1;
+  int length = 120;
+  int jitter = 50;
+  int accessPercent = 70;
+  int utf8 = 0;
+  int port = 8080;
+  int ch;
+  while ((ch = getopt(argc, argv, "n:r:b:l:j:a:up:")) != -1) {
+    switch (ch) {
+      case 'n': lines = strtoul(optarg, NULL, 10); break;
+      case 'r': rate = strtod(optarg, NULL); break;
+      case 'b': burst = atoi(optarg); break;
+      case 'l': length = atoi(optarg); break;
+      case 'j': jitter = atoi(optarg); break;
+      case 'a': accessPercent = atoi(optarg); break;
+      case 'u': utf8 = 1; break;
+      case 'p': port = atoi(optarg); break;
+      default: Usage();
+    }
+  }
+  if (burst < 1 || length < 1 || length > 64 * 1024 || jitter < 0 ||
+      jitter > 100 || rate < 0 || accessPercent < 0 || accessPercent > 100)
+    Usage();
+  srandom(getpid());
+
+  char banner[256];
+  int n = snprintf(banner, sizeof(banner),
+                   "INFO     dev_appserver_main.py:431] Running application "
+                   "fakeappserver on port %d: http://localhost:%d\n",
+                   port, port);
+  WriteAll(banner, n);
+
+  // Room for a burst of the longest lines, plus their prefixes.
+  size_t capacity = (size_t)burst * (length * 2 + 256);
+  char *buffer = malloc(capacity);
+  if (buffer == NULL)
+    return 1;
+
+  unsigned long long start = NowMicroseconds();
+  unsigned long seq = 0;
+  while (seq < lines) {
+    size_t used = 0;
+    for (int i = 0; i < burst && seq < lines; i++) {
+      seq++;
+      int spread = length * jitter / 100;
+      int lineLength = length;
+      if (spread > 0)
+        lineLength += (int)(random() % (2 * spread + 1)) - spread;
+      int access = (int)(random() % 100) < accessPercent;
+      used += FormatLine(buffer + used, seq, lineLength, access, utf8);
+    }
+    WriteAll(buffer, used);
+
+    // Sleep until the next burst is due.
+    if (rate > 0) {
+      unsigned long long due = start + (unsigned long long)(seq * 1e6 / rate);
+      unsigned long long now = NowMicroseconds();
+      if (due > now)
+        usleep((useconds_t)(due - now));
+    }
+  }
+  free(buffer);
+
+  char trailer[128];
+  n = snprintf(trailer, sizeof(trailer),
+               "INFO     fakeappserver: done, wrote %lu lines\n", seq);
+  WriteAll(trailer, n);
+  return 0;
+}
@@ -0,0 +1,115 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// gmlogdecode: prints GMLogBinaryWriter files as text.
+//
+//   gmlogdecode [-l level] [-f function] file ...
+//
+//   -l level     only messages at |level| and above: debug, info, error,
+//                assert, or a number
+//   -f function  only messages from functions whose name contains |function|
+//
+// Exits with 1 if a file can't be read or is damaged (after printing what
+// could be read of it), and 2 for bad usage.
+
+#import <Foundation/Foundation.h>
+#import <stdio.h>
+#import <stdlib.h>
+#import <string.h>
+#import <unistd.h>
+#import "GMLogBinaryReader.h"
+
+static void Usage(void) {
+  fprintf(stderr, "usage: gmlogdecode [-l level] [-f function] file ...\n");
+  exit(2);
+}
+
+// Returns the level named |name|, or -1.
+static int LevelNamed(const char *name) {
+  static const char *const kNames[] = { "debug", "info", "error", "assert" };
+  static const GMLoggerLevel kLevels[] = {
+    kGMLoggerLevelDebug, kGMLoggerLevelInfo,
+    kGMLoggerLevelError, kGMLoggerLevelAssert
+  };
+  for (size_t i = 0; i < sizeof(kNames) / sizeof(kNames[0]); i++) {
+    if (strcasecmp(name, kNames[i]) == 0)
+      return kLevels[i];
+  }
+  char *end = NULL;
+  long level = strtol(name, &end, 10);
+  if (end == name || *end != '\0' || level < 0)
+    return -1;
+  return (int)level;
+}
+
+int main(int argc, char *argv[]) {
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+
+  int level = kGMLoggerLevelUnknown;
+  NSString *func = nil;
+  int ch;
+  while ((ch = getopt(argc, argv, "l:f:")) != -1) {
+    switch (ch) {
+      case 'l':
+        level = LevelNamed(optarg);
+        if (level < 0)
+          Usage();
+        break;
+      case 'f':
+        func = [NSString stringWithUTF8String:optarg];
+        break;
+      default:
+        Usage();
+    }
+  }
+  if (optind >= argc)
+    Usage();
+
+  int rtn = 0;
+  for (int i = optind; i < argc; i++) {
+    NSString *path = [[NSFileManager defaultManager]
+                       stringWithFileSystemRepresentation:argv[i]
+                                                   length:strlen(argv[i])];
+    GMLogBinaryReader *reader = [GMLogBinaryReader readerWithContentsOfFile:path];
+    if (reader == nil) {
+      fprintf(stderr, "gmlogdecode: can't read %s\n", argv[i]);
+      rtn = 1;
+      continue;
+    }
+    [reader setMinimumLevel:level];
+    [reader setFunctionFilter:func];
+
+    NSAutoreleasePool *linePool = [[NSAutoreleasePool alloc] init];
+    int lines = 0;
+    NSString *line = nil;
+    while ((line = [reader nextLine])) {
+      printf("%s\n", [line UTF8String]);
+      // Files can be large; don't keep every line around.
+      if (++lines % 1000 == 0) {
+        [linePool release];
+        linePool = [[NSAutoreleasePool alloc] init];
+      }
+    }
+    if ([reader error]) {
+      fprintf(stderr, "gmlogdecode: %s: %s\n", argv[i],
+              [[reader error] UTF8String]);
+      rtn = 1;
+    }
+    [linePool release];
+  }
+
+  [pool release];
+  return rtn;
+}
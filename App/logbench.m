@@ -0,0 +1,209 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// logbench: measures how much dev_appserver output the launcher can take.
+//
+//   logbench [-s fakeappserver] [-t timeout] [-m lines/sec] [-p ms]
+//            [-M KB] [-- fakeappserver options]
+//
+//   -s path   the fakeappserver to run (by default, the one next to logbench)
+//   -t secs   give up after this long (300)
+//   -m rate   fail if fewer than |rate| lines a second got through
+//   -p ms     fail if the 99th percentile latency is over |ms|
+//   -M KB     fail if resident memory grew by more than |KB|
+//
+// Anything after "--" is passed to fakeappserver, to choose the rate, burst
+// size and line lengths; see fakeappserver.m. For example:
+//
+//   logbench -m 5000 -p 50 -- -n 100000 -r 0 -b 50 -l 200
+//
+// fakeappserver is run with MBEngineTask, just as the launcher runs
+// dev_appserver, with the same launch-complete hook on its MBLogFilter.
+// Its output goes to a real MBConsoleController, through an MBLogBenchmark
+// which measures what arrives. The console uses Console.nib if logbench
+// runs from inside the application bundle, and otherwise a text view in a
+// window of its own.
+//
+// Prints MBLogBenchmark's report. Exits with 1 if any lines were lost, the
+// run timed out or a limit above was missed, and 2 for bad usage.
+
+#import <Cocoa/Cocoa.h>
+#import <stdio.h>
+#import <stdlib.h>
+#import <unistd.h>
+#import "MBConsoleController.h"
+#import "MBEngineTask.h"
+#import "MBLogBenchmark.h"
+#import "MBLogFilter.h"
+
+static void Usage(void) {
+  fprintf(stderr, "usage: logbench [-s fakeappserver] [-t timeout] "
+          "[-m lines/sec] [-p ms] [-M KB] [-- fakeappserver options]\n");
+  exit(2);
+}
+
+// For when there's no Console.nib to load.
+@interface MBConsoleController (LogBenchmark)
+- (void)setTextView:(NSTextView *)view;
+@end
+
+@implementation MBConsoleController (LogBenchmark)
+- (void)setTextView:(NSTextView *)view {
+  textView_ = view;
+}
+@end
+
+int main(int argc, char *argv[]) {
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  [NSApplication sharedApplication];
+
+  NSString *server = nil;
+  double timeout = 300;
+  double minRate = -1;
+  double maxLatency = -1;
+  long long maxGrowth = -1;
+  int ch;
+  while ((ch = getopt(argc, argv, "s:t:m:p:M:")) != -1) {
+    switch (ch) {
+      case 's':
+        server = [NSString stringWithUTF8String:optarg];
+        break;
+      case 't':
+        timeout = strtod(optarg, NULL);
+        break;
+      case 'm':
+        minRate = strtod(optarg, NULL);
+        break;
+      case 'p':
+        maxLatency = strtod(optarg, NULL);
+        break;
+      case 'M':
+        maxGrowth = strtoll(optarg, NULL, 10);
+        break;
+      default:
+        Usage();
+    }
+  }
+  if (timeout <= 0)
+    Usage();
+  if (server == nil) {
+    NSString *me = [[NSString stringWithUTF8String:argv[0]]
+                     stringByStandardizingPath];
+    server = [[me stringByDeletingLastPathComponent]
+               stringByAppendingPathComponent:@"fakeappserver"];
+  }
+  if (![[NSFileManager defaultManager] isExecutableFileAtPath:server]) {
+    fprintf(stderr, "logbench: can't run %s\n", [server UTF8String]);
+    return 2;
+  }
+  NSMutableArray *arguments = [NSMutableArray array];
+  for (int i = optind; i < argc; i++)
+    [arguments addObject:[NSString stringWithUTF8String:argv[i]]];
+
+  MBConsoleController *console =
+    [[MBConsoleController alloc] initWithName:@"logbench"];
+  NSTextView *view = nil;
+  if ([[NSBundle mainBundle] pathForResource:@"Console" ofType:@"nib"]) {
+    [console window];
+  } else {
+    NSRect frame = NSMakeRect(0, 0, 640, 480);
+    NSWindow *window = [[NSWindow alloc]
+                         initWithContentRect:frame
+                                   styleMask:NSTitledWindowMask
+                                     backing:NSBackingStoreBuffered
+                                       defer:NO];
+    NSScrollView *scroller = [[[NSScrollView alloc] initWithFrame:frame]
+                               autorelease];
+    view = [[NSTextView alloc] initWithFrame:frame];
+    [scroller setDocumentView:view];
+    [scroller setHasVerticalScroller:YES];
+    [window setContentView:scroller];
+    [console setTextView:view];
+    [console setWindow:window];
+    [window release];
+  }
+  [console orderFront:nil];
+
+  MBEngineTask *task = [MBEngineTask taskWithProject:nil];
+  [task setLaunchPath:server];
+  [task setArguments:arguments];
+  [console setEngineTask:task];
+
+  // Sit between the task and the console.
+  MBLogBenchmark *benchmark =
+    [[MBLogBenchmark alloc] initWithReceiver:console];
+  [task setOutputReceiver:benchmark];
+  SEL launched = @selector(launchCompleted);
+  NSInvocation *callback = [NSInvocation invocationWithMethodSignature:
+                             [benchmark methodSignatureForSelector:launched]];
+  [callback setTarget:benchmark];
+  [callback setSelector:launched];
+  [[task logFilter] addProjectLaunchCompleteCallback:callback];
+
+  [benchmark start];
+  [task launch];
+  NSDate *giveUp = [NSDate dateWithTimeIntervalSinceNow:timeout];
+  while (![benchmark isFinished] &&
+         [giveUp timeIntervalSinceNow] > 0) {
+    NSAutoreleasePool *loopPool = [[NSAutoreleasePool alloc] init];
+    NSEvent *event = [NSApp nextEventMatchingMask:NSAnyEventMask
+                                        untilDate:[NSDate dateWithTimeIntervalSinceNow:0.1]
+                                           inMode:NSDefaultRunLoopMode
+                                          dequeue:YES];
+    if (event)
+      [NSApp sendEvent:event];
+    [loopPool release];
+  }
+  BOOL timedOut = ![benchmark isFinished];
+  if (timedOut)
+    [task interrupt];
+  [task waitUntilExit];
+  [benchmark finish];
+  [task setOutputReceiver:nil];
+
+  printf("%s", [[benchmark report] UTF8String]);
+  int rtn = 0;
+  if (timedOut) {
+    fprintf(stderr, "logbench: timed out after %.0f seconds\n", timeout);
+    rtn = 1;
+  }
+  if ([benchmark droppedLineCount] > 0 ||
+      [benchmark undecodableChunkCount] > 0) {
+    fprintf(stderr, "logbench: lost %lu lines\n",
+            [benchmark droppedLineCount]);
+    rtn = 1;
+  }
+  if (minRate >= 0 && [benchmark linesPerSecond] < minRate) {
+    fprintf(stderr, "logbench: %.0f lines/sec, wanted %.0f\n",
+            [benchmark linesPerSecond], minRate);
+    rtn = 1;
+  }
+  if (maxLatency >= 0 && [benchmark latencyPercentile:99] > maxLatency) {
+    fprintf(stderr, "logbench: p99 latency %.3f ms, wanted %.3f\n",
+            [benchmark latencyPercentile:99], maxLatency);
+    rtn = 1;
+  }
+  if (maxGrowth >= 0 && [benchmark memoryGrowth] / 1024 > maxGrowth) {
+    fprintf(stderr, "logbench: memory grew %lld KB, wanted %lld\n",
+            [benchmark memoryGrowth] / 1024, maxGrowth);
+    rtn = 1;
+  }
+
+  [benchmark release];
+  [console release];
+  [view release];
+  [pool release];
+  return rtn;
+}
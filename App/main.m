@@ -13,9 +13,11 @@ See the License for the specific language governing permissions and
 limitations under the License.
 */
 
+#import "MBStartupTrace.h"
 
 int main(int argc, char *argv[]) {
   NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  [MBStartupTrace traceLaunch];
 
   int rtn = NSApplicationMain(argc, (const char **) argv);
 
@@ -0,0 +1,135 @@
+/* Copyright 2009 Google Inc.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+     http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+*/
+
+// projectbench: times the project list at 100, 1000 and 10000 projects.
+//
+//   projectbench [-n counts] [-r repeats] [-d dir] [-o results.plist]
+//                [-c baseline.plist] [-x factor]
+//
+//   -n counts    comma separated project counts (100,1000,10000)
+//   -r repeats   calls to average the per-call operations over (1000)
+//   -d dir       scratch directory for the projects; removed afterwards
+//                (a new one in the temporary directory)
+//   -o file      save the results, for a later -c
+//   -c file      compare with results saved earlier
+//   -x factor    with -c, fail if anything got this many times slower (2)
+//
+// Prints "operation<TAB>projects<TAB>seconds" lines, or with -c,
+// "operation<TAB>projects<TAB>before<TAB>after<TAB>ratio" lines. See
+// MBProjectBenchmark.h for what is measured.
+//
+// Exits with 1 if the results can't be saved or the baseline read, or
+// something is slower than -x allows, and 2 for bad usage.
+
+#import <Cocoa/Cocoa.h>
+#import <stdio.h>
+#import <stdlib.h>
+#import <unistd.h>
+#import "MBProjectBenchmark.h"
+
+static void Usage(void) {
+  fprintf(stderr, "usage: projectbench [-n counts] [-r repeats] [-d dir] "
+          "[-o results.plist] [-c baseline.plist] [-x factor]\n");
+  exit(2);
+}
+
+int main(int argc, char *argv[]) {
+  NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+  [NSApplication sharedApplication];
+
+  NSString *counts = @"100,1000,10000";
+  int repeats = 1000;
+  NSString *dir = nil;
+  NSString *output = nil;
+  NSString *baselinePath = nil;
+  double factor = 2;
+  int ch;
+  while ((ch = getopt(argc, argv, "n:r:d:o:c:x:")) != -1) {
+    switch (ch) {
+      case 'n':
+        counts = [NSString stringWithUTF8String:optarg];
+        break;
+      case 'r':
+        repeats = atoi(optarg);
+        break;
+      case 'd':
+        dir = [NSString stringWithUTF8String:optarg];
+        break;
+      case 'o':
+        output = [NSString stringWithUTF8String:optarg];
+        break;
+      case 'c':
+        baselinePath = [NSString stringWithUTF8String:optarg];
+        break;
+      case 'x':
+        factor = strtod(optarg, NULL);
+        break;
+      default:
+        Usage();
+    }
+  }
+  if (optind != argc || repeats < 1 || factor <= 0)
+    Usage();
+
+  NSMutableArray *projectCounts = [NSMutableArray array];
+  NSEnumerator *countEnumerator =
+    [[counts componentsSeparatedByString:@","] objectEnumerator];
+  NSString *count = nil;
+  while ((count = [countEnumerator nextObject])) {
+    if ([count intValue] < 1)
+      Usage();
+    [projectCounts addObject:[NSNumber numberWithInt:[count intValue]]];
+  }
+
+  NSDictionary *baseline = nil;
+  if (baselinePath) {
+    baseline = [NSDictionary dictionaryWithContentsOfFile:baselinePath];
+    if (baseline == nil) {
+      fprintf(stderr, "projectbench: can't read %s\n",
+              [baselinePath UTF8String]);
+      return 1;
+    }
+  }
+  if (dir == nil) {
+    dir = [NSTemporaryDirectory() stringByAppendingPathComponent:
+            [NSString stringWithFormat:@"projectbench-%d",
+                      [[NSProcessInfo processInfo] processIdentifier]]];
+  }
+
+  MBProjectBenchmark *benchmark =
+    [[[MBProjectBenchmark alloc] initWithDirectory:dir] autorelease];
+  [benchmark setRepeats:repeats];
+  NSDictionary *results = [benchmark runWithProjectCounts:projectCounts];
+
+  int rtn = 0;
+  if (output && ![results writeToFile:output atomically:YES]) {
+    fprintf(stderr, "projectbench: can't write %s\n", [output UTF8String]);
+    rtn = 1;
+  }
+  if (baseline) {
+    BOOL slower = NO;
+    printf("%s", [[MBProjectBenchmark compareResults:results
+                                          toBaseline:baseline
+                                              factor:factor
+                                              slower:&slower] UTF8String]);
+    if (slower)
+      rtn = 1;
+  } else {
+    printf("%s", [[MBProjectBenchmark tableForResults:results] UTF8String]);
+  }
+
+  [pool release];
+  return rtn;
+}